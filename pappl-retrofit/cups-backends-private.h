@@ -42,6 +42,36 @@ extern "C" {
 
 #define MAX_BACKENDS	200		// Maximum number of backends we'll run
 
+// Interval in seconds for checking whether backends in discovery mode have
+// terminated, when the system does not support process file descriptors
+
+#define PR_BACKEND_CHECK_INTERVAL 0.25
+
+// Time in seconds after which an unused persistent CUPS backend gets shut
+// down, and time in seconds to wait for a persistent CUPS backend having
+// sent out the data of a job (PR_COPTIONS_PERSISTENT_CUPS_BACKENDS)
+
+#define PR_CUPS_BACKEND_IDLE_TIMEOUT 30
+#define PR_CUPS_BACKEND_DRAIN_TIMEOUT 60.0
+
+// Maximum size of the data and of a whole message on the side channel,
+// as in libcups
+
+#define PR_CUPS_SC_MAX_DATA   65535
+#define PR_CUPS_SC_MAX_BUFFER 65540
+
+// Time in seconds for which the result of a device discovery gets reused
+// (PR_COPTIONS_CACHE_CUPS_DEVICES)
+
+#define PR_CUPS_DEVICES_TTL 60
+
+// Maximum age in seconds of a discovery result which gets reported while
+// a new discovery is running, older results get not reported, the
+// devices of the new discovery get reported as they come in then
+// (PR_COPTIONS_CACHE_CUPS_DEVICES)
+
+#define PR_CUPS_DEVICES_MAX_AGE 300
+
 // Error messages for side channel of CUPS backends
 static const char * const pr_cups_sc_status_str[] =
 {
@@ -77,6 +107,35 @@ typedef struct pr_backend_device_s
         device_uri[1024];		// Device URI
 } pr_backend_device_t;
 
+// Device found by a device discovery, for the discovery result kept in
+// the global data (PR_COPTIONS_CACHE_CUPS_DEVICES)
+typedef struct pr_cups_discovered_s
+{
+  char  *device_info,			// Device info, as reported
+        *device_uri,			// Device URI, with "cups:" prefix
+        *device_id;			// IEEE-1284 device ID, can be NULL
+} pr_cups_discovered_t;
+
+// CUPS backend which keeps running across jobs, one for each device URI
+// (PR_COPTIONS_PERSISTENT_CUPS_BACKENDS)
+typedef struct pr_cups_backend_s
+{
+  char                  *device_uri,    // Device URI
+                        *settings;      // Printer, PPD file, and environment
+                                        // the backend got started with
+  int                   inputfd,        // FD for job data input
+                        pid;            // PID of CUPS backend
+  cf_filter_data_t      filter_data;    // Filter data of the backend, with
+                                        // its back and side channel pipes
+                                        // and the job data of the job which
+                                        // started it
+  ppd_filter_data_ext_t filter_data_ext;// PPD file of the backend
+  cf_filter_external_t  backend_params; // Parameters for launching backend
+  pr_cups_devlog_data_t devlog_data;    // Data for log function
+  double                last_used;      // Time when it got last detached
+  bool                  in_use;         // Attached to a device?
+} pr_cups_backend_t;
+
 // Device data structure to keep a running CUPS backend available as
 // PAPPL device
 typedef struct pr_cups_device_data_s
@@ -91,11 +150,21 @@ typedef struct pr_cups_device_data_s
   pr_printer_app_global_data_t *global_data; // Global data
   pr_cups_devlog_data_t        devlog_data;  // Data for log function
   cf_filter_data_t             *filter_data; // Common data for filter functions
+  char                         **envp;       // Environment of the job for the
+                                             // backend (PRINTER,
+                                             // PRINTER_LOCATION), NULL if
+                                             // none
   cf_filter_external_t         backend_params;// Parameters for launching
                                              // backend via
                                              // ppdFilterExternalCUPS()
   bool                         internal_filter_data; // Is filter_data
                                              // internal?
+  pr_cups_backend_t            *persistent;  // Persistent backend attached,
+                                             // NULL if none
+  int                          job_pipes[4]; // Back and side channel pipes
+                                             // of the job's filter_data while
+                                             // it uses the ones of the
+                                             // persistent backend
 } pr_cups_device_data_t;
 
 
@@ -120,10 +189,36 @@ extern void   _prCUPSDevLog(void *data, cf_loglevel_t level,
 			    const char *message, ...);
 extern int    _prCUPSCompareDevices(pr_backend_device_t *d0,
 				    pr_backend_device_t *d1);
-extern void   _prCUPSSigchldSigAction(int sig, siginfo_t *info,
-				      void *ucontext);
+extern int    _prCUPSDevParseLine(char *line, char **dclass, char **uri,
+				  char **info, char **device_id);
+extern bool   _prCUPSDevDiscover(pappl_device_cb_t cb, void *data,
+				 pappl_deverror_cb_t err_cb, void *err_data);
 extern bool   _prCUPSDevList(pappl_device_cb_t cb, void *data,
 			     pappl_deverror_cb_t err_cb, void *err_data);
+extern bool   _prCUPSDevCacheAdd(const char *device_info,
+				 const char *device_uri,
+				 const char *device_id, void *data);
+extern void   _prCUPSDevCacheDelete(pr_cups_discovered_t *device);
+extern void   *_prCUPSDevCacheRefresh(void *data);
+extern void   _prCUPSDevCacheExpire(pr_printer_app_global_data_t *global_data);
+extern void   _prCUPSDevCacheFree(pr_printer_app_global_data_t *global_data);
+extern ssize_t _prCUPSBackChannelRead(int fd, char *buffer, size_t bytes,
+				      double timeout);
+extern cups_sc_status_t _prCUPSSideChannelDoRequest(int fd,
+						    cups_sc_command_t command,
+						    char *data, int *datalen,
+						    double timeout);
+extern bool   _prCUPSBackendIsStreaming(const char *device_uri);
+extern char   *_prCUPSBackendSettings(pr_cups_device_data_t *device_data);
+extern void   _prCUPSBackendSetEnv(cf_filter_external_t *params,
+				   const char *device_uri, char **envp);
+extern int    _prCUPSBackendCompare(pr_cups_backend_t *a,
+				    pr_cups_backend_t *b, void *data);
+extern bool   _prCUPSBackendAttach(pappl_device_t *device);
+extern void   _prCUPSBackendDetach(pappl_device_t *device);
+extern void   _prCUPSBackendStop(pr_cups_backend_t *backend);
+extern void   *_prCUPSBackendReaper(void *data);
+extern void   _prCUPSBackendsFree(pr_printer_app_global_data_t *global_data);
 extern bool   _prCUPSDevLaunchBackend(pappl_device_t *device);
 extern void   _prCUPSDevStopBackend(pappl_device_t *device);
 extern bool   _prCUPSDevOpen(pappl_device_t *device, const char *device_uri,
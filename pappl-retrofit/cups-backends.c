@@ -20,6 +20,8 @@
 #include <cupsfilters/ieee1284.h>
 #include <cups/dir.h>
 #include <poll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
 
 
 //
@@ -152,65 +154,102 @@ _prCUPSCompareDevices(pr_backend_device_t *d0,// I - First device
 
 
 //
-// '_prCUPSSigchldSigAction()' - Handle 'child' signals from finished
-//                               CUPS backend processes
+// '_prCUPSDevParseLine()' - Split up an output line of a CUPS backend in
+//                           discovery mode, in place and in a single
+//                           pass. Each line is of the form:
+//
+//   class URI "make model" "info" ["1284 device ID"] ["location"]
+//
+//                           Escaped characters in the quoted fields get
+//                           unescaped while splitting.
 //
 
-void
-_prCUPSSigchldSigAction(int sig,		// I - Signal number (unused)
-			siginfo_t *info,	// I - Signal info
-			void *ucontext)		// I - Context info (unused)
+int					// O - 1 for a device, 0 for a line
+					//     which is not about an actual
+					//     device, -1 for a bad line
+_prCUPSDevParseLine(char *line,		// I - Line, gets modified
+		    char **dclass,	// O - Device class
+		    char **uri,		// O - Device URI
+		    char **info,	// O - Device info
+		    char **device_id)	// O - 1284 device ID, NULL if none
 {
-  int i;
-  pr_printer_app_global_data_t *global_data =
-    (pr_printer_app_global_data_t *)_PRCUPSDeviceUserData;
-  pr_backend_t *backend_list = global_data->backend_list;
+  char		*ptr,			// Pointer into line
+		*out,			// Output pointer for unescaping
+		*fields[4];		// Quoted fields
+  int		num_fields;		// Number of quoted fields
+
 
-  (void)sig;
-  (void)ucontext;
+  // device-class
+  for (ptr = *dclass = line; *ptr && !isspace(*ptr & 255); ptr ++);
+  while (isspace(*ptr & 255))
+    *ptr++ = '\0';
 
-  // One of the backends terminated, mark it as done and add the status
-  // to its record
-  for (i = 0; backend_list[i].name && i < MAX_BACKENDS; i ++)
-    if (backend_list[i].pid == info->si_pid)
+  // device-uri
+  if (!*ptr)
+    return (-1);
+  for (*uri = ptr; *ptr && !isspace(*ptr & 255); ptr ++);
+  while (isspace(*ptr & 255))
+    *ptr++ = '\0';
+
+  // Check whether we have discovered an actual device here
+  if (!strchr(*uri, ':'))
+    return (0);
+
+  // device-make-and-model, device-info, and optionally device-id and
+  // device-location
+  for (num_fields = 0; num_fields < 4 && *ptr == '\"'; num_fields ++)
+  {
+    for (fields[num_fields] = out = ++ ptr; *ptr && *ptr != '\"'; ptr ++)
     {
-      papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
-	       "Backend '%s' triggered SIGCHLD", backend_list[i].name);
-      backend_list[i].done = true;
-      backend_list[i].status =
-	(info->si_status == SIGTERM ? 0 : info->si_status);
+      if (*ptr == '\\' && ptr[1])
+	ptr ++;
+      *out++ = *ptr;
     }
+    if (*ptr != '\"')
+      return (-1);
+    for (*out = '\0', ptr ++; isspace(*ptr & 255); ptr ++);
+  }
+
+  if (num_fields < 2)
+    return (-1);
+
+  *info      = fields[1];
+  *device_id = (num_fields > 2 ? fields[2] : NULL);
+
+  return (1);
 }
 
 
 //
-// '_prCUPSDevList()' - List all devices which get discovered by the
-//                      CUPS backends in our specified CUPS backend
-//                      directory, taking into account include and
-//                      exclude lists.  Resulting CUPS device URIs are
-//                      prepended by "cups:" as this is the device
-//                      list callback function of our custom "cups"
-//                      scheme. The backends are always run as the
-//                      same user as the Printer Application, so
-//                      backends which require root are skipped when
-//                      running as normal user (A Printer Application
-//                      in a Snap runs as root). The backends are run
-//                      in the ppdFilterExternalCUPS() filter
-//                      function, so their environment is as close to
-//                      CUPS as possible. For the implementation I
-//                      mostly followed scheduler/cups-deviced.c from
-//                      CUPS. It is rather complex, but this is to
-//                      make the backends run in parallel, as
-//                      especially the network backends take some time
-//                      for their discovery run. Only this way we can
-//                      keep the response time always reasonable.
+// '_prCUPSDevDiscover()' - List all devices which get discovered by the
+//                          CUPS backends in our specified CUPS backend
+//                          directory, taking into account include and
+//                          exclude lists.  Resulting CUPS device URIs
+//                          are prepended by "cups:" as this is used
+//                          by the device list callback function of
+//                          our custom "cups" scheme. The backends are
+//                          always run as the same user as the Printer
+//                          Application, so backends which require
+//                          root are skipped when running as normal
+//                          user (A Printer Application in a Snap runs
+//                          as root). The backends are run in the
+//                          ppdFilterExternalCUPS() filter function,
+//                          so their environment is as close to CUPS
+//                          as possible. For the implementation I
+//                          mostly followed scheduler/cups-deviced.c
+//                          from CUPS. It is rather complex, but this
+//                          is to make the backends run in parallel,
+//                          as especially the network backends take
+//                          some time for their discovery run. Only
+//                          this way we can keep the response time
+//                          always reasonable.
 //
 
 bool
-_prCUPSDevList(pappl_device_cb_t cb,
-	       void *data,
-	       pappl_deverror_cb_t err_cb,
-	       void *err_data)
+_prCUPSDevDiscover(pappl_device_cb_t cb,
+		   void *data,
+		   pappl_deverror_cb_t err_cb,
+		   void *err_data)
 {
   pr_printer_app_global_data_t *global_data =
     (pr_printer_app_global_data_t *)_PRCUPSDeviceUserData;
@@ -225,22 +264,30 @@ _prCUPSDevList(pappl_device_cb_t cb,
 				// Active backends
   pr_backend_t  backends[MAX_BACKENDS];
 				// Array of backends
-  struct pollfd	backend_fds[MAX_BACKENDS];
-  				// Array for poll()
+  struct pollfd	backend_fds[2 * MAX_BACKENDS];
+  				// Array for ppoll()
+  int		fd_backends[2 * MAX_BACKENDS];
+				// Backend for each entry of backend_fds
+  nfds_t	num_fds;	// Number of entries in backend_fds
+  siginfo_t	child_info;	// Exit status of a backend from waitid()
+  bool		check_interval;	// Check for terminated backends regularly?
   cups_array_t	*devices = NULL;// Array of devices
-  int		i;		// Looping var
-  struct sigaction action;	// Actions for POSIX signals
-  struct sigaction old_action;	// Backup of Actions for POSIX signals
+  int		i, j;		// Looping vars
   cups_dir_t	*dir;		// Directory pointer
   cups_dentry_t *dent;		// Directory entry
-  int		timeout;	// Timeout in seconds
+  struct timespec timeout;	// Remaining time until the end of discovery
   int		status;		// Exit status of child
+  int		parsed;		// Result of parsing a backend output line
   int		pid;		// Process ID of child
-  double	current_time,	// Current time
-		end_time;	// Ending time
+  double	start_time,	// Start of the discovery
+		current_time,	// Current time
+		end_time,	// Ending time
+		end_poll;	// End of the current wait
+  int		num_devices = 0;// Number of devices found
   pr_backend_t  *backend;	// Current backend
   const char	*name;		// Name of process
-  char	        line[2048],	// Line from backend, for logging
+  char	        *lineptr,	// Start of the current line in the buffer
+	        *bufend,	// End of the data in the buffer
 	        *newline,       // Where in the buffer starts the next line?
 	        *ptr1,		// Pointer into line
 	        *ptr2,		// Pointer into line
@@ -248,8 +295,9 @@ _prCUPSDevList(pappl_device_cb_t cb,
 	        *uri,		// Device URI
 	        *info,		// Device info
 	        *device_id;	// 1284 device ID
-  size_t        bytes;          // Bytes read from pipe
-  pr_backend_device_t *device;  // New device
+  ssize_t       bytes;          // Bytes read from pipe
+  pr_backend_device_t key,	// Device to look up
+		*device;	// New device
 
   // Common arguments amd parameters for calling the CUPS backends in
   // discovery mode
@@ -265,18 +313,10 @@ _prCUPSDevList(pappl_device_cb_t cb,
   filter_data.logfunc = _prCUPSDevLog;
   filter_data.logdata = &devlog_data;
 
-  // Initialize backends list and link with global data
+  // Initialize backends list, it is only used by this call, so that
+  // several discoveries can run at the same time
   memset(backends, 0, sizeof(backends));
-  global_data->backend_list = backends;
-
-  // Listen to child signals to get note of backends which have finished or
-  // errorred to take their status and remove them from the poll
-  memset(&action, 0, sizeof(action));
-  sigemptyset(&action.sa_mask);
-  sigaddset(&action.sa_mask, SIGCHLD);
-  action.sa_flags = SA_SIGINFO;
-  action.sa_sigaction = _prCUPSSigchldSigAction;
-  sigaction(SIGCHLD, &action, &old_action);
+  start_time = _prGetCurrentTime();
 
   _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_DEBUG,
 		"Backend directory: %s; Ignoring backends: %s; Using only backends: %s",
@@ -394,10 +434,10 @@ _prCUPSDevList(pappl_device_cb_t cb,
       backend->count  = 0;
       backend->bytes  = 0;
       backend->done   = false;
-
-      // Terminating zero mark for SIGCHLD handler
-      if (num_backends + 1 < MAX_BACKENDS)
-	backends[num_backends + 1].name = NULL;
+      backend->eof    = false;
+      backend->overflow = false;
+      backend->pidfd  = -1;
+      backend->start_time = _prGetCurrentTime();
 
       // Launch the backend with pipe providing backend's stdout
       if ((backend->pipe = cfFilterPOpen(ppdFilterExternalCUPS,
@@ -415,8 +455,8 @@ _prCUPSDevList(pappl_device_cb_t cb,
       // over the end of an output line before the backend terminates that we
       // do not get blocked until the next output line or the end of this
       // backend
-      if (fcntl(backend->pipe, F_SETFD,
-		fcntl(backend->pipe, F_GETFD) | O_NONBLOCK))
+      if (fcntl(backend->pipe, F_SETFL,
+		fcntl(backend->pipe, F_GETFL) | O_NONBLOCK))
       {
 	_prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_ERROR,
 		      "Unable to set output pipe of '%s' to non-blocking- %s\n",
@@ -425,12 +465,20 @@ _prCUPSDevList(pappl_device_cb_t cb,
 	continue;
       }
 
+      // Do not let the backends of other discoveries running at the same
+      // time inherit the pipe, they would keep it open
+      fcntl(backend->pipe, F_SETFD, fcntl(backend->pipe, F_GETFD) | FD_CLOEXEC);
+
       _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_DEBUG,
 		    "Started backend %s (PID %d)",
 		    backend_params.filter, backend->pid);
-      
-      backend_fds[num_backends].fd     = backend->pipe;
-      backend_fds[num_backends].events = POLLIN;
+
+#ifdef SYS_pidfd_open
+      // Get a process file descriptor for the backend, it gets readable
+      // when the backend terminates, so that we get woken up by ppoll()
+      // right away
+      backend->pidfd = (int)syscall(SYS_pidfd_open, backend->pid, 0);
+#endif // SYS_pidfd_open
 
       active_backends ++;
       num_backends ++; 
@@ -446,213 +494,230 @@ _prCUPSDevList(pappl_device_cb_t cb,
 	   active_backends > 0 &&
 	   (current_time = _prGetCurrentTime()) < end_time)
     {
-      // Collect the output from the backends, but only within the timeout
-      //timeout = (int)(1000 * (end_time - current_time));
-      timeout = 1000;
-      if (poll(backend_fds, (nfds_t)num_backends, timeout) > 0)
+      // Poll only the output pipes and process file descriptors of the
+      // backends which are still running, finished ones are not in the
+      // set any more
+      check_interval = false;
+      for (i = 0, num_fds = 0; i < num_backends; i ++)
       {
-	for (i = 0; i < num_backends; i ++)
-	  if (backend_fds[i].revents && backends[i].pipe)
+	backend = backends + i;
+	if (!backend->pid || backend->eof)
+	  continue;
+	if (backend->pidfd < 0 && !backend->done)
+	  check_interval = true;
+	backend_fds[num_fds].fd      = backend->pipe;
+	backend_fds[num_fds].events  = POLLIN;
+	backend_fds[num_fds].revents = 0;
+	fd_backends[num_fds ++]      = i;
+	if (backend->pidfd >= 0 && !backend->done)
+	{
+	  backend_fds[num_fds].fd      = backend->pidfd;
+	  backend_fds[num_fds].events  = POLLIN;
+	  backend_fds[num_fds].revents = 0;
+	  fd_backends[num_fds ++]      = i;
+	}
+      }
+
+      // Collect the output from the backends, but only within the remaining
+      // time. For backends without process file descriptor we check
+      // regularly whether they have terminated
+      if (check_interval &&
+	  end_time - current_time > PR_BACKEND_CHECK_INTERVAL)
+	end_poll = current_time + PR_BACKEND_CHECK_INTERVAL;
+      else
+	end_poll = end_time;
+      timeout.tv_sec  = (time_t)(end_poll - current_time);
+      timeout.tv_nsec = (long)((end_poll - current_time -
+				(double)timeout.tv_sec) * 1000000000.0);
+      if (ppoll(backend_fds, num_fds, &timeout, NULL) < 0)
+      {
+	// Interrupted by a signal, only check for terminated backends
+	for (j = 0; j < (int)num_fds; j ++)
+	  backend_fds[j].revents = 0;
+      }
+
+      // Mark the backends whose process file descriptor got readable, or,
+      // if they do not have one, which have terminated, as done, taking
+      // their exit status without reaping them, this is done by
+      // cfFilterPClose(). Only our own backends get checked, so that
+      // other child processes and other device discoveries are not
+      // affected
+      for (j = 0; j < (int)num_fds; j ++)
+      {
+	backend = backends + fd_backends[j];
+	if (backend->done ||
+	    (backend->pidfd >= 0 ?
+	     (backend_fds[j].fd != backend->pidfd || !backend_fds[j].revents) :
+	     backend_fds[j].fd != backend->pipe))
+	  continue;
+	memset(&child_info, 0, sizeof(child_info));
+	if (!waitid(P_PID, (id_t)backend->pid, &child_info,
+		    WEXITED | WNOHANG | WNOWAIT) &&
+	    child_info.si_pid == backend->pid)
+	{
+	  // si_status is the exit code for a normal exit and the signal
+	  // number otherwise, convert it into a wait() status for the log
+	  // messages; backends which we have stopped with SIGTERM do not
+	  // count as failed
+	  if (child_info.si_code == CLD_EXITED)
+	    backend->status = (child_info.si_status & 0xff) << 8;
+	  else if (child_info.si_code == CLD_KILLED &&
+		   child_info.si_status == SIGTERM)
+	    backend->status = 0;
+	  else
+	    backend->status = child_info.si_status & 0x7f;
+	  backend->done = true;
+	}
+      }
+
+      // Read the output of the backends which have sent something and
+      // the rest of the output of the backends which have finished
+      for (j = 0; j < (int)num_fds; j ++)
+      {
+	i = fd_backends[j];
+	if (backend_fds[j].fd == backends[i].pipe &&
+	    (backend_fds[j].revents || backends[i].done))
 	  {
 	    while ((bytes =
 		    read(backends[i].pipe,
 			 backends[i].buf + backends[i].bytes,
 			 sizeof(backends[i].buf) - backends[i].bytes)) > 0)
 	    {
-	      // Parse the output lines
-
-	      //
-	      // Each line is of the form:
-	      //
-	      //   class URI "make model" "name" ["1284 device ID"] ["location"]
-	      //
-
-	      backends[i].bytes += bytes;
-	      while ((newline = strchr(backends[i].buf, '\n')) != NULL)
+	      // Parse the complete output lines in the buffer, we only need
+	      // to look for line ends in the newly read bytes, as the bytes
+	      // kept from the previous read are an incomplete line
+	      lineptr = backends[i].buf;
+	      ptr1    = backends[i].buf + backends[i].bytes;
+	      bufend  = ptr1 + bytes;
+	      while ((newline = memchr(ptr1, '\n', bufend - ptr1)) != NULL)
 	      {
-		// We have read at least one line
 		*newline = '\0';
-		newline ++;
-
-		// Save the line for logging
-		strncpy(line, backends[i].buf, sizeof(line) - 1);
-
-		// device-class
-		ptr1 = backends[i].buf;
-		for (dclass = ptr1; *ptr1; ptr1 ++)
-		  if (isspace(*ptr1 & 255))
-		    break;
-		while (isspace(*ptr1 & 255))
-		  *ptr1++ = '\0';
-
-		// device-uri
-		if (!*ptr1)
-		  goto error;
-		for (uri = ptr1; *ptr1; ptr1 ++)
-		  if (isspace(*ptr1 & 255))
-		    break;
-		while (isspace(*ptr1 & 255))
-		  *ptr1++ = '\0';
-
-		// Check whether we have discovered an actual device here
-		// and not something like
-		//
-		//    network socket "Unknown" "AppSocket/HP JetDirect"
-		//
-		if (!strchr(uri, ':'))
+		ptr1 = newline + 1;
+
+		if (backends[i].overflow)
 		{
-		  _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_DEBUG,
-				"Non-device output line from '%s': %s",
-				backends[i].name, line);
+		  // End of a too long line, already reported
+		  backends[i].overflow = false;
 		  goto nextline;
 		}
 
-		// device-make-and-model
-		if (*ptr1 != '\"')
-		  goto error;
-		for (ptr1 ++; *ptr1 && *ptr1 != '\"'; ptr1 ++)
+		if ((parsed = _prCUPSDevParseLine(lineptr, &dclass, &uri,
+						  &info, &device_id)) <= 0)
 		{
-		  if (*ptr1 == '\\' && ptr1[1])
-		    for (ptr2 = ptr1; *ptr2; ptr2 ++)
-		      *ptr2 = *(ptr2 + 1);
-		}
-		if (*ptr1 != '\"')
-		  goto error;
-		for (*ptr1++ = '\0'; isspace(*ptr1 & 255); *ptr1++ = '\0');
-
-		// device-info
-		if (*ptr1 != '\"')
-		  goto error;
-		for (ptr1 ++, info = ptr1; *ptr1 && *ptr1 != '\"'; ptr1 ++)
-		{
-		  if (*ptr1 == '\\' && ptr1[1])
-		    for (ptr2 = ptr1; *ptr2; ptr2 ++)
-		      *ptr2 = *(ptr2 + 1);
-		}
-		if (*ptr1 != '\"')
-		  goto error;
-		for (*ptr1++ = '\0'; isspace(*ptr1 & 255); *ptr1++ = '\0');
-
-		// device-id
-		if (*ptr1 == '\"')
-	        {
-		  for (ptr1 ++, device_id = ptr1; *ptr1 && *ptr1 != '\"';
-		       ptr1 ++)
-		  {
-		    if (*ptr1 == '\\' && ptr1[1])
-		      for (ptr2 = ptr1; *ptr2; ptr2 ++)
-			*ptr2 = *(ptr2 + 1);
-		  }
-		  if (*ptr1 != '\"')
-		    goto error;
-		  for (*ptr1++ = '\0'; isspace(*ptr1 & 255); *ptr1++ = '\0');
-
-		  // device-location
-		  if (*ptr1 == '\"')
-		  {
-		    for (ptr1 ++; *ptr1 && *ptr1 != '\"'; ptr1 ++)
-		    {
-		      if (*ptr1 == '\\' && ptr1[1])
-			for (ptr2 = ptr1; *ptr2; ptr2 ++)
-			  *ptr2 = *(ptr2 + 1);
-		    }
-		    if (*ptr1 != '\"')
-		      goto error;
-		    *ptr1 = '\0';
-		  }
-		}
-		else
-		  device_id = NULL;
-
-		// Add device entry to list/submit (use list only to detect
-		// duplicates)
-
-		// Allocate memory for the device record...
-		if ((device = calloc(1, sizeof(pr_backend_device_t))) == NULL)
-		{
-		  _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_ERROR,
-				"Ran out of memory allocating a device!");
+		  // Restore the separators for logging the line
+		  for (ptr2 = lineptr; ptr2 < newline; ptr2 ++)
+		    if (!*ptr2)
+		      *ptr2 = ' ';
+		  if (parsed == 0)
+		    // Something like
+		    //
+		    //    network socket "Unknown" "AppSocket/HP JetDirect"
+		    //
+		    _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_DEBUG,
+				  "Non-device output line from '%s': %s",
+				  backends[i].name, lineptr);
+		  else
+		    _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_ERROR,
+				  "Bad line from '%s': %s",
+				  backends[i].name, lineptr);
 		  goto nextline;
 		}
 
-		// Copy the strings over...
-		strncpy(device->device_class, dclass,
-			sizeof(device->device_class) - 1);
-		strncpy(device->device_info, info,
-			sizeof(device->device_info) - 1);
-		snprintf(device->device_uri, sizeof(device->device_uri),
+		// Check whether we have a duplicate and if so, skip it, use
+		// the list only to detect duplicates
+		memset(&key, 0, sizeof(key));
+		strncpy(key.device_class, dclass, sizeof(key.device_class) - 1);
+		strncpy(key.device_info, info, sizeof(key.device_info) - 1);
+		snprintf(key.device_uri, sizeof(key.device_uri),
 			 "cups:%s", uri);
 
-		// Check whether we have a duplicate and if so, skip it
-		if (cupsArrayFind(devices, device))
+		if (cupsArrayFind(devices, &key))
 		{
-		  free(device);
 		  _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_DEBUG,
 				"Duplicate device from backend '%s' skipped: %s (URI: %s Device ID: %s)",
-				backends[i].name, info, device->device_uri,
+				backends[i].name, info, key.device_uri,
 				device_id);
+		  goto nextline;
 		}
-		else
+
+		// Add new entry to the list
+		if ((device = malloc(sizeof(pr_backend_device_t))) == NULL)
 		{
-		  // Add new entry to the list
-		  cupsArrayAdd(devices, device);
-
-		  // If there is more than one backend, mark device info with
-		  // with backend name
-		  snprintf(buf, sizeof(buf), "%s%s%s%s", info,
-			   (num_backends > 1 ? " (" : ""),
-			   (num_backends > 1 ? backends[i].name : ""),
-			   (num_backends > 1 ? ")" : ""));
-		  if (num_backends > 1)
-		    for (ptr1 = buf + strlen(info) + 2; *ptr1 != ')'; ptr1 ++)
-		      *ptr1 = toupper(*ptr1);
-
-		  // Submit device info...
-		  ret = (*cb)(buf, device->device_uri, device_id, data);
-		  backends[i].count ++;
-		  _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_DEBUG,
-				"Device from backend '%s' added to list of available devices: %s (URI: %s Device ID: %s)",
-				backends[i].name, buf,
-				device->device_uri, device_id);
-		  if (ret)
-		    // Callback returned "true", stop process here
-		    goto stop_process;
+		  _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_ERROR,
+				"Ran out of memory allocating a device!");
+		  goto nextline;
 		}
+		memcpy(device, &key, sizeof(pr_backend_device_t));
+		cupsArrayAdd(devices, device);
+
+		// If there is more than one backend, mark device info with
+		// with backend name
+		snprintf(buf, sizeof(buf), "%s%s%s%s", info,
+			 (num_backends > 1 ? " (" : ""),
+			 (num_backends > 1 ? backends[i].name : ""),
+			 (num_backends > 1 ? ")" : ""));
+		if (num_backends > 1)
+		  for (ptr2 = buf + strlen(info) + 2; *ptr2 && *ptr2 != ')';
+		       ptr2 ++)
+		    *ptr2 = toupper(*ptr2 & 255);
+
+		// Submit device info...
+		ret = (*cb)(buf, device->device_uri, device_id, data);
+		backends[i].count ++;
+		num_devices ++;
+		_prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_DEBUG,
+			      "Device from backend '%s' added to list of available devices: %s (URI: %s Device ID: %s)",
+			      backends[i].name, buf,
+			      device->device_uri, device_id);
+		if (ret)
+		  // Callback returned "true", stop process here
+		  goto stop_process;
 
-		goto nextline;
+	      nextline:
+		lineptr = ptr1;
+	      }
 
-	      error:
-		// Bad format; strip trailing newline and write an
-		// error message.
+	      // Move the incomplete last line to the beginning of the buffer,
+	      // only once for all lines read
+	      backends[i].bytes = bufend - lineptr;
+	      if (backends[i].bytes && lineptr > backends[i].buf)
+		memmove(backends[i].buf, lineptr, backends[i].bytes);
+	      else if (backends[i].bytes == sizeof(backends[i].buf))
+	      {
+		// No line end in the whole buffer, drop the line
 		_prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_ERROR,
-			      "Bad line from '%s': %s",
-			      backends[i].name, line);
-
-	      nextline:
-		// Move rest of the buffer content to the beginning of
-		// the buffer
-		backends[i].bytes -= (newline - backends[i].buf);
-	        memmove(backends[i].buf, newline, backends[i].bytes);
+			      "Too long line from '%s' skipped",
+			      backends[i].name);
+		backends[i].bytes = 0;
+		backends[i].overflow = true;
 	      }
 	    }
 	    if (bytes == 0)
 	    {
-	      // Backend terminated
-	      backends[i].done = true;
+	      // Backend closed its output, everything is read
+	      backends[i].eof = true;
 	    }
-	    else if (bytes < 0 && errno != EAGAIN && errno != EWOULDBLOCK)
+	    else if (errno != EAGAIN && errno != EWOULDBLOCK)
 	    {
 	      // An error occurred (not simply no further bytes due to the
 	      // backend to take time to find the next device)
 	      _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_ERROR,
 			    "Read error from backend '%s' - %s",
 			    backends[i].name, strerror(errno));
-	      close(backends[i].pipe);
-	      backends[i].pipe = 0;
-	      kill(backends[i].pid, SIGTERM);
-	      _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_ERROR,
-			    "PID %d (%s) killed after read error!",
-			    backends[i].pid, backends[i].name);
+	      backends[i].eof = true;
+	      if (!backends[i].done)
+	      {
+		kill(backends[i].pid, SIGTERM);
+		_prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_ERROR,
+			      "PID %d (%s) killed after read error!",
+			      backends[i].pid, backends[i].name);
+	      }
+	    }
+	    else if (backends[i].done)
+	    {
+	      // Backend terminated and nothing more to read, a child process
+	      // of it can still hold the pipe open, do not wait for it
+	      backends[i].eof = true;
 	    }
 	  }
       }
@@ -661,9 +726,11 @@ _prCUPSDevList(pappl_device_cb_t cb,
       // Log exit status from terminated children and close pipes
 
       for (i = num_backends, backend = backends; i > 0; i --, backend ++)
-	if (backend->done && backend->pid)
+	if (backend->eof && backend->pid)
 	{
 	  cfFilterPClose(backend->pipe, backend->pid, &filter_data);
+	  if (backend->pidfd >= 0)
+	    close(backend->pidfd);
 	  pid             = backend->pid;
 	  name            = backend->name;
 	  status          = backend->status;
@@ -682,12 +749,13 @@ _prCUPSDevList(pappl_device_cb_t cb,
 	    _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_DEBUG,
 			  "PID %d (%s) exited with no errors.",
 			  pid, name);
-	  if (backend->count)
-	    _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_DEBUG,
-			  "Found %d devices using the '%s' backend",
-			  backend->count, name);
+	  _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_DEBUG,
+			"Found %d devices using the '%s' backend in %.3f seconds",
+			backend->count, name,
+			_prGetCurrentTime() - backend->start_time);
 	  backend->pid    = 0;
 	  backend->pipe   = 0;
+	  backend->pidfd  = -1;
 	  active_backends --;
 	}
     }
@@ -706,13 +774,17 @@ _prCUPSDevList(pappl_device_cb_t cb,
 	}
       for (i = 0; i < num_backends; i ++)
 	if (backends[i].pid)
+	{
 	  cfFilterPClose(backends[i].pipe, backends[i].pid, &filter_data);
+	  if (backends[i].pidfd >= 0)
+	    close(backends[i].pidfd);
+	}
     }
   }
 
-  // Restore handling of SIGCHLD
-  sigaction(SIGCHLD, &old_action, NULL);
-  global_data->backend_list = NULL;
+  _prCUPSDevLog(&devlog_data, PAPPL_LOGLEVEL_DEBUG,
+		"Device discovery with %d backends found %d devices in %.3f seconds",
+		num_backends, num_devices, _prGetCurrentTime() - start_time);
 
   // Clean up
   for (i = 0; i < num_backends; i ++)
@@ -724,6 +796,1002 @@ _prCUPSDevList(pappl_device_cb_t cb,
 }
 
 
+//
+// '_prCUPSDevList()' - Device list callback function of our custom
+//                      "cups" scheme. Normally it runs the discovery
+//                      of the CUPS backends with _prCUPSDevDiscover().
+//                      With the PR_COPTIONS_CACHE_CUPS_DEVICES
+//                      component option the discovery runs in a
+//                      background thread and its result is kept for
+//                      PR_CUPS_DEVICES_TTL seconds, so that device
+//                      list requests get answered immediately. If
+//                      there is no result yet, or the result is older
+//                      than PR_CUPS_DEVICES_MAX_AGE seconds, the
+//                      devices are reported as they get found by the
+//                      running discovery. The callback is called
+//                      without holding the lock on the cached devices,
+//                      on copies of them.
+//
+
+bool
+_prCUPSDevList(pappl_device_cb_t cb,
+	       void *data,
+	       pappl_deverror_cb_t err_cb,
+	       void *err_data)
+{
+  pr_printer_app_global_data_t *global_data =
+    (pr_printer_app_global_data_t *)_PRCUPSDeviceUserData;
+  bool          ret = false,
+		finished;	// Has the discovery finished?
+  int		i;		// Looping var
+  double	age;		// Age of the cached result
+  cups_array_t	*devices,	// Devices to report
+		*copies;	// Copies of devices to report
+  pr_cups_discovered_t *device,	// Current device
+		*copy;		// Copy of device
+  pthread_t	thread;		// Thread for discovery
+
+
+  if (!(global_data->config->components & PR_COPTIONS_CACHE_CUPS_DEVICES))
+    return (_prCUPSDevDiscover(cb, data, err_cb, err_data));
+
+  pthread_mutex_lock(&global_data->cups_devices_mutex);
+
+  age = (global_data->cups_devices_time > 0.0 ?
+	 _prGetCurrentTime() - global_data->cups_devices_time : -1.0);
+
+  // Start a new discovery in the background if we have no result yet or
+  // the result got too old
+  if (!global_data->cups_devices_refreshing &&
+      (age < 0.0 || global_data->cups_devices_stale ||
+       age > PR_CUPS_DEVICES_TTL))
+  {
+    global_data->cups_devices_refreshing = true;
+    global_data->cups_devices_stale = false;
+    global_data->cups_devices_new =
+      cupsArrayNew3(NULL, NULL, NULL, 0, NULL,
+		    (cups_afree_func_t)_prCUPSDevCacheDelete);
+    if (pthread_create(&thread, NULL, _prCUPSDevCacheRefresh, global_data))
+    {
+      papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
+	       "Unable to start device discovery thread: %s",
+	       strerror(errno));
+      cupsArrayDelete(global_data->cups_devices_new);
+      global_data->cups_devices_new = NULL;
+      global_data->cups_devices_refreshing = false;
+    }
+    else
+      pthread_detach(thread);
+  }
+
+  // Report the devices of the last discovery if it is recent enough,
+  // otherwise the devices of the running discovery as they come in,
+  // until it is finished or our caller does not want more. When the
+  // discovery finishes, its list gets moved to cups_devices, so we can
+  // simply continue there
+  if (age >= 0.0 && age <= PR_CUPS_DEVICES_MAX_AGE)
+    devices = global_data->cups_devices;
+  else if (global_data->cups_devices_refreshing)
+    devices = global_data->cups_devices_new;
+  else
+  {
+    // No usable result and no discovery running, do the discovery right
+    // here
+    pthread_mutex_unlock(&global_data->cups_devices_mutex);
+    return (_prCUPSDevDiscover(cb, data, err_cb, err_data));
+  }
+
+  for (i = 0;;)
+  {
+    // Copy the devices which we did not report yet
+    copies = cupsArrayNew3(NULL, NULL, NULL, 0, NULL,
+			   (cups_afree_func_t)_prCUPSDevCacheDelete);
+    for (; i < cupsArrayCount(devices); i ++)
+    {
+      device = (pr_cups_discovered_t *)cupsArrayIndex(devices, i);
+      if ((copy = calloc(1, sizeof(pr_cups_discovered_t))) == NULL)
+	continue;
+      copy->device_info = strdup(device->device_info);
+      copy->device_uri = strdup(device->device_uri);
+      copy->device_id = (device->device_id ? strdup(device->device_id) :
+			 NULL);
+      cupsArrayAdd(copies, copy);
+    }
+    finished = (devices != global_data->cups_devices_new ||
+		!global_data->cups_devices_refreshing);
+
+    pthread_mutex_unlock(&global_data->cups_devices_mutex);
+
+    for (device = (pr_cups_discovered_t *)cupsArrayFirst(copies);
+	 device && !ret;
+	 device = (pr_cups_discovered_t *)cupsArrayNext(copies))
+      ret = (*cb)(device->device_info, device->device_uri,
+		  device->device_id, data);
+    cupsArrayDelete(copies);
+
+    if (ret || finished)
+      return (ret);
+
+    pthread_mutex_lock(&global_data->cups_devices_mutex);
+
+    while (devices == global_data->cups_devices_new &&
+	   global_data->cups_devices_refreshing &&
+	   i >= cupsArrayCount(devices))
+      pthread_cond_wait(&global_data->cups_devices_cond,
+			&global_data->cups_devices_mutex);
+
+    // The discovery has finished and its result already got replaced by
+    // the one of another discovery, we have reported a complete
+    // discovery then
+    if (devices != global_data->cups_devices_new &&
+	devices != global_data->cups_devices)
+      break;
+  }
+
+  pthread_mutex_unlock(&global_data->cups_devices_mutex);
+
+  return (ret);
+}
+
+
+//
+// '_prCUPSDevCacheAdd()' - Device callback for the discovery in the
+//                          background, adds the device to the list of
+//                          the running discovery and wakes up the
+//                          requests waiting for devices
+//
+
+bool					// O - Always false, to continue
+_prCUPSDevCacheAdd(const char *device_info, // I - Device info
+		   const char *device_uri, // I - Device URI
+		   const char *device_id, // I - IEEE-1284 device ID
+		   void *data)		// I - Global data
+{
+  pr_printer_app_global_data_t *global_data =
+    (pr_printer_app_global_data_t *)data;
+  pr_cups_discovered_t *device;	// New device
+
+
+  if ((device = calloc(1, sizeof(pr_cups_discovered_t))) == NULL)
+    return (false);
+  device->device_info = strdup(device_info);
+  device->device_uri = strdup(device_uri);
+  device->device_id = (device_id ? strdup(device_id) : NULL);
+
+  pthread_mutex_lock(&global_data->cups_devices_mutex);
+  cupsArrayAdd(global_data->cups_devices_new, device);
+  pthread_cond_broadcast(&global_data->cups_devices_cond);
+  pthread_mutex_unlock(&global_data->cups_devices_mutex);
+
+  return (false);
+}
+
+
+//
+// '_prCUPSDevCacheDelete()' - Free a device of the discovery result
+//
+
+void
+_prCUPSDevCacheDelete(pr_cups_discovered_t *device) // I - Device
+{
+  free(device->device_info);
+  free(device->device_uri);
+  free(device->device_id);
+  free(device);
+}
+
+
+//
+// '_prCUPSDevCacheRefresh()' - Thread function to run a discovery in the
+//                              background and to replace the cached
+//                              result by its result
+//
+
+void *					// O - Thread exit status, unused
+_prCUPSDevCacheRefresh(void *data)	// I - Global data
+{
+  pr_printer_app_global_data_t *global_data =
+    (pr_printer_app_global_data_t *)data;
+
+
+  _prCUPSDevDiscover(_prCUPSDevCacheAdd, global_data, NULL, NULL);
+
+  pthread_mutex_lock(&global_data->cups_devices_mutex);
+  cupsArrayDelete(global_data->cups_devices);
+  global_data->cups_devices = global_data->cups_devices_new;
+  global_data->cups_devices_new = NULL;
+  global_data->cups_devices_time = _prGetCurrentTime();
+  global_data->cups_devices_refreshing = false;
+  pthread_cond_broadcast(&global_data->cups_devices_cond);
+  pthread_mutex_unlock(&global_data->cups_devices_mutex);
+
+  return (NULL);
+}
+
+
+//
+// '_prCUPSDevCacheExpire()' - Let the next device list request start a
+//                             new discovery, to be called when the
+//                             backends have changed
+//
+
+void
+_prCUPSDevCacheExpire(pr_printer_app_global_data_t *global_data)
+{
+  pthread_mutex_lock(&global_data->cups_devices_mutex);
+  global_data->cups_devices_stale = true;
+  pthread_mutex_unlock(&global_data->cups_devices_mutex);
+}
+
+
+//
+// '_prCUPSDevCacheFree()' - Wait for a running discovery and free the
+//                           discovery result
+//
+
+void
+_prCUPSDevCacheFree(pr_printer_app_global_data_t *global_data)
+{
+  pthread_mutex_lock(&global_data->cups_devices_mutex);
+  while (global_data->cups_devices_refreshing)
+    pthread_cond_wait(&global_data->cups_devices_cond,
+		      &global_data->cups_devices_mutex);
+  cupsArrayDelete(global_data->cups_devices);
+  global_data->cups_devices = NULL;
+  global_data->cups_devices_time = 0.0;
+  pthread_mutex_unlock(&global_data->cups_devices_mutex);
+}
+
+
+//
+// '_prCUPSBackChannelRead()' - Read data from the back channel of a CUPS
+//                              backend, like cupsBackChannelRead() but
+//                              on the given file descriptor and not on
+//                              the process-wide FD 3, so that we can talk
+//                              to several backends at the same time
+//
+
+ssize_t					// O - Bytes read or -1 on error or
+					//     timeout
+_prCUPSBackChannelRead(int fd,		// I - Back channel FD
+		       char *buffer,	// I - Buffer to read into
+		       size_t bytes,	// I - Size of buffer
+		       double timeout)	// I - Timeout in seconds, negative
+					//     for none
+{
+  struct pollfd	pfd;			// Poll structure for poll()
+  int		ret;			// Result of poll()
+  int		msecs = (timeout < 0.0 ? -1 : (int)(timeout * 1000));
+					// Timeout for poll()
+
+
+  pfd.fd     = fd;
+  pfd.events = POLLIN;
+
+  while ((ret = poll(&pfd, 1, msecs)) < 0 &&
+	 (errno == EINTR || errno == EAGAIN));
+
+  if (ret < 1)
+    return (-1);
+
+  return (read(fd, buffer, bytes));
+}
+
+
+//
+// '_prCUPSSideChannelDoRequest()' - Send a request to a CUPS backend via
+//                                   its side channel and read the
+//                                   response, like
+//                                   cupsSideChannelDoRequest() but on the
+//                                   given file descriptor and not on the
+//                                   process-wide FD 4. Messages are the
+//                                   command, the status, the data length
+//                                   (2 bytes, big-endian), and the data.
+//
+
+cups_sc_status_t			// O - Status of the request
+_prCUPSSideChannelDoRequest(
+    int               fd,		// I  - Side channel FD
+    cups_sc_command_t command,		// I  - Command to send
+    char              *data,		// O  - Response data buffer
+    int               *datalen,		// IO - Size of data buffer on
+					//      entry, number of bytes in
+					//      buffer on return
+    double            timeout)		// I  - Timeout in seconds, negative
+					//      for none
+{
+  unsigned char	buffer[PR_CUPS_SC_MAX_BUFFER]; // Message buffer
+  struct pollfd	pfd;			// Poll structure for poll()
+  int		ret,			// Result of poll()
+		templen;		// Data length of the response
+  ssize_t	bytes;			// Bytes written or read
+  size_t	written;		// Bytes of the request written
+  int		msecs = (timeout < 0.0 ? -1 : (int)(timeout * 1000));
+					// Timeout for poll()
+
+
+  pfd.fd = fd;
+
+  // Discard a late response to an earlier request which timed out, so
+  // that it does not get taken as the response to this request
+  pfd.events = POLLIN;
+  while ((ret = poll(&pfd, 1, 0)) > 0 || (ret < 0 && errno == EINTR))
+  {
+    if (ret < 0)
+      continue;
+    if (!(pfd.revents & POLLIN))
+      break;			// Hangup or error, reported below
+    if ((bytes = read(fd, buffer, sizeof(buffer))) == 0 ||
+	(bytes < 0 && errno != EINTR && errno != EAGAIN))
+      break;
+  }
+
+  // Send the request, it has no data
+  buffer[0] = (unsigned char)command;
+  buffer[1] = CUPS_SC_STATUS_NONE;
+  buffer[2] = 0;
+  buffer[3] = 0;
+
+  pfd.events = POLLOUT;
+  for (written = 0; written < 4; written += (size_t)bytes)
+  {
+    while ((ret = poll(&pfd, 1, msecs)) < 0 &&
+	   (errno == EINTR || errno == EAGAIN));
+    if (ret < 1)
+      return (CUPS_SC_STATUS_TIMEOUT);
+
+    if ((bytes = write(fd, buffer + written, 4 - written)) < 0)
+    {
+      if (errno != EINTR && errno != EAGAIN)
+	return (CUPS_SC_STATUS_IO_ERROR);
+      bytes = 0;
+    }
+  }
+
+  // Read the response, it comes as one message
+  pfd.events = POLLIN;
+  while ((ret = poll(&pfd, 1, msecs)) < 0 &&
+	 (errno == EINTR || errno == EAGAIN));
+  if (ret < 1)
+    return (CUPS_SC_STATUS_TIMEOUT);
+
+  while ((bytes = read(fd, buffer, sizeof(buffer))) < 0)
+    if (errno != EINTR && errno != EAGAIN)
+      return (CUPS_SC_STATUS_IO_ERROR);
+
+  if (bytes < 4 || buffer[0] != (unsigned char)command)
+  {
+    if (datalen)
+      *datalen = 0;
+    return (CUPS_SC_STATUS_BAD_MESSAGE);
+  }
+
+  templen = (buffer[2] << 8) | buffer[3];
+  if (templen > 0 && (!data || !datalen))
+    return (CUPS_SC_STATUS_TOO_BIG);
+  else if (!datalen || templen > *datalen || templen > bytes - 4)
+    return (CUPS_SC_STATUS_TOO_BIG);
+
+  *datalen = templen;
+  if (templen > 0)
+    memcpy(data, buffer + 4, (size_t)templen);
+
+  if (buffer[1] > CUPS_SC_STATUS_NOT_IMPLEMENTED)
+    return (CUPS_SC_STATUS_BAD_MESSAGE);
+
+  return ((cups_sc_status_t)buffer[1]);
+}
+
+
+//
+// '_prCUPSBackendIsStreaming()' - Check whether the backend of a device
+//                                 URI only streams the data to the
+//                                 printer and so can stay running across
+//                                 jobs (PR_COPTIONS_PERSISTENT_CUPS_BACKENDS).
+//                                 These backends take their settings from
+//                                 the device URI and not from the job
+//                                 options. Backends which submit each job
+//                                 as a job to a server (ipp, lpd, smb,
+//                                 ...) or which use the job options or
+//                                 the job's title and user need to be
+//                                 started for each job. The socket
+//                                 backend is not kept running either,
+//                                 see _prCUPSBackendAttach().
+//
+
+bool					// O - true if the backend can stay
+					//     running
+_prCUPSBackendIsStreaming(const char *device_uri) // I - Device URI
+{
+  static const char * const schemes[] =	// Streaming backends
+  {
+    "parallel",
+    "serial",
+    "usb"
+  };
+  const char	*scheme,		// Scheme of the CUPS device URI
+		*ptr;			// End of scheme
+  int		i;			// Looping var
+
+
+  if (!device_uri || strncmp(device_uri, "cups:", 5))
+    return (false);
+
+  scheme = device_uri + 5;
+  if ((ptr = strchr(scheme, ':')) == NULL)
+    return (false);
+
+  for (i = 0; i < (int)(sizeof(schemes) / sizeof(schemes[0])); i ++)
+    if (strlen(schemes[i]) == (size_t)(ptr - scheme) &&
+	!strncmp(scheme, schemes[i], (size_t)(ptr - scheme)))
+      return (true);
+
+  return (false);
+}
+
+
+//
+// '_prCUPSBackendSettings()' - Get the printer, the PPD file, and the
+//                              environment with which the backend for
+//                              the device's job would get started, as a
+//                              string for comparison. A persistent
+//                              backend only gets reused for a job with
+//                              the same settings.
+//
+
+char *					// O - Settings, to be freed by the
+					//     caller, "" if the device has no
+					//     job
+_prCUPSBackendSettings(pr_cups_device_data_t *device_data) // I - Device data
+{
+  ppd_filter_data_ext_t *ext;		// PPD file data of the job
+  const char	*printer = NULL,	// Printer of the job
+		*ppdfile = NULL;	// PPD file of the job
+  char		*settings,		// Settings string
+		*ptr;			// Pointer into string
+  size_t	len;			// Length of string
+  int		i;			// Looping var
+
+
+  if (device_data->filter_data)
+  {
+    printer = device_data->filter_data->printer;
+    if ((ext = (ppd_filter_data_ext_t *)
+	 cfFilterDataGetExt(device_data->filter_data,
+			    PPD_FILTER_DATA_EXT)) != NULL)
+      ppdfile = ext->ppdfile;
+  }
+
+  len = (printer ? strlen(printer) : 0) + (ppdfile ? strlen(ppdfile) : 0) + 3;
+  for (i = 0; device_data->envp && device_data->envp[i]; i ++)
+    len += strlen(device_data->envp[i]) + 1;
+
+  if ((settings = (char *)malloc(len)) == NULL)
+    return (NULL);
+
+  if (!device_data->filter_data)
+  {
+    settings[0] = '\0';
+    return (settings);
+  }
+
+  snprintf(settings, len, "%s\n%s\n", printer ? printer : "",
+	   ppdfile ? ppdfile : "");
+  for (i = 0, ptr = settings + strlen(settings);
+       device_data->envp && device_data->envp[i];
+       i ++, ptr += strlen(ptr))
+    snprintf(ptr, len - (size_t)(ptr - settings), "%s\n",
+	     device_data->envp[i]);
+
+  return (settings);
+}
+
+
+//
+// '_prCUPSBackendSetEnv()' - Set the environment variables for starting a
+//                            CUPS backend in job execution mode: The
+//                            device URI and the variables of the job
+//                            (PRINTER, PRINTER_LOCATION). They are passed
+//                            via the backend's own environment, not via
+//                            the process-wide one.
+//
+
+void
+_prCUPSBackendSetEnv(cf_filter_external_t *params, // I - Backend parameters
+		     const char *device_uri, // I - Device URI ("cups:...")
+		     char       **envp)	// I - Environment of the job or NULL
+{
+  int		i;			// Looping var
+  char		name[256];		// Name of variable
+  const char	*value;			// Value of variable
+
+
+  cfFilterAddEnvVar("DEVICE_URI", (char *)device_uri + 5, &params->envp);
+
+  for (i = 0; envp && envp[i]; i ++)
+    if ((value = strchr(envp[i], '=')) != NULL &&
+	(size_t)(value - envp[i]) < sizeof(name))
+    {
+      memcpy(name, envp[i], (size_t)(value - envp[i]));
+      name[value - envp[i]] = '\0';
+      cfFilterAddEnvVar(name, (char *)value + 1, &params->envp);
+    }
+}
+
+
+//
+// '_prCUPSBackendCompare()' - Compare function for the list of persistent
+//                             CUPS backends, sorting by device URI
+//
+
+int					// O - Result of comparison
+_prCUPSBackendCompare(pr_cups_backend_t *a, // I - First backend
+		      pr_cups_backend_t *b, // I - Second backend
+		      void *data)	// I - Unused
+{
+  (void)data;
+  return (strcmp(a->device_uri, b->device_uri));
+}
+
+
+//
+// '_prCUPSBackendAttach()' - Connect the device to the persistent CUPS
+//                            backend of its device URI, starting the
+//                            backend if it is not running yet
+//                            (PR_COPTIONS_PERSISTENT_CUPS_BACKENDS). The
+//                            backend runs with its own filter_data, so
+//                            it does not depend on a job. If the device
+//                            has the filter_data of a job, the job gets
+//                            the back and side channel pipes of the
+//                            backend until the device gets detached.
+//
+//                            A backend gets started with the job data
+//                            and environment of the job which starts
+//                            it, as a backend started for each job. It
+//                            gets reused for the following jobs with the
+//                            same printer, PPD file, and environment,
+//                            otherwise it gets restarted. The job ID,
+//                            title, user, copies, and options of later
+//                            jobs cannot reach the running backend, this
+//                            is why only streaming backends, which do
+//                            not use them, get kept running (see
+//                            _prCUPSBackendIsStreaming()).
+//
+//                            The socket backend (AppSocket/JetDirect,
+//                            port 9100) streams, too, but is not kept
+//                            running: It would hold the network
+//                            connection to the printer for up to
+//                            PR_CUPS_BACKEND_IDLE_TIMEOUT seconds after
+//                            each job, so that other hosts could not
+//                            print in the meantime, and many printers
+//                            take the closing of the connection as the
+//                            end of a job, so that jobs sent back to
+//                            back would get merged into one. Local
+//                            devices (usb, parallel, serial) are not
+//                            shared with other hosts and the drivers
+//                            end each job in the data stream.
+//
+//                            If two printers use the same device URI,
+//                            only one of them can use the persistent
+//                            backend at a time. The other one gets a
+//                            backend started for this access, as without
+//                            persistent backends, which fails or waits
+//                            if the printer does not accept a second
+//                            connection.
+//
+
+bool					// O - true if attached, false if
+					//     the backend is in use by
+					//     another device or failed
+_prCUPSBackendAttach(pappl_device_t *device) // I - Device
+{
+  pr_cups_device_data_t *device_data =
+    (pr_cups_device_data_t *)papplDeviceGetData(device);
+  pr_printer_app_global_data_t *global_data = device_data->global_data;
+  pr_cups_backend_t key,		// Search key
+		*backend;		// Persistent backend
+  cf_filter_data_t *job_data = device_data->filter_data;
+					// Filter data of the job, if any
+  ppd_filter_data_ext_t *ext;		// PPD file data of the job
+  siginfo_t	child_info;		// Exit status of the backend
+  char		buf[2048],		// Path of the backend
+		*settings;		// Printer, PPD, environment of job
+  int		i;			// Looping var
+
+
+  if ((settings = _prCUPSBackendSettings(device_data)) == NULL)
+    return (false);
+
+  pthread_mutex_lock(&global_data->cups_backends_mutex);
+
+  if (!global_data->cups_backends)
+    global_data->cups_backends =
+      cupsArrayNew3((cups_array_func_t)_prCUPSBackendCompare, NULL, NULL, 0,
+		    NULL, NULL);
+
+  key.device_uri = device_data->device_uri;
+  if ((backend = (pr_cups_backend_t *)
+       cupsArrayFind(global_data->cups_backends, &key)) != NULL &&
+      !backend->in_use)
+  {
+    // Check whether the backend is still running, it could have terminated
+    // on an error, for example if the printer got disconnected
+    memset(&child_info, 0, sizeof(child_info));
+    if (waitid(P_PID, (id_t)backend->pid, &child_info,
+	       WEXITED | WNOHANG | WNOWAIT) || child_info.si_pid)
+    {
+      papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	       "Persistent CUPS backend for %s (PID %d) has terminated",
+	       backend->device_uri, backend->pid);
+      cupsArrayRemove(global_data->cups_backends, backend);
+      _prCUPSBackendStop(backend);
+      backend = NULL;
+    }
+    else if (job_data && strcmp(backend->settings, settings))
+    {
+      // Started for another printer, another PPD file, or without job,
+      // restart it with the data of this job
+      papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	       "Restarting persistent CUPS backend for %s (PID %d) with the "
+	       "settings of %s", backend->device_uri, backend->pid,
+	       job_data->printer ? job_data->printer : "the job");
+      cupsArrayRemove(global_data->cups_backends, backend);
+      _prCUPSBackendStop(backend);
+      backend = NULL;
+    }
+  }
+
+  if (backend && backend->in_use)
+  {
+    // Used by another device, let the caller start a backend of its own
+    pthread_mutex_unlock(&global_data->cups_backends_mutex);
+    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	     "Persistent CUPS backend for %s is in use by another printer, "
+	     "starting a separate backend", device_data->device_uri);
+    free(settings);
+    return (false);
+  }
+
+  if (!backend)
+  {
+    // Start a new backend, in job execution mode, it prints everything
+    // which we send to it until we close its input
+    if ((backend = (pr_cups_backend_t *)
+	 calloc(1, sizeof(pr_cups_backend_t))) == NULL)
+    {
+      pthread_mutex_unlock(&global_data->cups_backends_mutex);
+      papplDeviceError(device, "Ran out of memory allocating a device!");
+      free(settings);
+      return (false);
+    }
+    backend->device_uri = strdup(device_data->device_uri);
+    backend->settings   = settings;
+    settings            = NULL;
+    backend->devlog_data.system = global_data->system;
+    backend->filter_data.back_pipe[0] = -1;
+    backend->filter_data.back_pipe[1] = -1;
+    backend->filter_data.side_pipe[0] = -1;
+    backend->filter_data.side_pipe[1] = -1;
+    backend->filter_data.logfunc = _prCUPSDevLog;
+    backend->filter_data.logdata = &backend->devlog_data;
+    cfFilterOpenBackAndSidePipes(&backend->filter_data);
+
+    // The job data which ppdFilterExternalCUPS() puts on the command line
+    // and into the environment of the backend, copied, as the backend
+    // outlives the job
+    if (job_data)
+    {
+      backend->filter_data.printer =
+	(job_data->printer ? strdup(job_data->printer) : NULL);
+      backend->filter_data.job_id = job_data->job_id;
+      backend->filter_data.job_user =
+	(job_data->job_user ? strdup(job_data->job_user) : NULL);
+      backend->filter_data.job_title =
+	(job_data->job_title ? strdup(job_data->job_title) : NULL);
+      backend->filter_data.copies = job_data->copies;
+      for (i = 0; i < job_data->num_options; i ++)
+	backend->filter_data.num_options =
+	  cupsAddOption(job_data->options[i].name,
+			job_data->options[i].value,
+			backend->filter_data.num_options,
+			&backend->filter_data.options);
+      if ((ext = (ppd_filter_data_ext_t *)
+	   cfFilterDataGetExt(job_data, PPD_FILTER_DATA_EXT)) != NULL &&
+	  ext->ppdfile)
+      {
+	backend->filter_data_ext.ppdfile = strdup(ext->ppdfile);
+	cfFilterDataAddExt(&backend->filter_data, PPD_FILTER_DATA_EXT,
+			   &backend->filter_data_ext);
+      }
+    }
+
+    snprintf(buf, sizeof(buf), "%s/%s",
+	     global_data->backend_dir, device_data->device_uri + 5);
+    *(strchr(buf, ':')) = '\0';
+    backend->backend_params.filter = strdup(buf);
+    backend->backend_params.exec_mode = 1;
+    _prCUPSBackendSetEnv(&backend->backend_params, device_data->device_uri,
+			 device_data->envp);
+
+    if ((backend->inputfd =
+	 cfFilterPOpen(ppdFilterExternalCUPS,
+		       -1, open("/dev/null", O_RDWR),
+		       0, &backend->filter_data, &backend->backend_params,
+		       &backend->pid)) == 0)
+    {
+      pthread_mutex_unlock(&global_data->cups_backends_mutex);
+      papplDeviceError(device,
+		       "Unable to execute '%s' - %s\n",
+		       backend->backend_params.filter, strerror(errno));
+      backend->pid = 0;
+      _prCUPSBackendStop(backend);
+      return (false);
+    }
+
+    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	     "Started persistent CUPS backend for %s (PID %d)",
+	     backend->device_uri, backend->pid);
+    cupsArrayAdd(global_data->cups_backends, backend);
+  }
+
+  backend->in_use = true;
+
+  pthread_mutex_unlock(&global_data->cups_backends_mutex);
+
+  free(settings);
+
+  // Connect the device to the backend
+  device_data->persistent  = backend;
+  device_data->inputfd     = backend->inputfd;
+  device_data->backend_pid = backend->pid;
+  device_data->backfd      = backend->filter_data.back_pipe[0];
+  device_data->sidefd      = backend->filter_data.side_pipe[0];
+
+  if (device_data->filter_data)
+  {
+    // Let the filters of the job use the channels of the backend
+    device_data->job_pipes[0] = device_data->filter_data->back_pipe[0];
+    device_data->job_pipes[1] = device_data->filter_data->back_pipe[1];
+    device_data->job_pipes[2] = device_data->filter_data->side_pipe[0];
+    device_data->job_pipes[3] = device_data->filter_data->side_pipe[1];
+    device_data->filter_data->back_pipe[0] = backend->filter_data.back_pipe[0];
+    device_data->filter_data->back_pipe[1] = backend->filter_data.back_pipe[1];
+    device_data->filter_data->side_pipe[0] = backend->filter_data.side_pipe[0];
+    device_data->filter_data->side_pipe[1] = backend->filter_data.side_pipe[1];
+    device_data->internal_filter_data = false;
+  }
+  else
+  {
+    device_data->filter_data = &backend->filter_data;
+    device_data->internal_filter_data = false;
+  }
+
+  return (true);
+}
+
+
+//
+// '_prCUPSBackendDetach()' - Disconnect the device from its persistent
+//                            CUPS backend at the end of a job or of an
+//                            administrative access. The end of a job is
+//                            marked by asking the backend to send out
+//                            all data to the printer, via the side
+//                            channel. The backend stays running until it
+//                            is not used for PR_CUPS_BACKEND_IDLE_TIMEOUT
+//                            seconds.
+//
+
+void
+_prCUPSBackendDetach(pappl_device_t *device) // I - Device
+{
+  pr_cups_device_data_t *device_data =
+    (pr_cups_device_data_t *)papplDeviceGetData(device);
+  pr_printer_app_global_data_t *global_data = device_data->global_data;
+  pr_cups_backend_t *backend = device_data->persistent;
+  cups_sc_status_t sc_status;		// Status of side channel request
+  int		datalen;		// Length of side channel answer
+  pthread_t	thread;			// Idle backend reaper thread
+
+
+  datalen = 0;
+  if ((sc_status =
+       _prCUPSSideChannelDoRequest(device_data->sidefd,
+				   CUPS_SC_CMD_DRAIN_OUTPUT, NULL, &datalen,
+				   PR_CUPS_BACKEND_DRAIN_TIMEOUT)) !=
+      CUPS_SC_STATUS_OK)
+    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	     "Persistent CUPS backend for %s did not confirm sending out "
+	     "the data: %s", backend->device_uri,
+	     pr_cups_sc_status_str[sc_status]);
+
+  // Give the job its own pipes back
+  if (device_data->filter_data == &backend->filter_data)
+    device_data->filter_data = NULL;
+  else if (device_data->filter_data)
+  {
+    device_data->filter_data->back_pipe[0] = device_data->job_pipes[0];
+    device_data->filter_data->back_pipe[1] = device_data->job_pipes[1];
+    device_data->filter_data->side_pipe[0] = device_data->job_pipes[2];
+    device_data->filter_data->side_pipe[1] = device_data->job_pipes[3];
+  }
+
+  device_data->persistent  = NULL;
+  device_data->backend_pid = 0;
+  device_data->inputfd     = -1;
+  device_data->backfd      = -1;
+  device_data->sidefd      = -1;
+
+  // Mark the backend as idle and let the reaper shut it down when it stays
+  // idle for too long
+  pthread_mutex_lock(&global_data->cups_backends_mutex);
+  backend->in_use    = false;
+  backend->last_used = _prGetCurrentTime();
+  if (!global_data->cups_backends_reaper &&
+      !global_data->cups_backends_shutdown)
+  {
+    if (pthread_create(&thread, NULL, _prCUPSBackendReaper, global_data))
+      papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
+	       "Unable to start thread for shutting down idle CUPS "
+	       "backends: %s", strerror(errno));
+    else
+    {
+      pthread_detach(thread);
+      global_data->cups_backends_reaper = true;
+    }
+  }
+  pthread_cond_broadcast(&global_data->cups_backends_cond);
+  pthread_mutex_unlock(&global_data->cups_backends_mutex);
+}
+
+
+//
+// '_prCUPSBackendStop()' - Shut down a persistent CUPS backend, which is
+//                          not in the list any more, and free it
+//
+
+void
+_prCUPSBackendStop(pr_cups_backend_t *backend) // I - Backend
+{
+  int i;
+
+
+  // Closing the input makes the backend finish and terminate
+  if (backend->pid)
+  {
+    papplLog(backend->devlog_data.system, PAPPL_LOGLEVEL_DEBUG,
+	     "Shutting down persistent CUPS backend for %s (PID %d)",
+	     backend->device_uri, backend->pid);
+    cfFilterPClose(backend->inputfd, backend->pid, &backend->filter_data);
+  }
+
+  cfFilterCloseBackAndSidePipes(&backend->filter_data);
+  if (backend->filter_data_ext.ppdfile)
+  {
+    cfFilterDataRemoveExt(&backend->filter_data, PPD_FILTER_DATA_EXT);
+    free(backend->filter_data_ext.ppdfile);
+  }
+  free(backend->filter_data.printer);
+  free(backend->filter_data.job_user);
+  free(backend->filter_data.job_title);
+  cupsFreeOptions(backend->filter_data.num_options,
+		  backend->filter_data.options);
+  free((char *)(backend->backend_params.filter));
+  if (backend->backend_params.envp)
+  {
+    for (i = 0; backend->backend_params.envp[i]; i ++)
+      free(backend->backend_params.envp[i]);
+    free(backend->backend_params.envp);
+  }
+  free(backend->device_uri);
+  free(backend->settings);
+  free(backend);
+}
+
+
+//
+// '_prCUPSBackendReaper()' - Thread function to shut down the persistent
+//                            CUPS backends which are not used for
+//                            PR_CUPS_BACKEND_IDLE_TIMEOUT seconds, it
+//                            ends when there are no backends left
+//
+
+void *					// O - Thread exit status, unused
+_prCUPSBackendReaper(void *data)	// I - Global data
+{
+  pr_printer_app_global_data_t *global_data =
+    (pr_printer_app_global_data_t *)data;
+  pr_cups_backend_t *backend;		// Current backend
+  cups_array_t	*idle;			// Backends to shut down
+  double	current_time,		// Current time
+		next_time;		// Time of next check
+  struct timespec wake_time;		// Time of next check for
+					// pthread_cond_timedwait()
+
+
+  pthread_mutex_lock(&global_data->cups_backends_mutex);
+
+  while (!global_data->cups_backends_shutdown &&
+	 cupsArrayCount(global_data->cups_backends) > 0)
+  {
+    // Take the backends which are idle for too long out of the list
+    current_time = _prGetCurrentTime();
+    next_time = current_time + PR_CUPS_BACKEND_IDLE_TIMEOUT;
+    idle = cupsArrayNew(NULL, NULL);
+    for (backend =
+	   (pr_cups_backend_t *)cupsArrayFirst(global_data->cups_backends);
+	 backend;
+	 backend =
+	   (pr_cups_backend_t *)cupsArrayNext(global_data->cups_backends))
+    {
+      if (backend->in_use)
+	continue;
+      if (current_time - backend->last_used >= PR_CUPS_BACKEND_IDLE_TIMEOUT)
+      {
+	cupsArrayRemove(global_data->cups_backends, backend);
+	cupsArrayAdd(idle, backend);
+      }
+      else if (backend->last_used + PR_CUPS_BACKEND_IDLE_TIMEOUT < next_time)
+	next_time = backend->last_used + PR_CUPS_BACKEND_IDLE_TIMEOUT;
+    }
+
+    // Shut them down without blocking the other backends
+    if (cupsArrayCount(idle) > 0)
+    {
+      pthread_mutex_unlock(&global_data->cups_backends_mutex);
+      for (backend = (pr_cups_backend_t *)cupsArrayFirst(idle);
+	   backend;
+	   backend = (pr_cups_backend_t *)cupsArrayNext(idle))
+	_prCUPSBackendStop(backend);
+      pthread_mutex_lock(&global_data->cups_backends_mutex);
+    }
+    cupsArrayDelete(idle);
+
+    // Wait until the next backend can get idle for too long
+    wake_time.tv_sec  = (time_t)next_time;
+    wake_time.tv_nsec = (long)((next_time - (double)wake_time.tv_sec) *
+			       1000000000.0);
+    pthread_cond_timedwait(&global_data->cups_backends_cond,
+			   &global_data->cups_backends_mutex, &wake_time);
+  }
+
+  global_data->cups_backends_reaper = false;
+  pthread_cond_broadcast(&global_data->cups_backends_cond);
+  pthread_mutex_unlock(&global_data->cups_backends_mutex);
+
+  return (NULL);
+}
+
+
+//
+// '_prCUPSBackendsFree()' - Shut down all persistent CUPS backends, on
+//                           shutdown of the Printer Application
+//
+
+void
+_prCUPSBackendsFree(pr_printer_app_global_data_t *global_data)
+{
+  pr_cups_backend_t *backend;		// Current backend
+
+
+  pthread_mutex_lock(&global_data->cups_backends_mutex);
+  global_data->cups_backends_shutdown = true;
+  pthread_cond_broadcast(&global_data->cups_backends_cond);
+  while (global_data->cups_backends_reaper)
+    pthread_cond_wait(&global_data->cups_backends_cond,
+		      &global_data->cups_backends_mutex);
+  pthread_mutex_unlock(&global_data->cups_backends_mutex);
+
+  for (backend =
+	 (pr_cups_backend_t *)cupsArrayFirst(global_data->cups_backends);
+       backend;
+       backend =
+	 (pr_cups_backend_t *)cupsArrayNext(global_data->cups_backends))
+    _prCUPSBackendStop(backend);
+  cupsArrayDelete(global_data->cups_backends);
+  global_data->cups_backends = NULL;
+}
+
+
 //
 // '_prCUPSDevLaunchBackend()' - This function starts the CUPS backend
 //                               for a PAPPL device using the "cups"
@@ -774,6 +1842,14 @@ _prCUPSDevLaunchBackend(pappl_device_t *device)
     }
   }
 
+  // Use the persistent backend of the device URI, if it is not used by
+  // another device at the moment
+  if ((device_data->global_data->config->components &
+       PR_COPTIONS_PERSISTENT_CUPS_BACKENDS) &&
+      _prCUPSBackendIsStreaming(device_data->device_uri) &&
+      _prCUPSBackendAttach(device))
+    return (true);
+
   // Log function
   memset(&device_data->devlog_data, 0, sizeof(device_data->devlog_data));
   device_data->devlog_data.system = device_data->global_data->system;
@@ -817,8 +1893,9 @@ _prCUPSDevLaunchBackend(pappl_device_t *device)
   device_data->backend_params.filter = strdup(buf);
   device_data->backend_params.exec_mode = 1; // Run backend in job execution
                                              // mode
-  cfFilterAddEnvVar("DEVICE_URI", device_data->device_uri + 5,
-		    &device_data->backend_params.envp);
+  // When running for a job, tell the backend for which printer it works
+  _prCUPSBackendSetEnv(&device_data->backend_params, device_data->device_uri,
+		       device_data->envp);
 
   // Return the filter ends of the pipes
   device_data->backfd = device_data->filter_data->back_pipe[0];
@@ -867,6 +1944,13 @@ _prCUPSDevStopBackend(pappl_device_t *device)
     return;
   }
 
+  // Keep a persistent backend running
+  if (device_data->persistent)
+  {
+    _prCUPSBackendDetach(device);
+    return;
+  }
+
   // Close the backend sub-process
   if (device_data->backend_pid)
   {
@@ -1011,13 +2095,9 @@ _prCUPSDevRead(pappl_device_t *device,
   if (!device_data->backend_pid && !_prCUPSDevLaunchBackend(device))
     return (-1);
 
-  // Standard FD for back channel is 3, the CUPS library functions use
-  // always FD 3. Therefore we redirect our back channel pipe end to
-  // FD 3
-  dup2(device_data->backfd, 3);
-
   // Read from the back channel of the backend
-  return (cupsBackChannelRead(buffer, bytes, device_data->back_timeout));
+  return (_prCUPSBackChannelRead(device_data->backfd, buffer, bytes,
+				 device_data->back_timeout));
 }
 
 
@@ -1088,16 +2168,11 @@ _prCUPSDevStatus(pappl_device_t *device)
     return (reason);
 
   // Query status via side channel
-
-  // Standard FD for side channel is 4, the CUPS library functions
-  // always use FD 4. Therefore we redirect our side channel pipe end
-  // to FD 4
-  dup2(device_data->sidefd, 4);
-
   datalen = 1;
-  if ((sc_status = cupsSideChannelDoRequest(CUPS_SC_CMD_GET_STATE, &_prStatus,
-					    &datalen,
-					    device_data->side_timeout)) !=
+  if ((sc_status = _prCUPSSideChannelDoRequest(device_data->sidefd,
+					       CUPS_SC_CMD_GET_STATE,
+					       &_prStatus, &datalen,
+					       device_data->side_timeout)) !=
       CUPS_SC_STATUS_OK)
   {
     papplDeviceError(device, "Side channel error status: %s",
@@ -1162,16 +2237,11 @@ _prCUPSDevID(pappl_device_t *device,
     return (NULL);
 
   // Query device ID via side channel
-
-  // Standard FD for side channel is 4, the CUPS library functions
-  // always use FD 4. Therefore we redirect our side channel pipe end
-  // to FD 4
-  dup2(device_data->sidefd, 4);
-
   datalen = bufsize;
-  if ((sc_status = cupsSideChannelDoRequest(CUPS_SC_CMD_GET_DEVICE_ID,
-					    buffer, &datalen,
-					    device_data->side_timeout)) !=
+  if ((sc_status = _prCUPSSideChannelDoRequest(device_data->sidefd,
+					       CUPS_SC_CMD_GET_DEVICE_ID,
+					       buffer, &datalen,
+					       device_data->side_timeout)) !=
       CUPS_SC_STATUS_OK)
   {
     papplDeviceError(device, "Side channel error status: %s",
@@ -0,0 +1,120 @@
+//
+// PPD/Classic CUPS driver retro-fit Printer Application Library
+// (libpappl-retrofit) for the Printer Application Framework (PAPPL)
+//
+// dir-watcher-private.h
+//
+// Copyright © 2020 by Till Kamppeter.
+// Copyright © 2020 by Michael R Sweet.
+//
+// Licensed under Apache License v2.0.  See the file "LICENSE" for more
+// information.
+//
+
+#ifndef _PAPPL_RETROFIT_DIR_WATCHER_H_
+#  define _PAPPL_RETROFIT_DIR_WATCHER_H_
+
+//
+// Include necessary headers...
+//
+
+#include <pappl-retrofit/pappl-retrofit.h>
+#include <pappl/pappl.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+
+
+//
+// C++ magic...
+//
+
+#  ifdef __cplusplus
+extern "C" {
+#  endif // __cplusplus
+
+
+//
+// Constants...
+//
+
+#define PR_DIR_WATCHER_DEBOUNCE  2000   // Wait for this many ms without
+                                        // new events before applying the
+                                        // changes
+#define PR_DIR_WATCHER_MAX_DELAY 10000  // But apply them at the latest
+                                        // after this many ms
+#define PR_DIR_WATCHER_MAX_DEPTH 16     // Maximum depth of sub-directories
+                                        // in the PPD collections to watch
+
+
+//
+// Types...
+//
+
+typedef enum pr_dir_watch_kind_e        // What is in a watched directory
+{
+  PR_DIR_WATCH_PPD,                     // PPD files
+  PR_DIR_WATCH_FILTER,                  // CUPS filters
+  PR_DIR_WATCH_BACKEND                  // CUPS backends
+} pr_dir_watch_kind_t;
+
+typedef struct pr_dir_watch_s           // Watched directory
+{
+  int                 wd;               // inotify watch descriptor
+  char                *path;            // Directory path
+  pr_dir_watch_kind_t kind;             // Contents of the directory
+  int                 depth;            // Depth in PPD collection
+} pr_dir_watch_t;
+
+typedef struct pr_dir_watch_applied_s   // Change already applied to the
+                                        // driver list by someone else
+{
+  char            *path;                // Path of the PPD file
+  bool            removed;              // File removed?
+  ino_t           ino;                  // Inode of the added file
+  off_t           size;                 // Size of the added file
+  struct timespec mtime;                // Modification time of the added
+                                        // file
+} pr_dir_watch_applied_t;
+
+typedef struct pr_dir_watcher_s         // Directory watcher
+{
+  pr_printer_app_global_data_t *global_data; // Global data
+  int          fd;                      // inotify file descriptor
+  int          stop_pipe[2];            // Pipe to stop the thread
+  pthread_t    thread;                  // Watcher thread
+  cups_array_t *watches;                // Watched directories, by wd
+  // Changes collected since the last update
+  cups_array_t *added,                  // Added/changed PPD files
+               *removed,                // Removed PPD files
+               *applied;                // Changes already applied, for
+                                        // example by the web interface
+                                        // (driver_list_mutex)
+  bool         rescan,                  // Full rescan of the PPDs needed?
+               filters_changed,         // Filter directory changed?
+               backends_changed;        // Backend directory changed?
+  long long    first_change;            // Time of first change (ms), or 0
+} pr_dir_watcher_t;
+
+
+//
+// Functions...
+//
+
+extern void   _prDirWatcherApplied(
+				pr_printer_app_global_data_t *global_data,
+				cups_array_t *added, cups_array_t *removed);
+extern bool   _prDirWatcherStart(pr_printer_app_global_data_t *global_data);
+extern void   _prDirWatcherStop(pr_printer_app_global_data_t *global_data);
+
+
+//
+// C++ magic...
+//
+
+#  ifdef __cplusplus
+}
+#  endif // __cplusplus
+
+
+#endif // !_PAPPL_RETROFIT_DIR_WATCHER_H_
@@ -0,0 +1,685 @@
+//
+// PPD/Classic CUPS driver retro-fit Printer Application Library
+// (libpappl-retrofit) for the Printer Application Framework (PAPPL)
+//
+// dir-watcher.c
+//
+// Copyright © 2020 by Till Kamppeter.
+// Copyright © 2020 by Michael R Sweet.
+//
+// Licensed under Apache License v2.0.  See the file "LICENSE" for more
+// information.
+//
+
+//
+// Include necessary headers...
+//
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include <pappl-retrofit/pappl-retrofit-private.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+
+
+//
+// Constants...
+//
+
+#define PR_DIR_WATCH_PPD_EVENTS (IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | \
+				 IN_ATTRIB | IN_MOVED_FROM | IN_MOVED_TO)
+#define PR_DIR_WATCH_EXE_EVENTS (IN_CLOSE_WRITE | IN_DELETE | IN_ATTRIB | \
+				 IN_MOVED_FROM | IN_MOVED_TO)
+
+
+//
+// Local functions...
+//
+
+static int       watcher_compare(pr_dir_watch_t *a, pr_dir_watch_t *b,
+				 void *data);
+static int       watcher_compare_applied(pr_dir_watch_applied_t *a,
+					 pr_dir_watch_applied_t *b,
+					 void *data);
+static void      watcher_drop_applied(pr_dir_watcher_t *watcher);
+static void      watcher_free_applied(pr_dir_watch_applied_t *applied,
+				      void *data);
+static void      watcher_add(pr_dir_watcher_t *watcher, const char *path,
+			     pr_dir_watch_kind_t kind, int depth);
+static void      watcher_apply(pr_dir_watcher_t *watcher);
+static void      watcher_event(pr_dir_watcher_t *watcher,
+			       struct inotify_event *event);
+static void      watcher_free(pr_dir_watcher_t *watcher);
+static bool      watcher_is_generator(const char *path, bool exists);
+static void      *watcher_run(void *data);
+static long long watcher_time(void);
+
+
+//
+// '_prDirWatcherApplied()' - Tell the directory watcher about changes of
+//                            PPD files which the caller has already
+//                            applied to the driver list, like PPD files
+//                            uploaded or deleted via the web interface,
+//                            so that the watcher does not process them
+//                            a second time. Files which get changed
+//                            again before the watcher applies its
+//                            changes get processed nevertheless. To be
+//                            called with the driver list mutex held.
+//
+
+void
+_prDirWatcherApplied(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    cups_array_t                 *added,       // I - Added PPD files or NULL
+    cups_array_t                 *removed)     // I - Removed PPD files or
+                                               //     NULL
+{
+  pr_dir_watcher_t       *watcher = global_data->dir_watcher;
+                                // Directory watcher
+  pr_dir_watch_applied_t *applied; // Applied change
+  struct stat            fileinfo; // File information
+  char                   *path; // PPD file path
+  int                    i;     // Looping variable
+  cups_array_t           *paths; // Current path list
+
+
+  if (!watcher)
+    return;
+
+  for (i = 0; i < 2; i ++)
+  {
+    paths = (i == 0 ? added : removed);
+    for (path = (char *)cupsArrayFirst(paths);
+	 path;
+	 path = (char *)cupsArrayNext(paths))
+    {
+      if (i == 0 && stat(path, &fileinfo))
+	continue;
+      if ((applied =
+	   (pr_dir_watch_applied_t *)calloc(1,
+					    sizeof(pr_dir_watch_applied_t))) ==
+	  NULL ||
+	  (applied->path = strdup(path)) == NULL)
+      {
+	free(applied);
+	break;
+      }
+      applied->removed = (i == 1);
+      if (i == 0)
+      {
+	applied->ino   = fileinfo.st_ino;
+	applied->size  = fileinfo.st_size;
+	applied->mtime = fileinfo.st_mtim;
+      }
+      cupsArrayAdd(watcher->applied, applied);
+    }
+  }
+}
+
+
+//
+// '_prDirWatcherStart()' - Start a thread watching the PPD collection
+//                          directories, the filter directory, and the
+//                          backend directory.
+//
+//                          When PPD files get added, changed, or removed
+//                          (for example by a package installation) the
+//                          driver list gets updated, when filters or
+//                          backends change, the filter look-up cache gets
+//                          flushed. Events get collected until there are
+//                          no new ones for PR_DIR_WATCHER_DEBOUNCE ms, so
+//                          that a package installation leads to only one
+//                          update.
+//
+
+bool                            // O - `true` on success, `false` on error
+_prDirWatcherStart(
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  pr_dir_watcher_t *watcher;    // Directory watcher
+  ppd_collection_t *col;        // PPD collection
+
+
+  if (global_data->dir_watcher)
+    return (true);
+
+  if ((watcher = (pr_dir_watcher_t *)calloc(1, sizeof(pr_dir_watcher_t))) ==
+      NULL)
+    return (false);
+
+  watcher->global_data = global_data;
+  watcher->stop_pipe[0] = watcher->stop_pipe[1] = -1;
+  watcher->watches = cupsArrayNew((cups_array_func_t)watcher_compare, NULL);
+  watcher->added = cupsArrayNew3((cups_array_func_t)strcmp, NULL, NULL, 0,
+				 NULL, (cups_afree_func_t)free);
+  watcher->removed = cupsArrayNew3((cups_array_func_t)strcmp, NULL, NULL, 0,
+				   NULL, (cups_afree_func_t)free);
+  watcher->applied =
+    cupsArrayNew3((cups_array_func_t)watcher_compare_applied, NULL, NULL, 0,
+		  NULL, (cups_afree_func_t)watcher_free_applied);
+
+  if ((watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0 ||
+      pipe2(watcher->stop_pipe, O_CLOEXEC))
+  {
+    papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
+	     "Unable to watch directories for changes: %s", strerror(errno));
+    watcher_free(watcher);
+    return (false);
+  }
+
+  //
+  // Add the directories
+  //
+
+  for (col = (ppd_collection_t *)cupsArrayFirst(global_data->ppd_collections);
+       col;
+       col = (ppd_collection_t *)cupsArrayNext(global_data->ppd_collections))
+    watcher_add(watcher, col->path, PR_DIR_WATCH_PPD, 0);
+  if (global_data->filter_dir[0])
+    watcher_add(watcher, global_data->filter_dir, PR_DIR_WATCH_FILTER, 0);
+  if (global_data->backend_dir[0])
+    watcher_add(watcher, global_data->backend_dir, PR_DIR_WATCH_BACKEND, 0);
+
+  if (cupsArrayCount(watcher->watches) == 0)
+  {
+    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	     "No directories to watch for changes");
+    watcher_free(watcher);
+    return (false);
+  }
+
+  if (pthread_create(&watcher->thread, NULL, watcher_run, watcher))
+  {
+    papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
+	     "Unable to create directory watcher thread: %s",
+	     strerror(errno));
+    watcher_free(watcher);
+    return (false);
+  }
+
+  papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	   "Watching %d directories for changes",
+	   cupsArrayCount(watcher->watches));
+  global_data->dir_watcher = watcher;
+
+  return (true);
+}
+
+
+//
+// '_prDirWatcherStop()' - Stop the directory watcher thread, changes not
+//                         applied yet get discarded.
+//
+
+void
+_prDirWatcherStop(
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  pr_dir_watcher_t *watcher = global_data->dir_watcher;
+                                // Directory watcher
+
+
+  if (!watcher)
+    return;
+
+  if (write(watcher->stop_pipe[1], "", 1) == 1)
+    pthread_join(watcher->thread, NULL);
+  else
+    pthread_cancel(watcher->thread);
+
+  watcher_free(watcher);
+  global_data->dir_watcher = NULL;
+}
+
+
+//
+// 'watcher_add()' - Add a directory to be watched, for PPD collections
+//                   also add its sub-directories
+//
+
+static void
+watcher_add(pr_dir_watcher_t    *watcher, // I - Directory watcher
+	    const char          *path,    // I - Directory path
+	    pr_dir_watch_kind_t kind,     // I - Contents of the directory
+	    int                 depth)    // I - Depth in PPD collection
+{
+  int            wd;            // Watch descriptor
+  pr_dir_watch_t *watch,        // Watched directory
+                 key;           // Search key
+  cups_dir_t     *dir;          // Directory
+  cups_dentry_t  *dent;         // Directory entry
+  char           subdir[2048];  // Sub-directory path
+
+
+  if ((wd = inotify_add_watch(watcher->fd, path,
+			      kind == PR_DIR_WATCH_PPD ?
+			      PR_DIR_WATCH_PPD_EVENTS :
+			      PR_DIR_WATCH_EXE_EVENTS)) < 0)
+  {
+    papplLog(watcher->global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	     "Unable to watch directory %s: %s", path, strerror(errno));
+    return;
+  }
+
+  // Same directory reachable via different paths?
+  key.wd = wd;
+  if (cupsArrayFind(watcher->watches, &key))
+    return;
+
+  if ((watch = (pr_dir_watch_t *)calloc(1, sizeof(pr_dir_watch_t))) == NULL)
+    return;
+  watch->wd = wd;
+  watch->path = strdup(path);
+  watch->kind = kind;
+  watch->depth = depth;
+  cupsArrayAdd(watcher->watches, watch);
+
+  if (kind != PR_DIR_WATCH_PPD || depth >= PR_DIR_WATCHER_MAX_DEPTH ||
+      (dir = cupsDirOpen(path)) == NULL)
+    return;
+
+  while ((dent = cupsDirRead(dir)) != NULL)
+  {
+    if (dent->filename[0] == '.' || !S_ISDIR(dent->fileinfo.st_mode))
+      continue;
+    snprintf(subdir, sizeof(subdir), "%s/%s", path, dent->filename);
+    watcher_add(watcher, subdir, kind, depth + 1);
+  }
+  cupsDirClose(dir);
+}
+
+
+//
+// 'watcher_apply()' - Apply the collected changes
+//
+
+static void
+watcher_apply(pr_dir_watcher_t *watcher) // I - Directory watcher
+{
+  pr_printer_app_global_data_t *global_data = watcher->global_data;
+  pappl_system_t *system = global_data->system;
+
+
+  pthread_mutex_lock(&global_data->driver_list_mutex);
+  watcher_drop_applied(watcher);
+  if (watcher->rescan)
+  {
+    papplLog(system, PAPPL_LOGLEVEL_INFO,
+	     "PPD collections changed, rebuilding the driver list");
+    _prSetupDriverList(global_data);
+  }
+  else if (cupsArrayCount(watcher->added) || cupsArrayCount(watcher->removed))
+  {
+    papplLog(system, PAPPL_LOGLEVEL_INFO,
+	     "%d PPD file(s) added or changed, %d removed, updating the "
+	     "driver list", cupsArrayCount(watcher->added),
+	     cupsArrayCount(watcher->removed));
+    _prUpdateDriverList(global_data, watcher->added, watcher->removed);
+  }
+  pthread_mutex_unlock(&global_data->driver_list_mutex);
+
+  if (watcher->filters_changed)
+  {
+    papplLog(system, PAPPL_LOGLEVEL_INFO,
+	     "Filter directory %s changed", global_data->filter_dir);
+    _prCUPSFilterPathFlush();
+  }
+
+  if (watcher->backends_changed)
+  {
+    papplLog(system, PAPPL_LOGLEVEL_INFO,
+	     "Backend directory %s changed, the next device discovery uses "
+	     "the current backends", global_data->backend_dir);
+    _prCUPSDevCacheExpire(global_data);
+  }
+
+  cupsArrayClear(watcher->added);
+  cupsArrayClear(watcher->removed);
+  watcher->rescan = false;
+  watcher->filters_changed = false;
+  watcher->backends_changed = false;
+  watcher->first_change = 0;
+}
+
+
+//
+// 'watcher_compare()' - Compare function for the list of watched
+//                       directories, sorting by watch descriptor
+//
+
+static int
+watcher_compare(pr_dir_watch_t *a, // I - First watched directory
+		pr_dir_watch_t *b, // I - Second watched directory
+		void           *data) // I - Unused
+{
+  (void)data;
+  return (a->wd - b->wd);
+}
+
+
+//
+// 'watcher_compare_applied()' - Compare function for the list of changes
+//                               already applied, sorting by path
+//
+
+static int
+watcher_compare_applied(pr_dir_watch_applied_t *a, // I - First change
+			pr_dir_watch_applied_t *b, // I - Second change
+			void                   *data) // I - Unused
+{
+  (void)data;
+  return (strcmp(a->path, b->path));
+}
+
+
+//
+// 'watcher_drop_applied()' - Drop the collected changes which were
+//                            already applied to the driver list, if the
+//                            file is still in the state in which it was
+//                            applied
+//
+
+static void
+watcher_drop_applied(pr_dir_watcher_t *watcher) // I - Directory watcher
+{
+  int                    i;     // Looping variable
+  char                   *path; // PPD file path
+  pr_dir_watch_applied_t key,   // Search key
+                         *applied; // Applied change
+  struct stat            fileinfo; // File information
+
+
+  for (i = cupsArrayCount(watcher->added) - 1; i >= 0; i --)
+  {
+    key.path = path = (char *)cupsArrayIndex(watcher->added, i);
+    if ((applied = (pr_dir_watch_applied_t *)cupsArrayFind(watcher->applied,
+							   &key)) != NULL &&
+	!applied->removed && !stat(path, &fileinfo) &&
+	fileinfo.st_ino == applied->ino &&
+	fileinfo.st_size == applied->size &&
+	fileinfo.st_mtim.tv_sec == applied->mtime.tv_sec &&
+	fileinfo.st_mtim.tv_nsec == applied->mtime.tv_nsec)
+      cupsArrayRemove(watcher->added, path);
+  }
+
+  for (i = cupsArrayCount(watcher->removed) - 1; i >= 0; i --)
+  {
+    key.path = path = (char *)cupsArrayIndex(watcher->removed, i);
+    if ((applied = (pr_dir_watch_applied_t *)cupsArrayFind(watcher->applied,
+							   &key)) != NULL &&
+	applied->removed && access(path, F_OK))
+      cupsArrayRemove(watcher->removed, path);
+  }
+
+  cupsArrayClear(watcher->applied);
+}
+
+
+//
+// 'watcher_event()' - Note the change reported by an inotify event
+//
+
+static void
+watcher_event(pr_dir_watcher_t     *watcher, // I - Directory watcher
+	      struct inotify_event *event)   // I - Event
+{
+  pr_dir_watch_t *watch,        // Watched directory
+                 key;           // Search key
+  char           path[2048],    // Path of changed file
+                 *ptr;          // Path in list
+
+
+  if (event->mask & IN_Q_OVERFLOW)
+  {
+    // Events got lost, re-check everything
+    watcher->rescan = true;
+    watcher->filters_changed = true;
+    watcher->backends_changed = true;
+  }
+  else
+  {
+    key.wd = event->wd;
+    if ((watch = (pr_dir_watch_t *)cupsArrayFind(watcher->watches, &key)) ==
+	NULL)
+      return;
+
+    if (event->mask & IN_IGNORED)
+    {
+      // Directory is gone
+      cupsArrayRemove(watcher->watches, watch);
+      free(watch->path);
+      free(watch);
+      return;
+    }
+
+    // Ignore hidden and temporary files
+    if (event->len == 0 || event->name[0] == '.')
+      return;
+
+    snprintf(path, sizeof(path), "%s/%s", watch->path, event->name);
+
+    switch (watch->kind)
+    {
+      case PR_DIR_WATCH_FILTER :
+	  watcher->filters_changed = true;
+	  break;
+
+      case PR_DIR_WATCH_BACKEND :
+	  watcher->backends_changed = true;
+	  break;
+
+      case PR_DIR_WATCH_PPD :
+	  if (event->mask & IN_ISDIR)
+	  {
+	    // New or removed sub-directory, rescan all
+	    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+	      watcher_add(watcher, path, PR_DIR_WATCH_PPD, watch->depth + 1);
+	    watcher->rescan = true;
+	  }
+	  else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_ATTRIB |
+				  IN_DELETE | IN_MOVED_FROM) &&
+		   watcher_is_generator(path,
+					!(event->mask &
+					  (IN_DELETE | IN_MOVED_FROM))))
+	  {
+	    // The entries of PPD-generating executables and *.drv files
+	    // do not have the file's path as PPD path, so we cannot update
+	    // them incrementally, rescan all
+	    watcher->rescan = true;
+	  }
+	  else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_ATTRIB))
+	  {
+	    if ((ptr = cupsArrayFind(watcher->removed, path)) != NULL)
+	      cupsArrayRemove(watcher->removed, ptr);
+	    if (!cupsArrayFind(watcher->added, path))
+	      cupsArrayAdd(watcher->added, strdup(path));
+	  }
+	  else if (event->mask & (IN_DELETE | IN_MOVED_FROM))
+	  {
+	    if ((ptr = cupsArrayFind(watcher->added, path)) != NULL)
+	      cupsArrayRemove(watcher->added, ptr);
+	    if (!cupsArrayFind(watcher->removed, path))
+	      cupsArrayAdd(watcher->removed, strdup(path));
+	  }
+	  else
+	    return;
+	  break;
+    }
+  }
+
+  if (!watcher->first_change)
+    watcher->first_change = watcher_time();
+}
+
+
+//
+// 'watcher_free()' - Free the directory watcher
+//
+
+static void
+watcher_free(pr_dir_watcher_t *watcher) // I - Directory watcher
+{
+  pr_dir_watch_t *watch;        // Watched directory
+
+
+  if (watcher->fd >= 0)
+    close(watcher->fd);
+  if (watcher->stop_pipe[0] >= 0)
+    close(watcher->stop_pipe[0]);
+  if (watcher->stop_pipe[1] >= 0)
+    close(watcher->stop_pipe[1]);
+  for (watch = (pr_dir_watch_t *)cupsArrayFirst(watcher->watches);
+       watch;
+       watch = (pr_dir_watch_t *)cupsArrayNext(watcher->watches))
+  {
+    free(watch->path);
+    free(watch);
+  }
+  cupsArrayDelete(watcher->watches);
+  cupsArrayDelete(watcher->added);
+  cupsArrayDelete(watcher->removed);
+  cupsArrayDelete(watcher->applied);
+  free(watcher);
+}
+
+
+//
+// 'watcher_free_applied()' - Free an entry of the list of changes already
+//                            applied
+//
+
+static void
+watcher_free_applied(pr_dir_watch_applied_t *applied, // I - Applied change
+		     void                   *data)    // I - Unused
+{
+  (void)data;
+  free(applied->path);
+  free(applied);
+}
+
+
+//
+// 'watcher_is_generator()' - Check whether a file in a PPD collection is
+//                            not a PPD file but generates PPD files, a
+//                            PPD-generating executable (like the ones
+//                            in /usr/lib/cups/driver) or a *.drv file
+//                            (like the ones in /usr/share/cups/drv).
+//                            Of a removed file we only have the name,
+//                            so anything not named like a PPD file
+//                            counts as a generator then.
+//
+
+static bool                     // O - `true` if generator
+watcher_is_generator(const char *path,   // I - Path of the file
+		     bool       exists)  // I - Does the file still exist?
+{
+  size_t      len = strlen(path); // Length of path
+  struct stat fileinfo;         // File information
+
+
+  if (len > 4 && !strcasecmp(path + len - 4, ".drv"))
+    return (true);
+
+  if (exists)
+    return (!stat(path, &fileinfo) && S_ISREG(fileinfo.st_mode) &&
+	    (fileinfo.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)));
+
+  return (!((len > 4 && !strcasecmp(path + len - 4, ".ppd")) ||
+	    (len > 7 && !strcasecmp(path + len - 7, ".ppd.gz"))));
+}
+
+
+//
+// 'watcher_run()' - Thread function of the directory watcher
+//
+
+static void *                   // O - Thread exit status (unused)
+watcher_run(void *data)         // I - Directory watcher
+{
+  pr_dir_watcher_t     *watcher = (pr_dir_watcher_t *)data;
+  struct pollfd        pfds[2]; // Poll data
+  int                  timeout, // Poll timeout in ms
+                       ready;   // Result of poll()
+  long long            elapsed; // Time since first change
+  char                 buf[16384] // Event buffer
+    __attribute__ ((aligned(__alignof__(struct inotify_event))));
+  ssize_t              bytes;   // Bytes read
+  char                 *ptr;    // Pointer into buffer
+  struct inotify_event *event;  // Current event
+
+
+  pfds[0].fd = watcher->fd;
+  pfds[0].events = POLLIN;
+  pfds[1].fd = watcher->stop_pipe[0];
+  pfds[1].events = POLLIN;
+
+  for (;;)
+  {
+    // Wait for events, if changes are pending only for the debounce
+    // time, so that we apply them when no new events come any more
+    if (watcher->first_change)
+    {
+      elapsed = watcher_time() - watcher->first_change;
+      if (elapsed >= PR_DIR_WATCHER_MAX_DELAY)
+	timeout = 0;
+      else if (elapsed > PR_DIR_WATCHER_MAX_DELAY - PR_DIR_WATCHER_DEBOUNCE)
+	timeout = (int)(PR_DIR_WATCHER_MAX_DELAY - elapsed);
+      else
+	timeout = PR_DIR_WATCHER_DEBOUNCE;
+    }
+    else
+      timeout = -1;
+
+    if ((ready = poll(pfds, 2, timeout)) < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN)
+	continue;
+      papplLog(watcher->global_data->system, PAPPL_LOGLEVEL_ERROR,
+	       "Directory watcher stopped: %s", strerror(errno));
+      break;
+    }
+
+    if (pfds[1].revents)
+      break;
+
+    if (ready > 0 && (pfds[0].revents & POLLIN))
+    {
+      while ((bytes = read(watcher->fd, buf, sizeof(buf))) > 0)
+	for (ptr = buf; ptr < buf + bytes;
+	     ptr += sizeof(struct inotify_event) + event->len)
+	{
+	  event = (struct inotify_event *)ptr;
+	  watcher_event(watcher, event);
+	}
+    }
+
+    // Apply the changes when there were no new events during the
+    // debounce time or when they are pending for too long
+    if (watcher->first_change &&
+	(ready == 0 ||
+	 watcher_time() - watcher->first_change >= PR_DIR_WATCHER_MAX_DELAY))
+      watcher_apply(watcher);
+  }
+
+  return (NULL);
+}
+
+
+//
+// 'watcher_time()' - Current monotonic time in ms
+//
+
+static long long                // O - Time in ms
+watcher_time(void)
+{
+  struct timespec ts;           // Current time
+
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000);
+}
@@ -0,0 +1,194 @@
+//
+// PPD/Classic CUPS driver retro-fit Printer Application Library
+// (libpappl-retrofit) for the Printer Application Framework (PAPPL)
+//
+// driver-cache-private.h
+//
+// Copyright © 2020 by Till Kamppeter.
+// Copyright © 2020 by Michael R Sweet.
+//
+// Licensed under Apache License v2.0.  See the file "LICENSE" for more
+// information.
+//
+
+#ifndef _PAPPL_RETROFIT_DRIVER_CACHE_H_
+#  define _PAPPL_RETROFIT_DRIVER_CACHE_H_
+
+//
+// Include necessary headers...
+//
+
+#include <pappl-retrofit/pappl-retrofit.h>
+#include <pappl/pappl.h>
+#include <ppd/ppd.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+//
+// C++ magic...
+//
+
+#  ifdef __cplusplus
+extern "C" {
+#  endif // __cplusplus
+
+
+//
+// Constants...
+//
+
+// Format version of the driver setup cache files, increase it with every
+// change of the file format or of the way how the cached results get
+// determined in _prDriverSetup(), so that old cache entries get ignored
+
+#define PR_DRIVER_CACHE_VERSION 2
+
+// Cache files which did not get used for this number of days get removed
+// on startup
+
+#define PR_DRIVER_CACHE_MAX_AGE 30
+
+// Maximum number of option settings to probe for the resolutions: 2 color
+// modes, draft and normal quality without and high quality with each of
+// the 5 content optimizations
+
+#define PR_RES_PROBES_MAX 14
+
+// Default memory budget for the PPD files of the printers when loading
+// them lazily (PR_COPTIONS_LAZY_PPD_LOADING), in MB
+
+#define PR_PPD_MEMORY_BUDGET 32
+
+// Maximum number of threads for preparing the drivers of the saved
+// printers at startup (PR_COPTIONS_PREWARM_DRIVERS)
+
+#define PR_PREWARM_MAX_THREADS 16
+
+
+//
+// Types...
+//
+
+// Cached results of the driver setup of a PPD file, one file per entry.
+// The cache file consists of the entry up to "setup" (the header),
+// followed by the setup snapshot, if any. There are two kinds of entries:
+// The resolutions probed from a PPD file with given installable
+// accessory settings, and snapshots of the complete results of
+// _prDriverSetup() in Init mode, so that a printer can get set up
+// without loading its PPD file
+
+typedef struct pr_driver_cache_entry_s
+{
+  char     magic[8];                    // "PRDRVSET"
+  uint32_t version;                     // PR_DRIVER_CACHE_VERSION
+  uint32_t reserved;                    // Padding, always 0
+  uint64_t key;                         // Key, hash on PPD contents and
+                                        // installable accessory settings
+                                        // (resolutions) or on the
+                                        // identity of the PPD (snapshot)
+  int32_t  res[3][2];                   // Resolutions for draft, normal,
+                                        // and high print quality
+  uint64_t setup_size;                  // Size of the setup snapshot, 0 if
+                                        // there is none
+  unsigned char *setup;                 // Setup snapshot (not in header)
+} pr_driver_cache_entry_t;
+
+#define PR_DRIVER_CACHE_HEADER_SIZE offsetof(pr_driver_cache_entry_t, setup)
+
+// Buffer for writing and reading a setup snapshot
+
+typedef struct pr_setup_buf_s
+{
+  unsigned char *data;                  // Data
+  size_t        len,                    // Length of data
+                size,                   // Allocated size, when writing
+                pos;                    // Read position, when reading
+  bool          error;                  // Out of memory or of data?
+} pr_setup_buf_t;
+
+// Result of interpreting the PPD with one option setting when probing the
+// resolutions
+
+typedef struct pr_res_probe_s
+{
+  char     *key;                        // Option setting, "name=value"
+                                        // lines
+  unsigned hw_res[2];                   // HWResolution from PostScript code
+  int      jcl_scan,                    // Result of the last scan of a
+                                        // RESOLUTION= in the JCL code
+           jcl_res[2];                  // Last resolution found in JCL code
+  bool     jcl_found;                   // Any resolution found in JCL code?
+} pr_res_probe_t;
+
+
+// Preparation of the drivers of the saved printers at startup, one task
+// for each distinct driver and installable accessory configuration,
+// before the state file gets loaded, and one task for each driver
+// instance, to load its PPD file, after the state file got loaded, the
+// worker threads take the next task from the list
+
+typedef struct pr_prewarm_task_s
+{
+  char     *driver_name;                // Driver name
+  char     *ppd_path;                   // PPD path in collection
+  char     *inst_options;               // Installable accessory settings,
+                                        // "" for the defaults
+  struct pr_driver_extension_s *extension; // Driver extension of a printer
+                                        // of the instance, if the state
+                                        // file is loaded, NULL otherwise
+} pr_prewarm_task_t;
+
+typedef struct pr_prewarm_s
+{
+  pthread_mutex_t   mutex;              // Mutex for next_task
+  int               next_task,          // Next task to be done
+                    num_tasks,          // Number of tasks
+                    alloc_tasks;        // Allocated tasks
+  pr_prewarm_task_t *tasks;             // Tasks
+  pr_printer_app_global_data_t *global_data; // Global data
+} pr_prewarm_t;
+
+
+//
+// Functions...
+//
+
+extern uint64_t _prDriverCacheKey(ppd_file_t *ppd, int num_inst_options,
+				  cups_option_t *inst_options);
+extern bool   _prDriverCacheLoad(pr_printer_app_global_data_t *global_data,
+				 uint64_t key, pr_driver_cache_entry_t *entry);
+extern void   _prDriverCacheSave(pr_printer_app_global_data_t *global_data,
+				 pr_driver_cache_entry_t *entry);
+extern void   _prDriverCacheFree(pr_printer_app_global_data_t *global_data);
+extern void   _prDriverCachePrune(pr_printer_app_global_data_t *global_data);
+extern uint64_t _prDriverSetupKey(pr_printer_app_global_data_t *global_data,
+				  const char *ppd_path);
+extern bool   _prDriverSetupLoad(pr_printer_app_global_data_t *global_data,
+				 uint64_t key,
+				 pappl_pr_driver_data_t *driver_data,
+				 ipp_t **driver_attrs, int *num_filters,
+				 char ***filters);
+extern void   _prDriverSetupSave(pr_printer_app_global_data_t *global_data,
+				 uint64_t key,
+				 pappl_pr_driver_data_t *driver_data,
+				 ipp_t *driver_attrs, ppd_file_t *ppd);
+extern void   _prPPDCachePrune(pr_printer_app_global_data_t *global_data);
+extern uint64_t _prPPDIdentity(pr_printer_app_global_data_t *global_data,
+			       const char *ppd_path);
+extern bool   _prPPDMaterialize(pr_printer_app_global_data_t *global_data,
+				const char *ppd_path, char *filename,
+				size_t filenamesize, bool *temporary);
+
+
+//
+// C++ magic...
+//
+
+#  ifdef __cplusplus
+}
+#  endif // __cplusplus
+
+
+#endif // !_PAPPL_RETROFIT_DRIVER_CACHE_H_
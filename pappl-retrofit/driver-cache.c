@@ -0,0 +1,1718 @@
+//
+// PPD/Classic CUPS driver retro-fit Printer Application Library
+// (libpappl-retrofit) for the Printer Application Framework (PAPPL)
+//
+// driver-cache.c
+//
+// Copyright © 2020 by Till Kamppeter.
+// Copyright © 2020 by Michael R Sweet.
+//
+// Licensed under Apache License v2.0.  See the file "LICENSE" for more
+// information.
+//
+
+//
+// Include necessary headers...
+//
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include <pappl-retrofit/pappl-retrofit-private.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utime.h>
+
+
+//
+// Constants...
+//
+
+#define PR_DRIVER_CACHE_MAGIC "PRDRVSET" // Magic string of cache files
+
+
+//
+// Local functions...
+//
+
+static int      cache_compare(pr_driver_cache_entry_t *a,
+			      pr_driver_cache_entry_t *b, void *data);
+static void     cache_hash_group(uint64_t *hash, ppd_group_t *group);
+static void     cache_path(pr_printer_app_global_data_t *global_data,
+			   uint64_t key, char *buf, size_t bufsize);
+static bool     ppd_copy(pr_printer_app_global_data_t *global_data,
+			 const char *ppd_path, int fd);
+static void     ppd_evict(pr_printer_app_global_data_t *global_data);
+static void     ppd_free(pr_printer_app_global_data_t *global_data,
+			 ppd_file_t *ppd, size_t size);
+static ppd_file_t *ppd_load(pr_printer_app_global_data_t *global_data,
+			    const char *ppd_path, int num_inst_options,
+			    cups_option_t *inst_options);
+static size_t   ppd_size(ppd_file_t *ppd);
+static bool     ppd_source(pr_printer_app_global_data_t *global_data,
+			   const char *ppd_path, char *source,
+			   size_t sourcesize, struct stat *fileinfo);
+static bool     setup_get(pr_setup_buf_t *buf, void *data, size_t len);
+static char     *setup_get_string(pr_setup_buf_t *buf);
+static void     setup_put(pr_setup_buf_t *buf, const void *data, size_t len);
+static void     setup_put_string(pr_setup_buf_t *buf, const char *s);
+static ssize_t  setup_read_cb(pr_setup_buf_t *buf, ipp_uchar_t *buffer,
+			      size_t bytes);
+static ssize_t  setup_write_cb(pr_setup_buf_t *buf, ipp_uchar_t *buffer,
+			       size_t bytes);
+
+
+//
+// '_prDriverCacheKey()' - Calculate the key for the cached driver setup
+//                         results of a PPD file.
+//
+//                         The key is a hash on everything of the PPD
+//                         which the results depend on: The attributes,
+//                         the options with their choices and the
+//                         PostScript/JCL code of the choices, and the
+//                         JCL framing. The installable accessory
+//                         settings get included, as they get marked
+//                         when probing the PPD.
+//
+
+uint64_t                        // O - Key
+_prDriverCacheKey(ppd_file_t    *ppd,              // I - PPD file
+		  int           num_inst_options,  // I - Number of installable
+		                                   //     accessory settings
+		  cups_option_t *inst_options)     // I - Installable accessory
+		                                   //     settings
+{
+  int      i;                   // Looping variable
+  uint64_t hash = PR_FNV_OFFSET; // Hash on everything
+  uint32_t version = PR_DRIVER_CACHE_VERSION,
+           count;               // Number of items
+
+
+  _prHashBytes(&hash, &version, sizeof(version));
+
+  _prHashString(&hash, ppd->jcl_begin);
+  _prHashString(&hash, ppd->jcl_ps);
+  _prHashString(&hash, ppd->jcl_end);
+
+  count = (uint32_t)ppd->num_attrs;
+  _prHashBytes(&hash, &count, sizeof(count));
+  for (i = 0; i < ppd->num_attrs; i ++)
+  {
+    _prHashString(&hash, ppd->attrs[i]->name);
+    _prHashString(&hash, ppd->attrs[i]->spec);
+    _prHashString(&hash, ppd->attrs[i]->value);
+  }
+
+  count = (uint32_t)ppd->num_groups;
+  _prHashBytes(&hash, &count, sizeof(count));
+  for (i = 0; i < ppd->num_groups; i ++)
+    cache_hash_group(&hash, ppd->groups + i);
+
+  count = (uint32_t)num_inst_options;
+  _prHashBytes(&hash, &count, sizeof(count));
+  for (i = 0; i < num_inst_options; i ++)
+  {
+    _prHashString(&hash, inst_options[i].name);
+    _prHashString(&hash, inst_options[i].value);
+  }
+
+  return (hash);
+}
+
+
+//
+// '_prDriverCacheLoad()' - Find the cached driver setup results with the
+//                          given key, first in memory, then in the cache
+//                          directory in the state directory. A setup
+//                          snapshot gets read into entry->setup, which
+//                          the caller has to free.
+//
+
+bool                            // O - `true` if found, `false` otherwise
+_prDriverCacheLoad(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    uint64_t                     key,          // I - Key
+    pr_driver_cache_entry_t      *entry)       // O - Cached results
+{
+  pr_driver_cache_entry_t search,       // Search key
+                          loaded,       // Entry read from file
+                          *cached;      // Entry in memory
+  FILE                    *fp;          // Cache file
+  struct stat             fileinfo;     // Information about cache file
+  bool                    ret = false;  // Return value
+  char                    filename[2048]; // Name of cache file
+
+
+  search.key   = key;
+  loaded.setup = NULL;
+
+  pthread_mutex_lock(&global_data->driver_cache_mutex);
+
+  if (global_data->driver_cache &&
+      (cached = (pr_driver_cache_entry_t *)
+       cupsArrayFind(global_data->driver_cache, &search)) != NULL)
+  {
+    memcpy(entry, cached, sizeof(pr_driver_cache_entry_t));
+    ret = true;
+  }
+  else
+  {
+    cache_path(global_data, key, filename, sizeof(filename));
+    if ((fp = fopen(filename, "r")) != NULL)
+    {
+      if (!fstat(fileno(fp), &fileinfo) &&
+	  fread(&loaded, PR_DRIVER_CACHE_HEADER_SIZE, 1, fp) == 1 &&
+	  !memcmp(loaded.magic, PR_DRIVER_CACHE_MAGIC, sizeof(loaded.magic)) &&
+	  loaded.version == PR_DRIVER_CACHE_VERSION && loaded.key == key &&
+	  PR_DRIVER_CACHE_HEADER_SIZE + loaded.setup_size ==
+	  (uint64_t)fileinfo.st_size &&
+	  (!loaded.setup_size ||
+	   ((loaded.setup = (unsigned char *)
+	     malloc((size_t)loaded.setup_size)) != NULL &&
+	    fread(loaded.setup, (size_t)loaded.setup_size, 1, fp) == 1)))
+      {
+	memcpy(entry, &loaded, sizeof(pr_driver_cache_entry_t));
+
+	// A snapshot is only needed when setting up the first printer
+	// of a driver instance, keep only the resolutions in memory
+	if (!loaded.setup_size)
+	{
+	  if (!global_data->driver_cache)
+	    global_data->driver_cache =
+	      cupsArrayNew3((cups_array_func_t)cache_compare, NULL, NULL, 0,
+			    NULL, (cups_afree_func_t)free);
+	  if ((cached = (pr_driver_cache_entry_t *)
+	       malloc(sizeof(pr_driver_cache_entry_t))) != NULL)
+	  {
+	    memcpy(cached, entry, sizeof(pr_driver_cache_entry_t));
+	    cupsArrayAdd(global_data->driver_cache, cached);
+	  }
+	}
+
+	// Mark the file as used for _prDriverCachePrune()
+	utime(filename, NULL);
+	ret = true;
+      }
+      else
+      {
+	free(loaded.setup);
+	papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+		 "Ignoring invalid driver setup cache file %s", filename);
+      }
+      fclose(fp);
+    }
+  }
+
+  pthread_mutex_unlock(&global_data->driver_cache_mutex);
+
+  return (ret);
+}
+
+
+//
+// '_prDriverCacheSave()' - Store driver setup results in the memory
+//                          cache (not setup snapshots) and in the cache
+//                          directory. The file gets written under a
+//                          temporary name and then renamed, so that a
+//                          reader never sees a partially written file.
+//                          Failures only get logged, the results get
+//                          simply determined again next time.
+//
+
+void
+_prDriverCacheSave(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    pr_driver_cache_entry_t      *entry)       // I - Results to store
+{
+  int                     fd;           // File descriptor of cache file
+  bool                    written;      // Cache file completely written?
+  pr_driver_cache_entry_t *cached;      // Entry in memory
+  char                    *ptr,         // Pointer into file name
+                          filename[2048], // Name of cache file
+                          tempname[2048]; // Temporary name for writing
+
+
+  memcpy(entry->magic, PR_DRIVER_CACHE_MAGIC, sizeof(entry->magic));
+  entry->version  = PR_DRIVER_CACHE_VERSION;
+  entry->reserved = 0;
+
+  pthread_mutex_lock(&global_data->driver_cache_mutex);
+
+  if (!global_data->driver_cache)
+    global_data->driver_cache =
+      cupsArrayNew3((cups_array_func_t)cache_compare, NULL, NULL, 0, NULL,
+		    (cups_afree_func_t)free);
+  if (!entry->setup_size && !cupsArrayFind(global_data->driver_cache, entry) &&
+      (cached = (pr_driver_cache_entry_t *)
+       malloc(sizeof(pr_driver_cache_entry_t))) != NULL)
+  {
+    memcpy(cached, entry, sizeof(pr_driver_cache_entry_t));
+    cached->setup = NULL;
+    cupsArrayAdd(global_data->driver_cache, cached);
+  }
+
+  pthread_mutex_unlock(&global_data->driver_cache_mutex);
+
+  cache_path(global_data, entry->key, filename, sizeof(filename));
+  if ((ptr = strrchr(filename, '/')) != NULL)
+  {
+    *ptr = '\0';
+    if (mkdir(filename, 0755) && errno != EEXIST)
+    {
+      papplLog(global_data->system, PAPPL_LOGLEVEL_WARN,
+	       "Unable to create driver setup cache directory %s: %s",
+	       filename, strerror(errno));
+      return;
+    }
+    *ptr = '/';
+  }
+
+  snprintf(tempname, sizeof(tempname), "%s.XXXXXX", filename);
+  if ((fd = mkstemp(tempname)) < 0)
+  {
+    papplLog(global_data->system, PAPPL_LOGLEVEL_WARN,
+	     "Unable to create driver setup cache file %s: %s", filename,
+	     strerror(errno));
+    return;
+  }
+
+  written = (write(fd, entry, PR_DRIVER_CACHE_HEADER_SIZE) ==
+	     (ssize_t)PR_DRIVER_CACHE_HEADER_SIZE &&
+	     (!entry->setup_size ||
+	      write(fd, entry->setup, (size_t)entry->setup_size) ==
+	      (ssize_t)entry->setup_size));
+  if (close(fd))
+    written = false;
+  if (!written || rename(tempname, filename))
+  {
+    papplLog(global_data->system, PAPPL_LOGLEVEL_WARN,
+	     "Unable to write driver setup cache file %s: %s", filename,
+	     strerror(errno));
+    unlink(tempname);
+  }
+}
+
+
+//
+// '_prDriverCacheFree()' - Free the memory cache of driver setup results.
+//
+
+void
+_prDriverCacheFree(
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  pthread_mutex_lock(&global_data->driver_cache_mutex);
+  cupsArrayDelete(global_data->driver_cache);
+  global_data->driver_cache = NULL;
+  pthread_mutex_unlock(&global_data->driver_cache_mutex);
+}
+
+
+//
+// '_prDriverCachePrune()' - Remove the cache files which did not get used
+//                           for PR_DRIVER_CACHE_MAX_AGE days, files of
+//                           other versions of the cache, and left-overs
+//                           of interrupted writes. To be called on
+//                           startup, before any printer gets set up.
+//
+
+void
+_prDriverCachePrune(
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  cups_dir_t              *dir;         // Cache directory
+  cups_dentry_t           *dent;        // Directory entry
+  FILE                    *fp;          // Cache file
+  pr_driver_cache_entry_t header;       // Header of cache file
+  bool                    valid;        // Keep the file?
+  time_t                  outdated;     // Files older than this time
+                                        // get deleted
+  char                    *ptr,         // Pointer into file name
+                          filename[2048]; // Name of cache file
+
+
+  cache_path(global_data, 0, filename, sizeof(filename));
+  if ((ptr = strrchr(filename, '/')) != NULL)
+    *ptr = '\0';
+  if ((dir = cupsDirOpen(filename)) == NULL)
+    return;
+
+  outdated = time(NULL) - PR_DRIVER_CACHE_MAX_AGE * 24 * 60 * 60;
+
+  while ((dent = cupsDirRead(dir)) != NULL)
+  {
+    if (S_ISDIR(dent->fileinfo.st_mode))
+      continue;
+
+    cache_path(global_data, 0, filename, sizeof(filename));
+    if ((ptr = strrchr(filename, '/')) != NULL)
+      snprintf(ptr + 1, sizeof(filename) - (size_t)(ptr + 1 - filename),
+	       "%s", dent->filename);
+
+    // Temporary files of writes have a ".XXXXXX" suffix
+    valid = false;
+    if (!strchr(dent->filename, '.') && dent->fileinfo.st_mtime > outdated &&
+	(fp = fopen(filename, "r")) != NULL)
+    {
+      valid = (fread(&header, PR_DRIVER_CACHE_HEADER_SIZE, 1, fp) == 1 &&
+	       !memcmp(header.magic, PR_DRIVER_CACHE_MAGIC,
+		       sizeof(header.magic)) &&
+	       header.version == PR_DRIVER_CACHE_VERSION);
+      fclose(fp);
+    }
+
+    if (!valid)
+    {
+      unlink(filename);
+      papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	       "Removed outdated driver setup cache file %s", dent->filename);
+    }
+  }
+
+  cupsDirClose(dir);
+}
+
+
+//
+// '_prDriverSetupKey()' - Calculate the key for the setup snapshot of a
+//                         PPD file, without loading it: A hash on the
+//                         identity of the PPD and on everything else of
+//                         the Printer Application which the results of
+//                         _prDriverSetup() in Init mode depend on.
+//
+
+uint64_t                        // O - Key
+_prDriverSetupKey(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    const char                   *ppd_path)    // I - PPD path in collection
+{
+  uint64_t hash = PR_FNV_OFFSET, // Hash on everything
+           identity;            // Identity of the PPD
+  uint32_t version = PR_DRIVER_CACHE_VERSION,
+           size = (uint32_t)sizeof(pappl_pr_driver_data_t);
+
+
+  _prHashString(&hash, "setup");
+  _prHashBytes(&hash, &version, sizeof(version));
+  _prHashBytes(&hash, &size, sizeof(size));
+
+  identity = _prPPDIdentity(global_data, ppd_path);
+  _prHashBytes(&hash, &identity, sizeof(identity));
+
+  _prHashString(&hash, global_data->config->version);
+  _prHashBytes(&hash, &global_data->config->components,
+	       sizeof(global_data->config->components));
+  _prHashString(&hash, papplLocGetDefaultMediaSizeName());
+
+  return (hash);
+}
+
+
+//
+// '_prDriverSetupLoad()' - Set up a printer from the setup snapshot of
+//                          its PPD file, without loading the PPD file.
+//
+//                          The driver data gets filled in, except the
+//                          callbacks and the format, which the caller
+//                          sets, and of the extension the vendor PPD
+//                          options, the properties from the PPD, and
+//                          the human-readable strings. The look-up
+//                          tables of the driver instance get filled in
+//                          if they are still empty. The "*cupsFilter(2)"
+//                          lines of the PPD are returned, to select the
+//                          filters like with a loaded PPD.
+//
+//                          On failure nothing gets changed.
+//
+
+bool                            // O - `true` if set up, `false` otherwise
+_prDriverSetupLoad(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    uint64_t                     key,          // I - Key
+    pappl_pr_driver_data_t       *driver_data, // I/O - Driver data
+    ipp_t                        **driver_attrs, // I/O - Driver attributes
+    int                          *num_filters, // O - Number of filters
+    char                         ***filters)   // O - Filters, to be freed
+{
+  int                     i;            // Looping variable
+  pr_driver_extension_t   *extension =
+    (pr_driver_extension_t *)driver_data->extension;
+  pr_driver_instance_t    *instance = extension->instance;
+  pr_driver_cache_entry_t entry;        // Cache entry
+  pr_setup_buf_t          buf;          // Snapshot
+  pappl_pr_driver_data_t  data;         // Driver data from snapshot
+  const char              *vendor_ppd_options[PAPPL_MAX_VENDOR];
+                                        // PPD options of vendor options
+  bool                    props[3];     // Properties from the PPD
+  int32_t                 count_filters = 0, // Number of filters
+                          count_names = 0, // Number of look-up entries
+                          vendor_index; // Vendor index of entry
+  char                    **filter_list = NULL, // Filters
+                          *human_strings; // Human-readable strings
+  ipp_name_lookup_t       **names = NULL; // Look-up table entries
+  unsigned char           have_attrs;   // Driver attributes in snapshot?
+  ipp_t                   *attrs = NULL; // Driver attributes
+  bool                    ret = false;  // Return value
+
+
+  if (!instance || !_prDriverCacheLoad(global_data, key, &entry))
+    return (false);
+  if (!entry.setup)
+    return (false);
+
+  memset(&buf, 0, sizeof(buf));
+  buf.data = entry.setup;
+  buf.len  = (size_t)entry.setup_size;
+
+  // Driver data, the pointers in it are from the process which wrote the
+  // snapshot, the strings follow
+  if (!setup_get(&buf, &data, sizeof(data)) ||
+      data.num_media < 0 || data.num_media > PAPPL_MAX_MEDIA ||
+      data.num_source < 0 || data.num_source > PAPPL_MAX_SOURCE ||
+      data.num_type < 0 || data.num_type > PAPPL_MAX_TYPE ||
+      data.num_bin < 0 || data.num_bin > PAPPL_MAX_BIN ||
+      data.num_vendor < 0 || data.num_vendor > PAPPL_MAX_VENDOR)
+  {
+    free(entry.setup);
+    return (false);
+  }
+
+  for (i = 0; i < data.num_media; i ++)
+    data.media[i] = setup_get_string(&buf);
+  for (i = 0; i < data.num_source; i ++)
+    data.source[i] = setup_get_string(&buf);
+  for (i = 0; i < data.num_type; i ++)
+    data.type[i] = setup_get_string(&buf);
+  for (i = 0; i < data.num_bin; i ++)
+    data.bin[i] = setup_get_string(&buf);
+  for (i = 0; i < data.num_vendor; i ++)
+  {
+    data.vendor[i]        = setup_get_string(&buf);
+    vendor_ppd_options[i] = setup_get_string(&buf);
+  }
+
+  // Properties of the PPD file, "*cupsFilter(2)" lines, and the
+  // human-readable strings (each string takes at least 4 bytes in the
+  // snapshot, so the counts are limited by its size)
+  setup_get(&buf, props, sizeof(props));
+  if (setup_get(&buf, &count_filters, sizeof(count_filters)) &&
+      (count_filters < 0 ||
+       (size_t)count_filters > (buf.len - buf.pos) / 4 ||
+       (filter_list = (char **)calloc((size_t)count_filters + 1,
+				      sizeof(char *))) == NULL))
+  {
+    count_filters = 0;
+    buf.error     = true;
+  }
+  for (i = 0; i < count_filters; i ++)
+    if ((filter_list[i] = setup_get_string(&buf)) == NULL)
+      buf.error = true;
+  human_strings = setup_get_string(&buf);
+
+  // Look-up table entries
+  if (setup_get(&buf, &count_names, sizeof(count_names)) &&
+      (count_names < 0 ||
+       (size_t)count_names > (buf.len - buf.pos) / 12 ||
+       (names = (ipp_name_lookup_t **)calloc((size_t)count_names + 1,
+					     sizeof(ipp_name_lookup_t *))) ==
+       NULL))
+  {
+    count_names = 0;
+    buf.error   = true;
+  }
+  for (i = 0; i < count_names && !buf.error; i ++)
+  {
+    if ((names[i] = (ipp_name_lookup_t *)
+	 calloc(1, sizeof(ipp_name_lookup_t))) == NULL)
+    {
+      buf.error = true;
+      break;
+    }
+    names[i]->ppd = setup_get_string(&buf);
+    names[i]->ipp = setup_get_string(&buf);
+    setup_get(&buf, &vendor_index, sizeof(vendor_index));
+    names[i]->vendor_index = (int)vendor_index;
+    if (!names[i]->ppd || !names[i]->ipp)
+      buf.error = true;
+  }
+
+  // Driver attributes
+  if (setup_get(&buf, &have_attrs, sizeof(have_attrs)) && have_attrs &&
+      ((attrs = ippNew()) == NULL ||
+       ippReadIO(&buf, (ipp_io_cb_t)setup_read_cb, 1, NULL, attrs) !=
+       IPP_STATE_DATA))
+    buf.error = true;
+
+  if (!buf.error)
+  {
+    // Keep the extension and the callbacks
+    data.extension     = driver_data->extension;
+    data.delete_cb     = driver_data->delete_cb;
+    data.identify_cb   = driver_data->identify_cb;
+    data.printfile_cb  = driver_data->printfile_cb;
+    data.rendjob_cb    = driver_data->rendjob_cb;
+    data.rendpage_cb   = driver_data->rendpage_cb;
+    data.rstartjob_cb  = driver_data->rstartjob_cb;
+    data.rstartpage_cb = driver_data->rstartpage_cb;
+    data.rwriteline_cb = driver_data->rwriteline_cb;
+    data.status_cb     = driver_data->status_cb;
+    data.testpage_cb   = driver_data->testpage_cb;
+    data.format        = driver_data->format;
+    memcpy(driver_data, &data, sizeof(data));
+
+    memcpy(extension->vendor_ppd_options, vendor_ppd_options,
+	   (size_t)data.num_vendor * sizeof(const char *));
+    extension->defaults_pollable    = props[0];
+    extension->installable_options  = props[1];
+    extension->installable_pollable = props[2];
+    extension->human_strings        = human_strings;
+
+    if (!attrs)
+      attrs = ippNew();
+    if (*driver_attrs)
+    {
+      ippCopyAttributes(*driver_attrs, attrs, 0, NULL, NULL);
+      ippDelete(attrs);
+    }
+    else
+      *driver_attrs = attrs;
+    attrs = NULL;
+
+    *num_filters  = (int)count_filters;
+    *filters      = filter_list;
+    filter_list   = NULL;
+    count_filters = 0;
+
+    // The first printer of the driver instance fills in the look-up
+    // tables
+    pthread_mutex_lock(&instance->mutex);
+    if (!instance->ipp_names_complete)
+    {
+      for (i = 0; i < count_names; i ++)
+      {
+	cupsArrayAdd(instance->ipp_name_lookup, names[i]);
+	cupsArrayAdd(instance->ipp_name_lookup_ipp, names[i]);
+	names[i] = NULL;
+      }
+      instance->ipp_names_complete = true;
+    }
+    pthread_mutex_unlock(&instance->mutex);
+
+    ret = true;
+  }
+  else
+  {
+    for (i = 0; i < data.num_media; i ++)
+      free((char *)data.media[i]);
+    for (i = 0; i < data.num_source; i ++)
+      free((char *)data.source[i]);
+    for (i = 0; i < data.num_type; i ++)
+      free((char *)data.type[i]);
+    for (i = 0; i < data.num_bin; i ++)
+      free((char *)data.bin[i]);
+    for (i = 0; i < data.num_vendor; i ++)
+    {
+      free((char *)data.vendor[i]);
+      free((char *)vendor_ppd_options[i]);
+    }
+    free(human_strings);
+    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	     "Ignoring invalid driver setup snapshot %016llx",
+	     (unsigned long long)key);
+  }
+
+  for (i = 0; i < count_filters; i ++)
+    free(filter_list[i]);
+  free(filter_list);
+  for (i = 0; i < count_names; i ++)
+    if (names[i])
+    {
+      free(names[i]->ppd);
+      free(names[i]->ipp);
+      free(names[i]);
+    }
+  free(names);
+  ippDelete(attrs);
+  free(entry.setup);
+
+  return (ret);
+}
+
+
+//
+// '_prDriverSetupSave()' - Store the results of _prDriverSetup() in Init
+//                          mode as setup snapshot of the PPD file, for
+//                          _prDriverSetupLoad().
+//
+
+void
+_prDriverSetupSave(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    uint64_t                     key,          // I - Key
+    pappl_pr_driver_data_t       *driver_data, // I - Driver data
+    ipp_t                        *driver_attrs, // I - Driver attributes
+    ppd_file_t                   *ppd)         // I - PPD file
+{
+  int                     i;            // Looping variable
+  pr_driver_extension_t   *extension =
+    (pr_driver_extension_t *)driver_data->extension;
+  pr_driver_instance_t    *instance = extension->instance;
+  pr_driver_cache_entry_t entry;        // Cache entry
+  pr_setup_buf_t          buf;          // Snapshot
+  ipp_name_lookup_t       *opt_name;    // Look-up table entry
+  bool                    props[3];     // Properties from the PPD
+  int32_t                 count,        // Number of items
+                          vendor_index; // Vendor index of entry
+  unsigned char           have_attrs = (driver_attrs != NULL);
+                                        // Driver attributes in snapshot?
+
+
+  if (!instance)
+    return;
+
+  memset(&buf, 0, sizeof(buf));
+
+  // Driver data and its strings
+  setup_put(&buf, driver_data, sizeof(pappl_pr_driver_data_t));
+  for (i = 0; i < driver_data->num_media; i ++)
+    setup_put_string(&buf, driver_data->media[i]);
+  for (i = 0; i < driver_data->num_source; i ++)
+    setup_put_string(&buf, driver_data->source[i]);
+  for (i = 0; i < driver_data->num_type; i ++)
+    setup_put_string(&buf, driver_data->type[i]);
+  for (i = 0; i < driver_data->num_bin; i ++)
+    setup_put_string(&buf, driver_data->bin[i]);
+  for (i = 0; i < driver_data->num_vendor; i ++)
+  {
+    setup_put_string(&buf, driver_data->vendor[i]);
+    setup_put_string(&buf, extension->vendor_ppd_options[i]);
+  }
+
+  // Properties of the PPD file, "*cupsFilter(2)" lines, and the
+  // human-readable strings
+  props[0] = extension->defaults_pollable;
+  props[1] = extension->installable_options;
+  props[2] = extension->installable_pollable;
+  setup_put(&buf, props, sizeof(props));
+  count = (int32_t)ppd->num_filters;
+  setup_put(&buf, &count, sizeof(count));
+  for (i = 0; i < ppd->num_filters; i ++)
+    setup_put_string(&buf, ppd->filters[i]);
+  setup_put_string(&buf, extension->human_strings);
+
+  // Look-up table entries
+  pthread_mutex_lock(&instance->mutex);
+  count = (int32_t)cupsArrayCount(instance->ipp_name_lookup);
+  setup_put(&buf, &count, sizeof(count));
+  for (opt_name =
+	 (ipp_name_lookup_t *)cupsArrayFirst(instance->ipp_name_lookup);
+       opt_name;
+       opt_name =
+	 (ipp_name_lookup_t *)cupsArrayNext(instance->ipp_name_lookup))
+  {
+    setup_put_string(&buf, opt_name->ppd);
+    setup_put_string(&buf, opt_name->ipp);
+    vendor_index = (int32_t)opt_name->vendor_index;
+    setup_put(&buf, &vendor_index, sizeof(vendor_index));
+  }
+  pthread_mutex_unlock(&instance->mutex);
+
+  // Driver attributes
+  setup_put(&buf, &have_attrs, sizeof(have_attrs));
+  if (have_attrs &&
+      ippWriteIO(&buf, (ipp_io_cb_t)setup_write_cb, 1, NULL, driver_attrs) !=
+      IPP_STATE_DATA)
+    buf.error = true;
+
+  if (buf.error)
+  {
+    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	     "Unable to create the driver setup snapshot of PPD %s",
+	     extension->ppd_path);
+    free(buf.data);
+    return;
+  }
+
+  memset(&entry, 0, sizeof(entry));
+  entry.key        = key;
+  entry.setup_size = buf.len;
+  entry.setup      = buf.data;
+  _prDriverCacheSave(global_data, &entry);
+
+  free(buf.data);
+}
+
+
+//
+// '_prPPDAcquire()' - Get the PPD file of a printer for use, loading it
+//                     if it is not loaded yet or got evicted. Every
+//                     successful call must be followed by a call of
+//                     _prPPDRelease() when the PPD is not used any
+//                     more, the PPD does not get evicted before.
+//
+//                     The PPD is shared by all printers of the driver
+//                     instance. As the users of a PPD mark their option
+//                     settings in it, only one printer at a time uses
+//                     the shared PPD, if another printer needs it
+//                     meanwhile, it gets its own copy for the time of
+//                     use.
+//
+//                     The PPD gets loaded without holding the lock of
+//                     the PPD memory management, so that the printers
+//                     do not wait for each other's PPDs, only other
+//                     printers of the same instance wait for the
+//                     loading to complete.
+//
+
+ppd_file_t *                    // O - PPD file, NULL on error
+_prPPDAcquire(pr_driver_extension_t *extension) // I - Driver extension
+{
+  pr_printer_app_global_data_t *global_data = extension->global_data;
+  pr_driver_instance_t         *instance;   // Driver instance
+  ppd_file_t                   *ppd;        // PPD file
+  bool                         copy;        // Loading a copy for the
+                                            // printer?
+
+
+  pthread_mutex_lock(&global_data->ppd_lru_mutex);
+
+  for (;;)
+  {
+    instance = extension->instance;
+
+    // The printer is already using a PPD
+    if (extension->ppd_users > 0)
+    {
+      extension->ppd_users ++;
+      pthread_mutex_unlock(&global_data->ppd_lru_mutex);
+      return (extension->ppd);
+    }
+
+    if (!extension->ppd_loading && !instance->ppd_loading)
+      break;
+
+    pthread_cond_wait(&global_data->ppd_lru_cond,
+		      &global_data->ppd_lru_mutex);
+  }
+
+  if (instance->ppd_holder || !instance->ppd)
+  {
+    // If another printer is using the shared PPD, with its option
+    // settings marked, we load a copy for this printer
+    if ((copy = (instance->ppd_holder != NULL)))
+      extension->ppd_loading = true;
+    else
+      instance->ppd_loading = true;
+    pthread_mutex_unlock(&global_data->ppd_lru_mutex);
+
+    ppd = ppd_load(global_data, instance->ppd_path,
+		   instance->num_inst_options, instance->inst_options);
+
+    pthread_mutex_lock(&global_data->ppd_lru_mutex);
+    if (copy)
+      extension->ppd_loading = false;
+    else
+      instance->ppd_loading = false;
+    pthread_cond_broadcast(&global_data->ppd_lru_cond);
+
+    if (!ppd)
+    {
+      pthread_mutex_unlock(&global_data->ppd_lru_mutex);
+      return (NULL);
+    }
+
+    global_data->ppd_loads ++;
+    if (instance->ppd_holder || instance->ppd ||
+	extension->instance != instance)
+    {
+      // Copy for this printer (also if the printer got moved to another
+      // instance meanwhile)
+      extension->ppd         = ppd;
+      extension->ppd_private = true;
+      extension->ppd_size    = ppd_size(ppd);
+      global_data->ppd_resident_bytes += extension->ppd_size;
+      extension->ppd_users = 1;
+
+      pthread_mutex_unlock(&global_data->ppd_lru_mutex);
+
+      return (ppd);
+    }
+
+    instance->ppd           = ppd;
+    instance->ppd_size      = ppd_size(ppd);
+    instance->ppd_marked_by = extension;
+    global_data->ppd_resident_bytes += instance->ppd_size;
+
+    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	     "Loaded PPD %s, %lu PPD loads, %lu evictions, %lu bytes resident",
+	     instance->ppd_path, global_data->ppd_loads,
+	     global_data->ppd_evictions,
+	     (unsigned long)global_data->ppd_resident_bytes);
+  }
+  else if (instance->ppd_marked_by != extension)
+  {
+    // Another printer has marked its option settings, go back to the
+    // state of a freshly loaded PPD
+    ppdMarkDefaults(instance->ppd);
+    ppdMarkOptions(instance->ppd, instance->num_inst_options,
+		   instance->inst_options);
+    instance->ppd_marked_by = extension;
+  }
+
+  instance->ppd_holder   = extension;
+  extension->ppd         = instance->ppd;
+  extension->ppd_private = false;
+  extension->ppd_users   = 1;
+
+  // Most recently used PPDs at the end of the list, the first use of the
+  // instance's PPD adds it
+  if (!global_data->ppd_lru)
+    global_data->ppd_lru = cupsArrayNew(NULL, NULL);
+  cupsArrayRemove(global_data->ppd_lru, instance);
+  cupsArrayAdd(global_data->ppd_lru, instance);
+
+  ppd_evict(global_data);
+
+  pthread_mutex_unlock(&global_data->ppd_lru_mutex);
+
+  return (extension->ppd);
+}
+
+
+//
+// '_prPPDCachePrune()' - Remove the physical PPD files from the cache in
+//                        the state directory which do not belong to a
+//                        PPD of the current driver list any more, as
+//                        the PPD got removed or changed, unless a
+//                        driver instance still uses them. To be called
+//                        when a new driver list gets published.
+//
+
+void
+_prPPDCachePrune(
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  int                  i;               // Looping variable
+  cups_dir_t           *dir;            // Cache directory
+  cups_dentry_t        *dent;           // Directory entry
+  cups_array_t         *files;          // Cache files not (yet) found to
+                                        // be in use
+  pr_driver_list_t     *list;           // Driver list
+  pr_ppd_path_t        *ppd_path;       // PPD path list entry
+  pr_driver_instance_t *instance;       // Driver instance
+  time_t               outdated;        // Temporary files older than this
+                                        // time get deleted
+  char                 *name,           // Name of cache file
+                       dirname[1024],   // Cache directory
+                       filename[2048];  // Name of cache file
+
+
+  snprintf(dirname, sizeof(dirname), "%s/%s.ppds", global_data->state_dir,
+	   global_data->config->system_package_name);
+  if ((dir = cupsDirOpen(dirname)) == NULL)
+    return;
+
+  // Temporary files of writes (with ".XXXXXX" suffix) older than 24 hours
+  // are left-overs of interrupted writes
+  outdated = time(NULL) - 24 * 60 * 60;
+
+  files = cupsArrayNew3((cups_array_func_t)strcmp, NULL, NULL, 0, NULL,
+			(cups_afree_func_t)free);
+  while ((dent = cupsDirRead(dir)) != NULL)
+  {
+    if (S_ISDIR(dent->fileinfo.st_mode))
+      continue;
+    if (strlen(dent->filename) == 20 && !strcmp(dent->filename + 16, ".ppd"))
+      cupsArrayAdd(files, strdup(dent->filename));
+    else if (dent->fileinfo.st_mtime < outdated)
+    {
+      snprintf(filename, sizeof(filename), "%s/%s", dirname, dent->filename);
+      unlink(filename);
+    }
+  }
+  cupsDirClose(dir);
+
+  // Files of the PPDs in the driver list, the printer setups look up
+  // PPD paths in the list meanwhile, so do not use its current element
+  if ((list = _prDriverListAcquire(global_data)) != NULL)
+  {
+    for (i = 0;
+	 i < cupsArrayCount(list->ppd_paths) && cupsArrayCount(files) > 0;
+	 i ++)
+    {
+      ppd_path = (pr_ppd_path_t *)cupsArrayIndex(list->ppd_paths, i);
+      snprintf(filename, sizeof(filename), "%016llx.ppd",
+	       (unsigned long long)_prPPDIdentity(global_data,
+						  ppd_path->ppd_path));
+      if ((name = (char *)cupsArrayFind(files, filename)) != NULL)
+	cupsArrayRemove(files, name);
+    }
+    _prDriverListRelease(global_data, list);
+  }
+
+  // Files in use by printers
+  pthread_mutex_lock(&global_data->driver_instances_mutex);
+  for (instance =
+	 (pr_driver_instance_t *)cupsArrayFirst(global_data->driver_instances);
+       instance;
+       instance =
+	 (pr_driver_instance_t *)cupsArrayNext(global_data->driver_instances))
+    if (instance->temp_ppd_name &&
+	(name = strrchr(instance->temp_ppd_name, '/')) != NULL &&
+	(name = (char *)cupsArrayFind(files, name + 1)) != NULL)
+      cupsArrayRemove(files, name);
+  pthread_mutex_unlock(&global_data->driver_instances_mutex);
+
+  for (name = (char *)cupsArrayFirst(files);
+       name;
+       name = (char *)cupsArrayNext(files))
+  {
+    snprintf(filename, sizeof(filename), "%s/%s", dirname, name);
+    unlink(filename);
+    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	     "Removed cached PPD file %s, its PPD is not available any more",
+	     filename);
+  }
+
+  cupsArrayDelete(files);
+}
+
+
+//
+// '_prPPDIdentity()' - Get a hash identifying the contents of a PPD from
+//                      the collections without reading it: The PPD path,
+//                      and the path, inode, size, and modification time
+//                      of the source file of the PPD, the PPD file
+//                      itself or the *.drv file or driver program which
+//                      generates it.
+//
+
+uint64_t                        // O - Hash
+_prPPDIdentity(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    const char                   *ppd_path)    // I - PPD path in collection
+{
+  uint64_t    hash = PR_FNV_OFFSET;     // Hash on PPD path and source
+  struct stat fileinfo;                 // Information about source file
+  char        source[1024];             // Source file of the PPD
+
+
+  _prHashString(&hash, ppd_path);
+  if (ppd_source(global_data, ppd_path, source, sizeof(source), &fileinfo))
+  {
+    _prHashString(&hash, source);
+    _prHashBytes(&hash, &fileinfo.st_ino, sizeof(fileinfo.st_ino));
+    _prHashBytes(&hash, &fileinfo.st_size, sizeof(fileinfo.st_size));
+    _prHashBytes(&hash, &fileinfo.st_mtime, sizeof(fileinfo.st_mtime));
+  }
+
+  return (hash);
+}
+
+
+//
+// '_prPPDInstanceRemove()' - Remove the PPD file of a driver instance from
+//                            the PPD memory management and free it, when
+//                            the last printer of the instance is gone.
+//
+
+void
+_prPPDInstanceRemove(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    pr_driver_instance_t         *instance)    // I - Driver instance
+{
+  pthread_mutex_lock(&global_data->ppd_lru_mutex);
+
+  while (instance->ppd_loading)
+    pthread_cond_wait(&global_data->ppd_lru_cond,
+		      &global_data->ppd_lru_mutex);
+
+  cupsArrayRemove(global_data->ppd_lru, instance);
+  if (instance->ppd)
+  {
+    ppd_free(global_data, instance->ppd, instance->ppd_size);
+    instance->ppd = NULL;
+  }
+
+  pthread_mutex_unlock(&global_data->ppd_lru_mutex);
+}
+
+
+//
+// '_prPPDRelease()' - Release the PPD file of a printer after use. In
+//                     lazy loading mode the least recently used PPDs of
+//                     all printers get evicted if they exceed the memory
+//                     budget.
+//
+
+void
+_prPPDRelease(pr_driver_extension_t *extension) // I - Driver extension
+{
+  pr_printer_app_global_data_t *global_data = extension->global_data;
+
+
+  pthread_mutex_lock(&global_data->ppd_lru_mutex);
+
+  if (extension->ppd_users > 0 && -- extension->ppd_users == 0)
+  {
+    if (extension->ppd_private)
+      ppd_free(global_data, extension->ppd, extension->ppd_size);
+    else if (extension->instance->ppd_holder == extension)
+      extension->instance->ppd_holder = NULL;
+    extension->ppd         = NULL;
+    extension->ppd_private = false;
+  }
+  ppd_evict(global_data);
+
+  pthread_mutex_unlock(&global_data->ppd_lru_mutex);
+}
+
+
+//
+// '_prPPDRemove()' - Remove a printer from the PPD memory management, when
+//                    the printer gets deleted.
+//
+
+void
+_prPPDRemove(pr_driver_extension_t *extension) // I - Driver extension
+{
+  pr_printer_app_global_data_t *global_data = extension->global_data;
+
+
+  if (!extension->instance)
+    return;
+
+  pthread_mutex_lock(&global_data->ppd_lru_mutex);
+
+  while (extension->ppd_loading)
+    pthread_cond_wait(&global_data->ppd_lru_cond,
+		      &global_data->ppd_lru_mutex);
+
+  if (extension->ppd_users > 0)
+  {
+    if (extension->ppd_private)
+      ppd_free(global_data, extension->ppd, extension->ppd_size);
+    else if (extension->instance->ppd_holder == extension)
+      extension->instance->ppd_holder = NULL;
+    extension->ppd         = NULL;
+    extension->ppd_private = false;
+    extension->ppd_users   = 0;
+  }
+  if (extension->instance->ppd_marked_by == extension)
+    extension->instance->ppd_marked_by = NULL;
+
+  pthread_mutex_unlock(&global_data->ppd_lru_mutex);
+}
+
+
+//
+// '_prPPDSetInstance()' - Move a printer to another driver instance, when
+//                         its installable accessory settings change. If
+//                         the printer is using the PPD of its old
+//                         instance, it keeps it as its own copy until it
+//                         releases it.
+//
+
+void
+_prPPDSetInstance(pr_driver_extension_t *extension, // I - Driver extension
+		  pr_driver_instance_t  *instance)  // I - New instance
+{
+  pr_printer_app_global_data_t *global_data = extension->global_data;
+  pr_driver_instance_t         *old = extension->instance;
+
+
+  pthread_mutex_lock(&global_data->ppd_lru_mutex);
+
+  if (extension->ppd_users > 0 && !extension->ppd_private)
+  {
+    extension->ppd_private = true;
+    extension->ppd_size    = old->ppd_size;
+    old->ppd               = NULL;
+    old->ppd_holder        = NULL;
+    cupsArrayRemove(global_data->ppd_lru, old);
+  }
+  if (old->ppd_marked_by == extension)
+    old->ppd_marked_by = NULL;
+  extension->instance = instance;
+
+  pthread_mutex_unlock(&global_data->ppd_lru_mutex);
+}
+
+
+//
+// '_prPPDMaterialize()' - Get a physical file with the contents of a PPD
+//                         from the collections.
+//
+//                         PPDs which are compiled from *.drv files,
+//                         generated by executables, or compressed need
+//                         to be run through the compiler, executable,
+//                         or decompressor to get the actual PPD. To do
+//                         this only once, the results are kept in a
+//                         cache directory in the state directory, named
+//                         by a hash on the PPD path and on inode, size,
+//                         and modification time of the source file.
+//                         The cache file is shared by all printers
+//                         using the PPD, and between runs of the Printer
+//                         Application.
+//
+//                         If the cache directory is not writable, a
+//                         temporary file gets created, which the caller
+//                         has to remove when not needed any more.
+//
+
+bool                            // O - `true` on success, `false` on error
+_prPPDMaterialize(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    const char                   *ppd_path,    // I - PPD path in collection
+    char                         *filename,    // O - Name of PPD file
+    size_t                       filenamesize, // I - Size of filename
+    bool                         *temporary)   // O - Temporary file?
+{
+  int         fd;                       // File descriptor
+  struct stat fileinfo;                 // Information about cache file
+  char        dirname[1024],            // Cache directory
+              tempname[1024];           // Temporary name for writing
+
+
+  *temporary = false;
+
+  snprintf(dirname, sizeof(dirname), "%s/%s.ppds", global_data->state_dir,
+	   global_data->config->system_package_name);
+  snprintf(filename, filenamesize, "%s/%016llx.ppd", dirname,
+	   (unsigned long long)_prPPDIdentity(global_data, ppd_path));
+
+  // Cache hit
+  if (!stat(filename, &fileinfo) && fileinfo.st_size > 0)
+    return (true);
+
+  // Write the PPD into the cache, under a temporary name first, so that
+  // no other printer setup sees a partially written file
+  if ((mkdir(dirname, 0755) && errno != EEXIST) ||
+      snprintf(tempname, sizeof(tempname), "%s.XXXXXX", filename) < 0 ||
+      (fd = mkstemp(tempname)) < 0)
+  {
+    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	     "Unable to write PPD cache file %s: %s", filename,
+	     strerror(errno));
+  }
+  else
+  {
+    if (ppd_copy(global_data, ppd_path, fd) && !close(fd) &&
+	!chmod(tempname, 0644) && !rename(tempname, filename))
+    {
+      papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	       "Cached PPD %s as %s", ppd_path, filename);
+      return (true);
+    }
+    close(fd);
+    unlink(tempname);
+  }
+
+  // No cache, use a temporary file
+  if ((fd = cupsTempFd(filename, (int)filenamesize)) < 0)
+  {
+    papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
+	     "Unable to create temporary PPD file for %s: %s", ppd_path,
+	     strerror(errno));
+    return (false);
+  }
+  if (!ppd_copy(global_data, ppd_path, fd))
+  {
+    close(fd);
+    unlink(filename);
+    return (false);
+  }
+  close(fd);
+  *temporary = true;
+
+  return (true);
+}
+
+
+//
+// 'prPPDMemoryStats()' - Get the counters of the PPD memory management:
+//                        How often PPD files got loaded and evicted,
+//                        and the estimated memory used by the currently
+//                        loaded PPD files of all printers.
+//
+
+void
+prPPDMemoryStats(pr_printer_app_global_data_t *global_data, // I - Global data
+		 unsigned long *loads,     // O - Number of PPD loads
+		 unsigned long *evictions, // O - Number of PPD evictions
+		 size_t        *resident)  // O - Bytes used by loaded PPDs
+{
+  pthread_mutex_lock(&global_data->ppd_lru_mutex);
+
+  if (loads)
+    *loads = global_data->ppd_loads;
+  if (evictions)
+    *evictions = global_data->ppd_evictions;
+  if (resident)
+    *resident = global_data->ppd_resident_bytes;
+
+  pthread_mutex_unlock(&global_data->ppd_lru_mutex);
+}
+
+
+//
+// 'cache_compare()' - Compare the keys of two cache entries.
+//
+
+static int                      // O - Result of comparison
+cache_compare(pr_driver_cache_entry_t *a,    // I - First entry
+	      pr_driver_cache_entry_t *b,    // I - Second entry
+	      void                    *data) // I - Callback data (unused)
+{
+  (void)data;
+
+  return (a->key < b->key ? -1 : (a->key > b->key ? 1 : 0));
+}
+
+
+//
+// 'cache_hash_group()' - Add an option group with all its options,
+//                        choices, and sub-groups to a hash.
+//
+
+static void
+cache_hash_group(uint64_t    *hash,  // I/O - Hash
+		 ppd_group_t *group) // I   - Option group
+{
+  int          i, j;            // Looping variables
+  ppd_option_t *option;         // Option
+  ppd_choice_t *choice;         // Choice of option
+  uint32_t     count;           // Number of items
+
+
+  _prHashString(hash, group->name);
+  count = (uint32_t)group->num_options;
+  _prHashBytes(hash, &count, sizeof(count));
+  for (i = group->num_options, option = group->options;
+       i > 0;
+       i --, option ++)
+  {
+    _prHashString(hash, option->keyword);
+    _prHashString(hash, option->defchoice);
+    count = (uint32_t)option->num_choices;
+    _prHashBytes(hash, &count, sizeof(count));
+    for (j = option->num_choices, choice = option->choices;
+	 j > 0;
+	 j --, choice ++)
+    {
+      _prHashString(hash, choice->choice);
+      _prHashString(hash, choice->code);
+    }
+  }
+
+  for (i = 0; i < group->num_subgroups; i ++)
+    cache_hash_group(hash, group->subgroups + i);
+}
+
+
+//
+// 'cache_path()' - Get the file name of the cache file for a key.
+//
+
+static void
+cache_path(pr_printer_app_global_data_t *global_data, // I - Global data
+	   uint64_t                     key,          // I - Key
+	   char                         *buf,         // O - File name
+	   size_t                       bufsize)      // I - Size of buffer
+{
+  snprintf(buf, bufsize, "%s/%s.setup/%016llx", global_data->state_dir,
+	   global_data->config->system_package_name, (unsigned long long)key);
+}
+
+
+//
+// 'ppd_copy()' - Write a PPD from the collections into a file.
+//
+
+static bool                     // O - `true` on success, `false` on error
+ppd_copy(pr_printer_app_global_data_t *global_data, // I - Global data
+	 const char                   *ppd_path,    // I - PPD path
+	 int                          fd)           // I - Output file
+{
+  cups_file_t *fp;                      // PPD file stream
+  ssize_t     bytes;                    // Bytes read
+  bool        ret = true;               // Return value
+  char        buf[8192];                // Copy buffer
+
+
+  if ((fp = ppdCollectionGetPPD(ppd_path, NULL, (cf_logfunc_t)papplLog,
+				global_data->system)) == NULL)
+  {
+    papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
+	     "Unable to get PPD %s from the collections", ppd_path);
+    return (false);
+  }
+
+  while ((bytes = cupsFileRead(fp, buf, sizeof(buf))) > 0)
+    if (write(fd, buf, (size_t)bytes) != bytes)
+    {
+      ret = false;
+      break;
+    }
+  if (bytes < 0)
+    ret = false;
+
+  cupsFileClose(fp);
+
+  return (ret);
+}
+
+
+//
+// 'ppd_evict()' - Free the least recently used PPD files which are not in
+//                 use, until the loaded PPD files fit into the memory
+//                 budget. Only in lazy loading mode. Must be called with
+//                 the PPD list locked.
+//
+
+static void
+ppd_evict(pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  pr_driver_instance_t *instance;       // Driver instance
+
+
+  if (!(global_data->config->components & PR_COPTIONS_LAZY_PPD_LOADING))
+    return;
+
+  for (instance = (pr_driver_instance_t *)cupsArrayFirst(global_data->ppd_lru);
+       instance &&
+	 global_data->ppd_resident_bytes > global_data->ppd_memory_budget;
+       instance = (pr_driver_instance_t *)cupsArrayNext(global_data->ppd_lru))
+  {
+    if (!instance->ppd || instance->ppd_holder)
+      continue;
+
+    ppd_free(global_data, instance->ppd, instance->ppd_size);
+    instance->ppd           = NULL;
+    instance->ppd_marked_by = NULL;
+    global_data->ppd_evictions ++;
+
+    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	     "Evicted PPD %s, %lu PPD loads, %lu evictions, %lu bytes resident",
+	     instance->ppd_path, global_data->ppd_loads,
+	     global_data->ppd_evictions,
+	     (unsigned long)global_data->ppd_resident_bytes);
+  }
+}
+
+
+//
+// 'ppd_free()' - Free a loaded PPD file with its PPD cache. Must be called
+//                with the PPD list locked.
+//
+
+static void
+ppd_free(pr_printer_app_global_data_t *global_data, // I - Global data
+	 ppd_file_t                   *ppd,         // I - PPD file
+	 size_t                       size)         // I - Estimated size
+{
+  // We do the removal of the PPD cache separately to assure that the
+  // function of libppd (and not of libcups) is used
+  ppdCacheDestroy(ppd->cache);
+  ppd->cache = NULL;
+  ppdClose(ppd);
+  global_data->ppd_resident_bytes -= size;
+}
+
+
+//
+// 'ppd_load()' - Load a PPD file from the collections and bring it into
+//                the state in which _prDriverSetup() expects it: The
+//                defaults and the installable accessory settings
+//                marked, and with PPD cache.
+//
+
+static ppd_file_t *             // O - PPD file, NULL on error
+ppd_load(pr_printer_app_global_data_t *global_data, // I - Global data
+	 const char    *ppd_path,         // I - PPD path in collection
+	 int           num_inst_options,  // I - Number of accessory settings
+	 cups_option_t *inst_options)     // I - Accessory settings
+{
+  ppd_file_t   *ppd;                    // PPD file
+  ppd_status_t err;                     // Last error in file
+  int          line;                    // Line number in file
+  bool         temporary;               // Temporary PPD file?
+  char         filename[1024];          // Name of PPD file
+
+
+  if (!_prPPDMaterialize(global_data, ppd_path, filename, sizeof(filename),
+			 &temporary))
+    return (NULL);
+
+  ppd = ppdOpenFile(filename);
+  if (temporary)
+    unlink(filename);
+  if (!ppd)
+  {
+    err = ppdLastError(&line);
+    papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
+	     "PPD %s: %s on line %d", ppd_path, ppdErrorString(err), line);
+    return (NULL);
+  }
+
+  ppdMarkDefaults(ppd);
+  ppd->cache = ppdCacheCreateWithPPD(ppd);
+  ppdMarkOptions(ppd, num_inst_options, inst_options);
+
+  return (ppd);
+}
+
+
+//
+// 'ppd_size()' - Estimate the memory used by a loaded PPD file, from the
+//                sizes of its data structures and strings.
+//
+
+static size_t                   // O - Estimated size in bytes
+ppd_size(ppd_file_t *ppd)       // I - PPD file
+{
+  int          i, j, k;         // Looping variables
+  size_t       size;            // Size
+  ppd_group_t  *group;          // Option group
+  ppd_option_t *option;         // Option
+
+
+  size = sizeof(ppd_file_t) + ppd->num_sizes * sizeof(ppd_size_t);
+
+  for (i = 0; i < ppd->num_attrs; i ++)
+    size += sizeof(ppd_attr_t) + sizeof(ppd_attr_t *) +
+            (ppd->attrs[i]->value ? strlen(ppd->attrs[i]->value) + 1 : 0);
+
+  for (i = ppd->num_groups, group = ppd->groups; i > 0; i --, group ++)
+  {
+    size += sizeof(ppd_group_t);
+    for (j = group->num_options, option = group->options;
+	 j > 0;
+	 j --, option ++)
+    {
+      size += sizeof(ppd_option_t) + option->num_choices * sizeof(ppd_choice_t);
+      for (k = 0; k < option->num_choices; k ++)
+	if (option->choices[k].code)
+	  size += strlen(option->choices[k].code) + 1;
+    }
+  }
+
+  return (size);
+}
+
+
+//
+// 'ppd_source()' - Find the source file of a PPD from the collections: The
+//                  PPD file itself, the *.drv file for "drv:///..."
+//                  names, or the driver program for "program:..." names
+//                  of PPDs generated by programs in the collection
+//                  directories.
+//
+
+static bool                     // O - `true` if found, `false` otherwise
+ppd_source(pr_printer_app_global_data_t *global_data, // I - Global data
+	   const char  *ppd_path,       // I - PPD path in collection
+	   char        *source,         // O - Source file
+	   size_t      sourcesize,      // I - Size of source
+	   struct stat *fileinfo)       // O - Information about source file
+{
+  int              i;                   // Looping variable
+  ppd_collection_t *col;                // PPD collection
+  const char       *scheme_end;         // End of scheme of generated PPD
+  char             *ptr,                // Pointer into name
+                   name[1024];          // Name of source in collection
+
+
+  for (scheme_end = ppd_path;
+       isalnum(*scheme_end & 255) || strchr("+-.", *scheme_end & 255);
+       scheme_end ++);
+
+  if (scheme_end == ppd_path || *scheme_end != ':')
+  {
+    // A PPD file, its path may have further components after the file
+    // name, take the longest existing prefix
+    strncpy(source, ppd_path, sourcesize - 1);
+    source[sourcesize - 1] = '\0';
+    while (stat(source, fileinfo) && (ptr = strrchr(source, '/')) != NULL &&
+	   ptr > source)
+      *ptr = '\0';
+    return (!stat(source, fileinfo));
+  }
+
+  if (scheme_end - ppd_path == 3 && !strncmp(ppd_path, "drv", 3))
+  {
+    // "drv:///<*.drv file>/<PPD name>", the path of the *.drv file is
+    // absolute or relative to a collection directory
+    for (scheme_end ++; *scheme_end == '/'; scheme_end ++);
+    strncpy(name, scheme_end, sizeof(name) - 1);
+    name[sizeof(name) - 1] = '\0';
+    if ((ptr = strrchr(name, '/')) != NULL)
+      *ptr = '\0';
+    snprintf(source, sourcesize, "/%s", name);
+    if (!stat(source, fileinfo))
+      return (true);
+  }
+  else
+    // "<program>:...", the program is in a collection directory
+    snprintf(name, sizeof(name), "%.*s", (int)(scheme_end - ppd_path),
+	     ppd_path);
+
+  // Printer setups call this in parallel, so do not use the current
+  // element of the array
+  for (i = 0; i < cupsArrayCount(global_data->ppd_collections); i ++)
+  {
+    col = (ppd_collection_t *)cupsArrayIndex(global_data->ppd_collections,
+					     i);
+    snprintf(source, sourcesize, "%s/%s", col->path, name);
+    if (!stat(source, fileinfo) && S_ISREG(fileinfo->st_mode))
+      return (true);
+  }
+
+  return (false);
+}
+
+
+//
+// 'setup_get()' - Read data from a setup snapshot. When reading beyond
+//                 the end, the buffer gets marked as erroneous and the
+//                 data zeroed.
+//
+
+static bool                     // O - `true` on success, `false` on error
+setup_get(pr_setup_buf_t *buf,  // I - Snapshot
+	  void           *data, // O - Data
+	  size_t         len)   // I - Length of data
+{
+  if (buf->error || len > buf->len - buf->pos)
+  {
+    buf->error = true;
+    memset(data, 0, len);
+    return (false);
+  }
+
+  memcpy(data, buf->data + buf->pos, len);
+  buf->pos += len;
+
+  return (true);
+}
+
+
+//
+// 'setup_get_string()' - Read a string from a setup snapshot.
+//
+
+static char *                   // O - String, NULL if none or on error
+setup_get_string(pr_setup_buf_t *buf) // I - Snapshot
+{
+  uint32_t len;                 // Length of string, with terminator
+  char     *s;                  // String
+
+
+  if (!setup_get(buf, &len, sizeof(len)) || !len)
+    return (NULL);
+
+  if (len > buf->len - buf->pos || buf->data[buf->pos + len - 1] != '\0' ||
+      (s = (char *)malloc(len)) == NULL)
+  {
+    buf->error = true;
+    return (NULL);
+  }
+
+  memcpy(s, buf->data + buf->pos, len);
+  buf->pos += len;
+
+  return (s);
+}
+
+
+//
+// 'setup_put()' - Append data to a setup snapshot. If memory runs out,
+//                 the buffer gets marked as erroneous.
+//
+
+static void
+setup_put(pr_setup_buf_t *buf,  // I - Snapshot
+	  const void     *data, // I - Data
+	  size_t         len)   // I - Length of data
+{
+  size_t        new_size;       // New size of buffer
+  unsigned char *new_data;      // New buffer
+
+
+  if (buf->error)
+    return;
+
+  if (buf->len + len > buf->size)
+  {
+    new_size = buf->size ? 2 * buf->size : 65536;
+    while (buf->len + len > new_size)
+      new_size *= 2;
+    if ((new_data = (unsigned char *)realloc(buf->data, new_size)) == NULL)
+    {
+      buf->error = true;
+      return;
+    }
+    buf->data = new_data;
+    buf->size = new_size;
+  }
+
+  memcpy(buf->data + buf->len, data, len);
+  buf->len += len;
+}
+
+
+//
+// 'setup_put_string()' - Append a string to a setup snapshot, the length
+//                        with terminator (0 for NULL) and the string.
+//
+
+static void
+setup_put_string(pr_setup_buf_t *buf, // I - Snapshot
+		 const char     *s)   // I - String or NULL
+{
+  uint32_t len = s ? (uint32_t)strlen(s) + 1 : 0;
+                                // Length of string, with terminator
+
+
+  setup_put(buf, &len, sizeof(len));
+  if (len)
+    setup_put(buf, s, len);
+}
+
+
+//
+// 'setup_read_cb()' - Read callback for ippReadIO(), reading the driver
+//                     attributes from a setup snapshot.
+//
+
+static ssize_t                  // O - Bytes read
+setup_read_cb(pr_setup_buf_t *buf,    // I - Snapshot
+	      ipp_uchar_t    *buffer, // O - Buffer
+	      size_t         bytes)   // I - Size of buffer
+{
+  if (bytes > buf->len - buf->pos)
+    bytes = buf->len - buf->pos;
+
+  memcpy(buffer, buf->data + buf->pos, bytes);
+  buf->pos += bytes;
+
+  return ((ssize_t)bytes);
+}
+
+
+//
+// 'setup_write_cb()' - Write callback for ippWriteIO(), writing the driver
+//                      attributes into a setup snapshot.
+//
+
+static ssize_t                  // O - Bytes written, -1 on error
+setup_write_cb(pr_setup_buf_t *buf,    // I - Snapshot
+	       ipp_uchar_t    *buffer, // I - Data
+	       size_t         bytes)   // I - Length of data
+{
+  setup_put(buf, buffer, bytes);
+
+  return (buf->error ? -1 : (ssize_t)bytes);
+}
@@ -0,0 +1,136 @@
+//
+// PPD/Classic CUPS driver retro-fit Printer Application Library
+// (libpappl-retrofit) for the Printer Application Framework (PAPPL)
+//
+// driver-index-private.h
+//
+// Copyright © 2020 by Till Kamppeter.
+// Copyright © 2020 by Michael R Sweet.
+//
+// Licensed under Apache License v2.0.  See the file "LICENSE" for more
+// information.
+//
+
+#ifndef _PAPPL_RETROFIT_DRIVER_INDEX_H_
+#  define _PAPPL_RETROFIT_DRIVER_INDEX_H_
+
+//
+// Include necessary headers...
+//
+
+#include <pappl-retrofit/pappl-retrofit.h>
+#include <pappl/pappl.h>
+#include <ppd/ppd.h>
+#include <pthread.h>
+#include <stdint.h>
+
+
+//
+// C++ magic...
+//
+
+#  ifdef __cplusplus
+extern "C" {
+#  endif // __cplusplus
+
+
+//
+// Constants...
+//
+
+// Format version of the driver index file, increase it with every change
+// of the file format or of the way how the driver list gets created from
+// the PPD files, so that old index files get rebuilt
+
+#define PR_DRIVER_INDEX_VERSION 1
+
+// FNV-1a 64-bit hash, used for the keys of index and cache files
+
+#define PR_FNV_OFFSET 0xcbf29ce484222325ULL // Offset basis
+#define PR_FNV_PRIME  0x100000001b3ULL      // Prime
+
+// Maximum number of threads for scanning the PPD collections
+
+#define PR_PPD_SCAN_MAX_THREADS 16
+
+
+//
+// Types...
+//
+
+// Header of the driver index file, it is followed by the string table,
+// with 5 zero-terminated strings for each driver: Name, description,
+// device ID, sorting index, and PPD path
+
+typedef struct pr_driver_index_header_s
+{
+  char     magic[8];                    // "PRDRVIDX"
+  uint32_t version;                     // PR_DRIVER_INDEX_VERSION
+  uint32_t num_drivers;                 // Number of driver entries
+  uint64_t key;                         // Key of the state of the PPD
+                                        // collections
+  uint64_t strings_size;                // Size of the string table
+} pr_driver_index_header_t;
+
+// Published driver list, a new one gets created for every update of the
+// driver list and is never changed. Readers take a reference with
+// _prDriverListAcquire() and give it back with _prDriverListRelease(),
+// the list gets freed when the last reference is gone
+
+typedef struct pr_driver_list_s
+{
+  int               ref_count;          // Number of references
+  int               num_drivers;        // Number of drivers
+  pappl_pr_driver_t *drivers;           // Driver list, as handed to PAPPL
+  cups_array_t      *ppd_paths;         // PPD paths of the drivers
+} pr_driver_list_t;
+
+// Parallel scan of the PPD collections, the collections are split up into
+// scan units, the worker threads take the next unscanned unit and put
+// the result into the unit's own slot, so no locking is needed for the
+// results
+
+typedef struct pr_ppd_scan_s
+{
+  pthread_mutex_t  mutex;               // Mutex for next_unit
+  int              next_unit,           // Next unit to be scanned
+                   num_units;           // Number of units
+  ppd_collection_t *units;              // Units, each is a directory tree
+  cups_array_t     **results;           // PPD lists of the units
+  pappl_system_t   *system;             // System, for logging
+} pr_ppd_scan_t;
+
+
+//
+// Functions...
+//
+
+extern uint64_t _prDriverIndexKey(pr_printer_app_global_data_t *global_data);
+extern bool   _prDriverIndexLoad(pr_printer_app_global_data_t *global_data,
+				 uint64_t key);
+extern bool   _prDriverIndexSave(pr_printer_app_global_data_t *global_data,
+				 uint64_t key);
+extern cups_array_t *_prDriverIndexListPPDs(
+				pr_printer_app_global_data_t *global_data);
+extern void   _prHashBytes(uint64_t *hash, const void *data, size_t len);
+extern void   _prHashString(uint64_t *hash, const char *s);
+extern pr_driver_list_t *_prDriverListAcquire(
+				pr_printer_app_global_data_t *global_data);
+extern void   _prDriverListFree(pappl_pr_driver_t *drivers, int num_drivers,
+				cups_array_t *ppd_paths);
+extern void   _prDriverListPublish(pr_printer_app_global_data_t *global_data);
+extern void   _prDriverListRelease(pr_printer_app_global_data_t *global_data,
+				   pr_driver_list_t *list);
+extern void   _prDriverListsFree(pr_printer_app_global_data_t *global_data);
+
+
+//
+// C++ magic...
+//
+
+#  ifdef __cplusplus
+}
+#  endif // __cplusplus
+
+
+#endif // !_PAPPL_RETROFIT_DRIVER_INDEX_H_
@@ -0,0 +1,977 @@
+//
+// PPD/Classic CUPS driver retro-fit Printer Application Library
+// (libpappl-retrofit) for the Printer Application Framework (PAPPL)
+//
+// driver-index.c
+//
+// Copyright © 2020 by Till Kamppeter.
+// Copyright © 2020 by Michael R Sweet.
+//
+// Licensed under Apache License v2.0.  See the file "LICENSE" for more
+// information.
+//
+
+//
+// Include necessary headers...
+//
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include <pappl-retrofit/pappl-retrofit-private.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+//
+// Constants...
+//
+
+#define PR_DRIVER_INDEX_MAGIC "PRDRVIDX"  // Magic string of index files
+#define PR_DRIVER_INDEX_MAX_DEPTH 16      // Maximum depth of sub-directory
+                                          // recursion when checking the
+                                          // PPD directories
+
+
+//
+// Local functions...
+//
+
+static int      index_compare_names(const char *s, const char *t);
+static int      index_compare_ppds(const void *a, const void *b);
+static uint64_t index_hash_dir(const char *path, int depth);
+static void     *index_scan_worker(void *data);
+static void     index_path(pr_printer_app_global_data_t *global_data,
+			   char *buf, size_t bufsize);
+
+
+//
+// '_prDriverIndexKey()' - Calculate the key for the driver index file.
+//
+//                         The key is a hash on everything which the
+//                         driver list depends on: The configuration
+//                         flags and regular expressions, the PPD
+//                         collection directories and name, inode,
+//                         size, and modification time of every file
+//                         in them. Only stat() gets called on the
+//                         files, no PPD file gets opened and no
+//                         PPD-generating executable gets run.
+//
+
+uint64_t                        // O - Key of the current state
+_prDriverIndexKey(
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  int              i;           // Looping variable
+  uint64_t         hash = PR_FNV_OFFSET, // Hash on everything
+                   dir_hash;    // Hash on a directory tree
+  uint32_t         version = PR_DRIVER_INDEX_VERSION,
+                   components = (uint32_t)global_data->config->components;
+  ppd_collection_t *col;        // PPD collection
+  cups_array_t     *regex_list; // Driver selection regular expressions
+
+
+  _prHashBytes(&hash, &version, sizeof(version));
+  _prHashBytes(&hash, &components, sizeof(components));
+  _prHashString(&hash, global_data->config->driver_display_regex);
+  if ((regex_list = global_data->config->driver_selection_regex_list) !=
+      NULL)
+    for (i = 0; i < cupsArrayCount(regex_list); i ++)
+      _prHashString(&hash, (char *)cupsArrayIndex(regex_list, i));
+  _prHashString(&hash, global_data->user_ppd_dir);
+
+  // The order of the collections matters, it determines which PPD wins
+  // in case of duplicates
+  for (i = 0; i < cupsArrayCount(global_data->ppd_collections); i ++)
+  {
+    col = (ppd_collection_t *)cupsArrayIndex(global_data->ppd_collections,
+					     i);
+    _prHashString(&hash, col->path);
+    dir_hash = index_hash_dir(col->path, 0);
+    _prHashBytes(&hash, &dir_hash, sizeof(dir_hash));
+  }
+
+  return (hash);
+}
+
+
+//
+// '_prDriverIndexLoad()' - Load the driver list and the PPD path list
+//                          from the driver index file, if the file is
+//                          valid and has the given key, meaning that
+//                          nothing has changed since it got written.
+//                          On success the new lists replace the ones
+//                          in the global data.
+//
+
+bool                            // O - `true` if loaded, `false` otherwise
+_prDriverIndexLoad(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    uint64_t                     key)          // I - Expected key
+{
+  int                      i, j;        // Looping variables
+  int                      fd;          // File descriptor of index file
+  struct stat              fileinfo;    // Information about the index file
+  void                     *map;        // Memory-mapped index file
+  const pr_driver_index_header_t *header; // Header of index file
+  const char               *ptr,        // Pointer into string table
+                           *end,        // End of string table
+                           *strings[5]; // Strings of a driver entry
+  size_t                   len;         // Length of a string
+  int                      num_drivers; // Number of drivers
+  pappl_pr_driver_t        *drivers;    // Driver list
+  cups_array_t             *ppd_paths;  // PPD path list
+  pr_ppd_path_t            *ppd_path;   // PPD path list entry
+  pappl_system_t           *system = global_data->system;
+  char                     filename[2048]; // Name of index file
+
+
+  index_path(global_data, filename, sizeof(filename));
+
+  if ((fd = open(filename, O_RDONLY)) < 0)
+  {
+    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	     "No driver index file %s, scanning PPD collections",
+	     filename);
+    return (false);
+  }
+
+  if (fstat(fd, &fileinfo) ||
+      fileinfo.st_size < (off_t)sizeof(pr_driver_index_header_t) ||
+      (map = mmap(NULL, (size_t)fileinfo.st_size, PROT_READ, MAP_PRIVATE,
+		  fd, 0)) == MAP_FAILED)
+  {
+    close(fd);
+    papplLog(system, PAPPL_LOGLEVEL_WARN,
+	     "Unable to read driver index file %s, scanning PPD collections",
+	     filename);
+    return (false);
+  }
+  close(fd);
+
+  header = (const pr_driver_index_header_t *)map;
+  if (memcmp(header->magic, PR_DRIVER_INDEX_MAGIC, sizeof(header->magic)) ||
+      header->version != PR_DRIVER_INDEX_VERSION ||
+      header->strings_size != (uint64_t)fileinfo.st_size -
+                              sizeof(pr_driver_index_header_t))
+  {
+    munmap(map, (size_t)fileinfo.st_size);
+    papplLog(system, PAPPL_LOGLEVEL_WARN,
+	     "Driver index file %s is invalid or of an old format, "
+	     "scanning PPD collections", filename);
+    return (false);
+  }
+
+  if (header->key != key)
+  {
+    munmap(map, (size_t)fileinfo.st_size);
+    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	     "PPD collections changed since creation of driver index file %s, "
+	     "scanning them", filename);
+    return (false);
+  }
+
+  //
+  // Read the entries, each consists of 5 strings: Driver name,
+  // description, device ID, sorting index, and path of the PPD file in
+  // the collections
+  //
+
+  num_drivers = (int)header->num_drivers;
+  ptr         = (const char *)map + sizeof(pr_driver_index_header_t);
+  end         = ptr + header->strings_size;
+  drivers     = (pappl_pr_driver_t *)calloc(num_drivers > 0 ? num_drivers : 1,
+					    sizeof(pappl_pr_driver_t));
+  ppd_paths   = cupsArrayNew(_prComparePPDPaths, NULL);
+
+  for (i = 0; i < num_drivers; i ++)
+  {
+    for (j = 0; j < 5; j ++)
+    {
+      if (ptr >= end || (len = strnlen(ptr, (size_t)(end - ptr))) >=
+	  (size_t)(end - ptr))
+	break;
+      strings[j] = ptr;
+      ptr += len + 1;
+    }
+    if (j < 5)
+      break;
+
+    drivers[i].name        = strdup(strings[0]);
+    drivers[i].description = strdup(strings[1]);
+    drivers[i].device_id   = strdup(strings[2]);
+    drivers[i].extension   = strdup(strings[3]);
+    if (strings[4][0])
+    {
+      ppd_path = (pr_ppd_path_t *)calloc(1, sizeof(pr_ppd_path_t));
+      ppd_path->driver_name = strdup(strings[0]);
+      ppd_path->ppd_path    = strdup(strings[4]);
+      cupsArrayAdd(ppd_paths, ppd_path);
+    }
+  }
+
+  munmap(map, (size_t)fileinfo.st_size);
+
+  if (i < num_drivers || num_drivers == 0)
+  {
+    _prDriverListFree(drivers, i, ppd_paths);
+    papplLog(system, PAPPL_LOGLEVEL_WARN,
+	     "Driver index file %s is corrupted, scanning PPD collections",
+	     filename);
+    return (false);
+  }
+
+  //
+  // Replace the driver list, the old one belongs to the published list
+  // and gets released when it is not used any more
+  //
+
+  global_data->num_drivers = num_drivers;
+  global_data->drivers     = drivers;
+  global_data->ppd_paths   = ppd_paths;
+
+  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	   "Loaded %d driver entries from driver index file %s",
+	   num_drivers, filename);
+
+  return (true);
+}
+
+
+//
+// '_prDriverIndexSave()' - Save the driver list and the PPD path list
+//                          of the global data in the driver index file,
+//                          together with the key of the state of the
+//                          PPD collections from which they were
+//                          created. The file gets written under a
+//                          temporary name and then renamed, so that
+//                          a reader never sees a partially written
+//                          file.
+//
+
+bool                            // O - `true` on success, `false` on error
+_prDriverIndexSave(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    uint64_t                     key)          // I - Key of the state
+{
+  int                      i, j;        // Looping variables
+  int                      fd;          // File descriptor of index file
+  FILE                     *fp = NULL;  // Index file
+  pr_driver_index_header_t header;      // Header of index file
+  pr_ppd_path_t            search,      // Search key for PPD path
+                           *ppd_path;   // PPD path list entry
+  const char               *strings[5]; // Strings of a driver entry
+  bool                     ret = true;  // Return value
+  pappl_system_t           *system = global_data->system;
+  char                     filename[2048], // Name of index file
+                           tempname[2048]; // Temporary name for writing
+
+
+  if (!global_data->drivers || global_data->num_drivers <= 0)
+    return (false);
+
+  index_path(global_data, filename, sizeof(filename));
+  snprintf(tempname, sizeof(tempname), "%s.XXXXXX", filename);
+
+  if ((fd = mkstemp(tempname)) < 0 || (fp = fdopen(fd, "w")) == NULL)
+  {
+    if (fd >= 0)
+    {
+      close(fd);
+      unlink(tempname);
+    }
+    papplLog(system, PAPPL_LOGLEVEL_WARN,
+	     "Unable to create driver index file %s: %s", filename,
+	     strerror(errno));
+    return (false);
+  }
+
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, PR_DRIVER_INDEX_MAGIC, sizeof(header.magic));
+  header.version     = PR_DRIVER_INDEX_VERSION;
+  header.num_drivers = (uint32_t)global_data->num_drivers;
+  header.key         = key;
+
+  // Collect the strings, first pass only for the size of the string table
+  for (i = 0; i < global_data->num_drivers; i ++)
+  {
+    search.driver_name = global_data->drivers[i].name;
+    ppd_path = (pr_ppd_path_t *)cupsArrayFind(global_data->ppd_paths,
+					      &search);
+    strings[0] = global_data->drivers[i].name;
+    strings[1] = global_data->drivers[i].description;
+    strings[2] = global_data->drivers[i].device_id;
+    strings[3] = (const char *)global_data->drivers[i].extension;
+    strings[4] = (ppd_path ? ppd_path->ppd_path : NULL);
+    for (j = 0; j < 5; j ++)
+      header.strings_size += (strings[j] ? strlen(strings[j]) : 0) + 1;
+  }
+
+  if (fwrite(&header, sizeof(header), 1, fp) != 1)
+    ret = false;
+
+  for (i = 0; ret && i < global_data->num_drivers; i ++)
+  {
+    search.driver_name = global_data->drivers[i].name;
+    ppd_path = (pr_ppd_path_t *)cupsArrayFind(global_data->ppd_paths,
+					      &search);
+    strings[0] = global_data->drivers[i].name;
+    strings[1] = global_data->drivers[i].description;
+    strings[2] = global_data->drivers[i].device_id;
+    strings[3] = (const char *)global_data->drivers[i].extension;
+    strings[4] = (ppd_path ? ppd_path->ppd_path : NULL);
+    for (j = 0; j < 5; j ++)
+      if (fputs(strings[j] ? strings[j] : "", fp) == EOF ||
+	  fputc('\0', fp) == EOF)
+	ret = false;
+  }
+
+  if (fclose(fp))
+    ret = false;
+
+  if (ret && rename(tempname, filename))
+    ret = false;
+
+  if (!ret)
+  {
+    papplLog(system, PAPPL_LOGLEVEL_WARN,
+	     "Unable to write driver index file %s: %s", filename,
+	     strerror(errno));
+    unlink(tempname);
+  }
+  else
+    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	     "Saved %d driver entries in driver index file %s",
+	     global_data->num_drivers, filename);
+
+  return (ret);
+}
+
+
+//
+// '_prDriverIndexListPPDs()' - List the PPD files of all collections,
+//                              like ppdCollectionListPPDs() does, but
+//                              scanning in parallel.
+//
+//                              The collections get split up into scan
+//                              units. A collection directory which
+//                              contains only sub-directories (like
+//                              /usr/share/ppd with one sub-directory
+//                              per driver project) gets split into
+//                              one unit per sub-directory, any other
+//                              collection is one unit. A pool of worker
+//                              threads, one per CPU core, scans the
+//                              units with ppdCollectionListPPDs().
+//
+//                              The results get joined and sorted in
+//                              the same order as ppdCollectionListPPDs()
+//                              sorts the PPDs of all collections (by
+//                              manufacturer, make and model, language,
+//                              and name), so that the driver list,
+//                              including which of two duplicates gets
+//                              dropped, is the same as with a serial
+//                              scan and does not depend on the timing
+//                              of the threads.
+//
+
+cups_array_t *                  // O - List of PPDs (ppd_info_t), NULL if
+                                //     none found
+_prDriverIndexListPPDs(
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  int              i, j;        // Looping variables
+  pr_ppd_scan_t    scan;        // Scan data
+  ppd_collection_t *col;        // PPD collection
+  cups_dir_t       *dir;        // Collection directory
+  cups_dentry_t    *dent;       // Directory entry
+  cups_array_t     *subdirs,    // Sub-directories of collection
+                   *ppds = NULL; // Result
+  char             *subdir;     // Sub-directory name
+  bool             split;       // Split up collection?
+  int              alloc_units = 0, // Allocated units
+                   num_threads; // Number of worker threads
+  pthread_t        threads[PR_PPD_SCAN_MAX_THREADS]; // Worker threads
+  ppd_info_t       *ppd,        // PPD list entry
+                   **sorted = NULL; // PPDs in sorting order
+  int              num_ppds = 0, // Number of PPDs
+                   alloc_ppds = 0; // Allocated entries in sorted
+  char             path[2048];  // Path of sub-directory
+
+
+  memset(&scan, 0, sizeof(scan));
+  scan.system = global_data->system;
+
+  //
+  // Create the scan units
+  //
+
+  for (i = 0; i < cupsArrayCount(global_data->ppd_collections); i ++)
+  {
+    col = (ppd_collection_t *)cupsArrayIndex(global_data->ppd_collections,
+					     i);
+    subdirs = cupsArrayNew3((cups_array_func_t)strcmp, NULL, NULL, 0, NULL,
+			    (cups_afree_func_t)free);
+    split = false;
+    if ((dir = cupsDirOpen(col->path)) != NULL)
+    {
+      split = true;
+      while ((dent = cupsDirRead(dir)) != NULL)
+      {
+	if (dent->filename[0] == '.')
+	  continue;
+	if (!S_ISDIR(dent->fileinfo.st_mode))
+	{
+	  // Files directly in the collection directory, keep it as a whole
+	  split = false;
+	  break;
+	}
+	cupsArrayAdd(subdirs, strdup(dent->filename));
+      }
+      cupsDirClose(dir);
+    }
+    if (!split || cupsArrayCount(subdirs) < 2)
+      cupsArrayClear(subdirs);
+
+    if (scan.num_units + cupsArrayCount(subdirs) + 1 > alloc_units)
+    {
+      alloc_units = 2 * (scan.num_units + cupsArrayCount(subdirs) + 1);
+      scan.units =
+	(ppd_collection_t *)reallocarray(scan.units, alloc_units,
+					 sizeof(ppd_collection_t));
+    }
+
+    if (cupsArrayCount(subdirs) == 0)
+    {
+      scan.units[scan.num_units].name = col->name;
+      scan.units[scan.num_units].path = strdup(col->path);
+      scan.num_units ++;
+    }
+    else
+      for (subdir = (char *)cupsArrayFirst(subdirs);
+	   subdir;
+	   subdir = (char *)cupsArrayNext(subdirs))
+      {
+	snprintf(path, sizeof(path), "%s/%s", col->path, subdir);
+	scan.units[scan.num_units].name = col->name;
+	scan.units[scan.num_units].path = strdup(path);
+	scan.num_units ++;
+      }
+
+    cupsArrayDelete(subdirs);
+  }
+
+  if (scan.num_units == 0)
+    return (NULL);
+
+  //
+  // Scan the units with a pool of worker threads
+  //
+
+  scan.results = (cups_array_t **)calloc(scan.num_units,
+					 sizeof(cups_array_t *));
+  pthread_mutex_init(&scan.mutex, NULL);
+
+  if ((num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+    num_threads = 1;
+  if (num_threads > PR_PPD_SCAN_MAX_THREADS)
+    num_threads = PR_PPD_SCAN_MAX_THREADS;
+  if (num_threads > scan.num_units)
+    num_threads = scan.num_units;
+
+  papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	   "Scanning %d PPD collection directories with %d threads",
+	   scan.num_units, num_threads);
+
+  // If a thread cannot get created, the others (or we ourselves) take
+  // over its work
+  for (i = 0; i < num_threads - 1; i ++)
+    if (pthread_create(threads + i, NULL, index_scan_worker, &scan))
+      break;
+  index_scan_worker(&scan);
+  for (j = 0; j < i; j ++)
+    pthread_join(threads[j], NULL);
+
+  pthread_mutex_destroy(&scan.mutex);
+
+  //
+  // Join and sort the results
+  //
+
+  for (i = 0; i < scan.num_units; i ++)
+  {
+    if (scan.results[i])
+    {
+      if (!ppds)
+	ppds = cupsArrayNew(NULL, NULL);
+      if (num_ppds + cupsArrayCount(scan.results[i]) > alloc_ppds)
+      {
+	alloc_ppds = 2 * (num_ppds + cupsArrayCount(scan.results[i]));
+	sorted = (ppd_info_t **)reallocarray(sorted, alloc_ppds,
+					     sizeof(ppd_info_t *));
+      }
+      for (ppd = (ppd_info_t *)cupsArrayFirst(scan.results[i]);
+	   ppd;
+	   ppd = (ppd_info_t *)cupsArrayNext(scan.results[i]))
+	sorted[num_ppds ++] = ppd;
+      cupsArrayDelete(scan.results[i]);
+    }
+    free((char *)scan.units[i].path);
+  }
+
+  if (num_ppds > 1)
+    qsort(sorted, (size_t)num_ppds, sizeof(ppd_info_t *),
+	  index_compare_ppds);
+  for (i = 0; i < num_ppds; i ++)
+    cupsArrayAdd(ppds, sorted[i]);
+
+  free(sorted);
+  free(scan.results);
+  free(scan.units);
+
+  return (ppds);
+}
+
+
+//
+// '_prDriverListAcquire()' - Get a reference to the published driver
+//                            list, to be given back with
+//                            _prDriverListRelease(). The list does not
+//                            change and does not get freed while the
+//                            reference is held, even if the driver list
+//                            gets updated in the meantime.
+//
+
+pr_driver_list_t *              // O - Driver list, NULL if none
+_prDriverListAcquire(
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  pr_driver_list_t *list;       // Driver list
+
+
+  pthread_mutex_lock(&global_data->driver_list_ref_mutex);
+  if ((list = global_data->driver_list) != NULL)
+    list->ref_count ++;
+  pthread_mutex_unlock(&global_data->driver_list_ref_mutex);
+
+  return (list);
+}
+
+
+//
+// '_prDriverListFree()' - Free a driver list and a PPD path list,
+//                         including all their strings.
+//
+
+void
+_prDriverListFree(pappl_pr_driver_t *drivers,     // I - Driver list
+		  int               num_drivers, // I - Number of drivers
+		  cups_array_t      *ppd_paths)  // I - PPD path list
+{
+  int           i;              // Looping variable
+  pr_ppd_path_t *ppd_path;      // PPD path list entry
+
+
+  for (i = 0; i < num_drivers; i ++)
+  {
+    free((char *)drivers[i].name);
+    free((char *)drivers[i].description);
+    free((char *)drivers[i].device_id);
+    free(drivers[i].extension);
+  }
+  free(drivers);
+
+  for (ppd_path = (pr_ppd_path_t *)cupsArrayFirst(ppd_paths);
+       ppd_path;
+       ppd_path = (pr_ppd_path_t *)cupsArrayNext(ppd_paths))
+  {
+    free((char *)ppd_path->driver_name);
+    free((char *)ppd_path->ppd_path);
+    free(ppd_path);
+  }
+  cupsArrayDelete(ppd_paths);
+}
+
+
+//
+// '_prDriverListPublish()' - Make the driver list in the global data the
+//                            published one, build the matcher index for
+//                            it, and submit it to PAPPL.
+//
+//                            The driver list and the PPD path list in
+//                            the global data belong to the published
+//                            list afterwards, the code updating the
+//                            driver list must create new ones for the
+//                            next update and must not change or free
+//                            them.
+//
+//                            PAPPL reads the driver list without any
+//                            lock of ours, for example when showing
+//                            the "Add Printer" page of the web
+//                            interface, and two updates can come in
+//                            while it is still reading, so the lists
+//                            replaced by updates stay until
+//                            _prDriverListsFree() at shutdown. Memory
+//                            only grows with the number of updates.
+//
+
+void
+_prDriverListPublish(
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  pr_driver_list_t *list,       // New driver list
+                   *old_list;   // Driver list to be retired
+
+
+  if (!global_data->ppd_paths)
+    global_data->ppd_paths = cupsArrayNew(_prComparePPDPaths, NULL);
+
+  if ((list = (pr_driver_list_t *)calloc(1, sizeof(pr_driver_list_t))) ==
+      NULL)
+  {
+    papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
+	     "Unable to allocate memory for the driver list, keeping the "
+	     "old one");
+    _prDriverListFree(global_data->drivers, global_data->num_drivers,
+		      global_data->ppd_paths);
+    pthread_mutex_lock(&global_data->driver_list_ref_mutex);
+    if ((list = global_data->driver_list) != NULL)
+    {
+      global_data->num_drivers = list->num_drivers;
+      global_data->drivers     = list->drivers;
+      global_data->ppd_paths   = list->ppd_paths;
+    }
+    else
+    {
+      global_data->num_drivers = 0;
+      global_data->drivers     = NULL;
+      global_data->ppd_paths   = NULL;
+    }
+    pthread_mutex_unlock(&global_data->driver_list_ref_mutex);
+    return;
+  }
+
+  list->ref_count   = 1;        // Reference of the global data
+  list->num_drivers = global_data->num_drivers;
+  list->drivers     = global_data->drivers;
+  list->ppd_paths   = global_data->ppd_paths;
+
+  pthread_mutex_lock(&global_data->driver_list_ref_mutex);
+  if ((old_list = global_data->driver_list) != NULL)
+  {
+    // If the list cannot get remembered, it stays allocated, as PAPPL
+    // can still be reading it
+    if (!global_data->retired_driver_lists)
+      global_data->retired_driver_lists = cupsArrayNew(NULL, NULL);
+    cupsArrayAdd(global_data->retired_driver_lists, old_list);
+  }
+  global_data->driver_list = list;
+  pthread_mutex_unlock(&global_data->driver_list_ref_mutex);
+
+  _prDriverMatcherBuild(global_data);
+  papplSystemSetPrinterDrivers(global_data->system, list->num_drivers,
+			       list->drivers,
+			       global_data->config->autoadd_cb,
+			       global_data->config->printer_extra_setup_cb,
+			       _prDriverSetup, global_data);
+
+  // Remove the cached physical files of PPDs which are gone or changed
+  _prPPDCachePrune(global_data);
+}
+
+
+//
+// '_prDriverListRelease()' - Give back a reference to a driver list, the
+//                            list gets freed with the last reference.
+//
+
+void
+_prDriverListRelease(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    pr_driver_list_t             *list)        // I - Driver list or NULL
+{
+  bool free_list;               // Last reference gone?
+
+
+  if (!list)
+    return;
+
+  pthread_mutex_lock(&global_data->driver_list_ref_mutex);
+  free_list = (-- list->ref_count == 0);
+  pthread_mutex_unlock(&global_data->driver_list_ref_mutex);
+
+  if (free_list)
+  {
+    _prDriverListFree(list->drivers, list->num_drivers, list->ppd_paths);
+    free(list);
+  }
+}
+
+
+//
+// '_prDriverListsFree()' - Release the published and the retired driver
+//                          lists when shutting down.
+//
+
+void
+_prDriverListsFree(
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  int              i;           // Looping variable
+  pr_driver_list_t *list;       // Published driver list
+  cups_array_t     *retired;    // Retired driver lists
+
+
+  pthread_mutex_lock(&global_data->driver_list_ref_mutex);
+  list    = global_data->driver_list;
+  retired = global_data->retired_driver_lists;
+  global_data->driver_list          = NULL;
+  global_data->retired_driver_lists = NULL;
+  pthread_mutex_unlock(&global_data->driver_list_ref_mutex);
+
+  _prDriverListRelease(global_data, list);
+  for (i = 0; i < cupsArrayCount(retired); i ++)
+    _prDriverListRelease(global_data,
+			 (pr_driver_list_t *)cupsArrayIndex(retired, i));
+  cupsArrayDelete(retired);
+
+  global_data->num_drivers = 0;
+  global_data->drivers     = NULL;
+  global_data->ppd_paths   = NULL;
+}
+
+
+//
+// '_prHashBytes()' - Add data to a FNV-1a hash, start with PR_FNV_OFFSET.
+//
+
+void
+_prHashBytes(uint64_t   *hash,  // I/O - Hash
+	     const void *data,  // I   - Data
+	     size_t     len)    // I   - Length of data
+{
+  const unsigned char *ptr = (const unsigned char *)data;
+
+
+  while (len --)
+  {
+    *hash ^= *ptr ++;
+    *hash *= PR_FNV_PRIME;
+  }
+}
+
+
+//
+// '_prHashString()' - Add a string, including its terminating zero byte,
+//                     to a FNV-1a hash. NULL counts as an empty string.
+//
+
+void
+_prHashString(uint64_t   *hash, // I/O - Hash
+	      const char *s)    // I   - String
+{
+  if (!s)
+    s = "";
+
+  _prHashBytes(hash, s, strlen(s) + 1);
+}
+
+
+//
+// 'index_compare_names()' - Compare two names, case-insensitively and
+//                           with numbers compared by their value, like
+//                           cupsdCompareNames() in CUPS, which
+//                           ppdCollectionListPPDs() uses for sorting.
+//
+
+static int                      // O - Result of comparison
+index_compare_names(const char *s, // I - First name
+		    const char *t) // I - Second name
+{
+  int diff;                     // Difference of first differing digits
+
+
+  while (*s && *t)
+  {
+    if (isdigit(*s & 255) && isdigit(*t & 255))
+    {
+      // Compare the numbers by their value, skip leading zeros and
+      // equal digits
+      while (*s == '0')
+	s ++;
+      while (*t == '0')
+	t ++;
+      while (isdigit(*s & 255) && *s == *t)
+      {
+	s ++;
+	t ++;
+      }
+
+      if (isdigit(*s & 255) && !isdigit(*t & 255))
+	return (1);
+      else if (!isdigit(*s & 255) && isdigit(*t & 255))
+	return (-1);
+      else if (!isdigit(*s & 255) || !isdigit(*t & 255))
+	continue;
+
+      // The number with more remaining digits is the larger one
+      diff = (*s < *t ? -1 : 1);
+      while (isdigit(*s & 255) && isdigit(*t & 255))
+      {
+	s ++;
+	t ++;
+      }
+      if (isdigit(*s & 255))
+	return (1);
+      else if (isdigit(*t & 255))
+	return (-1);
+      else
+	return (diff);
+    }
+    else if (tolower(*s & 255) < tolower(*t & 255))
+      return (-1);
+    else if (tolower(*s & 255) > tolower(*t & 255))
+      return (1);
+
+    s ++;
+    t ++;
+  }
+
+  if (*s)
+    return (1);
+  else if (*t)
+    return (-1);
+  else
+    return (0);
+}
+
+
+//
+// 'index_compare_ppds()' - Compare function for sorting the PPDs of all
+//                          scan units in the order of
+//                          ppdCollectionListPPDs(): Manufacturer, make
+//                          and model, language, and finally the name,
+//                          which is unique.
+//
+
+static int                      // O - Result of comparison
+index_compare_ppds(const void *a, // I - First PPD
+		   const void *b) // I - Second PPD
+{
+  const ppd_info_t *pa = *((const ppd_info_t **)a),
+                   *pb = *((const ppd_info_t **)b);
+  int              diff;        // Result of comparison
+
+
+  if ((diff = strcasecmp(pa->record.make, pb->record.make)) != 0)
+    return (diff);
+  else if ((diff = index_compare_names(pa->record.make_and_model,
+				       pb->record.make_and_model)) != 0)
+    return (diff);
+  else if ((diff = strcmp(pa->record.languages[0],
+			  pb->record.languages[0])) != 0)
+    return (diff);
+  else
+    return (strcmp(pa->record.name, pb->record.name));
+}
+
+
+//
+// 'index_hash_dir()' - Create a hash on name, inode, size, mode, and
+//                      modification time of all files in the
+//                      directory tree. The hashes of the entries get
+//                      summed up so that the result does not depend
+//                      on the order in which the directory entries
+//                      get read.
+//
+
+static uint64_t                 // O - Hash of directory tree
+index_hash_dir(const char *path, // I - Directory
+	       int        depth) // I - Recursion depth
+{
+  cups_dir_t    *dir;           // Directory pointer
+  cups_dentry_t *dent;          // Directory entry
+  uint64_t      sum = 0,        // Sum of the entries' hashes
+                hash,           // Hash of the current entry
+                sub;            // Hash of sub-directory
+  char          filename[2048]; // Name of sub-directory
+
+
+  if (depth > PR_DRIVER_INDEX_MAX_DEPTH || (dir = cupsDirOpen(path)) == NULL)
+    return (0);
+
+  while ((dent = cupsDirRead(dir)) != NULL)
+  {
+    hash = PR_FNV_OFFSET;
+    _prHashString(&hash, dent->filename);
+    _prHashBytes(&hash, &dent->fileinfo.st_ino,
+		     sizeof(dent->fileinfo.st_ino));
+    _prHashBytes(&hash, &dent->fileinfo.st_size,
+		     sizeof(dent->fileinfo.st_size));
+    _prHashBytes(&hash, &dent->fileinfo.st_mode,
+		     sizeof(dent->fileinfo.st_mode));
+    _prHashBytes(&hash, &dent->fileinfo.st_mtime,
+		     sizeof(dent->fileinfo.st_mtime));
+    if (S_ISDIR(dent->fileinfo.st_mode))
+    {
+      snprintf(filename, sizeof(filename), "%s/%s", path, dent->filename);
+      sub = index_hash_dir(filename, depth + 1);
+      _prHashBytes(&hash, &sub, sizeof(sub));
+    }
+    sum += hash;
+  }
+
+  cupsDirClose(dir);
+
+  return (sum);
+}
+
+
+//
+// 'index_scan_worker()' - Worker thread for scanning PPD collections
+//
+
+static void *                   // O - Thread exit status (unused)
+index_scan_worker(void *data)   // I - Scan data
+{
+  pr_ppd_scan_t *scan = (pr_ppd_scan_t *)data;
+  int           unit;           // Unit to scan
+  cups_array_t  *col;           // Collection list with only this unit
+
+
+  for (;;)
+  {
+    pthread_mutex_lock(&scan->mutex);
+    unit = scan->next_unit ++;
+    pthread_mutex_unlock(&scan->mutex);
+
+    if (unit >= scan->num_units)
+      break;
+
+    col = cupsArrayNew(NULL, NULL);
+    cupsArrayAdd(col, scan->units + unit);
+    scan->results[unit] =
+      ppdCollectionListPPDs(col, 0, 0, NULL, (cf_logfunc_t)papplLog,
+			    scan->system);
+    cupsArrayDelete(col);
+  }
+
+  return (NULL);
+}
+
+
+//
+// 'index_path()' - Get the name of the driver index file, it is in the
+//                  state directory, next to the state file.
+//
+
+static void
+index_path(pr_printer_app_global_data_t *global_data, // I - Global data
+	   char                         *buf,         // O - File name
+	   size_t                       bufsize)      // I - Size of buffer
+{
+  snprintf(buf, bufsize, "%s/%s.drivers", global_data->state_dir,
+	   global_data->config->system_package_name);
+}
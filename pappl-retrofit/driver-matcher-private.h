@@ -0,0 +1,125 @@
+//
+// PPD/Classic CUPS driver retro-fit Printer Application Library
+// (libpappl-retrofit) for the Printer Application Framework (PAPPL)
+//
+// driver-matcher-private.h
+//
+// Copyright © 2020 by Till Kamppeter.
+// Copyright © 2020 by Michael R Sweet.
+//
+// Licensed under Apache License v2.0.  See the file "LICENSE" for more
+// information.
+//
+
+#ifndef _PAPPL_RETROFIT_DRIVER_MATCHER_H_
+#  define _PAPPL_RETROFIT_DRIVER_MATCHER_H_
+
+//
+// Include necessary headers...
+//
+
+#include <pappl-retrofit/pappl-retrofit.h>
+#include <pappl/pappl.h>
+#include <pthread.h>
+#include <regex.h>
+
+
+//
+// C++ magic...
+//
+
+#  ifdef __cplusplus
+extern "C" {
+#  endif // __cplusplus
+
+
+//
+// Constants...
+//
+
+// Maximum number of threads for matching drivers to a batch of devices
+// (prBestMatchingPPDBatch())
+
+#define PR_MATCH_MAX_THREADS 16
+
+
+//
+// Types...
+//
+
+// Entry of the driver matcher index, maps a make and model ("MFG\nMDL"
+// from the driver's device ID) or a driver name prefix (the part before
+// a "--") to a driver
+
+typedef struct pr_driver_match_s
+{
+  char       *key;                      // Make and model or name prefix
+  int        driver;                    // Index in driver list
+} pr_driver_match_t;
+
+// Driver matcher index, built once for each driver list, so that
+// prBestMatchingPPD() only needs to score the few drivers which match
+// make and model. The entries are in plain arrays sorted by key and
+// driver, so that look-ups do not change the index and can run in
+// parallel
+
+typedef struct pr_driver_matcher_s
+{
+  pr_driver_list_t  *list;              // Driver list (referenced)
+  pappl_pr_driver_t *drivers;           // Drivers of the list
+  int          num_drivers;             // Number of drivers
+  bool         generic;                 // First driver is "generic"?
+  int          num_make_model,          // Number of make and model entries
+               num_name_prefix;         // Number of name prefix entries
+  pr_driver_match_t *make_model,        // Entries by make and model
+               *name_prefix;            // Entries by driver name prefix
+  int          *scores,                 // Score of each driver which does
+                                        // not depend on the device
+               *regex_index;            // Index of the first priority
+                                        // regular expression matching the
+                                        // driver name, -1 for none
+  const char   **make_models;           // Make and model key of each
+                                        // driver, NULL if it has none
+  const char   **regexes;               // Driver selection regular
+                                        // expressions (from the
+                                        // configuration)
+} pr_driver_matcher_t;
+
+// Batch of devices to find drivers for, the worker threads take the next
+// device and put the result into the device's own slot. All of them use
+// the same matcher index, the batch holds the read lock on it until the
+// last device is done
+
+typedef struct pr_match_batch_s
+{
+  pthread_mutex_t    mutex;             // Mutex for next_device
+  int                next_device,       // Next device to be matched
+                     num_devices;       // Number of devices
+  const char * const *device_ids;       // Device IDs
+  const char         **driver_names;    // Resulting driver names
+  pr_driver_matcher_t *matcher;         // Matcher index
+  pr_printer_app_global_data_t *global_data; // Global data
+} pr_match_batch_t;
+
+
+//
+// Functions...
+//
+
+extern void   _prDriverMatcherBuild(pr_printer_app_global_data_t *global_data);
+extern const char *_prDriverMatcherBest(
+				pr_printer_app_global_data_t *global_data,
+				const char *device_id);
+extern void   _prDriverMatcherFree(pr_printer_app_global_data_t *global_data);
+
+
+//
+// C++ magic...
+//
+
+#  ifdef __cplusplus
+}
+#  endif // __cplusplus
+
+
+#endif // !_PAPPL_RETROFIT_DRIVER_MATCHER_H_
@@ -0,0 +1,724 @@
+//
+// PPD/Classic CUPS driver retro-fit Printer Application Library
+// (libpappl-retrofit) for the Printer Application Framework (PAPPL)
+//
+// driver-matcher.c
+//
+// Copyright © 2020 by Till Kamppeter.
+// Copyright © 2020 by Michael R Sweet.
+//
+// Licensed under Apache License v2.0.  See the file "LICENSE" for more
+// information.
+//
+
+//
+// Include necessary headers...
+//
+
+#ifndef _GNU_SOURCE
+#  define _GNU_SOURCE
+#endif
+
+#include <pappl-retrofit/pappl-retrofit-private.h>
+#include <unistd.h>
+
+
+//
+// Local functions...
+//
+
+static int      matcher_compare_make_model(const void *a, const void *b);
+static int      matcher_compare_name_prefix(const void *a, const void *b);
+static void     matcher_delete(pr_printer_app_global_data_t *global_data,
+			       pr_driver_matcher_t *matcher);
+static bool     matcher_add(pr_driver_match_t **entries, int *num_entries,
+			    int *alloc_entries, char *key, int driver);
+static int      matcher_find(pr_driver_match_t *entries, int num_entries,
+			     const char *key, bool nocase);
+static void     *matcher_batch_worker(void *data);
+static const char *matcher_best(pr_printer_app_global_data_t *global_data,
+				pr_driver_matcher_t *matcher,
+				const char *device_id);
+static const char *matcher_intern(pr_printer_app_global_data_t *global_data,
+				  const char *name);
+static void     matcher_publish(pr_printer_app_global_data_t *global_data,
+				pr_driver_matcher_t *matcher);
+
+
+//
+// '_prDriverMatcherBuild()' - Build the matcher index for the published
+//                             driver list.
+//
+//                             The device IDs of all drivers get parsed
+//                             and the driver selection regular
+//                             expressions get compiled and matched on
+//                             all driver names here, once for each
+//                             driver list, instead of on every call of
+//                             prBestMatchingPPD(). The index holds
+//                             a reference to the driver list, so that
+//                             the list lives as long as the index.
+//                             Without drivers or when memory runs out
+//                             the old index gets removed, so that it
+//                             does not keep answering with drivers
+//                             which are not in the list any more.
+//
+
+void
+_prDriverMatcherBuild(
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  int                 i, j;             // Looping variables
+  pr_driver_matcher_t *matcher;         // New matcher index
+  pappl_pr_driver_t   *driver;          // Current driver
+  int                 num_ddid;         // Number of device ID fields
+  cups_option_t       *ddid;            // Device ID fields of driver
+  const char          *dmfg, *dmdl,     // Make and model of driver
+                      *regex,           // Regular expression
+                      *ptr;             // Pointer into driver name
+  char                *key;             // Key for index entry
+  size_t              len;              // Length of name or key
+  cups_array_t        *regex_list =
+    global_data->config->driver_selection_regex_list;
+  int                 num_re = 0;       // Number of regular expressions
+  regex_t             *res = NULL;      // Compiled regular expressions
+  int                 alloc_make_model = 0, // Allocated entries
+                      alloc_name_prefix = 0;
+  pr_driver_list_t    *list;            // Driver list
+
+
+  if ((list = _prDriverListAcquire(global_data)) == NULL)
+  {
+    matcher_publish(global_data, NULL);
+    return;
+  }
+  if (list->num_drivers <= 0)
+  {
+    _prDriverListRelease(global_data, list);
+    matcher_publish(global_data, NULL);
+    return;
+  }
+
+  if ((matcher = (pr_driver_matcher_t *)calloc(1,
+					       sizeof(pr_driver_matcher_t))) ==
+      NULL)
+  {
+    papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
+	     "Unable to allocate memory for the driver matcher index");
+    _prDriverListRelease(global_data, list);
+    matcher_publish(global_data, NULL);
+    return;
+  }
+
+  matcher->list        = list;
+  matcher->drivers     = list->drivers;
+  matcher->num_drivers = list->num_drivers;
+  matcher->generic     = !strcasecmp(list->drivers[0].name, "generic");
+  matcher->scores      = (int *)calloc(matcher->num_drivers, sizeof(int));
+  matcher->regex_index = (int *)calloc(matcher->num_drivers, sizeof(int));
+  matcher->make_models = (const char **)calloc(matcher->num_drivers,
+					       sizeof(const char *));
+
+  if (!matcher->scores || !matcher->regex_index || !matcher->make_models)
+  {
+    papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
+	     "Unable to allocate memory for the driver matcher index");
+    matcher_delete(global_data, matcher);
+    matcher_publish(global_data, NULL);
+    return;
+  }
+
+  // Compile regular expressions to prioritize drivers
+  if (regex_list && cupsArrayCount(regex_list) > 0 &&
+      (res = (regex_t *)calloc(cupsArrayCount(regex_list),
+			       sizeof(regex_t))) != NULL &&
+      (matcher->regexes =
+       (const char **)calloc(cupsArrayCount(regex_list),
+			     sizeof(const char *))) != NULL)
+  {
+    for (regex = (const char *)cupsArrayFirst(regex_list);
+	 regex;
+	 regex = (const char *)cupsArrayNext(regex_list))
+    {
+      if (regcomp(res + num_re, regex,
+		  REG_ICASE | REG_EXTENDED | REG_NOSUB))
+      {
+	papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
+		 "Invalid regular expression: %s", regex);
+	continue;
+      }
+      matcher->regexes[num_re ++] = regex;
+    }
+  }
+
+  // Index the drivers, the first entry ("generic" or a real driver) is
+  // never a match candidate
+  for (i = 1, driver = matcher->drivers + 1; i < matcher->num_drivers;
+       i ++, driver ++)
+  {
+    matcher->regex_index[i] = -1;
+
+    // Make and model from the driver's device ID
+    ddid = NULL;
+    if (driver->device_id && driver->device_id[0] &&
+	(num_ddid = papplDeviceParseID(driver->device_id, &ddid)) > 0 &&
+	ddid != NULL)
+    {
+      if ((dmfg = cupsGetOption("MANUFACTURER", num_ddid, ddid)) == NULL)
+	dmfg = cupsGetOption("MFG", num_ddid, ddid);
+      if ((dmdl = cupsGetOption("MODEL", num_ddid, ddid)) == NULL)
+	dmdl = cupsGetOption("MDL", num_ddid, ddid);
+      if (dmfg && dmdl)
+      {
+	len = strlen(dmfg) + strlen(dmdl) + 2;
+	if ((key = (char *)malloc(len)) != NULL)
+	{
+	  snprintf(key, len, "%s\n%s", dmfg, dmdl);
+	  if (matcher_add(&matcher->make_model, &matcher->num_make_model,
+			  &alloc_make_model, key, i))
+	    matcher->make_models[i] = key;
+	}
+      }
+      cupsFreeOptions(num_ddid, ddid);
+    }
+
+    // Name prefixes, a normalized make and model matches if the driver
+    // name continues with "--" after it
+    for (ptr = strstr(driver->name, "--"); ptr; ptr = strstr(ptr + 1, "--"))
+      if ((key = strndup(driver->name, (size_t)(ptr - driver->name))) !=
+	  NULL)
+	matcher_add(&matcher->name_prefix, &matcher->num_name_prefix,
+		    &alloc_name_prefix, key, i);
+
+    // User-added? Prioritize, as if the user adds something, he wants
+    // to use it
+    if (strstr(driver->name, "-user-added"))
+      matcher->scores[i] += 32000;
+
+    // PPD matches user's/system's language?
+    // To be added when PAPPL supports internationalization (TODO)
+    // score + 2 for 2-char language
+    // score + 4 for 5-char language/country
+
+    // PPD is English language version?
+    len = strlen(driver->name);
+    if ((len >= 3 && !strcmp(driver->name + len - 3, "-en")) ||
+	(len >= 6 && !strncmp(driver->name + len - 6, "-en-", 4)))
+      matcher->scores[i] += 1;
+
+    // Match the regular expressions on the driver name
+    for (j = 0; j < num_re; j ++)
+      if (!regexec(res + j, driver->name, 0, NULL, 0))
+      {
+	// Regular expression matches
+	matcher->scores[i] += (4000 - 10 * j);
+	matcher->regex_index[i] = j;
+	break;
+      }
+  }
+
+  if (res)
+  {
+    for (j = 0; j < num_re; j ++)
+      regfree(res + j);
+    free(res);
+  }
+
+  // Sort the entries by key, and entries with the same key by driver, so
+  // that the earliest driver comes first
+  if (matcher->num_make_model > 1)
+    qsort(matcher->make_model, (size_t)matcher->num_make_model,
+	  sizeof(pr_driver_match_t), matcher_compare_make_model);
+  if (matcher->num_name_prefix > 1)
+    qsort(matcher->name_prefix, (size_t)matcher->num_name_prefix,
+	  sizeof(pr_driver_match_t), matcher_compare_name_prefix);
+
+  papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	   "Driver matcher index: %d make/model and %d name prefix entries",
+	   matcher->num_make_model, matcher->num_name_prefix);
+
+  matcher_publish(global_data, matcher);
+}
+
+
+//
+// '_prDriverMatcherBest()' - Find the best driver for a device in the
+//                            matcher index, see matcher_best(). The
+//                            returned name stays valid until the Printer
+//                            Application shuts down, also when the
+//                            driver list gets replaced.
+//
+
+const char *                            // O - Driver name or NULL if no
+                                        //     driver matches
+_prDriverMatcherBest(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    const char                   *device_id)   // I - IEEE-1284 device ID
+{
+  const char *ret;                      // Return value
+
+
+  pthread_rwlock_rdlock(&global_data->driver_matcher_lock);
+  ret = matcher_best(global_data, global_data->driver_matcher, device_id);
+  pthread_rwlock_unlock(&global_data->driver_matcher_lock);
+
+  return (ret);
+}
+
+
+//
+// 'prBestMatchingPPDBatch()' - Find the best drivers for a batch of
+//                              devices, for example all printers
+//                              found by one discovery run.
+//
+//                              The devices are matched in parallel on
+//                              a pool of worker threads, all using the
+//                              same matcher index of the driver list,
+//                              which stays locked for reading until the
+//                              whole batch is done. The result for each
+//                              device is the same as prBestMatchingPPD()
+//                              gives, and the returned driver names stay
+//                              valid until the Printer Application shuts
+//                              down, the caller must not free them.
+//
+
+int                                     // O - Number of devices for which
+                                        //     a driver was found
+prBestMatchingPPDBatch(
+    int                num_devices,     // I - Number of devices
+    const char * const *device_ids,     // I - IEEE-1284 device IDs
+    const char         **driver_names,  // O - Driver names, NULL for no
+                                        //     driver, same order as the
+                                        //     device IDs
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  int              i, j;                // Looping variables
+  int              num_found = 0,       // Number of devices with driver
+                   num_threads;         // Number of worker threads
+  pthread_t        threads[PR_MATCH_MAX_THREADS - 1]; // Worker threads
+  pr_match_batch_t batch;               // Batch data
+
+
+  if (num_devices <= 0 || !device_ids || !driver_names || !global_data)
+    return (0);
+
+  memset(&batch, 0, sizeof(batch));
+  batch.num_devices  = num_devices;
+  batch.device_ids   = device_ids;
+  batch.driver_names = driver_names;
+  batch.global_data  = global_data;
+
+  pthread_mutex_init(&batch.mutex, NULL);
+
+  if ((num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+    num_threads = 1;
+  if (num_threads > PR_MATCH_MAX_THREADS)
+    num_threads = PR_MATCH_MAX_THREADS;
+  if (num_threads > num_devices)
+    num_threads = num_devices;
+
+  // The workers do not lock the index themselves, so that a waiting
+  // update of the driver list cannot get between them and the batch
+  pthread_rwlock_rdlock(&global_data->driver_matcher_lock);
+  batch.matcher = global_data->driver_matcher;
+
+  // If a thread cannot get created, the others (or we ourselves) take
+  // over its work
+  for (i = 0; i < num_threads - 1; i ++)
+    if (pthread_create(threads + i, NULL, matcher_batch_worker, &batch))
+      break;
+  matcher_batch_worker(&batch);
+  for (j = 0; j < i; j ++)
+    pthread_join(threads[j], NULL);
+
+  pthread_rwlock_unlock(&global_data->driver_matcher_lock);
+
+  pthread_mutex_destroy(&batch.mutex);
+
+  for (i = 0; i < num_devices; i ++)
+    if (driver_names[i])
+      num_found ++;
+
+  return (num_found);
+}
+
+
+//
+// '_prDriverMatcherFree()' - Free the driver matcher index and the
+//                            returned driver names.
+//
+
+void
+_prDriverMatcherFree(
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  pthread_rwlock_wrlock(&global_data->driver_matcher_lock);
+  matcher_delete(global_data, global_data->driver_matcher);
+  global_data->driver_matcher = NULL;
+  pthread_rwlock_unlock(&global_data->driver_matcher_lock);
+
+  pthread_mutex_lock(&global_data->driver_names_mutex);
+  cupsArrayDelete(global_data->driver_names);
+  global_data->driver_names = NULL;
+  pthread_mutex_unlock(&global_data->driver_names_mutex);
+}
+
+
+//
+// 'matcher_compare_make_model()' - Compare function for the make and
+//                                  model entries of the matcher index,
+//                                  case-insensitive, as device IDs come
+//                                  in different capitalizations.
+//
+
+static int
+matcher_compare_make_model(const void *a, // I - First entry
+			   const void *b) // I - Second entry
+{
+  const pr_driver_match_t *ma = (const pr_driver_match_t *)a,
+                          *mb = (const pr_driver_match_t *)b;
+  int                     ret;          // Result of comparison
+
+
+  if ((ret = strcasecmp(ma->key, mb->key)) != 0)
+    return (ret);
+  return (ma->driver - mb->driver);
+}
+
+
+//
+// 'matcher_compare_name_prefix()' - Compare function for the name prefix
+//                                   entries of the matcher index.
+//
+
+static int
+matcher_compare_name_prefix(const void *a, // I - First entry
+			    const void *b) // I - Second entry
+{
+  const pr_driver_match_t *ma = (const pr_driver_match_t *)a,
+                          *mb = (const pr_driver_match_t *)b;
+  int                     ret;          // Result of comparison
+
+
+  if ((ret = strcmp(ma->key, mb->key)) != 0)
+    return (ret);
+  return (ma->driver - mb->driver);
+}
+
+
+//
+// 'matcher_delete()' - Delete a matcher index and release its driver
+//                      list.
+//
+
+static void
+matcher_delete(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    pr_driver_matcher_t          *matcher)     // I - Matcher index
+{
+  int i;                                // Looping variable
+
+
+  if (!matcher)
+    return;
+
+  for (i = 0; i < matcher->num_make_model; i ++)
+    free(matcher->make_model[i].key);
+  for (i = 0; i < matcher->num_name_prefix; i ++)
+    free(matcher->name_prefix[i].key);
+  free(matcher->make_model);
+  free(matcher->name_prefix);
+  free(matcher->scores);
+  free(matcher->regex_index);
+  free(matcher->make_models);
+  free(matcher->regexes);
+  _prDriverListRelease(global_data, matcher->list);
+  free(matcher);
+}
+
+
+//
+// 'matcher_add()' - Add an entry to the matcher index, the key gets
+//                   owned by the index.
+//
+
+static bool                             // O - `true` on success
+matcher_add(pr_driver_match_t **entries, // I/O - Index entries
+	    int          *num_entries,  // I/O - Number of entries
+	    int          *alloc_entries, // I/O - Allocated entries
+	    char         *key,          // I - Key, allocated
+	    int          driver)        // I - Index of driver
+{
+  pr_driver_match_t *new_entries;       // Grown entry array
+
+
+  if (*num_entries >= *alloc_entries)
+  {
+    if ((new_entries =
+	 (pr_driver_match_t *)realloc(*entries,
+				      (*alloc_entries + 1024) *
+				      sizeof(pr_driver_match_t))) == NULL)
+    {
+      free(key);
+      return (false);
+    }
+    *entries = new_entries;
+    *alloc_entries += 1024;
+  }
+
+  (*entries)[*num_entries].key    = key;
+  (*entries)[*num_entries].driver = driver;
+  (*num_entries) ++;
+
+  return (true);
+}
+
+
+//
+// 'matcher_find()' - Find the first entry with a given key in a sorted
+//                    entry array.
+//
+
+static int                              // O - Index of first entry with
+                                        //     key, or of the first entry
+                                        //     after it if there is none
+matcher_find(pr_driver_match_t *entries, // I - Sorted entries
+	     int               num_entries, // I - Number of entries
+	     const char        *key,    // I - Key to search for
+	     bool              nocase)  // I - Compare case-insensitively?
+{
+  int left = 0,                         // Left end of search range
+      right = num_entries,              // Right end of search range
+      middle;                           // Middle of search range
+
+
+  while (left < right)
+  {
+    middle = (left + right) / 2;
+    if ((nocase ? strcasecmp(entries[middle].key, key) :
+	 strcmp(entries[middle].key, key)) < 0)
+      left = middle + 1;
+    else
+      right = middle;
+  }
+
+  return (left);
+}
+
+
+//
+// 'matcher_intern()' - Get a copy of a driver name which stays valid
+//                      until shutdown. Each name is copied only once, so
+//                      that the memory used is bounded by the drivers
+//                      which were ever returned.
+//
+
+static const char *                     // O - Copy of name, NULL on error
+matcher_intern(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    const char                   *name)        // I - Driver name
+{
+  const char *ret;                      // Return value
+
+
+  pthread_mutex_lock(&global_data->driver_names_mutex);
+
+  if (!global_data->driver_names)
+    global_data->driver_names =
+      cupsArrayNew3((cups_array_func_t)strcmp, NULL, NULL, 0,
+		    (cups_acopy_func_t)strdup, (cups_afree_func_t)free);
+  if ((ret = (const char *)cupsArrayFind(global_data->driver_names,
+					 (void *)name)) == NULL &&
+      cupsArrayAdd(global_data->driver_names, (void *)name))
+    ret = (const char *)cupsArrayFind(global_data->driver_names,
+				      (void *)name);
+
+  pthread_mutex_unlock(&global_data->driver_names_mutex);
+
+  return (ret);
+}
+
+
+//
+// 'matcher_publish()' - Replace the matcher index, NULL removes it.
+//
+
+static void
+matcher_publish(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    pr_driver_matcher_t          *matcher)     // I - New matcher index
+{
+  pr_driver_matcher_t *old_matcher;     // Matcher index to be replaced
+
+
+  pthread_rwlock_wrlock(&global_data->driver_matcher_lock);
+  old_matcher = global_data->driver_matcher;
+  global_data->driver_matcher = matcher;
+  pthread_rwlock_unlock(&global_data->driver_matcher_lock);
+
+  matcher_delete(global_data, old_matcher);
+}
+
+
+//
+// 'matcher_batch_worker()' - Worker thread for matching drivers to a
+//                            batch of devices.
+//
+
+static void *                           // O - Thread exit status (unused)
+matcher_batch_worker(void *data)        // I - Batch data
+{
+  pr_match_batch_t *batch = (pr_match_batch_t *)data;
+  int              device;              // Current device
+
+
+  for (;;)
+  {
+    pthread_mutex_lock(&batch->mutex);
+    device = batch->next_device ++;
+    pthread_mutex_unlock(&batch->mutex);
+
+    if (device >= batch->num_devices)
+      break;
+
+    batch->driver_names[device] =
+      matcher_best(batch->global_data, batch->matcher,
+		   batch->device_ids[device]);
+  }
+
+  return (NULL);
+}
+
+
+//
+// 'matcher_best()' - Find the best driver for a device in a matcher
+//                    index, the caller holds the read lock on it.
+//
+//                    Drivers whose device ID has the same make and
+//                    model get 16000 points, drivers whose name starts
+//                    with the normalized make and model followed by
+//                    "--" get 8000. To this the device-independent
+//                    score of the driver gets added.
+//
+//                    If no driver matches and the first driver of the
+//                    list is the generic one, "generic" gets returned.
+//
+
+static const char *                     // O - Driver name or NULL if no
+                                        //     driver matches
+matcher_best(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    pr_driver_matcher_t          *matcher,     // I - Matcher index or NULL
+    const char                   *device_id)   // I - IEEE-1284 device ID
+{
+  int                 num_did;          // Number of device ID fields
+  cups_option_t       *did = NULL;      // Device ID fields
+  const char          *mfg, *mdl;       // Make and model of device
+  char                buf[1024];        // Normalized make and model
+  pr_driver_match_t   *entries,         // Entries to search in
+                      *match;           // Current match
+  int                 pass,             // Make/model or name prefix
+                      i,                // Index of current match
+                      num_entries,      // Number of entries
+                      score,            // Score of current match
+                      best = -1,        // Best driver
+                      best_score = 0;   // Score of best driver
+  size_t              len;              // Length of key
+  char                *key = NULL;      // Make and model key
+  const char          *search,          // Key to search for
+                      *ret = NULL;      // Return value
+
+
+  if (device_id == NULL)
+    return (NULL);
+
+  // Parse the IEEE-1284 device ID to see if this is a printer we support...
+  num_did = papplDeviceParseID(device_id, &did);
+  if (num_did == 0 || did == NULL)
+    return (NULL);
+
+  // Make and model
+  if ((mfg = cupsGetOption("MANUFACTURER", num_did, did)) == NULL)
+    mfg = cupsGetOption("MFG", num_did, did);
+  if ((mdl = cupsGetOption("MODEL", num_did, did)) == NULL)
+    mdl = cupsGetOption("MDL", num_did, did);
+
+  if (mfg && mdl)
+  {
+    // Normalize device ID to format of driver name and match
+    cfIEEE1284NormalizeMakeModel(device_id, NULL,
+				 CF_IEEE1284_NORMALIZE_IPP, NULL,
+				 buf, sizeof(buf),
+				 NULL, NULL, NULL);
+
+    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	     "Device ID to match: %s", device_id);
+    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	     "Normalized make and model to match against driver name: %s", buf);
+
+    len = strlen(mfg) + strlen(mdl) + 2;
+    if ((key = (char *)malloc(len)) != NULL)
+      snprintf(key, len, "%s\n%s", mfg, mdl);
+  }
+
+  if (matcher)
+  {
+    for (pass = 0; key && pass < 2; pass ++)
+    {
+      if (pass == 0)
+      {
+	entries     = matcher->make_model;
+	num_entries = matcher->num_make_model;
+	search      = key;
+      }
+      else
+      {
+	entries     = matcher->name_prefix;
+	num_entries = matcher->num_name_prefix;
+	search      = buf;
+      }
+
+      for (i = matcher_find(entries, num_entries, search, pass == 0),
+	     match = entries + i;
+	   i < num_entries &&
+	     (pass == 0 ? !strcasecmp(match->key, search) :
+	      !strcmp(match->key, search));
+	   i ++, match ++)
+      {
+	// A driver which matches by its device ID does not get extra
+	// points for its name
+	if (pass == 1 && matcher->make_models[match->driver] &&
+	    !strcasecmp(matcher->make_models[match->driver], key))
+	  continue;
+
+	score = (pass == 0 ? 16000 : 8000) + matcher->scores[match->driver];
+	if (matcher->regex_index[match->driver] >= 0)
+	  papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
+		   "Driver %s matched driver priority regular expression %d: \"%s\"",
+		   matcher->drivers[match->driver].name,
+		   matcher->regex_index[match->driver] + 1,
+		   matcher->regexes[matcher->regex_index[match->driver]]);
+
+	// Better match than the previous one? On equal scores the driver
+	// earlier in the list wins
+	if (score > best_score ||
+	    (score == best_score && match->driver < best))
+	{
+	  best_score = score;
+	  best       = match->driver;
+	}
+      }
+    }
+
+    // The driver list can get replaced as soon as the caller unlocks, so
+    // return a copy of the name which stays valid
+    if (best >= 0)
+      ret = matcher_intern(global_data, matcher->drivers[best].name);
+    else if (matcher->generic)
+      ret = "generic";
+  }
+
+  cupsFreeOptions(num_did, did);
+  free(key);
+
+  return (ret);
+}
@@ -26,6 +26,10 @@
 #include <pappl-retrofit/print-job-private.h>
 #include <pappl-retrofit/cups-backends-private.h>
 #include <pappl-retrofit/web-interface-private.h>
+#include <pappl-retrofit/driver-index-private.h>
+#include <pappl-retrofit/driver-cache-private.h>
+#include <pappl-retrofit/driver-matcher-private.h>
+#include <pappl-retrofit/dir-watcher-private.h>
 #include <pappl/pappl.h>
 #include <ppd/ppd.h>
 #include <cupsfilters/ieee1284.h>
@@ -46,6 +50,34 @@ extern "C" {
 #  endif // __cplusplus
 
 
+//
+// Macros...
+//
+
+// Level-gated logging: The arguments only get evaluated and the message
+// only gets formatted if the log level of the system lets it through.
+// Use these for debug messages in loops and other hot paths.
+
+#define _PR_LOG_ENABLED(system, level) \
+  ((pappl_loglevel_t)(level) >= papplSystemGetLogLevel(system))
+#define _PR_LOG(system, level, ...) \
+  do { \
+    if (_PR_LOG_ENABLED(system, level)) \
+      papplLog(system, level, __VA_ARGS__); \
+  } while (0)
+#define _PR_LOG_PRINTER(printer, level, ...) \
+  do { \
+    if (_PR_LOG_ENABLED(papplPrinterGetSystem(printer), level)) \
+      papplLogPrinter(printer, level, __VA_ARGS__); \
+  } while (0)
+#define _PR_LOG_JOB(job, level, ...) \
+  do { \
+    if (_PR_LOG_ENABLED(papplPrinterGetSystem(papplJobGetPrinter(job)), \
+			level)) \
+      papplLogJob(job, level, __VA_ARGS__); \
+  } while (0)
+
+
 //
 // Types...
 //
@@ -56,25 +88,107 @@ typedef struct pr_ppd_path_s		// Driver-name/PPD-path pair
   const char *ppd_path;	                // PPD path in collections
 } pr_ppd_path_t;
 
+typedef struct pr_filter_path_s        // Filter look-up cache entry
+{
+  char       *path;                     // Absolute path of the filter
+  bool       executable;                // Is it an executable file?
+} pr_filter_path_t;
+
+typedef struct pr_regex_cache_s        // Compiled regular expression
+                                        // cache entry
+{
+  char       *pattern;                  // Regular expression
+  int        cflags;                    // Flags for regcomp()
+  bool       temporary;                 // Not in the cache (cache full)?
+  regex_t    re;                        // Compiled regular expression
+} pr_regex_cache_t;
+
+struct pr_devid_s                       // Parsed IEEE-1284 device ID
+{
+  int           num_fields;             // Number of fields
+  cups_option_t *fields;                // Fields as key/value pairs
+};
+
+typedef struct pr_strings_buf_s        // Growable buffer for building a
+                                        // *.strings-type translation table
+{
+  char       *data;                     // Table, zero-terminated
+  size_t     len,                       // Length of the table
+             size;                      // Allocated size of the buffer
+} pr_strings_buf_t;
+
+typedef struct pr_driver_instance_s     // Data derived from the PPD file
+                                        // shared by all printers using the
+                                        // same driver with the same
+                                        // installable accessory settings
+{
+  char       *key;                      // Driver name, PPD identity, and
+                                        // accessory settings
+  char       *driver_name;              // Driver name
+  char       *ppd_path;                 // Path of the PPD in the collection
+  int        num_inst_options;          // Installable accessory settings
+  cups_option_t *inst_options;          // marked in the PPD
+  int        ref_count;                 // Number of printers using it
+  pthread_mutex_t mutex;                // Serializes building the look-up
+                                        // tables
+  ppd_file_t *ppd;                      // PPD file with PPD cache, NULL if
+                                        // not loaded yet or evicted
+  size_t     ppd_size;                  // Estimated memory used by the PPD
+  bool       ppd_loading;               // Is the PPD getting loaded?
+  struct pr_driver_extension_s *ppd_holder, // Printer using the PPD, NULL
+                                        // if unused, it can get evicted
+             *ppd_marked_by;            // Last printer which used the PPD
+                                        // and marked its options in it
+  cups_array_t *ipp_name_lookup;        // Look-up tables for the IPP names
+  cups_array_t *ipp_name_lookup_ipp;    // assigned to vendor PPD options
+  bool       ipp_names_complete;        // Look-up tables complete, with
+                                        // the vendor option indices?
+  char       *temp_ppd_name;            // File name of physical copy of the
+                                        // PPD file to be used by CUPS filters
+  bool       temp_ppd_temporary;        // Is the copy a temporary file (not
+                                        // in the PPD cache)?
+  char       *human_strings;            // Table of human-readable strings
+                                        // from the PPD file
+} pr_driver_instance_t;
+
 typedef struct ipp_name_lookup_s        // Entry for PPD/IPP option name
                                         // look-up table
 {
-  const char *ppd;                      // PPD option name
+  char       *ppd;                      // PPD option name
   char       *ipp;                      // Assigned IPP attribute name
+  int        vendor_index;              // Index of the vendor option, -1
+                                        // if the option is not available
 } ipp_name_lookup_t;
 
 // Additional driver data specific to the CUPS-driver retro-fitting
 // printer applications
 typedef struct pr_driver_extension_s	// Driver data extension
 {
-  ppd_file_t *ppd;                      // PPD file loaded from collection
+  ppd_file_t *ppd;                      // PPD file in use by the printer,
+                                        // NULL if not in use, use
+                                        // _prPPDAcquire() to access it
+  char       *ppd_path;                 // Path of the PPD in the collection
+  int        ppd_users;                 // Number of users of the PPD
+  bool       ppd_loading,               // Is a copy of the PPD getting
+                                        // loaded for the printer?
+             ppd_private;               // Is the PPD the printer's own copy,
+                                        // as another printer is using the
+                                        // shared one?
+  size_t     ppd_size;                  // Estimated memory used by the
+                                        // printer's own copy
   const char *vendor_ppd_options[PAPPL_MAX_VENDOR]; // Names of the PPD options
                                         // represented as vendor options;
   cups_array_t *ipp_name_lookup;        // Look-up table for the IPP names
-                                        // assigned to vendor PPD options
+                                        // assigned to vendor PPD options,
+                                        // sorted/hashed by PPD option name
+                                        // (shared, from instance)
+  cups_array_t *ipp_name_lookup_ipp;    // Same entries, sorted/hashed by
+                                        // IPP attribute name
+                                        // (shared, from instance)
   char       *human_strings;            // Table of human-readable strings
                                         // from the PPD file, for displaying
                                         // the vendor options in the web UI
+                                        // (shared, from instance)
   char       *human_strings_resource;   // Resource under which we registered
                                         // the human-readable strings
   int        num_inst_options;          // PPD option settings representing 
@@ -93,6 +207,10 @@ typedef struct pr_driver_extension_s	// Driver data extension
                                         // raster input
   char       *temp_ppd_name;            // File name of temporary copy of the
                                         // PPD file to be used by CUPS filters
+                                        // (shared, from instance)
+  pr_driver_instance_t *instance;       // Data shared with other printers
+                                        // using the same driver and
+                                        // accessory settings
   bool       updated;                   // Is the driver data updated for
                                         // "Installable Options" changes?
   pr_printer_app_global_data_t *global_data; // Global data
@@ -106,10 +224,14 @@ typedef struct pr_backend_s
   int		pid,			// Process ID
                 status;			// Exit status
   int		pipe;			// Pipe from backend stdout
+  int		pidfd;			// Process file descriptor, -1 if none
   int		count;			// Number of devices found
   char          buf[4096];              // Buffer to hold backend output
   size_t        bytes;                  // Bytes in the buffer
   bool          done;                   // Sub-process finished?
+  bool          eof;                    // All output read?
+  bool          overflow;               // Skipping rest of too long line?
+  double        start_time;             // Time when backend got started
 } pr_backend_t;
 
 // Global variables for this Printer Application.
@@ -124,12 +246,61 @@ struct pr_printer_app_global_data_s
   pappl_pr_driver_t       *drivers;        // Driver index (for menu and
                                            // auto-add)
   cups_array_t            *ppd_paths,      // List of the paths to each PPD
+                                           // (these 3 are the list being
+                                           // built, only for the code
+                                           // updating the driver list,
+                                           // readers use driver_list)
                           *ppd_collections;// List of all directories providing
                                            // PPD files
-  pr_backend_t            *backend_list;   // Pointer to list of CUPS backends
-                                           // running in discovery mode to find
-                                           // devices, for access by SIGCHLD
-                                           // handler
+  pr_driver_list_t        *driver_list;    // Published driver list
+  cups_array_t            *retired_driver_lists; // Driver lists replaced
+                                           // by updates, PAPPL can still
+                                           // be reading them, kept until
+                                           // shutdown
+  pthread_mutex_t         driver_list_ref_mutex; // Mutex for the references
+                                           // to the driver lists
+  cups_array_t            *cups_devices,   // Devices found by the last
+                                           // discovery of the CUPS backends
+                          *cups_devices_new; // Devices found by the running
+                                           // discovery
+  double                  cups_devices_time; // Time when cups_devices got
+                                           // complete, 0 if none yet
+  bool                    cups_devices_refreshing, // Discovery running?
+                          cups_devices_stale; // Backends changed?
+  pthread_mutex_t         cups_devices_mutex; // Mutex for cups_devices*
+  pthread_cond_t          cups_devices_cond; // Signals new devices and end
+                                           // of discovery
+  cups_array_t            *cups_backends;  // Persistent CUPS backends
+  pthread_mutex_t         cups_backends_mutex; // Mutex for cups_backends*
+  pthread_cond_t          cups_backends_cond; // Wakes up the idle backend
+                                           // reaper
+  bool                    cups_backends_reaper, // Idle backend reaper running?
+                          cups_backends_shutdown; // Shutting down?
+  pthread_mutex_t         driver_list_mutex; // Serializes updates of the
+                                           // driver list
+  pr_driver_matcher_t     *driver_matcher; // Index for finding the best
+                                           // driver for a device
+  pthread_rwlock_t        driver_matcher_lock; // Lock for driver_matcher
+  cups_array_t            *driver_names;   // Driver names returned by
+                                           // prBestMatchingPPD(), kept
+                                           // until shutdown
+  pthread_mutex_t         driver_names_mutex; // Mutex for driver_names
+  pr_dir_watcher_t        *dir_watcher;    // Watcher for PPD, filter, and
+                                           // backend directories
+  cups_array_t            *driver_cache;   // Driver setup results in memory
+  pthread_mutex_t         driver_cache_mutex; // Mutex for driver_cache
+  cups_array_t            *driver_instances; // Shared driver instances
+  pthread_mutex_t         driver_instances_mutex; // Mutex for
+                                           // driver_instances
+  cups_array_t            *ppd_lru;        // Driver instances with their
+                                           // PPDs, least recently used PPD
+                                           // first
+  pthread_mutex_t         ppd_lru_mutex;   // Mutex for PPD memory management
+  pthread_cond_t          ppd_lru_cond;    // Signals that a PPD is loaded
+  size_t                  ppd_memory_budget, // Memory budget for loaded PPDs
+                          ppd_resident_bytes; // Memory used by loaded PPDs
+  unsigned long           ppd_loads,       // Number of PPD loads
+                          ppd_evictions;   // Number of PPD evictions
   // Directories for auxiliary files and components
   char              state_dir[1024];     // State/config file directory,
                                          // customizable via STATE_DIR
@@ -159,11 +330,15 @@ struct pr_printer_app_global_data_s
 // Functions...
 //
 
+extern int    _prCompareDrivers(const void *a, const void *b);
 extern int    _prComparePPDPaths(void *a, void *b, void *data);
 extern void   _prDriverDelete(pappl_printer_t *printer,
 			      pappl_pr_driver_data_t *driver_data);
+extern size_t _prDriverHashSlot(const char **table, size_t size,
+				const char *s, bool nocase);
 extern char   *_prCUPSFilterPath(const char *filter,
 				 const char *filter_dir);
+extern void   _prCUPSFilterPathFlush(void);
 extern char   *_prPPDFindCUPSFilter(const char *input_format,
 				    int num_filters, char **filters,
 				    const char *filter_dir);
@@ -182,6 +357,13 @@ extern void   _prMediaCol(pwg_size_t *pwg_size, const char *def_source,
 			  const char *def_type, int left_offset,
 			  int top_offset, pappl_media_tracking_t tracking,
 			  pappl_media_col_t *col);
+extern ppd_file_t *_prPPDAcquire(pr_driver_extension_t *extension);
+extern void   _prPPDRelease(pr_driver_extension_t *extension);
+extern void   _prPPDRemove(pr_driver_extension_t *extension);
+extern void   _prPPDInstanceRemove(pr_printer_app_global_data_t *global_data,
+				   pr_driver_instance_t *instance);
+extern void   _prPPDSetInstance(pr_driver_extension_t *extension,
+				pr_driver_instance_t *instance);
 extern int    _prPollDeviceOptionDefaults(pappl_printer_t *printer,
 					  bool installable,
 					  cups_option_t **defaults);
@@ -192,6 +374,9 @@ extern void   _prPrinterUpdateForInstallableOptions(
 extern void   _prSetupDriverList(pr_printer_app_global_data_t *global_data);
 extern void   _prSetup(pr_printer_app_global_data_t *global_data);
 extern bool   _prStatus(pappl_printer_t *printer);
+extern void   _prUpdateDriverList(
+				pr_printer_app_global_data_t *global_data,
+				cups_array_t *added, cups_array_t *removed);
 extern bool   _prUpdateStatus(pappl_printer_t *printer,
 			      pappl_device_t *device);
 extern pappl_system_t *_prSystemCB(int num_options, cups_option_t *options,
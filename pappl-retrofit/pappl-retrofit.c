@@ -20,6 +20,84 @@
 #endif
 
 #include <pappl-retrofit/pappl-retrofit-private.h>
+#include <fcntl.h>
+
+
+//
+// Constants...
+//
+
+#define PR_IPP_NAME_HASH_SIZE 256       // Hash size of the PPD/IPP option
+                                        // name look-up tables
+#define PR_REGEX_CACHE_MAX 64           // Maximum number of compiled
+                                        // regular expressions in the cache
+
+// Regular expressions to find page description languages in the
+// "CMD"/"COMMAND SET" field of device IDs
+#define PR_PDL_REGEX_POSTSCRIPT "^(POSTSCRIPT|BRSCRIPT|PS$|PS2$|PS3$)"
+#define PR_PDL_REGEX_PDF        "^(PDF)"
+#define PR_PDL_REGEX_PCL5       "^(PCL([ -]?5([ -]?[ce])?)?)$"
+#define PR_PDL_REGEX_PCL5C      "^(PCL[ -]?5[ -]?c)$"
+#define PR_PDL_REGEX_PCLXL      "^(PCL[ -]?XL|PXL|PCL[ -]?6)$"
+
+
+//
+// Local globals...
+//
+
+// Filter look-up cache, shared by all printers, as they all use the same
+// filter directory
+static cups_array_t    *filter_path_cache = NULL;
+static pthread_mutex_t filter_path_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Compiled regular expressions for matching device ID fields, shared by
+// all threads
+static cups_array_t    *regex_cache = NULL;
+static pthread_mutex_t regex_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// PPD options which are handled by PAPPL/IPP and so do not get a vendor
+// option, sorted case-insensitively for binary search
+static const char * const pappl_handled_options[] =
+{
+  "Duplex",
+  "InputSlot",
+  "MediaType",
+  "OutputBin",
+  "PageRegion",
+  "PageSize"
+};
+
+// Standard IPP attribute names which are not available for vendor
+// options, sorted case-insensitively for binary search
+static const char * const standard_ipp_names[] =
+{
+  "color",
+  "copies",
+  "finishings",
+  "finishings-col",
+  "ipp-attribute-fidelity",
+  "job-mandatory-attributes",
+  "job-name",
+  "job-pages-per-set",
+  "media",
+  "media-col",
+  "media-size",
+  "media-source",
+  "media-type",
+  "multiple-document-handling",
+  "orientation-requested",
+  "output-bin",
+  "output-mode",
+  "overrides",
+  "page-ranges",
+  "print-color-mode",
+  "print-content-optimize",
+  "print-quality",
+  "print-rendering-intent",
+  "print-scaling",
+  "printer-resolution",
+  "sides"
+};
 
 
 //
@@ -68,6 +146,26 @@ prRetroFitPrinterApp(pr_printer_app_config_t *printer_app_config,
 		      &global_data);   // Global data
 
   // Clean up
+  _prDirWatcherStop(&global_data);
+  pthread_mutex_destroy(&global_data.driver_list_mutex);
+  _prDriverMatcherFree(&global_data);
+  pthread_rwlock_destroy(&global_data.driver_matcher_lock);
+  pthread_mutex_destroy(&global_data.driver_names_mutex);
+  _prDriverListsFree(&global_data);
+  pthread_mutex_destroy(&global_data.driver_list_ref_mutex);
+  _prDriverCacheFree(&global_data);
+  pthread_mutex_destroy(&global_data.driver_cache_mutex);
+  cupsArrayDelete(global_data.driver_instances);
+  pthread_mutex_destroy(&global_data.driver_instances_mutex);
+  cupsArrayDelete(global_data.ppd_lru);
+  pthread_mutex_destroy(&global_data.ppd_lru_mutex);
+  pthread_cond_destroy(&global_data.ppd_lru_cond);
+  _prCUPSDevCacheFree(&global_data);
+  pthread_mutex_destroy(&global_data.cups_devices_mutex);
+  pthread_cond_destroy(&global_data.cups_devices_cond);
+  _prCUPSBackendsFree(&global_data);
+  pthread_mutex_destroy(&global_data.cups_backends_mutex);
+  pthread_cond_destroy(&global_data.cups_backends_cond);
   cupsArrayDelete(global_data.config->spooling_conversions);
   cupsArrayDelete(global_data.config->stream_formats);
   if (global_data.config->driver_selection_regex_list)
@@ -99,176 +197,224 @@ const char *			// O - Driver name or `NULL` for none
 prBestMatchingPPD(const char *device_id,	// I - IEEE-1284 device ID
 		  pr_printer_app_global_data_t *global_data)
 {
-  int           i, j;
-  const char	*ret = NULL;		// Return value
-  int		num_did;		// Number of device ID key/value pairs
-  cups_option_t	*did = NULL;		// Device ID key/value pairs
-  int		num_ddid;		// Device ID of driver list entry
-  cups_option_t	*ddid = NULL;		// Device ID of driver list entry
-  const char	*mfg, *dmfg, *mdl, *dmdl; // Device ID fields
-  char          buf[1024];
-  int           score, best_score = 0,
-                best = -1;
-  cups_array_t  *compiled_re_list = NULL;
-  regex_t       *re;
-  const char    *regex;
-  int           num_drivers = global_data->num_drivers;
-  pappl_pr_driver_t *drivers = global_data->drivers;
-
-
-  if (device_id == NULL || num_drivers == 0 || drivers == NULL)
-    return (NULL);
+  // Score only the drivers which match make and model, using the
+  // matcher index built together with the driver list. If none of the
+  // PPDs matches we get the generic PPD if we have one
+  return (_prDriverMatcherBest(global_data, device_id));
+}
 
-  // Parse the IEEE-1284 device ID to see if this is a printer we support...
-  num_did = papplDeviceParseID(device_id, &did);
-  if (num_did == 0 || did == NULL)
-    return (NULL);
+//
+// 'regex_cache_compare()' - Compare function for the compiled regular
+//                           expression cache
+//
+
+static int
+regex_cache_compare(pr_regex_cache_t *a, // I - First entry
+		    pr_regex_cache_t *b, // I - Second entry
+		    void             *data) // I - Unused
+{
+  int ret;
+
+
+  (void)data;
+  if ((ret = strcmp(a->pattern, b->pattern)) != 0)
+    return (ret);
+  return (a->cflags - b->cflags);
+}
+
+
+//
+// 'regex_cache_get()' - Get a compiled regular expression from the cache,
+//                       compiling and adding it if it is not there yet.
+//                       Compiled expressions are never removed and can
+//                       be used by several threads at once. When the
+//                       cache is full, the expression gets compiled into
+//                       a new entry which the caller has to free with
+//                       regex_cache_release().
+//
+
+static pr_regex_cache_t *               // O - Cache entry or NULL on error
+regex_cache_get(const char *pattern,    // I - Regular expression
+		int        cflags,      // I - Flags for regcomp()
+		int        *err)        // O - -3 on invalid expression, -5 if
+                                        //     out of memory
+{
+  pr_regex_cache_t search,              // Search key
+                   *entry;              // Cache entry
+
+
+  search.pattern = (char *)pattern;
+  search.cflags  = cflags;
+
+  pthread_mutex_lock(&regex_cache_mutex);
 
-  // Make and model
-  if ((mfg = cupsGetOption("MANUFACTURER", num_did, did)) == NULL)
-    mfg = cupsGetOption("MFG", num_did, did);
-  if ((mdl = cupsGetOption("MODEL", num_did, did)) == NULL)
-    mdl = cupsGetOption("MDL", num_did, did);
+  if (!regex_cache)
+    regex_cache = cupsArrayNew((cups_array_func_t)regex_cache_compare, NULL);
 
-  if (mfg && mdl)
+  if ((entry = (pr_regex_cache_t *)cupsArrayFind(regex_cache, &search)) ==
+      NULL)
   {
-    // Normalize device ID to format of driver name and match
-    cfIEEE1284NormalizeMakeModel(device_id, NULL,
-				 CF_IEEE1284_NORMALIZE_IPP, NULL,
-				 buf, sizeof(buf),
-				 NULL, NULL, NULL);
-
-    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
-	     "Device ID to match: %s", device_id);
-    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
-	     "Normalized make and model to match against driver name: %s", buf);
-    // Compile regular expressions to prioritize drivers
-    if (global_data->config->driver_selection_regex_list)
+    if ((entry = (pr_regex_cache_t *)calloc(1, sizeof(pr_regex_cache_t))) ==
+	NULL ||
+	(entry->pattern = strdup(pattern)) == NULL)
     {
-      compiled_re_list = cupsArrayNew(NULL, NULL);
-      for (regex = (const char *)
-	     cupsArrayFirst(global_data->config->driver_selection_regex_list);
-	   regex;
-	   regex = (const char *)
-	     cupsArrayNext(global_data->config->driver_selection_regex_list))
-      {
-	if ((re = (regex_t *)calloc(1, sizeof(regex_t))) != NULL)
-        {
-	  if (regcomp(re, regex, REG_ICASE | REG_EXTENDED | REG_NOSUB))
-	  {
-	    regfree(re);
-	    papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
-		     "Invalid regular expression: %s", regex);
-	    continue;
-	  }
-	}
-	else
-	{
-	  papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
-		   "Out of memory, cannot add more regular expressions to driver prioritization list, first not included one is: %s", regex);
-	  break;
-	}
-	cupsArrayAdd(compiled_re_list, re);
-      }
+      free(entry);
+      *err = -5;
+      entry = NULL;
     }
-
-    // Match make and model with device ID of driver list entry
-    for (i = 1; i < num_drivers; i ++)
+    else if (regcomp(&entry->re, pattern, cflags))
+    {
+      free(entry->pattern);
+      free(entry);
+      *err = -3;
+      entry = NULL;
+    }
+    else
     {
-      score = 0;
+      entry->cflags = cflags;
+      if (cupsArrayCount(regex_cache) < PR_REGEX_CACHE_MAX)
+	cupsArrayAdd(regex_cache, entry);
+      else
+	entry->temporary = true;
+    }
+  }
 
-      // Match make and model with device ID of driver list entry
-      if (drivers[i].device_id[0] &&
-	  (num_ddid = papplDeviceParseID(drivers[i].device_id, &ddid)) > 0 &&
-	  ddid != NULL)
-      {
-	if ((dmfg = cupsGetOption("MANUFACTURER", num_ddid, ddid)) == NULL)
-	  dmfg = cupsGetOption("MFG", num_ddid, ddid);
-	if ((dmdl = cupsGetOption("MODEL", num_ddid, ddid)) == NULL)
-	  dmdl = cupsGetOption("MDL", num_ddid, ddid);
-	if (dmfg && dmdl &&
-	    strcasecmp(mfg, dmfg) == 0 &&
-	    strcasecmp(mdl, dmdl) == 0)
-	  // Match
-	  score += 16000;
-	cupsFreeOptions(num_ddid, ddid);
-      }
+  pthread_mutex_unlock(&regex_cache_mutex);
 
-      // Match normalized device ID with driver name
-      if (score == 0 && strncmp(buf, drivers[i].name, strlen(buf)) == 0 &&
-	  strlen(drivers[i].name) >= strlen(buf) + 2 &&
-	  drivers[i].name[strlen(buf)] == '-' &&
-	  drivers[i].name[strlen(buf) + 1] == '-')
-	// Match
-	score += 8000;
+  return (entry);
+}
 
-      // PPD must at least match make and model to get considered
-      if (score == 0)
-	continue;
 
-      // User-added? Prioritize, as if the user adds something, he wants
-      // to use it
-      if (strstr(drivers[i].name, "-user-added"))
-	score += 32000;
+//
+// 'regex_cache_release()' - Free a compiled regular expression which did
+//                           not fit into the cache any more.
+//
+
+static void
+regex_cache_release(pr_regex_cache_t *entry) // I - Cache entry
+{
+  if (entry && entry->temporary)
+  {
+    regfree(&entry->re);
+    free(entry->pattern);
+    free(entry);
+  }
+}
+
 
-      // PPD matches user's/system's language?
-      // To be added when PAPPL supports internationalization (TODO)
-      // score + 2 for 2-char language
-      // score + 4 for 5-char language/country
+//
+// 'prDevIDNew()' - Parse an IEEE-1284 device ID into an object which
+//                  can be used for several look-ups and matches with
+//                  prDevIDRegExMatchField() and the prDevIDSupports*()
+//                  functions, so that the device ID gets parsed only
+//                  once.
+//
 
-      // PPD is English language version?
-      if (!strcmp(drivers[i].name + strlen(drivers[i].name) - 3, "-en") ||
-	  !strncmp(drivers[i].name + strlen(drivers[i].name) - 6, "-en-", 4))
-	score += 1;
+pr_devid_t *                            // O - Parsed device ID, NULL if
+                                        //     the device ID is invalid
+prDevIDNew(const char *device_id)       // I - IEEE-1284 device ID
+{
+  pr_devid_t *devid;                    // Parsed device ID
 
-      // Match the regular expressions on the driver name
-      if (compiled_re_list)
-      {
-	for (j = 0, re = (regex_t *)cupsArrayFirst(compiled_re_list);
-	     re; j ++, re = (regex_t *)cupsArrayNext(compiled_re_list))
-	{
-	  if (!regexec(re, drivers[i].name, 0, NULL, 0))
-	  {
-	    // Regular expression matches
-	    score += (4000 - 10 * j);
-	    papplLog(global_data->system, PAPPL_LOGLEVEL_DEBUG,
-		     "Driver %s matched driver priority regular expression %d: \"%s\"",
-		     drivers[i].name, j + 1,
-		     (char *)cupsArrayIndex(
-		       global_data->config->driver_selection_regex_list, j));
-	    break;
-	  }
-	}
-      }
 
-      // Better match than the previous one?
-      if (score > best_score)
-      {
-	best_score = score;
-	best = i;
-      }
-    }
+  if (!device_id || !device_id[0])
+    return (NULL);
+
+  if ((devid = (pr_devid_t *)calloc(1, sizeof(pr_devid_t))) == NULL)
+    return (NULL);
+
+  devid->num_fields = papplDeviceParseID(device_id, &devid->fields);
+  if (devid->num_fields == 0 || devid->fields == NULL)
+  {
+    prDevIDDelete(devid);
+    return (NULL);
+  }
+
+  return (devid);
+}
+
+
+//
+// 'prDevIDDelete()' - Free a parsed device ID.
+//
+
+void
+prDevIDDelete(pr_devid_t *devid)        // I - Parsed device ID
+{
+  if (!devid)
+    return;
+
+  cupsFreeOptions(devid->num_fields, devid->fields);
+  free(devid);
+}
+
+
+//
+// 'prDevIDRegExMatchField()' - Same as prRegExMatchDevIDField() but on
+//                              a parsed device ID. The regular
+//                              expression gets compiled only once and
+//                              is then taken from a cache.
+//
+
+int                                               // O - >  0: Match(es) found
+                                                  //     =  0: No match
+                                                  //     = -1: Field not found
+                                                  //     < -1: Error
+prDevIDRegExMatchField(pr_devid_t *devid,         // I - Parsed device ID
+		       const char *key,           // I - Name of the field to
+			                          //     match the regexp on
+		       const char *value_regex,   // I - Regular expression
+		       pr_devid_regex_mode_t mode)// I - Matching mode
+{
+  int	        ret = 0;		// Return value
+  const char    *value;                 // String to match the regexp on
+  char          buf[2048];              // Buffer to manipulate the value
+                                        // string in
+  pr_regex_cache_t *re;                 // Compiled regular expression
+  char          *ptr1, *ptr2;
+
+  if (!key || !key[0] || !value_regex || !value_regex[0])
+    return (-4);
+
+  if (!devid)
+    return (-2);
+
+  // Does the device ID contain the requested field?
+  if ((value = cupsGetOption(key, devid->num_fields, devid->fields)) == NULL)
+    return (-1);
+
+  // Get the compiled regular expression
+  if ((re = regex_cache_get(value_regex, REG_ICASE | REG_EXTENDED | REG_NOSUB,
+			    &ret)) == NULL)
+    return (ret);
 
-    if (compiled_re_list)
+  // Copy the value string
+  strncpy(buf, value, sizeof(buf) - 1);
+  buf[sizeof(buf) - 1] = '\0';
+
+  // Go through the value's comma-separated items and match the
+  // regular expression
+  for (ptr1 = buf; *ptr1;)
+  {
+    // Find and mark end of item
+    if (mode == PR_DEVID_REGEX_MATCH_ITEM &&
+	(ptr2 = strchr(ptr1, ',')) != NULL)
     {
-      for (re = (regex_t *)cupsArrayFirst(compiled_re_list);
-	   re; re = (regex_t *)cupsArrayNext(compiled_re_list))
-	regfree(re);
-      cupsArrayDelete(compiled_re_list);
+      *ptr2 = '\0';
+      ptr2 ++;
     }
-  }
+    else
+      ptr2 = ptr1 + strlen(ptr1);
 
-  // Found at least one match? Take the best one
-  if (best >= 0)
-    ret = drivers[best].name;
-  // None of the PPDs matches? Assign the generic PPD if we have one
-  else if (!strcasecmp(drivers[0].name, "generic"))
-    ret = "generic";
-  else
-    ret = NULL;
+    // Match the regular expression on the item
+    if (!regexec(&re->re, ptr1, 0, NULL, 0))
+      ret ++;
 
-  // Clean up
-  cupsFreeOptions(num_did, did);
+    // Next item
+    ptr1 = ptr2;
+  }
+
+  regex_cache_release(re);
 
   return (ret);
 }
@@ -292,6 +438,11 @@ prBestMatchingPPD(const char *device_id,	// I - IEEE-1284 device ID
 //                              0 on no match, and the number of
 //                              matching items otherwise.
 //
+//                              To match several fields or expressions
+//                              on the same device ID, parse it only
+//                              once with prDevIDNew() and use
+//                              prDevIDRegExMatchField().
+//
 
 int                                               // O - >  0: Match(es) found
                                                   //     =  0: No match
@@ -303,74 +454,60 @@ prRegExMatchDevIDField(const char *device_id,     // I - Device ID to search in
 		       const char *value_regex,   // I - Regular expression
 		       pr_devid_regex_mode_t mode)// I - Matching mode
 {
-  int	        ret = 0;		// Return value
-  int		num_did;		// Number of device ID key/value pairs
-  cups_option_t	*did = NULL;		// Device ID key/value pairs
-  const char    *value;                 // String to match the regexp on
-  char          buf[2048];              // Buffer to manipulate the value
-                                        // string in
-  regex_t	*re;                    // Compiled regular expression
-  char          *ptr1, *ptr2;
+  int	        ret;			// Return value
+  pr_devid_t    *devid;                 // Parsed device ID
 
   if (!device_id || !device_id[0] || !key || !key[0] ||
       !value_regex || !value_regex[0])
     return (-4);
 
   // Parse the IEEE-1284 device ID to find the field we are looking after
-  num_did = papplDeviceParseID(device_id, &did);
-  if (num_did == 0 || did == NULL)
+  if ((devid = prDevIDNew(device_id)) == NULL)
     return (-2);
 
-  // Does the device ID contain the requested field?
-  if ((value = cupsGetOption(key, num_did, did)) == NULL)
-  {
-    ret = -1;
-    goto out;
-  }
+  ret = prDevIDRegExMatchField(devid, key, value_regex, mode);
 
-  if ((re = (regex_t *)calloc(1, sizeof(regex_t))) != NULL)
-  {
-    // Compile the regular expression
-    if (regcomp(re, value_regex, REG_ICASE | REG_EXTENDED | REG_NOSUB))
-    {
-      regfree(re);
-      ret = -3;
-      goto out;
-    }
+  prDevIDDelete(devid);
 
-    // Copy the value string
-    strncpy(buf, value, sizeof(buf) - 1);
+  return (ret);
+}
 
-    // Go through the value's comma-separated items and match the
-    // regular expression
-    for (ptr1 = buf; *ptr1;)
-    {
-      // Find and mark end of item
-      if (mode == PR_DEVID_REGEX_MATCH_ITEM &&
-	  (ptr2 = strchr(ptr1, ',')) != NULL)
-      {
-	*ptr2 = '\0';
-	ptr2 ++;
-      }
-      else
-	ptr2 = ptr1 + strlen(ptr1);
 
-      // Match the regular expression on the item
-      if (!regexec(re, ptr1, 0, NULL, 0))
-	ret ++;
+//
+// 'devid_supports_pdl()' - Check whether one of the PDLs in the
+//                          "CMD"/"COMMAND SET" field of a parsed device
+//                          ID matches a regular expression
+//
 
-      // Next item
-      ptr1 = ptr2;
-    }
+static bool
+devid_supports_pdl(pr_devid_t *devid,   // I - Parsed device ID
+		   const char *regexp)  // I - Regular expression
+{
+  return (prDevIDRegExMatchField(devid, "CMD",
+				 regexp, PR_DEVID_REGEX_MATCH_ITEM) > 0 ||
+	  prDevIDRegExMatchField(devid, "COMMAND SET",
+				 regexp, PR_DEVID_REGEX_MATCH_ITEM) > 0);
+}
 
-    regfree(re);
-  }
-  else
-    ret = -5;
 
- out:
-  // Clean up
-  cupsFreeOptions(num_did, did);
+//
+// 'supports_pdl()' - Check whether one of the PDLs in the "CMD"/"COMMAND
+//                    SET" field of a device ID matches a regular
+//                    expression, parsing the device ID only once
+//
+
+static bool
+supports_pdl(const char *device_id,     // I - IEEE-1284 device ID
+	     const char *regexp)        // I - Regular expression
+{
+  bool       ret;                       // Return value
+  pr_devid_t *devid;                    // Parsed device ID
+
+
+  if ((devid = prDevIDNew(device_id)) == NULL)
+    return (false);
+  ret = devid_supports_pdl(devid, regexp);
+  prDevIDDelete(devid);
 
   return (ret);
 }
@@ -384,11 +521,7 @@ prRegExMatchDevIDField(const char *device_id,     // I - Device ID to search in
 bool
 prSupportsPostScript(const char *device_id)
 {
-  const char *regexp = "^(POSTSCRIPT|BRSCRIPT|PS$|PS2$|PS3$)";
-  return(prRegExMatchDevIDField(device_id, "CMD",
-				regexp, PR_DEVID_REGEX_MATCH_ITEM) > 0 ||
-	 prRegExMatchDevIDField(device_id, "COMMAND SET",
-				regexp, PR_DEVID_REGEX_MATCH_ITEM) > 0);
+  return (supports_pdl(device_id, PR_PDL_REGEX_POSTSCRIPT));
 }
 
 
@@ -400,11 +533,7 @@ prSupportsPostScript(const char *device_id)
 bool
 prSupportsPDF(const char *device_id)
 {
-  const char *regexp = "^(PDF)";
-  return(prRegExMatchDevIDField(device_id, "CMD",
-				regexp, PR_DEVID_REGEX_MATCH_ITEM) > 0 ||
-	 prRegExMatchDevIDField(device_id, "COMMAND SET",
-				regexp, PR_DEVID_REGEX_MATCH_ITEM) > 0);
+  return (supports_pdl(device_id, PR_PDL_REGEX_PDF));
 }
 
 
@@ -416,11 +545,7 @@ prSupportsPDF(const char *device_id)
 bool
 prSupportsPCL5(const char *device_id)
 {
-  const char *regexp = "^(PCL([ -]?5([ -]?[ce])?)?)$";
-  return(prRegExMatchDevIDField(device_id, "CMD",
-				regexp, PR_DEVID_REGEX_MATCH_ITEM) > 0 ||
-	 prRegExMatchDevIDField(device_id, "COMMAND SET",
-				regexp, PR_DEVID_REGEX_MATCH_ITEM) > 0);
+  return (supports_pdl(device_id, PR_PDL_REGEX_PCL5));
 }
 
 
@@ -432,11 +557,7 @@ prSupportsPCL5(const char *device_id)
 bool
 prSupportsPCL5c(const char *device_id)
 {
-  const char *regexp = "^(PCL[ -]?5[ -]?c)$";
-  return(prRegExMatchDevIDField(device_id, "CMD",
-				regexp, PR_DEVID_REGEX_MATCH_ITEM) > 0 ||
-	 prRegExMatchDevIDField(device_id, "COMMAND SET",
-				regexp, PR_DEVID_REGEX_MATCH_ITEM) > 0);
+  return (supports_pdl(device_id, PR_PDL_REGEX_PCL5C));
 }
 
 
@@ -448,11 +569,67 @@ prSupportsPCL5c(const char *device_id)
 bool
 prSupportsPCLXL(const char *device_id)
 {
-  const char *regexp = "^(PCL[ -]?XL|PXL|PCL[ -]?6)$";
-  return(prRegExMatchDevIDField(device_id, "CMD",
-				regexp, PR_DEVID_REGEX_MATCH_ITEM) > 0 ||
-	 prRegExMatchDevIDField(device_id, "COMMAND SET",
-				regexp, PR_DEVID_REGEX_MATCH_ITEM) > 0);
+  return (supports_pdl(device_id, PR_PDL_REGEX_PCLXL));
+}
+
+
+//
+// 'prDevIDSupportsPostScript()' - Check by a parsed device ID whether a
+//                                 printer supports PostScript
+//
+
+bool
+prDevIDSupportsPostScript(pr_devid_t *devid)	// I - Parsed device ID
+{
+  return (devid_supports_pdl(devid, PR_PDL_REGEX_POSTSCRIPT));
+}
+
+
+//
+// 'prDevIDSupportsPDF()' - Check by a parsed device ID whether a printer
+//                          supports PDF
+//
+
+bool
+prDevIDSupportsPDF(pr_devid_t *devid)	// I - Parsed device ID
+{
+  return (devid_supports_pdl(devid, PR_PDL_REGEX_PDF));
+}
+
+
+//
+// 'prDevIDSupportsPCL5()' - Check by a parsed device ID whether a printer
+//                           supports PCL 5(c/e)
+//
+
+bool
+prDevIDSupportsPCL5(pr_devid_t *devid)	// I - Parsed device ID
+{
+  return (devid_supports_pdl(devid, PR_PDL_REGEX_PCL5));
+}
+
+
+//
+// 'prDevIDSupportsPCL5c()' - Check by a parsed device ID whether a printer
+//                            supports PCL 5c (color)
+//
+
+bool
+prDevIDSupportsPCL5c(pr_devid_t *devid)	// I - Parsed device ID
+{
+  return (devid_supports_pdl(devid, PR_PDL_REGEX_PCL5C));
+}
+
+
+//
+// 'prDevIDSupportsPCLXL()' - Check by a parsed device ID whether a printer
+//                            supports PCL-XL
+//
+
+bool
+prDevIDSupportsPCLXL(pr_devid_t *devid)	// I - Parsed device ID
+{
+  return (devid_supports_pdl(devid, PR_PDL_REGEX_PCLXL));
 }
 
 
@@ -503,7 +680,8 @@ prPSIdentify(
 
   papplPrinterGetDriverData(printer, &driver_data);
   extension = (pr_driver_extension_t *)driver_data.extension;
-  ppd = extension->ppd;
+  if ((ppd = _prPPDAcquire(extension)) == NULL)
+    return;
 
   // Note: We directly output to the printer device without using
   //       _prPrintFilterFunction() as only use printf()/puts() and
@@ -539,6 +717,8 @@ prPSIdentify(
   else
     papplDevicePuts(device, "\004");
   papplDeviceFlush(device);
+
+  _prPPDRelease(extension);
 }
 
 
@@ -618,15 +798,11 @@ prIdentify(
     if (!device_data->backend_pid && !_prCUPSDevLaunchBackend(device))
       return;
 
-    // Standard FD for the side channel is 4, the CUPS library
-    // functions use always FD 4. Therefore we redirect our side
-    // channel pipe end to FD 4
-    dup2(device_data->sidefd, 4);
-
     datalen = 0;
-    if ((sc_status = cupsSideChannelDoRequest(CUPS_SC_CMD_SOFT_RESET, NULL,
-					      &datalen,
-					      device_data->side_timeout)) !=
+    if ((sc_status =
+	 _prCUPSSideChannelDoRequest(device_data->sidefd,
+				     CUPS_SC_CMD_SOFT_RESET, NULL, &datalen,
+				     device_data->side_timeout)) !=
 	CUPS_SC_STATUS_OK)
 	papplDeviceError(device, "Side channel error status: %s",
 			 pr_cups_sc_status_str[sc_status]);
@@ -670,93 +846,510 @@ _prComparePPDPaths(void *a,
 
 
 //
-// '_prDriverDelete()' - Free dynamic data structures of the driver
-//                       when removing a printer.
+// 'hash_ipp_name()' - Hash of an option name for the PPD/IPP option name
+//                     look-up tables. PPD keywords and IPP attribute
+//                     names are both case-sensitive.
 //
 
-void
-_prDriverDelete(
-    pappl_printer_t *printer,              // I - Printer to be removed
-    pappl_pr_driver_data_t *driver_data)   // I - Printer's driver data
+static int                               // O - Hash value
+hash_ipp_name(const char *name)          // I - Option name
 {
-  int                   i;
-  pr_driver_extension_t *extension;
-  ipp_name_lookup_t     *opt_name;
+  uint64_t hash = PR_FNV_OFFSET;         // Hash value
 
 
-  if (printer)
-    papplLogPrinter(printer, PAPPL_LOGLEVEL_DEBUG,
-		    "Freeing memory from driver data");
+  for (; *name; name ++)
+  {
+    hash ^= (unsigned char)*name;
+    hash *= PR_FNV_PRIME;
+  }
 
-  extension = (pr_driver_extension_t *)driver_data->extension;
+  return ((int)(hash % PR_IPP_NAME_HASH_SIZE));
+}
 
-  // PPD file
 
-  // We do the removal of the PPD cache separately to assure that the
-  // function of libppd (and not of libcups) is used, as in libppd the
-  // PPD cache data structure is different (Content optimize presets
-  // added).
-  ppdCacheDestroy(extension->ppd->cache);
-  extension->ppd->cache = NULL;
-  ppdClose(extension->ppd);
+//
+// 'compare_ipp_names_ppd()' - Compare function for the PPD/IPP option name
+//                             look-up table, by PPD option name.
+//
 
-  // Media source
-  for (i = 0; i < driver_data->num_source; i ++)
-    if (driver_data->source[i])
-      free((char *)(driver_data->source[i]));
+static int
+compare_ipp_names_ppd(ipp_name_lookup_t *a, // I - First entry
+		      ipp_name_lookup_t *b, // I - Second entry
+		      void              *data) // I - Unused
+{
+  (void)data;
+  return (strcmp(a->ppd, b->ppd));
+}
 
-  // Media type
-  for (i = 0; i < driver_data->num_type; i ++)
-    if (driver_data->type[i])
-      free((char *)(driver_data->type[i]));
 
-  // Media size
-  for (i = 0; i < driver_data->num_media; i ++)
-    if (driver_data->media[i])
-      free((char *)(driver_data->media[i]));
+//
+// 'compare_ipp_names_ipp()' - Compare function for the PPD/IPP option name
+//                             look-up table, by IPP attribute name.
+//
 
-  // Output bins
-  for (i = 0; i < driver_data->num_bin; i ++)
-    if (driver_data->bin[i])
-      free((char *)(driver_data->bin[i]));
+static int
+compare_ipp_names_ipp(ipp_name_lookup_t *a, // I - First entry
+		      ipp_name_lookup_t *b, // I - Second entry
+		      void              *data) // I - Unused
+{
+  (void)data;
+  return (strcmp(a->ipp, b->ipp));
+}
 
-  // Vendor options
-  for (i = 0; i < driver_data->num_vendor; i ++)
-  {
-    if (driver_data->vendor[i])
-      free((char *)(driver_data->vendor[i]));
-    if (extension->vendor_ppd_options[i])
-      free((char *)(extension->vendor_ppd_options[i]));
+
+//
+// 'hash_ipp_names_ppd()' - Hash function for the PPD/IPP option name
+//                          look-up table, by PPD option name.
+//
+
+static int
+hash_ipp_names_ppd(ipp_name_lookup_t *entry, // I - Entry
+		   void              *data)  // I - Unused
+{
+  (void)data;
+  return (hash_ipp_name(entry->ppd));
+}
+
+
+//
+// 'hash_ipp_names_ipp()' - Hash function for the PPD/IPP option name
+//                          look-up table, by IPP attribute name.
+//
+
+static int
+hash_ipp_names_ipp(ipp_name_lookup_t *entry, // I - Entry
+		   void              *data)  // I - Unused
+{
+  (void)data;
+  return (hash_ipp_name(entry->ipp));
+}
+
+
+//
+// 'compare_driver_instances()' - Compare function for the list of shared
+//                                driver instances
+//
+
+static int
+compare_driver_instances(pr_driver_instance_t *a,
+			 pr_driver_instance_t *b,
+			 void                 *data)
+{
+  (void)data;
+  return (strcmp(a->key, b->key));
+}
+
+
+//
+// 'driver_instance_get()' - Get the shared instance of a driver with the
+//                           given installable accessory settings, create
+//                           it if no other printer uses it yet.
+//
+//                           The instance is identified by the driver
+//                           name, the identity of the PPD (path and
+//                           modification time of the source file), and
+//                           the accessory settings. Printers which are
+//                           not configured for their accessories yet
+//                           (Init mode of _prDriverSetup()) share an
+//                           instance of their own, also if the settings
+//                           are empty.
+//
+
+static pr_driver_instance_t *              // O - Driver instance
+driver_instance_get(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    const char                   *driver_name, // I - Driver name
+    const char                   *ppd_path,    // I - PPD path
+    bool                         configured,   // I - Accessories configured?
+    int                          num_inst_options, // I - Number of settings
+    cups_option_t                *inst_options) // I - Accessory settings
+{
+  int                  i;                     // Looping variable
+  size_t               len;                   // Length of key
+  cups_option_t        *opt;                  // Current setting
+  char                 *ptr;                  // Pointer into key
+  pr_driver_instance_t search,
+                       *instance;
+
+
+  // Key, the settings are sorted by cupsAddOption()/cupsParseOptions()
+  len = strlen(driver_name) + 20;
+  for (i = num_inst_options, opt = inst_options; i > 0; i --, opt ++)
+    len += strlen(opt->name) + strlen(opt->value) + 2;
+  if ((search.key = (char *)malloc(len)) == NULL)
+    return (NULL);
+  snprintf(search.key, len, "%s\t%016llx\t%c", driver_name,
+	   (unsigned long long)_prPPDIdentity(global_data, ppd_path),
+	   configured ? '+' : '-');
+  for (i = num_inst_options, opt = inst_options, ptr = search.key;
+       i > 0;
+       i --, opt ++)
+  {
+    ptr += strlen(ptr);
+    snprintf(ptr, len - (size_t)(ptr - search.key), " %s=%s", opt->name,
+	     opt->value);
   }
 
-  // Extension
+  pthread_mutex_lock(&global_data->driver_instances_mutex);
+
+  if (!global_data->driver_instances)
+    global_data->driver_instances =
+      cupsArrayNew((cups_array_func_t)compare_driver_instances, NULL);
+
+  if ((instance = (pr_driver_instance_t *)
+       cupsArrayFind(global_data->driver_instances, &search)) == NULL &&
+      (instance = (pr_driver_instance_t *)
+       calloc(1, sizeof(pr_driver_instance_t))) != NULL)
+  {
+    instance->key         = search.key;
+    search.key            = NULL;
+    instance->driver_name = strdup(driver_name);
+    instance->ppd_path    = strdup(ppd_path);
+    for (i = num_inst_options, opt = inst_options; i > 0; i --, opt ++)
+      instance->num_inst_options =
+	cupsAddOption(opt->name, opt->value, instance->num_inst_options,
+		      &instance->inst_options);
+    instance->ipp_name_lookup =
+      cupsArrayNew3((cups_array_func_t)compare_ipp_names_ppd, NULL,
+		    (cups_ahash_func_t)hash_ipp_names_ppd,
+		    PR_IPP_NAME_HASH_SIZE, NULL, NULL);
+    instance->ipp_name_lookup_ipp =
+      cupsArrayNew3((cups_array_func_t)compare_ipp_names_ipp, NULL,
+		    (cups_ahash_func_t)hash_ipp_names_ipp,
+		    PR_IPP_NAME_HASH_SIZE, NULL, NULL);
+    pthread_mutex_init(&instance->mutex, NULL);
+    cupsArrayAdd(global_data->driver_instances, instance);
+  }
+  if (instance)
+    instance->ref_count ++;
+
+  pthread_mutex_unlock(&global_data->driver_instances_mutex);
+
+  free(search.key);
+
+  return (instance);
+}
+
+
+//
+// 'driver_instance_release()' - Release a printer's reference to a shared
+//                               driver instance, free the instance when
+//                               the last printer using it is gone.
+//
+
+static void
+driver_instance_release(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    pr_driver_instance_t         *instance)    // I - Driver instance
+{
+  ipp_name_lookup_t *opt_name;          // Look-up table entry
+
+
+  if (!instance)
+    return;
+
+  pthread_mutex_lock(&global_data->driver_instances_mutex);
+
+  if (-- instance->ref_count > 0)
+  {
+    pthread_mutex_unlock(&global_data->driver_instances_mutex);
+    return;
+  }
+
+  cupsArrayRemove(global_data->driver_instances, instance);
+
+  pthread_mutex_unlock(&global_data->driver_instances_mutex);
+
+  _prPPDInstanceRemove(global_data, instance);
+  if (instance->temp_ppd_name)
+  {
+    if (instance->temp_ppd_temporary)
+      unlink(instance->temp_ppd_name);
+    free(instance->temp_ppd_name);
+  }
   for (opt_name =
-	 (ipp_name_lookup_t *)cupsArrayFirst(extension->ipp_name_lookup);
+	 (ipp_name_lookup_t *)cupsArrayFirst(instance->ipp_name_lookup);
        opt_name;
        opt_name =
-	 (ipp_name_lookup_t *)cupsArrayNext(extension->ipp_name_lookup))
+	 (ipp_name_lookup_t *)cupsArrayNext(instance->ipp_name_lookup))
   {
+    free(opt_name->ppd);
     free(opt_name->ipp);
     free(opt_name);
   }
-  cupsArrayDelete(extension->ipp_name_lookup);
+  cupsArrayDelete(instance->ipp_name_lookup);
+  cupsArrayDelete(instance->ipp_name_lookup_ipp);
+  pthread_mutex_destroy(&instance->mutex);
+  cupsFreeOptions(instance->num_inst_options, instance->inst_options);
+  free(instance->human_strings);
+  free(instance->ppd_path);
+  free(instance->driver_name);
+  free(instance->key);
+  free(instance);
+}
+
+
+//
+// 'driver_instance_share_strings()' - Replace the human-readable strings
+//                                     of a printer by the identical ones
+//                                     of the shared driver instance (also
+//                                     if the printer has not built any),
+//                                     or hand them over to the instance
+//                                     if it has none yet.
+//
+
+static void
+driver_instance_share_strings(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    pr_driver_extension_t        *extension)   // I - Driver extension
+{
+  pr_driver_instance_t *instance = extension->instance;
+
+
+  if (!instance)
+    return;
+
+  pthread_mutex_lock(&global_data->driver_instances_mutex);
+
+  if (instance->human_strings)
+  {
+    free(extension->human_strings);
+    extension->human_strings = instance->human_strings;
+  }
+  else
+    instance->human_strings = extension->human_strings;
+
+  pthread_mutex_unlock(&global_data->driver_instances_mutex);
+}
+
+
+//
+// 'driver_instance_switch()' - Move a printer to the driver instance for
+//                              its (new) installable accessory settings.
+//                              The human-readable strings and the
+//                              physical PPD file are the same for all
+//                              instances of a driver, the new instance
+//                              takes them over if it does not have them
+//                              yet.
+//
+
+static void
+driver_instance_switch(
+    pappl_system_t        *system,     // I - System
+    pr_driver_extension_t *extension)  // I - Driver extension
+{
+  pr_printer_app_global_data_t *global_data = extension->global_data;
+  pr_driver_instance_t *old = extension->instance,
+                       *instance;
+  bool                 need_file,      // Does the instance need a PPD file?
+                       temporary = false; // Temporary PPD file?
+  char                 filename[1024]; // Physical PPD file
+
+
+  if (!old ||
+      (instance = driver_instance_get(global_data, old->driver_name,
+				      extension->ppd_path, true,
+				      extension->num_inst_options,
+				      extension->inst_options)) == NULL)
+    return;
+
+  if (instance == old)
+  {
+    driver_instance_release(global_data, instance);
+    return;
+  }
+
+  // A temporary PPD file gets removed with the old instance, so get a
+  // file of our own in this case, without blocking the other printers
+  // meanwhile
+  pthread_mutex_lock(&global_data->driver_instances_mutex);
+  if ((need_file = (old->temp_ppd_name && !instance->temp_ppd_name)) &&
+      !(temporary = old->temp_ppd_temporary))
+    strncpy(filename, old->temp_ppd_name, sizeof(filename) - 1);
+  filename[sizeof(filename) - 1] = '\0';
+  pthread_mutex_unlock(&global_data->driver_instances_mutex);
+  if (need_file && temporary &&
+      !_prPPDMaterialize(global_data, extension->ppd_path, filename,
+			 sizeof(filename), &temporary))
+    need_file = temporary = false;
+
+  pthread_mutex_lock(&global_data->driver_instances_mutex);
+  if (!instance->human_strings && old->human_strings)
+    instance->human_strings = strdup(old->human_strings);
+  if (need_file && !instance->temp_ppd_name)
+  {
+    instance->temp_ppd_name      = strdup(filename);
+    instance->temp_ppd_temporary = temporary;
+    temporary                    = false;
+  }
+  if (extension->human_strings)
+    extension->human_strings = instance->human_strings;
+  if (extension->temp_ppd_name)
+    extension->temp_ppd_name = instance->temp_ppd_name;
+  extension->ipp_name_lookup     = instance->ipp_name_lookup;
+  extension->ipp_name_lookup_ipp = instance->ipp_name_lookup_ipp;
+  pthread_mutex_unlock(&global_data->driver_instances_mutex);
+
+  if (temporary)
+    unlink(filename);
+
+  // The web interface reads the strings from where we have registered
+  // them
+  if (extension->human_strings_resource && extension->human_strings)
+  {
+    papplSystemRemoveResource(system, extension->human_strings_resource);
+    papplSystemAddStringsData(system, extension->human_strings_resource,
+			      "en", extension->human_strings);
+  }
+
+  _prPPDSetInstance(extension, instance);
+  driver_instance_release(global_data, old);
+}
+
+
+//
+// '_prDriverDelete()' - Free dynamic data structures of the driver
+//                       when removing a printer.
+//
+
+void
+_prDriverDelete(
+    pappl_printer_t *printer,              // I - Printer to be removed
+    pappl_pr_driver_data_t *driver_data)   // I - Printer's driver data
+{
+  int                   i;
+  pr_driver_extension_t *extension;
+
+
+  if (printer)
+    papplLogPrinter(printer, PAPPL_LOGLEVEL_DEBUG,
+		    "Freeing memory from driver data");
+
+  extension = (pr_driver_extension_t *)driver_data->extension;
+
+  // PPD file (belongs to the shared driver instance)
+  _prPPDRemove(extension);
+  free(extension->ppd_path);
+
+  // Media source
+  for (i = 0; i < driver_data->num_source; i ++)
+    if (driver_data->source[i])
+      free((char *)(driver_data->source[i]));
+
+  // Media type
+  for (i = 0; i < driver_data->num_type; i ++)
+    if (driver_data->type[i])
+      free((char *)(driver_data->type[i]));
+
+  // Media size
+  for (i = 0; i < driver_data->num_media; i ++)
+    if (driver_data->media[i])
+      free((char *)(driver_data->media[i]));
+
+  // Output bins
+  for (i = 0; i < driver_data->num_bin; i ++)
+    if (driver_data->bin[i])
+      free((char *)(driver_data->bin[i]));
+
+  // Vendor options
+  for (i = 0; i < driver_data->num_vendor; i ++)
+  {
+    if (driver_data->vendor[i])
+      free((char *)(driver_data->vendor[i]));
+    if (extension->vendor_ppd_options[i])
+      free((char *)(extension->vendor_ppd_options[i]));
+  }
+
+  // Extension
   if (extension->human_strings_resource)
   {
     papplSystemRemoveResource(extension->global_data->system,
 			      extension->human_strings_resource);
     free(extension->human_strings_resource);
   }
-  if (extension->human_strings)
-    free(extension->human_strings);
   if (extension->num_inst_options)
     cupsFreeOptions(extension->num_inst_options, extension->inst_options);
   free(extension->stream_filter);
-  if (extension->temp_ppd_name)
+  // Human-readable strings, temporary PPD file, and the option name
+  // look-up tables belong to the shared driver instance
+  if (extension->instance)
+    driver_instance_release(extension->global_data, extension->instance);
+  else
+    free(extension->human_strings);
+  free(extension);
+}
+
+
+//
+// 'compare_filter_paths()' - Compare function for the filter look-up cache
+//
+
+static int
+compare_filter_paths(pr_filter_path_t *a, // I - First entry
+		     pr_filter_path_t *b, // I - Second entry
+		     void             *data) // I - Unused
+{
+  (void)data;
+  return (strcmp(a->path, b->path));
+}
+
+
+//
+// 'free_filter_path()' - Free an entry of the filter look-up cache
+//
+
+static void
+free_filter_path(pr_filter_path_t *entry, // I - Entry
+		 void             *data)  // I - Unused
+{
+  (void)data;
+  free(entry->path);
+  free(entry);
+}
+
+
+//
+// 'filter_executable()' - Check whether a filter is an executable file,
+//                         remembering the filters found, as the filters
+//                         get checked by every printer setup and print
+//                         job. Missing filters are not remembered, so
+//                         that they are found as soon as they get
+//                         installed, also outside the watched filter
+//                         directory.
+//
+
+static bool                     // O - `true` if executable
+filter_executable(const char *filter_path) // I - Absolute path of filter
+{
+  pr_filter_path_t key,         // Search key
+                   *entry;      // Cache entry
+  bool             executable;  // Is the filter executable?
+
+
+  key.path = (char *)filter_path;
+  pthread_mutex_lock(&filter_path_mutex);
+  if (!filter_path_cache)
+    filter_path_cache =
+      cupsArrayNew3((cups_array_func_t)compare_filter_paths, NULL, NULL, 0,
+		    NULL, (cups_afree_func_t)free_filter_path);
+  if ((entry = (pr_filter_path_t *)cupsArrayFind(filter_path_cache, &key)) !=
+      NULL)
+    executable = entry->executable;
+  else
   {
-    unlink(extension->temp_ppd_name);
-    free(extension->temp_ppd_name);
+    executable = (access(filter_path, X_OK) == 0);
+    if (executable &&
+	(entry = (pr_filter_path_t *)calloc(1, sizeof(pr_filter_path_t))) !=
+	NULL)
+    {
+      entry->path = strdup(filter_path);
+      entry->executable = executable;
+      cupsArrayAdd(filter_path_cache, entry);
+    }
   }
-  free(extension);
+  pthread_mutex_unlock(&filter_path_mutex);
+
+  return (executable);
 }
 
 
@@ -793,7 +1386,7 @@ _prCUPSFilterPath(const char *filter,       // I - CUPS filter name
 	     "%s/%s", filter_dir, filter);
   }
 
-  if (access(filter_path, X_OK) == 0)
+  if (filter_executable(filter_path))
     return (filter_path);
 
   free(filter_path);
@@ -801,6 +1394,21 @@ _prCUPSFilterPath(const char *filter,       // I - CUPS filter name
 }
 
 
+//
+// '_prCUPSFilterPathFlush()' - Flush the filter look-up cache, to be called
+//                              when the filter directory changes.
+//
+
+void
+_prCUPSFilterPathFlush(void)
+{
+  pthread_mutex_lock(&filter_path_mutex);
+  cupsArrayDelete(filter_path_cache);
+  filter_path_cache = NULL;
+  pthread_mutex_unlock(&filter_path_mutex);
+}
+
+
 //
 // '_prPPDFindCUPSFilter()' - Check the strings of the
 //                            "*cupsFilter(2):" lines in a PPD file
@@ -1049,59 +1657,360 @@ _prOptionHasCode(
 //
 // 'add_strings_line()' - Add a new translation to a translation table of
 //                        *.strings type (the way translations are handled
-//                        by PAPPL).
+//                        by PAPPL). If memory runs out the table gets
+//                        freed, as an incomplete table would silently
+//                        show raw option names, and `false` is returned,
+//                        the caller should stop building it then.
 //
 
-static void
+static bool                    // O - `false` if out of memory
 add_strings_line(
-    char **strings_data,   // Strings translation list list in a string
-    const char *key,       // Key, option name, or English string
-    const char *attr,      // Option's attribute/choice or NULL
-    const char *ui_string) // Human-readable string or translation
+    pappl_system_t *system,    // System, for logging
+    pr_strings_buf_t *strings, // Strings translation list being built
+    const char *key,           // Key, option name, or English string
+    const char *attr,          // Option's attribute/choice or NULL
+    const char *ui_string)     // Human-readable string or translation
 {
   char buf[1024];
-  size_t append_pos, append_chars;
+  size_t append_chars, new_size;
+  char *new_data;
 
-  if (!strings_data || !key || !ui_string)
-    return;
+  if (!strings || !key || !ui_string)
+    return (true);
 
   snprintf(buf, sizeof(buf), "\"%s%s%s\" = \"%s\";\n",
 	   key, attr ? "." : "", attr ? attr : "", ui_string);
-  append_pos = *strings_data ? strlen(*strings_data) : 0;
   append_chars = strlen(buf);
 
-  *strings_data = realloc(*strings_data,
-			  (append_pos + append_chars + 1) *
-			  sizeof(char));
-  strcpy(*strings_data + append_pos, buf);
+  // Grow the buffer geometrically, so that building the table takes
+  // linear time also for PPDs with many options
+  if (strings->len + append_chars + 1 > strings->size)
+  {
+    new_size = strings->size ? 2 * strings->size : 4096;
+    while (strings->len + append_chars + 1 > new_size)
+      new_size *= 2;
+    if ((new_data = realloc(strings->data, new_size)) == NULL)
+    {
+      papplLog(system, PAPPL_LOGLEVEL_ERROR,
+	       "Unable to allocate memory for the human-readable strings of "
+	       "the printer options, the web interface will show the option "
+	       "names.");
+      free(strings->data);
+      strings->data = NULL;
+      strings->len  = 0;
+      strings->size = 0;
+      return (false);
+    }
+    strings->data = new_data;
+    strings->size = new_size;
+  }
+
+  memcpy(strings->data + strings->len, buf, append_chars + 1);
+  strings->len += append_chars;
+
+  return (true);
 }
 
 
 //
-// '_prDriverSetup()' - PostScript driver setup callback.
-//
-//                      Runs in two modes: Init and Update
+// 'probe_key()' - Create a string which identifies the option settings
+//                 applied for probing the resolution of a combination of
+//                 color mode, print quality, and content optimization.
 //
-//                      It runs in Init mode when the
-//                      driver_data->extension is still NULL, meaning
-//                      that the extension structure is not yet
-//                      defined. This is the case when the printer
-//                      data structure is created on startup or on
-//                      adding a printer. Then we load and read the
-//                      PPD and enter the properties into the driver
-//                      data structure, not taking into account any
-//                      user defaults or accessory settings.
+
+static char *                   // O - Key string, to be freed by caller
+probe_key(ppd_cache_t *pc,      // I - PPD cache
+	  int         i,        // I - Color mode
+	  int         j,        // I - Print quality
+	  int         k)        // I - Content optimization, 0 for none
+{
+  int           l;              // Looping variable
+  int           num_options[2]; // Number of options in the two sets
+  cups_option_t *options[2];    // Option sets
+  size_t        len = 1;        // Length of key
+  char          *key,           // Key string
+                *ptr;           // Pointer into key
+
+
+  num_options[0] = pc->num_presets[i][j];
+  options[0]     = pc->presets[i][j];
+  num_options[1] = (k > 0 ? pc->num_optimize_presets[k] : 0);
+  options[1]     = (k > 0 ? pc->optimize_presets[k] : NULL);
+
+  for (l = 0; l < num_options[0] + num_options[1]; l ++)
+  {
+    cups_option_t *opt = (l < num_options[0] ? options[0] + l :
+			  options[1] + l - num_options[0]);
+    len += strlen(opt->name) + strlen(opt->value) + 2;
+  }
+
+  if ((key = (char *)malloc(len)) == NULL)
+    return (NULL);
+
+  for (l = 0, ptr = key; l < num_options[0] + num_options[1]; l ++)
+  {
+    cups_option_t *opt = (l < num_options[0] ? options[0] + l :
+			  options[1] + l - num_options[0]);
+    ptr += sprintf(ptr, "%s=%s\n", opt->name, opt->value);
+  }
+  *ptr = '\0';
+
+  return (key);
+}
+
+
 //
-//                      When called again with the data structure
-//                      already present, it runs in Update mode,
-//                      applying user defaults and modifying the data
-//                      structure if the user changed the
-//                      configuration of installable accessories.
-//                      This mode is triggered when called by the
-//                      _prStatus() callback which in turn is called
-//                      after completely loading the printer's state
-//                      file entry or when doing changes on the
-//                      "Device Settings" web interface page.
+// 'probe_resolutions()' - Find the resolutions for draft, normal, and
+//                         high print quality by applying each preset to
+//                         the PPD file in turn. Combinations with the
+//                         same option settings get interpreted only
+//                         once. The marked options of the PPD get
+//                         changed.
+//
+
+static void
+probe_resolutions(
+    ppd_file_t    *ppd,              // I - PPD file
+    int           num_inst_options,  // I - Number of installable
+                                     //     accessory settings
+    cups_option_t *inst_options,     // I - Installable accessory settings
+    int           res[3][2])         // O - Resolutions
+{
+  int          i, j, k, l, m, n;           // Looping variables
+  ppd_cache_t  *pc = ppd->cache;
+  cups_page_header2_t header,              // CUPS raster headers to investigate
+                      optheader;           // PPD with ppdRasterInterpretPPD()
+  pr_res_probe_t probes[PR_RES_PROBES_MAX], // Results of the distinct
+                                           // option settings
+               *probe;
+  int          num_probes = 0;
+  char         *key;
+  char         *p, *q = NULL;
+  ppd_attr_t   *ppd_attr;
+
+
+  // Investigate PPD's/printer's basic properties by interpreting
+  // the PostScript snippets of the default settings of the options
+  ppdRasterInterpretPPD(&header, ppd, 0, NULL, NULL);
+
+  // Apply each preset to the PPD file in turn and find out which resolution
+  // would get used
+
+  memset(res, 0, 3 * sizeof(*res));
+  for (i = 0; i < 2; i ++)
+  {
+    for (j = 0; j < 3; j ++)
+    {
+      for (k = 0; k < 5; k ++)
+      {
+	if (j < 2 && k > 0)
+	  // Consider resolution increases by content optimization only on
+	  // high quality
+	  continue;
+	// Many presets are the same for color and monochrome or for
+	// several content types, so interpret each distinct option
+	// setting only once
+	key = probe_key(pc, i, j, k);
+	for (n = num_probes, probe = probes; n > 0; n --, probe ++)
+	  if (probe->key && key && !strcmp(probe->key, key))
+	    break;
+	if (n > 0)
+	  free(key);
+	else
+	{
+	  probe = probes + num_probes ++;
+	  memset(probe, 0, sizeof(pr_res_probe_t));
+	  probe->key = key;
+	  optheader = header;
+	  ppdMarkDefaults(ppd);
+	  ppdMarkOptions(ppd, num_inst_options, inst_options);
+	  ppdMarkOptions(ppd, pc->num_presets[i][j], pc->presets[i][j]);
+	  if (k > 0)
+	    ppdMarkOptions(ppd, pc->num_optimize_presets[k],
+			   pc->optimize_presets[k]);
+	  // Check influence on the Resolution by (pseudo) PostScript code
+	  // assigned to the option choices
+	  ppdRasterInterpretPPD(&optheader, ppd, 0, NULL, NULL);
+	  probe->hw_res[0] = optheader.HWResolution[0];
+	  probe->hw_res[1] = optheader.HWResolution[1];
+	  if (probe->hw_res[0] == 100 && probe->hw_res[1] == 100)
+	  {
+	    // Check influence on the Resolution by JCL/PJL code
+	    // assigned to the option choices, the last setting wins
+	    p = ppdEmitString(ppd, PPD_ORDER_JCL, 0);
+	    if (p)
+	    {
+	      q = p;
+	      while ((q = strstr(q, "RESOLUTION=")))
+	      {
+		q += 11;
+		if ((probe->jcl_scan = sscanf(q, "%dX%d",
+					      &(probe->jcl_res[0]),
+					      &(probe->jcl_res[1]))) == 1)
+		  probe->jcl_res[1] = probe->jcl_res[0];
+		if (probe->jcl_scan > 0)
+		  probe->jcl_found = true;
+	      }
+	      free(p);
+	    }
+	  }
+	}
+
+	l = 0;
+	if (probe->hw_res[0] != 100 || probe->hw_res[1] != 100)
+        {
+	  l = 1;
+	  if (probe->hw_res[0] > res[j][0])
+	    res[j][0] = probe->hw_res[0];
+	  if (probe->hw_res[1] > res[j][1])
+	    res[j][1] = probe->hw_res[1];
+	}
+	else
+        {
+	  l = probe->jcl_scan;
+	  if (probe->jcl_found)
+	  {
+	    res[j][0] = probe->jcl_res[0];
+	    res[j][1] = probe->jcl_res[1];
+	  }
+	}
+        if (l == 0)
+	{
+	  // Check choice names whether they suggest that the setting influences
+	  // the resolution
+	  m = pc->num_presets[i][j];
+	  for (l = 0; l < m + (k > 0 ? pc->num_optimize_presets[k] : 0); l ++)
+	  {
+	    if (l < m)
+	      q = pc->presets[i][j][l].value;
+	    else if (k > 0)
+	      q = pc->optimize_presets[k][l - m].value;
+	    if ((p = strcasestr(q, "dpi")) != NULL)
+	    {
+	      if (p > q)
+	      {
+		p --;
+		while (p > q && isspace(*p))
+		  p --;
+		if (p > q && isdigit(*p))
+	        {
+		  char x;
+		  while (p > q && isdigit(*p))
+		    p --;
+		  if (p > q && (*p == 'x' || *p == 'X'))
+		    p --;
+		  while (p > q && isdigit(*p))
+		    p --;
+		  while (!isdigit(*p))
+		    p ++;
+		  if (sscanf(p, "%d%c%d",
+			     &(res[j][0]), &x, &(res[j][1])) == 2)
+		    res[j][1] = res[j][0];
+		}
+	      }
+	    }
+	  }
+	}
+      }
+    }
+  }
+
+  for (n = 0; n < num_probes; n ++)
+    free(probes[n].key);
+
+  if (res[1][0] == 0 || res[1][1] == 0) // Normal quality resolution
+  {
+    // Normal quality resolution not defined by presets, find base resolution
+    if (header.HWResolution[0] != 100 || header.HWResolution[1] != 100)
+    {
+      res[1][0] = header.HWResolution[0];
+      res[1][1] = header.HWResolution[1];
+    }
+    else if ((ppd_attr = ppdFindAttr(ppd, "DefaultResolution", NULL)) != NULL)
+    {
+      // Use the PPD-defined default resolution...
+      if (sscanf(ppd_attr->value, "%dx%d", &(res[1][0]), &(res[1][1])) == 1)
+	res[1][1] = res[1][0];
+    }
+    else
+      // Resort to 300 dpi
+      res[1][0] = res[1][1] = 300;
+  }
+    
+  if (res[0][0] == 0 || res[0][1] == 0) // Draft quality resolution
+  {
+    // Draft quality resolution not defined by presets, use normal quality
+    // or base resolution
+    res[0][0] = res[1][0];
+    res[0][1] = res[1][1];
+  }
+  
+  if (res[2][0] == 0 || res[2][1] == 0) // High quality resolution
+  {
+    // High quality resolution not defined by presets, use normal quality
+    // or base resolution
+    res[2][0] = res[1][0];
+    res[2][1] = res[1][1];
+  }
+}
+
+
+//
+// 'name_in_table()' - Check whether a name is in one of the fixed,
+//                     sorted name tables (case-insensitive).
+//
+
+static bool                              // O - `true` if name is in table
+name_in_table(const char        *name,   // I - Name
+	      const char * const *table, // I - Sorted table
+	      size_t            num_names) // I - Number of names in table
+{
+  size_t left = 0,                       // Left end of search range
+         right = num_names,              // Right end of search range
+         middle;                         // Middle of search range
+  int    diff;                           // Comparison result
+
+
+  while (left < right)
+  {
+    middle = (left + right) / 2;
+    if ((diff = strcasecmp(name, table[middle])) == 0)
+      return (true);
+    else if (diff < 0)
+      right = middle;
+    else
+      left = middle + 1;
+  }
+
+  return (false);
+}
+
+
+//
+// '_prDriverSetup()' - PostScript driver setup callback.
+//
+//                      Runs in two modes: Init and Update
+//
+//                      It runs in Init mode when the
+//                      driver_data->extension is still NULL, meaning
+//                      that the extension structure is not yet
+//                      defined. This is the case when the printer
+//                      data structure is created on startup or on
+//                      adding a printer. Then we load and read the
+//                      PPD and enter the properties into the driver
+//                      data structure, not taking into account any
+//                      user defaults or accessory settings.
+//
+//                      When called again with the data structure
+//                      already present, it runs in Update mode,
+//                      applying user defaults and modifying the data
+//                      structure if the user changed the
+//                      configuration of installable accessories.
+//                      This mode is triggered when called by the
+//                      _prStatus() callback which in turn is called
+//                      after completely loading the printer's state
+//                      file entry or when doing changes on the
+//                      "Device Settings" web interface page.
 //
 
 bool					   // O - `true` on success, `false`
@@ -1122,18 +2031,25 @@ _prDriverSetup(
                                            // structure and not freshly
                                            // creating it?
   pr_driver_extension_t *extension;
-  cups_array_t *ppd_paths = global_data->ppd_paths;
+  pr_driver_list_t *list = NULL;           // Driver list, referenced while
+                                           // we use its PPD path entry
   pr_ppd_path_t *ppd_path,
                search_ppd_path;
   ppd_file_t   *ppd = NULL;		   // PPD file loaded from collection
   ppd_cache_t  *pc;
-  cups_file_t  *tempfp;
-  int          tempfd,
-               bytes;
-  char         tempfile[1024];
+  char         ppd_file[1024];             // Physical file of the PPD
+  bool         ppd_temporary = false,      // Is it a temporary file?
+               ppd_file_needed;            // Do we need to create it?
   pr_stream_format_t *stream_format;
-  cups_page_header2_t header,              // CUPS raster headers to investigate
-                      optheader;           // PPD with ppdRasterInterpretPPD()
+  pr_driver_cache_entry_t cache_entry;     // Cached driver setup results
+  uint64_t     setup_key = 0;              // Key of the setup snapshot
+  bool         setup_cached = false;       // Set up from the snapshot?
+  int          num_filters = 0;            // Number of "*cupsFilter(2)"
+                                           // lines of the PPD
+  char         **filters = NULL;           // "*cupsFilter(2)" lines
+  pr_strings_buf_t human_strings = {NULL, 0, 0},
+               *strings = NULL;            // Human-readable strings, NULL if
+                                           // not to be built
 
   ipp_attribute_t *attr;
   cups_option_t *opt;
@@ -1157,8 +2073,10 @@ _prDriverSetup(
   pappl_media_col_t tmp_col;
   int          count;
   int          controlled_by_presets;
-  ipp_name_lookup_t *opt_name;
-  bool         pollable;
+  ipp_name_lookup_t *opt_name,
+               search_name;                // Search key for look-up tables
+  bool         pollable,
+               ipp_names_complete;         // Look-up tables complete?
   char         buf[1024],
                ipp_opt[80],
                ipp_supported[256],
@@ -1170,46 +2088,6 @@ _prDriverSetup(
   int          default_choice,
                first_choice;
   char         *ptr = NULL;
-  const char * const pappl_handled_options[] =
-  {
-   "PageSize",
-   "PageRegion",
-   "InputSlot",
-   "MediaType",
-   "OutputBin",
-   "Duplex",
-   NULL
-  };
-  const char * const standard_ipp_names[] =
-  {
-   "media",
-   "media-size",
-   "media-source",
-   "media-type",
-   "printer-resolution",
-   "output-bin",
-   "sides",
-   "color",
-   "print-color-mode",
-   "print-quality",
-   "print-content-optimize",
-   "copies",
-   "finishings",
-   "finishings-col",
-   "job-pages-per-set",
-   "orientation-requested",
-   "media-col",
-   "output-mode",
-   "ipp-attribute-fidelity",
-   "job-name",
-   "page-ranges",
-   "multiple-document-handling",
-   "job-mandatory-attributes",
-   "overrides",
-   "print-rendering-intent",
-   "print-scaling",
-   NULL
-  };
 
 
   if (!driver_data || !driver_attrs)
@@ -1221,11 +2099,15 @@ _prDriverSetup(
 
   if (driver_data->extension == NULL)
   {
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "Initializing driver data for driver \"%s\"", driver_name);
 
-    if (!ppd_paths || cupsArrayCount(ppd_paths) == 0)
+    // The driver list can get updated while we are working, keep the
+    // current one until we are done with its PPD path entry
+    if ((list = _prDriverListAcquire(global_data)) == NULL ||
+	!list->ppd_paths || cupsArrayCount(list->ppd_paths) == 0)
     {
+      _prDriverListRelease(global_data, list);
       papplLog(system, PAPPL_LOGLEVEL_ERROR,
 	       "Driver callback did not find PPD indices.");
       return (false);
@@ -1256,13 +2138,15 @@ _prDriverSetup(
 		 "Automatic printer driver selection for printer "
 		 "\"%s\" with device ID \"%s\" failed.",
 		 device_uri, device_id);
+	_prDriverListRelease(global_data, list);
 	return (false);
       }
     }
     else
       search_ppd_path.driver_name = driver_name;
 
-    ppd_path = (pr_ppd_path_t *)cupsArrayFind(ppd_paths, &search_ppd_path);
+    ppd_path = (pr_ppd_path_t *)cupsArrayFind(list->ppd_paths,
+					      &search_ppd_path);
 
     if (ppd_path == NULL)
     {
@@ -1272,6 +2156,7 @@ _prDriverSetup(
 		 "For the printer driver \"%s\" got auto-selected which does "
 		 "not exist in this Printer Application.",
 		 search_ppd_path.driver_name);
+	_prDriverListRelease(global_data, list);
 	return (false);
       }
       else
@@ -1284,56 +2169,6 @@ _prDriverSetup(
       }
     }
 
-    if ((ppd = ppdOpen2(ppdCollectionGetPPD(ppd_path->ppd_path, NULL,
-					    (cf_logfunc_t)papplLog,
-					    system))) == NULL)
-    {
-      ppd_status_t	err;		// Last error in file
-      int		line;		// Line number in file
-
-      err = ppdLastError(&line);
-      papplLog(system, PAPPL_LOGLEVEL_ERROR,
-	       "PPD %s: %s on line %d", ppd_path->ppd_path,
-	       ppdErrorString(err), line);
-      return (false);
-    }
-
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
-	     "Using PPD %s: %s", ppd_path->ppd_path, ppd->nickname);
-
-    ppdMarkDefaults(ppd);
-
-    if ((pc = ppdCacheCreateWithPPD(ppd)) != NULL)
-      ppd->cache = pc;
-
-    for (i = 0; i < 2; i ++)
-    {
-      for (j = 0; j < 3; j ++)
-      {
-	snprintf(buf, sizeof(buf), "Presets for %s, %s:",
-		 i == 1 ? "color" : "gray",
-		 j == 0 ? "draft" : (j == 1 ? "normal" : "high"));
-	for (k = 0; k < pc->num_presets[i][j]; k ++)
-	  snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), " %s=%s",
-		  pc->presets[i][j][k].name, pc->presets[i][j][k].value);
-	papplLog(system, PAPPL_LOGLEVEL_DEBUG, "%s", buf);
-      }
-    }
-    for (i = 0; i < 5; i ++)
-    {
-      snprintf(buf, sizeof(buf), "Optimize presets %s:",
-	      (i == 0 ? "automatic" :
-	       (i == 1 ? "photo" :
-		(i == 2 ? "graphics" :
-		 (i == 3 ? "text" :
-		  "text and graphics")))));
-      for (k = 0; k < pc->num_optimize_presets[i]; k ++)
-	snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), " %s=%s",
-		 pc->optimize_presets[i][k].name,
-		 pc->optimize_presets[i][k].value);
-      papplLog(system, PAPPL_LOGLEVEL_DEBUG, "%s", buf);
-    }
-
     //
     // Populate driver data record
     //
@@ -1342,7 +2177,8 @@ _prDriverSetup(
     driver_data->extension =
       (pr_driver_extension_t *)calloc(1, sizeof(pr_driver_extension_t));
     extension = (pr_driver_extension_t *)driver_data->extension;
-    extension->ppd                  = ppd;
+    extension->ppd                  = NULL;
+    extension->ppd_path             = strdup(ppd_path->ppd_path);
     extension->ipp_name_lookup      = NULL;
     extension->human_strings        = NULL;
     extension->human_strings_resource = NULL;
@@ -1354,7 +2190,23 @@ _prDriverSetup(
     extension->filterless_ps        = false;
     extension->updated              = false;
     extension->temp_ppd_name        = NULL;
+    extension->instance             = driver_instance_get(global_data,
+							  ppd_path->driver_name,
+							  ppd_path->ppd_path,
+							  false, 0, NULL);
     extension->global_data          = global_data;
+    _prDriverListRelease(global_data, list);
+    if (!extension->instance)
+    {
+      papplLog(system, PAPPL_LOGLEVEL_ERROR,
+	       "Unable to allocate memory for the driver data.");
+      _prDriverDelete(NULL, driver_data);
+      return (false);
+    }
+    extension->ipp_name_lookup      = extension->instance->ipp_name_lookup;
+    extension->ipp_name_lookup_ipp  =
+      extension->instance->ipp_name_lookup_ipp;
+
     driver_data->delete_cb          = _prDriverDelete;
     driver_data->identify_cb        = global_data->config->identify_cb;
     driver_data->identify_default   = PAPPL_IDENTIFY_ACTIONS_SOUND;
@@ -1371,10 +2223,77 @@ _prDriverSetup(
     driver_data->format             = "application/vnd.printer-specific";
     driver_data->orient_default     = IPP_ORIENT_NONE;
 
-    // Make and model
-    strncpy(driver_data->make_and_model,
-	    ppd->nickname,
-	    sizeof(driver_data->make_and_model) - 1);
+    // If this PPD file got already set up before, we take the results
+    // from the setup snapshot, so that we do not need to load it
+    setup_key = _prDriverSetupKey(global_data, extension->ppd_path);
+    if ((setup_cached = _prDriverSetupLoad(global_data, setup_key,
+					   driver_data, driver_attrs,
+					   &num_filters, &filters)) == true)
+      _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
+	      "Using driver setup snapshot of PPD %s: %s", extension->ppd_path,
+	      driver_data->make_and_model);
+    else
+    {
+      // Get the PPD file, it is loaded with the first use, if no other
+      // printer of the driver instance has loaded it already
+      if ((ppd = _prPPDAcquire(extension)) == NULL)
+      {
+	_prDriverDelete(NULL, driver_data);
+	return (false);
+      }
+      pc = ppd->cache;
+
+      _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
+	       "Using PPD %s: %s", extension->ppd_path, ppd->nickname);
+
+      // Log the presets, only if they get actually logged, to not format
+      // them for nothing
+      if (pc && _PR_LOG_ENABLED(system, PAPPL_LOGLEVEL_DEBUG))
+      {
+	for (i = 0; i < 2; i ++)
+	{
+	  for (j = 0; j < 3; j ++)
+	  {
+	    snprintf(buf, sizeof(buf), "Presets for %s, %s:",
+		     i == 1 ? "color" : "gray",
+		     j == 0 ? "draft" : (j == 1 ? "normal" : "high"));
+	    for (k = 0; k < pc->num_presets[i][j]; k ++)
+	      snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), " %s=%s",
+		      pc->presets[i][j][k].name, pc->presets[i][j][k].value);
+	    papplLog(system, PAPPL_LOGLEVEL_DEBUG, "%s", buf);
+	  }
+	}
+	for (i = 0; i < 5; i ++)
+	{
+	  snprintf(buf, sizeof(buf), "Optimize presets %s:",
+		  (i == 0 ? "automatic" :
+		   (i == 1 ? "photo" :
+		    (i == 2 ? "graphics" :
+		     (i == 3 ? "text" :
+		      "text and graphics")))));
+	  for (k = 0; k < pc->num_optimize_presets[i]; k ++)
+	    snprintf(buf + strlen(buf), sizeof(buf) - strlen(buf), " %s=%s",
+		     pc->optimize_presets[i][k].name,
+		     pc->optimize_presets[i][k].value);
+	  papplLog(system, PAPPL_LOGLEVEL_DEBUG, "%s", buf);
+	}
+      }
+
+      // The human-readable strings only need to be built if no other
+      // printer with this driver has done it already
+      pthread_mutex_lock(&global_data->driver_instances_mutex);
+      if (!extension->instance || !extension->instance->human_strings)
+	strings = &human_strings;
+      pthread_mutex_unlock(&global_data->driver_instances_mutex);
+
+      // Make and model
+      strncpy(driver_data->make_and_model,
+	      ppd->nickname,
+	      sizeof(driver_data->make_and_model) - 1);
+
+      num_filters = ppd->num_filters;
+      filters     = ppd->filters;
+    }
 
     // In case of a PPD for a PostScript printer is a filter defined
     // (in a "*cupsFilter(2): ..." line) which is not installed or no
@@ -1387,12 +2306,12 @@ _prDriverSetup(
     // which is not installed and therefore they will not be displayed
     // in the web interface. We also will not create a physical copy
     // of the PPD file for use by CUPS filters.
-    if (ppd->num_filters == 0)
+    if (num_filters == 0)
       extension->filterless_ps = true;
     else
     {
       ptr = _prPPDFindCUPSFilter("application/vnd.cups-postscript",
-				 ppd->num_filters, ppd->filters,
+				 num_filters, filters,
 				 global_data->filter_dir);
       if (ptr && ptr[0] == '.')
 	extension->filterless_ps = true;
@@ -1401,33 +2320,51 @@ _prDriverSetup(
       free(ptr);
     }
 
-    // Create a physical copy of the PPD file in a temporary file so that
-    // the CUPS filter defined in the PPD file or a CUPS backend can read it.
+    // Use the physical file of the PPD so that the CUPS filter defined in
+    // the PPD file or a CUPS backend can read it. All printers with the
+    // same driver share one file.
     if (!extension->filterless_ps ||
 	(device_uri && strncmp(device_uri, "cups:", 5) == 0))
     {
-      papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+      _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	       "CUPS filter to be applied defined in the PPD file or CUPS backend used");
-      tempfp = ppdCollectionGetPPD(ppd_path->ppd_path, NULL,
-				   (cf_logfunc_t)papplLog,
-				   system);
-      if ((tempfd = cupsTempFd(tempfile, sizeof(tempfile))) >= 0)
+      // Getting the file can take time if it is not in the PPD cache,
+      // so do not block the other printers meanwhile
+      pthread_mutex_lock(&global_data->driver_instances_mutex);
+      ppd_file_needed = (extension->instance &&
+			 !extension->instance->temp_ppd_name);
+      pthread_mutex_unlock(&global_data->driver_instances_mutex);
+      if (ppd_file_needed &&
+	  !_prPPDMaterialize(global_data, extension->ppd_path, ppd_file,
+			     sizeof(ppd_file), &ppd_temporary))
+	ppd_file_needed = false;
+
+      pthread_mutex_lock(&global_data->driver_instances_mutex);
+      if (extension->instance && extension->instance->temp_ppd_name)
+	_PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
+		"Using physical PPD file of the driver for the CUPS filter: %s",
+		extension->instance->temp_ppd_name);
+      else if (extension->instance && ppd_file_needed)
       {
-	papplLog(system, PAPPL_LOGLEVEL_DEBUG,
-		 "Creating physical PPD file for the CUPS filter: %s",
-		 tempfile);
-	while ((bytes = cupsFileRead(tempfp, buf, sizeof(buf))) > 0)
-	  bytes = write(tempfd, buf, bytes);
-	cupsFileClose(tempfp);
-	close(tempfd);
-	extension->temp_ppd_name = strdup(tempfile);
+	_PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
+		 "Physical PPD file for the CUPS filter: %s", ppd_file);
+	extension->instance->temp_ppd_name = strdup(ppd_file);
+	extension->instance->temp_ppd_temporary = ppd_temporary;
+	ppd_temporary = false;
       }
       else
 	papplLog(system, PAPPL_LOGLEVEL_WARN,
 		 "Unable to create physical PPD file for the CUPS filter, filter may not work correctly.");
+      if (extension->instance)
+	extension->temp_ppd_name = extension->instance->temp_ppd_name;
+      pthread_mutex_unlock(&global_data->driver_instances_mutex);
+
+      // Another printer with this driver was faster
+      if (ppd_temporary)
+	unlink(ppd_file);
     }
     else
-      papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+      _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	       "Sending PostScript output directly to the printer without CUPS filter");
 
     //
@@ -1443,7 +2380,7 @@ _prDriverSetup(
 	   cupsArrayNext(global_data->config->stream_formats))
       if ((ptr =
 	   _prPPDFindCUPSFilter(stream_format->dsttype,
-				   ppd->num_filters, ppd->filters,
+				   num_filters, filters,
 				   global_data->filter_dir)) != NULL)
 	break;
 
@@ -1452,27 +2389,32 @@ _prDriverSetup(
       papplLog(system, PAPPL_LOGLEVEL_ERROR,
 	       "No format found for printing in streaming mode");
       free(ptr);
-      // We do the removal of the PPD cache separately to assure that
-      // the function of libppd (and not of libcups) is used, as in
-      // libppd the PPD cache data structure is different (Content
-      // optimize presets added).
-      ppdCacheDestroy(extension->ppd->cache);
-      extension->ppd->cache = NULL;
-      ppdClose(extension->ppd);
-      free(extension);
+      free(human_strings.data);
+      if (setup_cached)
+      {
+	// Not yet shared with the driver instance
+	free(extension->human_strings);
+	extension->human_strings = NULL;
+	for (i = 0; i < num_filters; i ++)
+	  free(filters[i]);
+	free(filters);
+      }
+      else
+	_prPPDRelease(extension);
+      _prDriverDelete(NULL, driver_data);
       return (false);
     }
 
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "Converting raster input to format: %s", stream_format->dsttype);
     if (ptr[0] == '.')
-      papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+      _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	       "Passing on PostScript directly to printer");
     else if (ptr[0] == '-')
-      papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+      _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	       "Passing on %s directly to printer", stream_format->dsttype);
     else
-      papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+      _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	       "Using CUPS filter (printer driver): %s", ptr);
 
     extension->stream_filter = ptr;
@@ -1483,15 +2425,26 @@ _prDriverSetup(
     driver_data->rstartpage_cb = stream_format->rstartpage_cb;
     driver_data->rwriteline_cb = stream_format->rwriteline_cb;
 
+    // Set up from the snapshot, we are done
+    if (setup_cached)
+    {
+      for (i = 0; i < num_filters; i ++)
+	free(filters[i]);
+      free(filters);
+      driver_instance_share_strings(global_data, extension);
+      return (true);
+    }
+
     // We are in Init mode
     update = false;
   }
   else
   {
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "Updating driver data for %s", driver_data->make_and_model);
     extension = (pr_driver_extension_t *)driver_data->extension;
-    ppd = extension->ppd;
+    if ((ppd = _prPPDAcquire(extension)) == NULL)
+      return (false);
     pc = ppd->cache;
     extension->updated = true;
 
@@ -1507,146 +2460,43 @@ _prDriverSetup(
   //
   // Only after this structure have been created initially (right
   // after startup of the Printer Application or printer addition) the
-  // status callback is called for the first time, where the
-  // configuration file for the installable accessory settings is
-  // loaded. After that we re-run in Update mode to correct the
-  // options and choices for the actual accessory configuration.
-
-  // Investigate PPD's/printer's basic properties by interpreting
-  // the PostScript snippets of the default settings of the options
-  ppdRasterInterpretPPD(&header, ppd, 0, NULL, NULL);
-
-  // Resolution
-
-  // Apply each preset to the PPD file in turn and find out which resolution
-  // would get used
-
-  memset(res, 0, sizeof(res));
-  for (i = 0; i < 2; i ++)
-  {
-    for (j = 0; j < 3; j ++)
-    {
-      for (k = 0; k < 5; k ++)
-      {
-	if (j < 2 && k > 0)
-	  // Consider resolution increases by content optimization only on
-	  // high quality
-	  continue;
-	l = 0;
-	optheader = header;
-	ppdMarkDefaults(ppd);
-	ppdMarkOptions(ppd, extension->num_inst_options,
-		       extension->inst_options);
-	ppdMarkOptions(ppd, pc->num_presets[i][j], pc->presets[i][j]);
-	if (k > 0)
-	  ppdMarkOptions(ppd, pc->num_optimize_presets[k],
-			 pc->optimize_presets[k]);
-	// Check influence on the Resolution by (pseudo) PostScript code
-	// assigned to the option choices
-	ppdRasterInterpretPPD(&optheader, ppd, 0, NULL, NULL);
-	if (optheader.HWResolution[0] != 100 ||
-	    optheader.HWResolution[1] != 100)
-        {
-	  l = 1;
-	  if (optheader.HWResolution[0] > res[j][0])
-	    res[j][0] = optheader.HWResolution[0];
-	  if (optheader.HWResolution[1] > res[j][1])
-	    res[j][1] = optheader.HWResolution[1];
-	}
-	else
-        {
-	  // Check influence on the Resolution by JCL/PJL code
-	  // assigned to the option choices
-	  p = ppdEmitString(ppd, PPD_ORDER_JCL, 0);
-	  if (p)
-	  {
-	    q = p;
-	    while ((q = strstr(q, "RESOLUTION=")))
-	    {
-	      q += 11;
-	      if ((l = sscanf(q, "%dX%d", &(res[j][0]), &(res[j][1]))) == 1)
-		res[j][1] = res[j][0];
-	    }
-	    free(p);
-	  }
-	}
-        if (l == 0)
-	{
-	  // Check choice names whether they suggest that the setting influences
-	  // the resolution
-	  m = pc->num_presets[i][j];
-	  for (l = 0; l < m + (k > 0 ? pc->num_optimize_presets[k] : 0); l ++)
-	  {
-	    if (l < m)
-	      q = pc->presets[i][j][l].value;
-	    else if (k > 0)
-	      q = pc->optimize_presets[k][l - m].value;
-	    if ((p = strcasestr(q, "dpi")) != NULL)
-	    {
-	      if (p > q)
-	      {
-		p --;
-		while (p > q && isspace(*p))
-		  p --;
-		if (p > q && isdigit(*p))
-	        {
-		  char x;
-		  while (p > q && isdigit(*p))
-		    p --;
-		  if (p > q && (*p == 'x' || *p == 'X'))
-		    p --;
-		  while (p > q && isdigit(*p))
-		    p --;
-		  while (!isdigit(*p))
-		    p ++;
-		  if (sscanf(p, "%d%c%d",
-			     &(res[j][0]), &x, &(res[j][1])) == 2)
-		    res[j][1] = res[j][0];
-		}
-	      }
-	    }
-	  }
-	}
-      }
-    }
-  }
-  ppdMarkDefaults(ppd);
-  ppdMarkOptions(ppd, extension->num_inst_options, extension->inst_options);
+  // status callback is called for the first time, where the
+  // configuration file for the installable accessory settings is
+  // loaded. After that we re-run in Update mode to correct the
+  // options and choices for the actual accessory configuration.
 
-  if (res[1][0] == 0 || res[1][1] == 0) // Normal quality resolution
+  // Resolution
+
+  // Probing the resolutions requires interpreting the PostScript code
+  // of the PPD for each preset, so we take the result from the cache
+  // if this PPD with the same accessory configuration was already
+  // probed before
+  memset(&cache_entry, 0, sizeof(cache_entry));
+  cache_entry.key = _prDriverCacheKey(ppd, extension->num_inst_options,
+				      extension->inst_options);
+  if (_prDriverCacheLoad(global_data, cache_entry.key, &cache_entry))
   {
-    // Normal quality resolution not defined by presets, find base resolution
-    if (header.HWResolution[0] != 100 || header.HWResolution[1] != 100)
-    {
-      res[1][0] = header.HWResolution[0];
-      res[1][1] = header.HWResolution[1];
-    }
-    else if ((ppd_attr = ppdFindAttr(ppd, "DefaultResolution", NULL)) != NULL)
+    for (j = 0; j < 3; j ++)
     {
-      // Use the PPD-defined default resolution...
-      if (sscanf(ppd_attr->value, "%dx%d", &(res[1][0]), &(res[1][1])) == 1)
-	res[1][1] = res[1][0];
+      res[j][0] = cache_entry.res[j][0];
+      res[j][1] = cache_entry.res[j][1];
     }
-    else
-      // Resort to 300 dpi
-      res[1][0] = res[1][1] = 300;
-  }
-    
-  if (res[0][0] == 0 || res[0][1] == 0) // Draft quality resolution
-  {
-    // Draft quality resolution not defined by presets, use normal quality
-    // or base resolution
-    res[0][0] = res[1][0];
-    res[0][1] = res[1][1];
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
+	    "Using cached resolutions of the PPD file");
   }
-  
-  if (res[2][0] == 0 || res[2][1] == 0) // High quality resolution
+  else
   {
-    // High quality resolution not defined by presets, use normal quality
-    // or base resolution
-    res[2][0] = res[1][0];
-    res[2][1] = res[1][1];
+    probe_resolutions(ppd, extension->num_inst_options,
+		      extension->inst_options, res);
+    for (j = 0; j < 3; j ++)
+    {
+      cache_entry.res[j][0] = res[j][0];
+      cache_entry.res[j][1] = res[j][1];
+    }
+    _prDriverCacheSave(global_data, &cache_entry);
   }
+  ppdMarkDefaults(ppd);
+  ppdMarkOptions(ppd, extension->num_inst_options, extension->inst_options);
 
   // The resolutions here are actually only used for Apple/PWG Raster
   // and image input data. As in case of Apple/PWG Raster jobs the
@@ -1745,14 +2595,14 @@ _prDriverSetup(
     driver_data->num_resolution = 1;
   }
 
-  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	   "Resolutions from presets (missing ones filled with defaults): Draft: %dx%ddpi, Normal: %dx%ddpi, High: %dx%ddpi",
 	   res[0][0], res[0][1], res[1][0], res[1][1], res[2][0], res[2][1]);
-  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	   "Resolution entries:");
   for (i = 0; i < driver_data->num_resolution; i ++)
   {
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "  %dx%ddpi",
 	     driver_data->x_resolution[i], driver_data->y_resolution[i]);
   }
@@ -1765,7 +2615,7 @@ _prDriverSetup(
     driver_data->x_default = res[1][0];
     driver_data->y_default = res[1][1];
   }
-  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	   "Default resolution: %dx%ddpi",
 	   driver_data->x_default, driver_data->y_default);
 
@@ -1949,7 +2799,7 @@ _prDriverSetup(
       for (i = 0; i < driver_data->num_source; i ++)
 	free((char *)(driver_data->source[i]));
     def_source = NULL;
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "Media source entries:");
     for (i = 0, j = 0, pwg_map = pc->sources;
 	 i < count && j < PAPPL_MAX_SOURCE;
@@ -1957,18 +2807,18 @@ _prDriverSetup(
       if (!(update &&
 	    ppdInstallableConflict(ppd, pc->source_option, pwg_map->ppd)))
       {
-	papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	_PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		 "  PPD: %s PWG: %s", pwg_map->ppd, pwg_map->pwg);
 	if (!pwg_map->pwg || !pwg_map->pwg[0])
 	{
-	  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	  _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		   "    -> Skipping source with undefined PWG name");
 	  continue;
 	}
 	for (k = 0; k < j; k++)
 	  if (strcmp(driver_data->source[k], pwg_map->pwg) == 0)
 	  {
-	    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		     "    -> Skipping duplicate source");
 	    break;
 	  }
@@ -2003,25 +2853,25 @@ _prDriverSetup(
       for (i = 0; i < driver_data->num_type; i ++)
 	free((char *)(driver_data->type[i]));
     def_type = NULL;
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "Media type entries:");
     for (i = 0, j = 0, pwg_map = pc->types;
 	 i < count && j < PAPPL_MAX_TYPE;
 	 i ++, pwg_map ++)
       if (!(update && ppdInstallableConflict(ppd, "MediaType", pwg_map->ppd)))
       {
-	papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	_PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		 "  PPD: %s PWG: %s", pwg_map->ppd, pwg_map->pwg);
 	if (!pwg_map->pwg || !pwg_map->pwg[0])
 	{
-	  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	  _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		   "    -> Skipping type with undefined PWG name");
 	  continue;
 	}
 	for (k = 0; k < j; k++)
 	  if (strcmp(driver_data->type[k], pwg_map->pwg) == 0)
 	  {
-	    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		     "    -> Skipping duplicate type");
 	    break;
 	  }
@@ -2055,6 +2905,7 @@ _prDriverSetup(
     papplLog(system, PAPPL_LOGLEVEL_ERROR,
 	     "PPD does not have a \"PageSize\" option or the option is "
 	     "missing PostScript/PJL code for selecting the page size.");
+    free(human_strings.data);
     _prDriverDelete(NULL, driver_data);
     return (false);
   }
@@ -2094,19 +2945,19 @@ _prDriverSetup(
       pc->custom_max_width > pc->custom_min_width &&
       pc->custom_max_length > pc->custom_min_length)
   {
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "Adding custom page size:");
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "  PWG keyword min dimensions: \"%s\"", pc->custom_min_keyword);
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "  PWG keyword max dimensions: \"%s\"", pc->custom_max_keyword);
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "  Minimum dimensions (width, length): %dx%d",
 	     pc->custom_min_width, pc->custom_min_length);
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "  Maximum dimensions (width, length): %dx%d",
 	     pc->custom_max_width, pc->custom_max_length);
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "  Margins (left, bottom, right, top): %d, %d, %d, %d",
 	     pc->custom_size.left, pc->custom_size.bottom,
 	     pc->custom_size.right, pc->custom_size.top);
@@ -2117,25 +2968,25 @@ _prDriverSetup(
   }
 
   // Standard page sizes
-  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	   "Media size entries:");
   for (i = 0, pwg_size = pc->sizes;
        i < count && j < PAPPL_MAX_MEDIA;
        i ++, pwg_size ++)
     if (!(update && ppdInstallableConflict(ppd, "PageSize", pwg_size->map.ppd)))
     {
-      papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+      _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	       "  PPD: %s PWG: %s", pwg_size->map.ppd, pwg_size->map.pwg);
       if (!pwg_size->map.pwg || !pwg_size->map.pwg[0])
       {
-	papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	_PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		 "    -> Skipping size with undefined PWG name");
 	continue;
       }
       for (k = 0; k < j; k++)
 	if (strcmp(driver_data->media[k], pwg_size->map.pwg) == 0)
 	{
-	  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	  _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		   "    -> Skipping duplicate size");
 	  break;
 	}
@@ -2211,7 +3062,7 @@ _prDriverSetup(
   // Set margin info
   driver_data->left_right = (def_left < def_right ? def_left : def_right);
   driver_data->bottom_top = (def_bottom < def_top ? def_bottom : def_top);
-  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	   "Margins: Left/Right: %d, Bottom/Top: %d",
 	   driver_data->left_right, driver_data->bottom_top);
   if (driver_data->left_right == 0 && driver_data->bottom_top == 0)
@@ -2399,16 +3250,16 @@ _prDriverSetup(
   }
 
   // Log "media-ready" entries
-  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	   "Entries for \"media-ready\" (numbers are 1/100 mm):");
   for (i = 0;
        i < PAPPL_MAX_SOURCE && driver_data->media_ready[i].source[0];
        i ++)
   {
     if (i == driver_data->num_source)
-      papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+      _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	       "Undo buffer for \"media-ready\":");
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "  %s: %s, %s%s, L=%d, B=%d, R=%d, T=%d",
 	     driver_data->media_ready[i].source,
 	     driver_data->media_ready[i].size_name,
@@ -2499,6 +3350,18 @@ _prDriverSetup(
 	free((char *)(extension->vendor_ppd_options[i]));
     }
 
+  // The look-up tables for the IPP names are shared by the printers of
+  // the driver instance, the first of them fills them in, for the others
+  // they are complete already and give the same results
+  pthread_mutex_lock(&extension->instance->mutex);
+  if ((ipp_names_complete = extension->instance->ipp_names_complete) == false)
+    for (opt_name =
+	   (ipp_name_lookup_t *)cupsArrayFirst(extension->ipp_name_lookup);
+	 opt_name;
+	 opt_name =
+	   (ipp_name_lookup_t *)cupsArrayNext(extension->ipp_name_lookup))
+      opt_name->vendor_index = -1;
+
   // Go through all the options of the PPD file
   driver_data->num_vendor = 0;
   for (i = ppd->num_groups, group = ppd->groups;
@@ -2530,7 +3393,7 @@ _prDriverSetup(
 	    ppd_attr->value)
 	{
 	  pollable = true;
-	  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	  _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		   "Default of option \"%s\" (\"%s\") can get queried from "
 		   "printer.", option->keyword, option->text);
 	}
@@ -2542,7 +3405,7 @@ _prDriverSetup(
       // Only note the fact that we have such options in the PPD file
       if (strncasecmp(group->name, "Installable", 11) == 0)
       {
-	papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	_PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		 "Installable accessory option: \"%s\" (\"%s\")",
 		 option->keyword, option->text);
 	extension->installable_options = true;
@@ -2557,10 +3420,9 @@ _prDriverSetup(
 	extension->defaults_pollable = true;
 
       // Is this option already handled by PAPPL/IPP
-      for (k = 0; pappl_handled_options[k]; k ++)
-	if (!strcasecmp(option->keyword, pappl_handled_options[k]))
-	  break;
-      if (pappl_handled_options[k] ||
+      if (name_in_table(option->keyword, pappl_handled_options,
+			sizeof(pappl_handled_options) /
+			sizeof(pappl_handled_options[0])) ||
 	  (pc->source_option &&
 	   !strcasecmp(option->keyword, pc->source_option)) ||
 	  (pc->sides_option &&
@@ -2588,17 +3450,9 @@ _prDriverSetup(
 
       // Check look-up table to see whether we already have an IPP name for
       // this PPD option
-      opt_name = NULL;
-      if (extension->ipp_name_lookup == NULL)
-	extension->ipp_name_lookup = cupsArrayNew(NULL, NULL);
-      else
-	for (opt_name =
-	       (ipp_name_lookup_t *)cupsArrayFirst(extension->ipp_name_lookup);
-	     opt_name;
-	     opt_name =
-	       (ipp_name_lookup_t *)cupsArrayNext(extension->ipp_name_lookup))
-	  if (strcmp(option->keyword, opt_name->ppd) == 0)
-	    break;
+      search_name.ppd = option->keyword;
+      opt_name = (ipp_name_lookup_t *)cupsArrayFind(extension->ipp_name_lookup,
+						    &search_name);
 
       if (opt_name == NULL)
       {
@@ -2639,22 +3493,15 @@ _prDriverSetup(
 	  }
 
 	  // Is this IPP attribute name a common IPP name?
-	  for (l = 0; standard_ipp_names[l]; l ++)
-	    if (!strcasecmp(ipp_opt, standard_ipp_names[l]))
-	      break;
-	  if (standard_ipp_names[l])
+	  if (name_in_table(ipp_opt, standard_ipp_names,
+			    sizeof(standard_ipp_names) /
+			    sizeof(standard_ipp_names[0])))
 	    // Standard name, not available for us
 	    continue;
 
 	  // Look up IPP name in look-up table
-	  for (opt_name =
-	        (ipp_name_lookup_t *)cupsArrayFirst(extension->ipp_name_lookup);
-	       opt_name;
-	       opt_name =
-		 (ipp_name_lookup_t *)cupsArrayNext(extension->ipp_name_lookup))
-	    if (strcmp(ipp_opt, opt_name->ipp) == 0)
-	      break;
-	  if (opt_name)
+	  search_name.ipp = ipp_opt;
+	  if (cupsArrayFind(extension->ipp_name_lookup_ipp, &search_name))
 	    // Already exists
 	    continue;
 
@@ -2673,9 +3520,11 @@ _prDriverSetup(
 
 	// Add the new name assignment to the look-up table
 	opt_name = (ipp_name_lookup_t *)calloc(1, sizeof(ipp_name_lookup_t));
-	opt_name->ppd = option->keyword;
+	opt_name->ppd = strdup(option->keyword);
 	opt_name->ipp = strdup(ipp_opt);
+	opt_name->vendor_index = -1;
 	cupsArrayAdd(extension->ipp_name_lookup, opt_name);
+	cupsArrayAdd(extension->ipp_name_lookup_ipp, opt_name);
       }
       else
 	// We have already an IPP name, take it from the look-up table
@@ -2703,7 +3552,7 @@ _prDriverSetup(
       // Add vendor option and its choices to driver IPP attributes
       if (option->ui == PPD_UI_PICKONE || option->ui == PPD_UI_BOOLEAN)
       {
-	papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	_PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		 "Adding vendor-specific option \"%s\" (\"%s\") as IPP option "
 		 "\"%s\"", option->keyword, option->text, ipp_opt);
 	if (*driver_attrs == NULL)
@@ -2746,7 +3595,7 @@ _prDriverSetup(
 	      ppdMarkOption(ppd, option->keyword, option->choices[1].choice);
 	    if (default_choice < 0)
 	    {
-	      papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	      _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		       "  -> Skipping - Boolean option does not make sense with current accessory configuration");
 	      continue;
 	    }
@@ -2759,7 +3608,7 @@ _prDriverSetup(
 		  !strcasecmp(option->choices[k].text, "true"))
 		default_choice = 1;
 	  }
-	  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	  _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		   "  Default: %s", (default_choice ? "true" : "false"));
 	  ippAddBoolean(*driver_attrs, IPP_TAG_PRINTER, ipp_supported, 1);
 	  ippAddBoolean(*driver_attrs, IPP_TAG_PRINTER, ipp_default,
@@ -2801,7 +3650,7 @@ _prDriverSetup(
 	    if ((!update) ||
 		(update && buf[0] && !strcasecmp(choice_list[0], buf)))
 	      default_choice = 0;
-	    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		     "  Adding choice for auto-selection from presets as \"%s\"%s",
 		     ipp_choice,
 		     default_choice == 0 ? " (default)" : "");
@@ -2868,9 +3717,9 @@ _prDriverSetup(
 		// Register human-readable strings of the vendor option
 		// choices in a *.strings-type translation table, to be
 		// displayed in the web interface
-		add_strings_line(&extension->human_strings,
-				 ipp_opt, ipp_choice,
-				 option->choices[k].text);
+		if (!add_strings_line(system, strings, ipp_opt, ipp_choice,
+				      option->choices[k].text))
+		  strings = NULL;
 	      }
 	      if (first_choice == -2)
 		first_choice = k;
@@ -2881,7 +3730,7 @@ _prDriverSetup(
 		default_choice = l;
 		ppdMarkOption(ppd, option->keyword, option->choices[k].choice);
 	      }
-	      papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	      _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		       "  Adding choice \"%s\" (\"%s\") as \"%s\"%s",
 		       option->choices[k].choice, option->choices[k].text,
 		       ipp_choice,
@@ -2914,7 +3763,7 @@ _prDriverSetup(
 	  if (l == controlled_by_presets ||
 	      (l == 1 + controlled_by_presets && num_cparams == 0))
 	  {
-	    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		     "   -> Skipping - Option does not make sense with current accessory configuration");
 	    continue;
 	  }
@@ -2924,6 +3773,8 @@ _prDriverSetup(
 	continue;
 
       // Add vendor option to lookup lists
+      if (!ipp_names_complete)
+	opt_name->vendor_index = driver_data->num_vendor;
       driver_data->vendor[driver_data->num_vendor] = strdup(ipp_opt);
       snprintf(buf, sizeof(buf), "%s%s", controlled_by_presets ? "/" : "",
 	       option->keyword);
@@ -2934,8 +3785,8 @@ _prDriverSetup(
 	// Register human-readable strings of the vendoe option
 	// in a *.strings-type translation table, to be displayed
 	// in the web interface
-	add_strings_line(&extension->human_strings,
-			 ipp_opt, NULL, option->text);
+	if (!add_strings_line(system, strings, ipp_opt, NULL, option->text))
+	  strings = NULL;
       }
 
       // Next entry ...
@@ -3007,10 +3858,10 @@ _prDriverSetup(
 	  // Register human-readable strings of the vendoe option
 	  // in a *.strings-type translation table, to be displayed
 	  // in the web interface
-	  add_strings_line(&extension->human_strings,
-			   ipp_custom_opt, NULL, buf);
+	  if (!add_strings_line(system, strings, ipp_custom_opt, NULL, buf))
+	    strings = NULL;
 	}
-	papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	_PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		 "  Adding custom parameter \"%s\" (\"%s\") as IPP attribute \"%s\"",
 		 cparam->name, cparam->text, ipp_custom_opt);
 	// Add parameter vendor option to lookup lists
@@ -3024,6 +3875,24 @@ _prDriverSetup(
     }
   }
 
+  extension->instance->ipp_names_complete = true;
+  pthread_mutex_unlock(&extension->instance->mutex);
+
+  // The human-readable strings are the same for all printers using this
+  // driver, keep only one copy of them
+  if (!update)
+  {
+    extension->human_strings = human_strings.data;
+    driver_instance_share_strings(global_data, extension);
+
+    // Store the results, so that the next time printers with this PPD
+    // get set up without loading it
+    _prDriverSetupSave(global_data, setup_key, driver_data, *driver_attrs,
+		       ppd);
+  }
+
+  _prPPDRelease(extension);
+
   return (true);
 }
 
@@ -3200,7 +4069,8 @@ _prPollDeviceOptionDefaults(
 
   papplPrinterGetDriverData(printer, &driver_data);
   extension = (pr_driver_extension_t *)driver_data.extension;
-  ppd = extension->ppd;
+  if ((ppd = _prPPDAcquire(extension)) == NULL)
+    return (0);
 
   *defaults = NULL;
   num_defaults = 0;
@@ -3213,6 +4083,7 @@ _prPollDeviceOptionDefaults(
   {
     papplLogPrinter(printer, PAPPL_LOGLEVEL_DEBUG,
 		    "Cannot access printer: Busy or otherwise not reachable");
+    _prPPDRelease(extension);
     return (0);
   }
 
@@ -3226,22 +4097,22 @@ _prPollDeviceOptionDefaults(
     // Start backend if not yet done so (first access is not by PAPPL device
     // API function)
     if (!device_data->backend_pid && !_prCUPSDevLaunchBackend(device))
+    {
+      _prPPDRelease(extension);
       return (0);
-
-    // Standard FD for the side channel is 4, the CUPS library
-    // functions use always FD 4. Therefore we redirect our side
-    // channel pipe end to FD 4
-    dup2(device_data->sidefd, 4);
+    }
 
     // See if the backend supports bidirectional I/O...
     datalen = 1;
-    if (cupsSideChannelDoRequest(CUPS_SC_CMD_GET_BIDI, buf, &datalen,
-				 5.0) != CUPS_SC_STATUS_OK ||
+    if (_prCUPSSideChannelDoRequest(device_data->sidefd,
+				    CUPS_SC_CMD_GET_BIDI, buf, &datalen,
+				    5.0) != CUPS_SC_STATUS_OK ||
 	buf[0] != CUPS_SC_BIDI_SUPPORTED)
     {
       papplLogPrinter(printer, PAPPL_LOGLEVEL_DEBUG,
 		      "Unable to query defaults from printer - no "
 		      "bidirectional I/O available!");
+      _prPPDRelease(extension);
       return (0);
     }
   }
@@ -3297,8 +4168,9 @@ _prPollDeviceOptionDefaults(
       sleep(1);
       datalen = 1;
     }
-    while (cupsSideChannelDoRequest(CUPS_SC_CMD_GET_CONNECTED, buf, &datalen,
-				    device_data->side_timeout) ==
+    while (_prCUPSSideChannelDoRequest(device_data->sidefd,
+				       CUPS_SC_CMD_GET_CONNECTED, buf,
+				       &datalen, device_data->side_timeout) ==
 	   CUPS_SC_STATUS_OK && !buf[0]);
   }
 
@@ -3436,8 +4308,9 @@ _prPollDeviceOptionDefaults(
       {
 	// Flush the data from the backend into the printer
 	datalen = 0;
-	cupsSideChannelDoRequest(CUPS_SC_CMD_DRAIN_OUTPUT, buf, &datalen,
-				 device_data->side_timeout);
+	_prCUPSSideChannelDoRequest(device_data->sidefd,
+				    CUPS_SC_CMD_DRAIN_OUTPUT, buf, &datalen,
+				    device_data->side_timeout);
       }
       
       //
@@ -3449,7 +4322,7 @@ _prPollDeviceOptionDefaults(
       // When we use a PAPPL-native backend then if no bytes get read
       // (bytes <= 0), we repeat up to 100 times in 100 msec intervals
       // (10 sec timeout), for a CUPS backend we use the built-in
-      // timeout handling of cupsBackChannelRead() (which is called by
+      // timeout handling of _prCUPSBackChannelRead() (which is called by
       // _prCUPSDevRead(), called by papplDeviceRead().
       for (k = 0; k < 100; k ++)
       {
@@ -3612,10 +4485,35 @@ _prPollDeviceOptionDefaults(
     papplLogPrinter(printer, PAPPL_LOGLEVEL_WARN,
 		    "Unable to configure some printer options.");
 
+  _prPPDRelease(extension);
+
   return (num_defaults);
 }
 
 
+//
+// 'inst_options_file_name()' - Get the name of the file with the saved
+//                              installable accessory settings of a
+//                              printer. It is the name which
+//                              papplPrinterOpenFile() gives to the
+//                              "inst-opt" resource, so that the files of
+//                              earlier sessions get found, but it can
+//                              also be formed for the printers in the
+//                              state file before PAPPL has created them.
+//
+
+static char *                           // O - File name
+inst_options_file_name(
+    const char *state_dir,              // I - State directory
+    int        printer_id,              // I - Printer ID
+    char       *buf,                    // I - Buffer for file name
+    size_t     bufsize)                 // I - Size of buffer
+{
+  snprintf(buf, bufsize, "%s/p%05d-inst-opt.conf", state_dir, printer_id);
+  return (buf);
+}
+
+
 //
 // '_prPrinterUpdateForInstallableOptions() - Update printer's driver
 //                                            data and driver IPP
@@ -3663,9 +4561,9 @@ _prPrinterUpdateForInstallableOptions(
   {
     /* No installable accessory configuration present in driver data. Check
        whether there is saved data from a previous session and load it if so */
-    if ((fd = papplPrinterOpenFile(printer, buf1, sizeof(buf1),
-				   extension->global_data->state_dir,
-				   "inst-opt", "conf", "r")) > 0)
+    inst_options_file_name(extension->global_data->state_dir,
+			   papplPrinterGetID(printer), buf1, sizeof(buf1));
+    if ((fd = open(buf1, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) > 0)
     {
       i = read(fd, buf2, sizeof(buf2) - 1);
       if (i >= 0)
@@ -3690,9 +4588,10 @@ _prPrinterUpdateForInstallableOptions(
   // Save new installable accessories configuration to file
   if (instoptstr && instoptstr != buf2)
   {
-    if ((fd = papplPrinterOpenFile(printer, buf1, sizeof(buf1),
-				   extension->global_data->state_dir,
-				   "inst-opt", "conf", "w")) > 0)
+    inst_options_file_name(extension->global_data->state_dir,
+			   papplPrinterGetID(printer), buf1, sizeof(buf1));
+    if ((fd = open(buf1, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW |
+		   O_CLOEXEC, 0600)) > 0)
     {
       i = write(fd, instoptstr, strlen(instoptstr));
       if (i < strlen(instoptstr))
@@ -3721,8 +4620,10 @@ _prPrinterUpdateForInstallableOptions(
     }
     extension->num_inst_options = cupsParseOptions(instoptstr, 0,
 						   &extension->inst_options);
-    ppdMarkOptions(extension->ppd,
-		   extension->num_inst_options, extension->inst_options);
+
+    // Printers with the same accessory settings share the PPD with these
+    // settings marked
+    driver_instance_switch(system, extension);
 
     // Get a copy of the driver IPP attributes to save the vendor option
     // settings
@@ -3827,6 +4728,398 @@ prSetupDeviceSettingsPage(pappl_printer_t *printer, // I - Printer
 }
 
 
+//
+// 'add_driver_entries()' - Add the driver list entries for a PPD file,
+//                          one for the PPD's own model and one for each
+//                          extra model in its "*Product" entries. The
+//                          driver list and the parallel list of PPD
+//                          paths get enlarged as needed.
+//
+
+static int                      // O - New number of entries
+add_driver_entries(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    ppd_info_t        *ppd,          // I   - PPD file info
+    regex_t           *driver_re,    // I   - Regex for driver info or NULL
+    pappl_pr_driver_t **driver_list, // I/O - Driver list
+    pr_ppd_path_t     ***path_list,  // I/O - PPD paths of the entries
+    int               *alloc_drivers, // I/O - Allocated entries
+    int               i)             // I   - Current number of entries
+{
+  int               j;
+  char              *mfg_mdl, *dev_id;
+  char              *end_model, *drv_name;
+  char              *ppd_model_name;
+  pr_ppd_path_t     *ppd_path;
+  char              driver_info[1024];
+  char              buf1[1024], buf2[1024];
+  char              *ptr;
+  int               pre_normalized;
+  pappl_system_t    *system = global_data->system;
+  pappl_pr_driver_t *drivers;
+  pr_ppd_path_t     **entry_paths;
+
+
+  // Make sure we have room for all entries of this PPD
+  if (i + PPD_MAX_PROD > *alloc_drivers)
+  {
+    *alloc_drivers *= 2;
+    *driver_list =
+      (pappl_pr_driver_t *)reallocarray(*driver_list, *alloc_drivers,
+					sizeof(pappl_pr_driver_t));
+    *path_list =
+      (pr_ppd_path_t **)reallocarray(*path_list, *alloc_drivers,
+				     sizeof(pr_ppd_path_t *));
+  }
+  drivers = *driver_list;
+  entry_paths = *path_list;
+
+  // If we have a regular expression to extract the extra info
+  // (driver info) from the *NickName entries of the PPDs (for
+  // example if the Printer Application contains more than one
+  // driver for some printers) we separate this extra info (at
+  // least the driver name in it) to combine it also with extra
+  // make/model names from *Product entries.
+  buf1[0] = '\0';
+  buf2[0] = '\0';
+  driver_info[0] = '\0';
+  if (driver_re)
+  {
+    // Get driver info from *NickName entry
+    cfIEEE1284NormalizeMakeModel(ppd->record.make_and_model,
+				  NULL,
+				  CF_IEEE1284_NORMALIZE_HUMAN,
+				  driver_re,
+				  buf2, sizeof(buf2),
+				  NULL, &end_model, &drv_name);
+    if (end_model)
+    {
+      ppd->record.make_and_model[end_model - buf2 - strlen(buf2) +
+				 strlen(ppd->record.make_and_model)] =
+	'\0';
+      if (drv_name)
+      {
+	if (drv_name[0])
+	{
+	  if (end_model[0] &&
+	      !strncasecmp(drv_name, end_model, strlen(drv_name)))
+	    snprintf(driver_info, sizeof(driver_info), "%s", drv_name);
+	  else
+	    snprintf(driver_info, sizeof(driver_info), ", %s", drv_name);
+	}
+      }
+      else
+      {
+	if (end_model[0])
+	  snprintf(driver_info, sizeof(driver_info), "%s", end_model);
+      }
+    }
+    else if (global_data->config->components &
+	     PR_COPTIONS_USE_ONLY_MATCHING_NICKNAMES)
+      return (i);
+  }
+  // Note: The last entry in the product list is the ModelName of the
+  // PPD and not an actual Product entry. Therefore we ignore it as
+  // a product name entry (Hidden feature of ppdCollectionListPPDs())
+  for (j = 0; j < PPD_MAX_PROD; j ++)
+    if (!ppd->record.products[j][0])
+      break;
+  ppd_model_name = (j > 0 ? ppd->record.products[j - 1] : NULL);
+  if (!driver_info[0])
+  {
+    if ((ptr = strchr(ppd->record.make_and_model, ',')) != NULL ||
+	(ptr = strchr(ppd->record.make_and_model, '(')) != NULL ||
+	(ptr = strstr(ppd->record.make_and_model, " - ")) != NULL)
+    {
+      if (*ptr == ',') ptr ++;
+      strncpy(driver_info, ptr, sizeof(driver_info) - 1);
+    }
+    else if (ppd_model_name &&
+	     strlen(ppd->record.make_and_model) >=
+	     strlen(ppd_model_name) &&
+	     !strncasecmp(ppd->record.make_and_model,
+			  ppd_model_name, strlen(ppd_model_name)))
+      strncpy(driver_info,
+	      ppd->record.make_and_model + strlen(ppd_model_name),
+	      sizeof(driver_info) - 1);
+  }
+  for (j = -1;
+       j < (global_data->config->components &
+	    PR_COPTIONS_PPD_NO_EXTRA_PRODUCTS ? 0 : PPD_MAX_PROD - 1);
+       j ++)
+  {
+    // End of product list
+    if (j >= 0 &&
+	(!ppd->record.products[j][0] || !ppd->record.products[j + 1][0]))
+      break;
+    // If there is only 1 product, ignore it, it is either the
+    // model of the PPD itself or something weird
+    if (j == 0 &&
+	(!ppd->record.products[1][0] || !ppd->record.products[2][0]))
+      break;
+    pre_normalized = 0;
+    dev_id = NULL;
+    if (j < 0)
+    {
+      // Model of PPD itself
+      if (ppd->record.device_id[0] &&
+	  (strstr(ppd->record.device_id, "MFG:") ||
+	   strstr(ppd->record.device_id, "MANUFACTURER:")) &&
+	  (strstr(ppd->record.device_id, "MDL:") ||
+	   strstr(ppd->record.device_id, "MODEL:")) &&
+	  !strstr(ppd->record.device_id, "MDL:hp_") &&
+	  !strstr(ppd->record.device_id, "MDL:hp-") &&
+	  !strstr(ppd->record.device_id, "MDL:HP_") &&
+	  !strstr(ppd->record.device_id, "MODEL:hp2") &&
+	  !strstr(ppd->record.device_id, "MODEL:hp3") &&
+	  !strstr(ppd->record.device_id, "MODEL:hp9") &&
+	  !strstr(ppd->record.device_id, "MODEL:HP2"))
+      {
+	// To check whether the device ID is not something
+	// weird, unsuitable as a display string, we save the
+	// normalized NickName for comparison. Only if the first
+	// word (cleaned manufacturer name or part of it) is the
+	// same, we accept the data of the device ID as display
+	// string.
+	strncpy(buf1,
+		(buf2[0] ? buf2 : ppd->record.make_and_model),
+		sizeof(buf1));
+	if ((ptr = strchr(buf1, ' ')) != NULL)
+	  *ptr = '\0';
+	// Convert device ID to make/model string, so that we can add
+	// the language for building final index strings
+	mfg_mdl =
+	  cfIEEE1284NormalizeMakeModel(ppd->record.device_id,
+				       NULL,
+				       CF_IEEE1284_NORMALIZE_HUMAN,
+				       NULL, buf2, sizeof(buf2),
+				       NULL, NULL, NULL);
+	if (strncasecmp(mfg_mdl, buf1, strlen(buf1)) == 0)
+	  pre_normalized = 1;
+      }
+      if (pre_normalized == 0)
+      {
+	if (ppd->record.products[0][0] &&
+	    ((ppd->record.products[1][0] &&
+	      ppd->record.products[2][0]) ||
+	     (!strncasecmp(ppd->record.products[0],
+			   ppd->record.make_and_model,
+			   strlen(ppd->record.products[0])))))
+	  mfg_mdl = ppd->record.products[0];
+	else if (ppd_model_name)
+	  mfg_mdl = ppd_model_name;
+	else
+	  mfg_mdl = ppd->record.make_and_model;
+      }
+      if (ppd->record.device_id[0])
+	dev_id = ppd->record.device_id;
+    }
+    else
+      // Extra models in list of products
+      mfg_mdl = ppd->record.products[j];
+    // Remove parentheses from model name if it came from a Product
+    // entry of the PPD
+    if (mfg_mdl[0] == '(' && mfg_mdl[strlen(mfg_mdl) - 1] == ')')
+    {
+      memmove(mfg_mdl, mfg_mdl + 1, strlen(mfg_mdl) - 2);
+      mfg_mdl[strlen(mfg_mdl) - 2] = '\0';
+    }
+    // We preferably register device IDs actually found in the PPD files,
+    // For PPDs without explicit device ID we try our best to fill the
+    // model field with only the model name, without driver specification
+    if (dev_id)
+      drivers[i].device_id = strdup(dev_id);
+    else
+    {
+      snprintf(buf1, sizeof(buf1) - 1, "MFG:%s;MDL:%s;",
+	       ppd->record.make, mfg_mdl);
+      drivers[i].device_id = strdup(buf1);
+    }
+    // New entry for PPD lookup table
+    ppd_path = (pr_ppd_path_t *)calloc(1, sizeof(pr_ppd_path_t));
+    // If we have driver info, make sure the string starts with
+    // ',', '(', or " - "
+    if (driver_info[0])
+    {
+      ptr = driver_info;
+      while (*ptr && *ptr != ',' && *ptr != '(' && strncmp(ptr, " - ", 3))
+      {
+	if (!isalnum(*ptr))
+	  ptr ++;
+	else
+	  break;
+      }
+      if (!*ptr)
+	driver_info[0] = '\0';
+      else if (isalnum(*ptr))
+      {
+	memmove(driver_info + 2, ptr, strlen(ptr) + 1);
+	driver_info[0] = ',';
+	driver_info[1] = ' ';
+      }
+      else
+      {
+	memmove(driver_info, ptr, strlen(ptr) + 1);
+	if (driver_info[0] == '(')
+	{
+	  memmove(driver_info + 1, driver_info, strlen(driver_info) + 1);
+	  driver_info[0] = ' ';
+	}
+      }
+    }
+    // Base make/model/language string to generate the needed index
+    // strings
+    snprintf(buf1, sizeof(buf1) - 1, "%s%s%s (%s)",
+	     mfg_mdl, driver_info,
+	     ((global_data->config->components &
+	       PR_COPTIONS_WEB_ADD_PPDS) &&
+	      !strncmp(ppd->record.name, global_data->user_ppd_dir,
+		       strlen(global_data->user_ppd_dir)) &&
+	      ppd->record.name[strlen(global_data->user_ppd_dir)] == '/' ?
+	      " - USER-ADDED" : ""),
+	     ppd->record.languages[0]);
+    // IPP-compatible string as driver name
+    drivers[i].name =
+      strdup(cfIEEE1284NormalizeMakeModel(buf1, ppd->record.make,
+					  CF_IEEE1284_NORMALIZE_IPP,
+					  NULL, buf2, sizeof(buf2),
+					  NULL, NULL, NULL));
+    ppd_path->driver_name = strdup(drivers[i].name);
+    // Path to grab PPD from repositories
+    ppd_path->ppd_path = strdup(ppd->record.name);
+    entry_paths[i] = ppd_path;
+    // Human-readable string to appear in the driver drop-down
+    if (pre_normalized)
+      drivers[i].description = strdup(buf1);
+    else
+      drivers[i].description =
+	strdup(cfIEEE1284NormalizeMakeModel(buf1, ppd->record.make,
+					    CF_IEEE1284_NORMALIZE_HUMAN,
+					    NULL, buf2, sizeof(buf2),
+					    NULL, NULL, NULL));
+    // List sorting index with padded numbers (typos in example intended)
+    // "LaserJet 3P" < "laserjet 4P" < "Laserjet3000P" < "LaserJet 4000P"
+    drivers[i].extension =
+      strdup(cfIEEE1284NormalizeMakeModel(buf1, ppd->record.make,
+				  CF_IEEE1284_NORMALIZE_COMPARE |
+				  CF_IEEE1284_NORMALIZE_LOWERCASE |
+				  CF_IEEE1284_NORMALIZE_SEPARATOR_SPACE |
+				  CF_IEEE1284_NORMALIZE_PAD_NUMBERS,
+				  NULL, buf2, sizeof(buf2),
+				  NULL, NULL, NULL));
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
+	     "File: %s; Make: %s; NickName: %s; ModelName: %s; DevID: %s; Printer (%d): %s (%s); --> Entry %d: Driver %s; "
+	     "Description: %s; Device ID: %s; Sorting index: %s",
+	     ppd_path->ppd_path, ppd->record.make,
+	     ppd->record.make_and_model, ppd_model_name,
+	     ppd->record.device_id, j, buf1, driver_info, i,
+	     drivers[i].name,
+	     drivers[i].description, drivers[i].device_id,
+	     (char *)(drivers[i].extension));
+    // Next position in the list
+    i ++;
+  }
+
+  return (i);
+}
+
+
+//
+// 'compile_driver_regex()' - Compile the regular expression for separating
+//                            the driver info from the model name in the
+//                            "*NickName" entries of the PPD files.
+//
+
+static regex_t *                // O - Compiled regex, NULL if none
+compile_driver_regex(
+    pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  regex_t *driver_re = NULL;    // Compiled regular expression
+
+
+  if (global_data->config->driver_display_regex)
+  {
+    if ((driver_re = (regex_t *)calloc(1, sizeof(regex_t))) != NULL)
+    {
+      if (regcomp(driver_re, global_data->config->driver_display_regex,
+		  REG_ICASE | REG_EXTENDED))
+      {
+	free(driver_re);
+	driver_re = NULL;
+	papplLog(global_data->system, PAPPL_LOGLEVEL_ERROR,
+		 "Invalid regular expression: %s",
+		 global_data->config->driver_display_regex);
+      }
+    }
+  }
+
+  return (driver_re);
+}
+
+
+//
+// '_prCompareDrivers()' - Compare function for sorting the driver list by
+//                         the sorting index in the extension field, with
+//                         generic drivers first. Entries with the same
+//                         index keep their original order.
+//
+
+int
+_prCompareDrivers(const void *a, // I - First driver entry
+		  const void *b) // I - Second driver entry
+{
+  const pappl_pr_driver_t *aa = *((const pappl_pr_driver_t **)a),
+                          *bb = *((const pappl_pr_driver_t **)b);
+  const char *ea = (const char *)aa->extension,
+             *eb = (const char *)bb->extension;
+  int ga = !strncmp(ea, "generic  ", 9),
+      gb = !strncmp(eb, "generic  ", 9),
+      result;
+
+
+  if (ga != gb)
+    return (ga ? -1 : 1);
+  if ((result = strcmp(ea, eb)) != 0)
+    return (result);
+  return (aa < bb ? -1 : (aa > bb ? 1 : 0));
+}
+
+
+//
+// '_prDriverHashSlot()' - Find the slot for a string in an open-addressing
+//                         hash table (FNV-1a hash, linear probing). It is
+//                         either the slot holding the string or the empty
+//                         slot where to put it. The table size must be a
+//                         power of 2 and larger than the number of
+//                         entries.
+//
+
+size_t                           // O - Slot
+_prDriverHashSlot(const char **table,  // I - Hash table
+		  size_t     size,     // I - Size of the table
+		  const char *s,       // I - String
+		  bool       nocase)   // I - Case-insensitive?
+{
+  uint64_t   hash = 0xcbf29ce484222325ULL; // FNV-1a hash
+  const char *ptr;                  // Pointer into string
+  size_t     slot;                  // Current slot
+
+
+  for (ptr = s; *ptr; ptr ++)
+  {
+    hash ^= (unsigned char)(nocase ? tolower(*ptr & 255) : *ptr);
+    hash *= 0x100000001b3ULL;
+  }
+
+  for (slot = (size_t)hash & (size - 1);
+       table[slot] &&
+	 (nocase ? strcasecmp(table[slot], s) : strcmp(table[slot], s));
+       slot = (slot + 1) & (size - 1));
+
+  return (slot);
+}
+
+
 //
 // '_prSetupDriverList()' - Create a driver list of the available PPD files.
 //
@@ -3834,35 +5127,45 @@ prSetupDeviceSettingsPage(pappl_printer_t *printer, // I - Printer
 void
 _prSetupDriverList(pr_printer_app_global_data_t *global_data)
 {
-  int              i, j, k;
-  char             *generic_ppd, *mfg_mdl, *dev_id;
-  char             *end_model, *drv_name;
-  char             *ppd_model_name;
+  int              i, j;
+  char             *generic_ppd;
   pr_ppd_path_t    *ppd_path;
-  int              num_options = 0;
-  cups_option_t    *options = NULL;
   cups_array_t     *ppds;
   ppd_info_t       *ppd;
-  char             driver_info[1024];
-  char             buf1[1024], buf2[1024];
-  char             *ptr;
-  int              pre_normalized;
-  pappl_pr_driver_t swap;
   pappl_system_t   *system = global_data->system;
-  int              num_drivers = global_data->num_drivers;
-  pappl_pr_driver_t *drivers = global_data->drivers;
-  cups_array_t     *ppd_paths = global_data->ppd_paths,
-                   *ppd_collections = global_data->ppd_collections;
+  int              num_drivers,
+                   alloc_drivers;       // Allocated driver entries
+  pappl_pr_driver_t *drivers,
+                   *sorted_drivers,     // Final, sorted driver list
+                   **sorted;            // Driver entries in sorting order
+  pr_ppd_path_t    **entry_paths;       // PPD paths of the driver entries
+  cups_array_t     *ppd_paths;
   regex_t          *driver_re = NULL;
+  uint64_t         index_key;
+  const char       **names,             // Hash tables for finding
+                   **descs;             // duplicates
+  size_t           hash_size,           // Size of the hash tables
+                   name_slot,           // Slot for driver name
+                   desc_slot;           // Slot for description
+
+
+  //
+  // Use the driver index file from the last run if nothing in the PPD
+  // collections has changed, this saves us from opening every PPD file
+  //
 
+  index_key = _prDriverIndexKey(global_data);
+  if (_prDriverIndexLoad(global_data, index_key))
+  {
+    _prDriverListPublish(global_data);
+    return;
+  }
 
   //
   // Create the list of all available PPD files
   //
 
-  ppds = ppdCollectionListPPDs(ppd_collections, 0,
-			       num_options, options,
-			       (cf_logfunc_t)papplLog, system);
+  ppds = _prDriverIndexListPPDs(global_data);
 
   //
   // Create driver list from the PPD list and submit it
@@ -3872,7 +5175,7 @@ _prSetupDriverList(pr_printer_app_global_data_t *global_data)
   {
     i = 0;
     num_drivers = cupsArrayCount(ppds);
-    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 	     "Found %d PPD files.", num_drivers);
     generic_ppd = NULL;
     if (!(global_data->config->components & PR_COPTIONS_NO_GENERIC_DRIVER))
@@ -3891,367 +5194,396 @@ _prSetupDriverList(pr_printer_app_global_data_t *global_data)
 	}
       }
       if (generic_ppd)
-	papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	_PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		 "Found generic PPD file: %s", generic_ppd);
       else
-	papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	_PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
 		 "No generic PPD file found, "
 		 "Printer Application will only support printers "
 		 "explicitly supported by the PPD files");
     }
-    // Create driver indices
-    if (drivers)
-      free(drivers);
-    drivers = (pappl_pr_driver_t *)calloc(num_drivers + PPD_MAX_PROD,
+    // Collect the driver entries, they get de-duplicated and sorted
+    // when all are there. The PPD paths of the entries are kept in a
+    // parallel array, so that the ones of duplicates can get dropped
+    alloc_drivers = num_drivers + PPD_MAX_PROD;
+    drivers = (pappl_pr_driver_t *)calloc(alloc_drivers,
 					  sizeof(pappl_pr_driver_t));
-    // Create list of PPD file paths
-    if (ppd_paths)
-      cupsArrayDelete(ppd_paths);
-    ppd_paths = cupsArrayNew(_prComparePPDPaths, NULL);
+    entry_paths = (pr_ppd_path_t **)calloc(alloc_drivers,
+					   sizeof(pr_ppd_path_t *));
     if (generic_ppd)
     {
       drivers[i].name = strdup("generic");
       drivers[i].description = strdup("Generic Printer");
       drivers[i].device_id = strdup("");
       drivers[i].extension = strdup(" generic");
-      i ++;
       ppd_path = (pr_ppd_path_t *)calloc(1, sizeof(pr_ppd_path_t));
       ppd_path->driver_name = strdup("generic");
-      ppd_path->ppd_path = strdup(generic_ppd);
-      cupsArrayAdd(ppd_paths, ppd_path);
-    }
-    if (global_data->config->driver_display_regex)
-    {
-      // Compile the regular expression for separating the driver info
-      // from the model name
-      if ((driver_re = (regex_t *)calloc(1, sizeof(regex_t))) != NULL)
-      {
-	if (regcomp(driver_re, global_data->config->driver_display_regex,
-		    REG_ICASE | REG_EXTENDED))
-	{
-	  regfree(driver_re);
-	  driver_re = NULL;
-	  papplLog(system, PAPPL_LOGLEVEL_ERROR,
-		   "Invalid regular expression: %s",
-		   global_data->config->driver_display_regex);
-	}
-      }
-    }
-    for (ppd = (ppd_info_t *)cupsArrayFirst(ppds);
-	 ppd;
-	 ppd = (ppd_info_t *)cupsArrayNext(ppds))
-    {
-      if (!generic_ppd || strcmp(ppd->record.name, generic_ppd))
-      {
-	// If we have a regular expression to extract the extra info
-	// (driver info) from the *NickName entries of the PPDs (for
-	// example if the Printer Application contains more than one
-	// driver for some printers) we separate this extra info (at
-	// least the driver name in it) to combine it also with extra
-	// make/model names from *Product entries.
-	buf1[0] = '\0';
-	buf2[0] = '\0';
-	driver_info[0] = '\0';
-	if (driver_re)
-        {
-	  // Get driver info from *NickName entry
-	  cfIEEE1284NormalizeMakeModel(ppd->record.make_and_model,
-					NULL,
-					CF_IEEE1284_NORMALIZE_HUMAN,
-				        driver_re,
-					buf2, sizeof(buf2),
-					NULL, &end_model, &drv_name);
-	  if (end_model)
-	  {
-	    ppd->record.make_and_model[end_model - buf2 - strlen(buf2) +
-				       strlen(ppd->record.make_and_model)] =
-	      '\0';
-	    if (drv_name)
-	    {
-	      if (drv_name[0])
-	      {
-		if (end_model[0] &&
-		    !strncasecmp(drv_name, end_model, strlen(drv_name)))
-		  snprintf(driver_info, sizeof(driver_info), "%s", drv_name);
-		else
-		  snprintf(driver_info, sizeof(driver_info), ", %s", drv_name);
-	      }
-	    }
-	    else
-	    {
-	      if (end_model[0])
-		snprintf(driver_info, sizeof(driver_info), "%s", end_model);
-	    }
-	  }
-	  else if (global_data->config->components &
-		   PR_COPTIONS_USE_ONLY_MATCHING_NICKNAMES)
-	  {
-	    free(ppd);
-	    continue;
-	  }
-	}
-	// Note: The last entry in the product list is the ModelName of the
-	// PPD and not an actual Product entry. Therefore we ignore it as
-	// a product name entry (Hidden feature of ppdCollectionListPPDs())
-	for (j = 0; j < PPD_MAX_PROD; j ++)
-	  if (!ppd->record.products[j][0])
-	    break;
-	ppd_model_name = (j > 0 ? ppd->record.products[j - 1] : NULL);
-	if (!driver_info[0])
-	{
-	  if ((ptr = strchr(ppd->record.make_and_model, ',')) != NULL ||
-	      (ptr = strchr(ppd->record.make_and_model, '(')) != NULL ||
-	      (ptr = strstr(ppd->record.make_and_model, " - ")) != NULL)
-	  {
-	    if (*ptr == ',') ptr ++;
-	    strncpy(driver_info, ptr, sizeof(driver_info) - 1);
-	  }
-	  else if (ppd_model_name &&
-		   strlen(ppd->record.make_and_model) >=
-		   strlen(ppd_model_name) &&
-		   !strncasecmp(ppd->record.make_and_model,
-				ppd_model_name, strlen(ppd_model_name)))
-	    strncpy(driver_info,
-		    ppd->record.make_and_model + strlen(ppd_model_name),
-		    sizeof(driver_info) - 1);
-	}
-        for (j = -1;
-	     j < (global_data->config->components &
-		  PR_COPTIONS_PPD_NO_EXTRA_PRODUCTS ? 0 : PPD_MAX_PROD - 1);
-	     j ++)
-	{
-	  // End of product list
-          if (j >= 0 &&
-	      (!ppd->record.products[j][0] || !ppd->record.products[j + 1][0]))
-            break;
-	  // If there is only 1 product, ignore it, it is either the
-	  // model of the PPD itself or something weird
-	  if (j == 0 &&
-	      (!ppd->record.products[1][0] || !ppd->record.products[2][0]))
-	    break;
-	  pre_normalized = 0;
-	  dev_id = NULL;
-	  if (j < 0)
-	  {
-	    // Model of PPD itself
-	    if (ppd->record.device_id[0] &&
-		(strstr(ppd->record.device_id, "MFG:") ||
-		 strstr(ppd->record.device_id, "MANUFACTURER:")) &&
-		(strstr(ppd->record.device_id, "MDL:") ||
-		 strstr(ppd->record.device_id, "MODEL:")) &&
-		!strstr(ppd->record.device_id, "MDL:hp_") &&
-		!strstr(ppd->record.device_id, "MDL:hp-") &&
-		!strstr(ppd->record.device_id, "MDL:HP_") &&
-		!strstr(ppd->record.device_id, "MODEL:hp2") &&
-		!strstr(ppd->record.device_id, "MODEL:hp3") &&
-		!strstr(ppd->record.device_id, "MODEL:hp9") &&
-		!strstr(ppd->record.device_id, "MODEL:HP2"))
-	    {
-	      // To check whether the device ID is not something
-	      // weird, unsuitable as a display string, we save the
-	      // normalized NickName for comparison. Only if the first
-	      // word (cleaned manufacturer name or part of it) is the
-	      // same, we accept the data of the device ID as display
-	      // string.
-	      strncpy(buf1,
-		      (buf2[0] ? buf2 : ppd->record.make_and_model),
-		      sizeof(buf1));
-	      if ((ptr = strchr(buf1, ' ')) != NULL)
-		*ptr = '\0';
-	      // Convert device ID to make/model string, so that we can add
-	      // the language for building final index strings
-	      mfg_mdl =
-		cfIEEE1284NormalizeMakeModel(ppd->record.device_id,
-					     NULL,
-					     CF_IEEE1284_NORMALIZE_HUMAN,
-					     NULL, buf2, sizeof(buf2),
-					     NULL, NULL, NULL);
-	      if (strncasecmp(mfg_mdl, buf1, strlen(buf1)) == 0)
-		pre_normalized = 1;
-	    }
-	    if (pre_normalized == 0)
-	    {
-	      if (ppd->record.products[0][0] &&
-		  ((ppd->record.products[1][0] &&
-		    ppd->record.products[2][0]) ||
-		   (!strncasecmp(ppd->record.products[0],
-				 ppd->record.make_and_model,
-				 strlen(ppd->record.products[0])))))
-		mfg_mdl = ppd->record.products[0];
-	      else if (ppd_model_name)
-		mfg_mdl = ppd_model_name;
-	      else
-		mfg_mdl = ppd->record.make_and_model;
-	    }
-	    if (ppd->record.device_id[0])
-	      dev_id = ppd->record.device_id;
-	  }
-	  else
-	    // Extra models in list of products
-	    mfg_mdl = ppd->record.products[j];
-	  // Remove parentheses from model name if it came from a Product
-	  // entry of the PPD
-	  if (mfg_mdl[0] == '(' && mfg_mdl[strlen(mfg_mdl) - 1] == ')')
-	  {
-	    memmove(mfg_mdl, mfg_mdl + 1, strlen(mfg_mdl) - 2);
-	    mfg_mdl[strlen(mfg_mdl) - 2] = '\0';
-	  }
-	  // We preferably register device IDs actually found in the PPD files,
-	  // For PPDs without explicit device ID we try our best to fill the
-	  // model field with only the model name, without driver specification
-	  if (dev_id)
-	    drivers[i].device_id = strdup(dev_id);
-	  else
-	  {
-	    snprintf(buf1, sizeof(buf1) - 1, "MFG:%s;MDL:%s;",
-		     ppd->record.make, mfg_mdl);
-	    drivers[i].device_id = strdup(buf1);
-	  }
-	  // New entry for PPD lookup table
-	  ppd_path = (pr_ppd_path_t *)calloc(1, sizeof(pr_ppd_path_t));
-	  // If we have driver info, make sure the string starts with
-	  // ',', '(', or " - "
-	  if (driver_info[0])
-	  {
-	    ptr = driver_info;
-	    while (*ptr && *ptr != ',' && *ptr != '(' && strncmp(ptr, " - ", 3))
-	    {
-	      if (!isalnum(*ptr))
-		ptr ++;
-	      else
-		break;
-	    }
-	    if (!*ptr)
-	      driver_info[0] = '\0';
-	    else if (isalnum(*ptr))
-	    {
-	      memmove(driver_info + 2, ptr, strlen(ptr) + 1);
-	      driver_info[0] = ',';
-	      driver_info[1] = ' ';
-	    }
-	    else
-	    {
-	      memmove(driver_info, ptr, strlen(ptr) + 1);
-	      if (driver_info[0] == '(')
-	      {
-		memmove(driver_info + 1, driver_info, strlen(driver_info) + 1);
-		driver_info[0] = ' ';
-	      }
-	    }
-	  }
-	  // Base make/model/language string to generate the needed index
-	  // strings
-	  snprintf(buf1, sizeof(buf1) - 1, "%s%s%s (%s)",
-		   mfg_mdl, driver_info,
-		   ((global_data->config->components &
-		     PR_COPTIONS_WEB_ADD_PPDS) &&
-		    !strncmp(ppd->record.name, global_data->user_ppd_dir,
-			     strlen(global_data->user_ppd_dir)) &&
-		    ppd->record.name[strlen(global_data->user_ppd_dir)] == '/' ?
-		    " - USER-ADDED" : ""),
-		   ppd->record.languages[0]);
-	  // IPP-compatible string as driver name
-	  drivers[i].name =
-	    strdup(cfIEEE1284NormalizeMakeModel(buf1, ppd->record.make,
-						CF_IEEE1284_NORMALIZE_IPP,
-						NULL, buf2, sizeof(buf2),
-						NULL, NULL, NULL));
-	  ppd_path->driver_name = strdup(drivers[i].name);
-	  // Path to grab PPD from repositories
-	  ppd_path->ppd_path = strdup(ppd->record.name);
-	  cupsArrayAdd(ppd_paths, ppd_path);
-	  // Human-readable string to appear in the driver drop-down
-	  if (pre_normalized)
-	    drivers[i].description = strdup(buf1);
-	  else
-	    drivers[i].description =
-	      strdup(cfIEEE1284NormalizeMakeModel(buf1, ppd->record.make,
-						  CF_IEEE1284_NORMALIZE_HUMAN,
-						  NULL, buf2, sizeof(buf2),
-						  NULL, NULL, NULL));
-	  // List sorting index with padded numbers (typos in example intended)
-	  // "LaserJet 3P" < "laserjet 4P" < "Laserjet3000P" < "LaserJet 4000P"
-	  drivers[i].extension =
-	    strdup(cfIEEE1284NormalizeMakeModel(buf1, ppd->record.make,
-					CF_IEEE1284_NORMALIZE_COMPARE |
-					CF_IEEE1284_NORMALIZE_LOWERCASE |
-					CF_IEEE1284_NORMALIZE_SEPARATOR_SPACE |
-					CF_IEEE1284_NORMALIZE_PAD_NUMBERS,
-					NULL, buf2, sizeof(buf2),
-					NULL, NULL, NULL));
-	  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
-		   "File: %s; Make: %s; NickName: %s; ModelName: %s; DevID: %s; Printer (%d): %s (%s); --> Entry %d: Driver %s; "
-		   "Description: %s; Device ID: %s; Sorting index: %s",
-		   ppd_path->ppd_path, ppd->record.make,
-		   ppd->record.make_and_model, ppd_model_name,
-		   ppd->record.device_id, j, buf1, driver_info, i,
-		   drivers[i].name,
-		   drivers[i].description, drivers[i].device_id,
-		   (char *)(drivers[i].extension));
-	  // Sort the new entry into the list via the extension
-	  for (k = i;
-	       k > 0 &&
-		 ((strncmp(drivers[k - 1].extension, "generic  ", 9) &&
-		   !strncmp(drivers[k].extension, "generic  ", 9)) ||
-		  strcmp((char *)(drivers[k - 1].extension),
-			 (char *)(drivers[k].extension)) > 0);
-	       k --)
-	  {
-	    swap = drivers[k - 1];
-	    drivers[k - 1] = drivers[k];
-	    drivers[k] = swap;
-	  }
-	  // Check for duplicates
-	  if (k > 0 &&
-	      (strcmp(drivers[k - 1].name, drivers[k].name) == 0 ||
-	       strcasecmp(drivers[k - 1].description,
-			  drivers[k].description) == 0))
-	  {
-	    // Remove the duplicate
-	    // We do not count the freeable memory here as in the end
-	    // we adjust the allocated memory anyway
-	    memmove(&drivers[k], &drivers[k + 1],
-		    (i - k) * sizeof(pappl_pr_driver_t));
-	    i --;
-	    papplLog(system, PAPPL_LOGLEVEL_DEBUG,
-		     "DUPLICATE REMOVED!");
-	  }
-	  // Next position in the list
-	  i ++;
-	}
-	// Add memory for PPD with multiple product entries
-	num_drivers += j;
-	drivers = (pappl_pr_driver_t *)reallocarray(drivers,
-						    num_drivers +
-						    PPD_MAX_PROD,
-						    sizeof(pappl_pr_driver_t));
+      ppd_path->ppd_path = strdup(generic_ppd);
+      entry_paths[i] = ppd_path;
+      i ++;
+    }
+    // Compile the regular expression for separating the driver info
+    // from the model name
+    driver_re = compile_driver_regex(global_data);
+    for (ppd = (ppd_info_t *)cupsArrayFirst(ppds);
+	 ppd;
+	 ppd = (ppd_info_t *)cupsArrayNext(ppds))
+    {
+      if (!generic_ppd || strcmp(ppd->record.name, generic_ppd))
+      {
+	i = add_driver_entries(global_data, ppd, driver_re, &drivers,
+			       &entry_paths, &alloc_drivers, i);
       }
       free(ppd);
     }
 
     // Free the compiled regular expression
     if (driver_re)
+    {
       regfree(driver_re);
+      free(driver_re);
+    }
 
     cupsArrayDelete(ppds);
 
-    // Final adjustment of allocated memory
-    drivers = (pappl_pr_driver_t *)reallocarray(drivers, i,
-						sizeof(pappl_pr_driver_t));
-    num_drivers = i;
+    // Remove duplicates: Of entries with the same driver name or the
+    // same description (case-insensitive) the first one wins, so the
+    // generic driver and PPDs found earlier in the collections take
+    // precedence
+    for (hash_size = 64; hash_size < 2 * (size_t)i; hash_size *= 2);
+    names = (const char **)calloc(hash_size, sizeof(const char *));
+    descs = (const char **)calloc(hash_size, sizeof(const char *));
+    ppd_paths = cupsArrayNew(_prComparePPDPaths, NULL);
+    for (j = 0, num_drivers = 0; j < i; j ++)
+    {
+      name_slot = _prDriverHashSlot(names, hash_size, drivers[j].name,
+				    false);
+      desc_slot = _prDriverHashSlot(descs, hash_size, drivers[j].description,
+				    true);
+      if (names[name_slot] || descs[desc_slot])
+      {
+	_PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
+		"DUPLICATE REMOVED: %s (%s)", drivers[j].name,
+		drivers[j].description);
+	free((char *)drivers[j].name);
+	free((char *)drivers[j].description);
+	free((char *)drivers[j].device_id);
+	free(drivers[j].extension);
+	free((char *)entry_paths[j]->driver_name);
+	free((char *)entry_paths[j]->ppd_path);
+	free(entry_paths[j]);
+	continue;
+      }
+      names[name_slot] = drivers[j].name;
+      descs[desc_slot] = drivers[j].description;
+      cupsArrayAdd(ppd_paths, entry_paths[j]);
+      drivers[num_drivers ++] = drivers[j];
+    }
+    free(names);
+    free(descs);
+    free(entry_paths);
+
+    // Sort the list via the extension, all in one go
+    sorted = (pappl_pr_driver_t **)calloc(num_drivers + 1,
+					  sizeof(pappl_pr_driver_t *));
+    for (j = 0; j < num_drivers; j ++)
+      sorted[j] = drivers + j;
+    qsort(sorted, (size_t)num_drivers, sizeof(pappl_pr_driver_t *),
+	  _prCompareDrivers);
+    sorted_drivers = (pappl_pr_driver_t *)calloc(num_drivers + 1,
+						 sizeof(pappl_pr_driver_t));
+    for (j = 0; j < num_drivers; j ++)
+      sorted_drivers[j] = *(sorted[j]);
+    free(sorted);
+    free(drivers);
+    drivers = sorted_drivers;
+
     papplLog(system, PAPPL_LOGLEVEL_DEBUG,
 	     "Created %d driver entries.", num_drivers);
     global_data->num_drivers = num_drivers;
     global_data->drivers = drivers;
     global_data->ppd_paths = ppd_paths;
+
+    // Save the list for the next start
+    _prDriverIndexSave(global_data, index_key);
   }
   else
+  {
     papplLog(system, PAPPL_LOGLEVEL_FATAL, "No PPD files found.");
 
-  papplSystemSetPrinterDrivers(system, num_drivers, drivers,
-			       global_data->config->autoadd_cb,
-			       global_data->config->printer_extra_setup_cb,
-			       _prDriverSetup, global_data);
+    // Keep the current list if we have one, otherwise submit an empty
+    // list to register our callbacks
+    if (global_data->driver_list)
+      return;
+    global_data->num_drivers = 0;
+    global_data->drivers     = NULL;
+    global_data->ppd_paths   = NULL;
+  }
+
+  // The old list gets freed when neither PAPPL nor anyone else uses it
+  // any more
+  _prDriverListPublish(global_data);
+}
+
+
+//
+// '_prUpdateDriverList()' - Update the driver list after PPD files got
+//                           added to or removed from the PPD collections,
+//                           for example uploaded by the user.
+//
+//                           Only the entries of the affected PPD files get
+//                           removed from or added to the driver list and
+//                           the PPD path list, only the directories of
+//                           added files get scanned, so this is fast also
+//                           with thousands of PPD files. Files in "added"
+//                           which were already there (replaced by an
+//                           upload) get their old entries replaced.
+//
+//                           Entries of the existing list win over new
+//                           ones with the same name or description, as
+//                           the user PPD directory is the last
+//                           collection. Entries which were dropped as
+//                           duplicates of an entry being removed now do
+//                           not come back, this needs a full refresh via
+//                           _prSetupDriverList().
+//
+
+void
+_prUpdateDriverList(
+    pr_printer_app_global_data_t *global_data, // I - Global data
+    cups_array_t *added,        // I - Paths of added PPD files or NULL
+    cups_array_t *removed)      // I - Paths of removed PPD files or NULL
+{
+  int              i, j,
+                   num_kept;            // Number of kept entries
+  char             *path,               // PPD file path
+                   *dir,                // Directory of PPD file
+                   *ptr;                // Pointer into path
+  pr_ppd_path_t    *ppd_path,           // PPD path entry
+                   key;                 // Search key for PPD path list
+  ppd_collection_t *dir_cols;           // Directories to scan
+  cups_array_t     *changed,            // Added and removed PPD files
+                   *dirs,               // Directories of added PPD files
+                   *added_set,          // Added PPD files
+                   *removed_names,      // Driver names to remove
+                   *collections,        // Collection list for scanning
+                   *ppds,               // PPDs in user PPD directory
+                   *ppd_paths;          // New PPD path list
+  ppd_info_t       *ppd;
+  regex_t          *driver_re;
+  pappl_system_t   *system = global_data->system;
+  int              num_drivers,
+                   alloc_drivers;       // Allocated driver entries
+  pappl_pr_driver_t *drivers,
+                   *sorted_drivers,     // Final, sorted driver list
+                   **sorted;            // Driver entries in sorting order
+  pr_ppd_path_t    **entry_paths;       // PPD paths of the driver entries
+  const char       **names,             // Hash tables for finding
+                   **descs;             // duplicates
+  size_t           hash_size,           // Size of the hash tables
+                   name_slot,           // Slot for driver name
+                   desc_slot;           // Slot for description
+  int              old_num_drivers = global_data->num_drivers;
+  pappl_pr_driver_t *old_drivers = global_data->drivers;
+  cups_array_t     *old_ppd_paths = global_data->ppd_paths;
+
+
+  if (cupsArrayCount(added) == 0 && cupsArrayCount(removed) == 0)
+    return;
+
+  // Without a driver list we cannot do it incrementally
+  if (!old_drivers)
+  {
+    _prSetupDriverList(global_data);
+    return;
+  }
+
+  //
+  // Sorted sets of the changed PPD files, for fast lookup
+  //
+
+  changed = cupsArrayNew((cups_array_func_t)strcmp, NULL);
+  added_set = cupsArrayNew((cups_array_func_t)strcmp, NULL);
+  for (path = (char *)cupsArrayFirst(added);
+       path;
+       path = (char *)cupsArrayNext(added))
+  {
+    cupsArrayAdd(changed, path);
+    cupsArrayAdd(added_set, path);
+  }
+  for (path = (char *)cupsArrayFirst(removed);
+       path;
+       path = (char *)cupsArrayNext(removed))
+    cupsArrayAdd(changed, path);
+
+  //
+  // Find the entries of the changed PPD files
+  //
+
+  removed_names = cupsArrayNew((cups_array_func_t)strcmp, NULL);
+  for (ppd_path = (pr_ppd_path_t *)cupsArrayFirst(old_ppd_paths);
+       ppd_path;
+       ppd_path = (pr_ppd_path_t *)cupsArrayNext(old_ppd_paths))
+    if (cupsArrayFind(changed, (void *)ppd_path->ppd_path))
+      cupsArrayAdd(removed_names, (void *)ppd_path->driver_name);
+
+  //
+  // Copy the entries which we keep, they are already free of duplicates
+  // and sorted. The old list stays published until the new one replaces
+  // it and can be in use after that, so the new list gets its own copies
+  //
+
+  alloc_drivers = old_num_drivers + PPD_MAX_PROD;
+  drivers = (pappl_pr_driver_t *)calloc(alloc_drivers,
+					sizeof(pappl_pr_driver_t));
+  entry_paths = (pr_ppd_path_t **)calloc(alloc_drivers,
+					 sizeof(pr_ppd_path_t *));
+  for (i = 0, j = 0; j < old_num_drivers; j ++)
+  {
+    if (cupsArrayFind(removed_names, (void *)old_drivers[j].name))
+      continue;
+    key.driver_name = old_drivers[j].name;
+    if ((ppd_path =
+	 (pr_ppd_path_t *)cupsArrayFind(old_ppd_paths, &key)) == NULL)
+      continue;
+    drivers[i].name        = strdup(old_drivers[j].name);
+    drivers[i].description = strdup(old_drivers[j].description);
+    drivers[i].device_id   = strdup(old_drivers[j].device_id);
+    drivers[i].extension   = strdup((char *)old_drivers[j].extension);
+    entry_paths[i] = (pr_ppd_path_t *)calloc(1, sizeof(pr_ppd_path_t));
+    entry_paths[i]->driver_name = strdup(ppd_path->driver_name);
+    entry_paths[i]->ppd_path    = strdup(ppd_path->ppd_path);
+    i ++;
+  }
+  num_kept = i;
+
+  //
+  // Create the entries for the added PPD files
+  //
+
+  if (cupsArrayCount(added_set) > 0)
+  {
+    // Scan only the directories holding the added files
+    dirs = cupsArrayNew3((cups_array_func_t)strcmp, NULL, NULL, 0, NULL,
+			 (cups_afree_func_t)free);
+    for (path = (char *)cupsArrayFirst(added_set);
+	 path;
+	 path = (char *)cupsArrayNext(added_set))
+      if ((ptr = strrchr(path, '/')) != NULL && ptr > path)
+      {
+	dir = strndup(path, (size_t)(ptr - path));
+	if (cupsArrayFind(dirs, dir))
+	  free(dir);
+	else
+	  cupsArrayAdd(dirs, dir);
+      }
+    collections = cupsArrayNew(NULL, NULL);
+    dir_cols = (ppd_collection_t *)calloc(cupsArrayCount(dirs) + 1,
+					  sizeof(ppd_collection_t));
+    for (j = 0, dir = (char *)cupsArrayFirst(dirs);
+	 dir;
+	 j ++, dir = (char *)cupsArrayNext(dirs))
+    {
+      dir_cols[j].name = NULL;
+      dir_cols[j].path = dir;
+      cupsArrayAdd(collections, dir_cols + j);
+    }
+    ppds = ppdCollectionListPPDs(collections, 0, 0, NULL,
+				 (cf_logfunc_t)papplLog, system);
+    cupsArrayDelete(collections);
+    free(dir_cols);
+    cupsArrayDelete(dirs);
+
+    driver_re = compile_driver_regex(global_data);
+    for (ppd = (ppd_info_t *)cupsArrayFirst(ppds);
+	 ppd;
+	 ppd = (ppd_info_t *)cupsArrayNext(ppds))
+    {
+      if (cupsArrayFind(added_set, ppd->record.name))
+	i = add_driver_entries(global_data, ppd, driver_re, &drivers,
+			       &entry_paths, &alloc_drivers, i);
+      free(ppd);
+    }
+    cupsArrayDelete(ppds);
+    if (driver_re)
+    {
+      regfree(driver_re);
+      free(driver_re);
+    }
+  }
+
+  //
+  // Drop new entries which duplicate already present ones
+  //
+
+  for (hash_size = 64; hash_size < 2 * (size_t)i; hash_size *= 2);
+  names = (const char **)calloc(hash_size, sizeof(const char *));
+  descs = (const char **)calloc(hash_size, sizeof(const char *));
+  ppd_paths = cupsArrayNew(_prComparePPDPaths, NULL);
+  for (j = 0, num_drivers = 0; j < i; j ++)
+  {
+    name_slot = _prDriverHashSlot(names, hash_size, drivers[j].name,
+				  false);
+    desc_slot = _prDriverHashSlot(descs, hash_size, drivers[j].description,
+				  true);
+    if (j >= num_kept && (names[name_slot] || descs[desc_slot]))
+    {
+      _PR_LOG(system, PAPPL_LOGLEVEL_DEBUG,
+	      "DUPLICATE REMOVED: %s (%s)", drivers[j].name,
+	      drivers[j].description);
+      free((char *)drivers[j].name);
+      free((char *)drivers[j].description);
+      free((char *)drivers[j].device_id);
+      free(drivers[j].extension);
+      free((char *)entry_paths[j]->driver_name);
+      free((char *)entry_paths[j]->ppd_path);
+      free(entry_paths[j]);
+      continue;
+    }
+    names[name_slot] = drivers[j].name;
+    descs[desc_slot] = drivers[j].description;
+    cupsArrayAdd(ppd_paths, entry_paths[j]);
+    drivers[num_drivers ++] = drivers[j];
+  }
+  free(names);
+  free(descs);
+  free(entry_paths);
+
+  //
+  // Sort the list
+  //
+
+  sorted = (pappl_pr_driver_t **)calloc(num_drivers + 1,
+					sizeof(pappl_pr_driver_t *));
+  for (j = 0; j < num_drivers; j ++)
+    sorted[j] = drivers + j;
+  qsort(sorted, (size_t)num_drivers, sizeof(pappl_pr_driver_t *),
+	_prCompareDrivers);
+  sorted_drivers = (pappl_pr_driver_t *)calloc(num_drivers + 1,
+					       sizeof(pappl_pr_driver_t));
+  for (j = 0; j < num_drivers; j ++)
+    sorted_drivers[j] = *(sorted[j]);
+  free(sorted);
+  free(drivers);
+
+  papplLog(system, PAPPL_LOGLEVEL_DEBUG,
+	   "Updated driver list: %d entries removed, %d entries added, "
+	   "%d entries total.", old_num_drivers - num_kept,
+	   num_drivers - num_kept, num_drivers);
+  global_data->num_drivers = num_drivers;
+  global_data->drivers = sorted_drivers;
+  global_data->ppd_paths = ppd_paths;
+
+  // Save the list for the next start
+  _prDriverIndexSave(global_data, _prDriverIndexKey(global_data));
+
+  // The old list gets freed when neither PAPPL nor anyone else uses it
+  // any more
+  _prDriverListPublish(global_data);
+
+  cupsArrayDelete(removed_names);
+  cupsArrayDelete(changed);
+  cupsArrayDelete(added_set);
 }
 
 
@@ -4274,13 +5606,19 @@ _prSetup(pr_printer_app_global_data_t *global_data)  // I - Global data
 
   _prCleanDebugCopies(global_data);
 
+  //
+  // Clean up outdated driver setup cache files in the state directory
+  //
+
+  _prDriverCachePrune(global_data);
+
   //
   // Create PPD collection index data structure
   //
 
   global_data->num_drivers = 0;
   global_data->drivers = NULL;
-  global_data->ppd_paths = cupsArrayNew(_prComparePPDPaths, NULL);
+  global_data->ppd_paths = NULL;
   global_data->ppd_collections = cupsArrayNew(NULL, NULL);
 
   //
@@ -4325,6 +5663,18 @@ _prSetup(pr_printer_app_global_data_t *global_data)  // I - Global data
   // Create the list of all available PPD files
   //
 
+  pthread_mutex_init(&global_data->driver_list_mutex, NULL);
+  pthread_mutex_init(&global_data->driver_list_ref_mutex, NULL);
+  pthread_rwlock_init(&global_data->driver_matcher_lock, NULL);
+  pthread_mutex_init(&global_data->driver_names_mutex, NULL);
+  pthread_mutex_init(&global_data->driver_cache_mutex, NULL);
+  pthread_mutex_init(&global_data->driver_instances_mutex, NULL);
+  pthread_mutex_init(&global_data->ppd_lru_mutex, NULL);
+  pthread_cond_init(&global_data->ppd_lru_cond, NULL);
+  pthread_mutex_init(&global_data->cups_devices_mutex, NULL);
+  pthread_cond_init(&global_data->cups_devices_cond, NULL);
+  pthread_mutex_init(&global_data->cups_backends_mutex, NULL);
+  pthread_cond_init(&global_data->cups_backends_cond, NULL);
   _prSetupDriverList(global_data);
 
   //
@@ -4537,6 +5887,388 @@ prTestPage(
 }
 
 
+//
+// 'prewarm_driver()' - Do the expensive steps of the driver setup for one
+//                      driver and installable accessory configuration in
+//                      advance, or load the PPD file of a driver instance
+//                      into the PPD memory management.
+//
+//                      For the default accessory configuration the driver
+//                      gets set up as in Init mode of _prDriverSetup(),
+//                      for a printer which does not exist: This gets the
+//                      PPD into the PPD cache, and stores the resolutions
+//                      and the setup snapshot. For the saved accessory
+//                      configuration of a printer (Update mode) the
+//                      resolutions get probed into the driver setup
+//                      cache.
+//
+
+static void
+prewarm_driver(pr_printer_app_global_data_t *global_data, // I - Global data
+	       pr_prewarm_task_t            *task)        // I - Task
+{
+  ppd_file_t              *ppd;         // PPD file
+  ppd_cache_t             *pc;          // PPD cache
+  int                     num_inst_options; // Number of accessory settings
+  cups_option_t           *inst_options = NULL; // Accessory settings
+  pr_driver_cache_entry_t cache_entry;  // Cached driver setup results
+  pappl_pr_driver_data_t  driver_data;  // Driver data of Init mode
+  ipp_t                   *driver_attrs = NULL; // Driver attributes
+  bool                    temporary;    // Temporary PPD file?
+  char                    filename[1024]; // Name of PPD file
+
+
+  // State file loaded, keep the PPD in memory for the first job
+  if (task->extension)
+  {
+    if (_prPPDAcquire(task->extension))
+      _prPPDRelease(task->extension);
+    return;
+  }
+
+  if (!task->inst_options[0])
+  {
+    memset(&driver_data, 0, sizeof(driver_data));
+    if (_prDriverSetup(global_data->system, task->driver_name, NULL, NULL,
+		       &driver_data, &driver_attrs, global_data))
+      _prDriverDelete(NULL, &driver_data);
+    ippDelete(driver_attrs);
+    return;
+  }
+
+  if (!_prPPDMaterialize(global_data, task->ppd_path, filename,
+			 sizeof(filename), &temporary))
+    return;
+  ppd = ppdOpenFile(filename);
+  if (temporary)
+    unlink(filename);
+  if (!ppd)
+    return;
+
+  ppdMarkDefaults(ppd);
+  if ((pc = ppdCacheCreateWithPPD(ppd)) != NULL)
+  {
+    ppd->cache = pc;
+    num_inst_options = cupsParseOptions(task->inst_options, 0,
+					&inst_options);
+    ppdMarkOptions(ppd, num_inst_options, inst_options);
+    memset(&cache_entry, 0, sizeof(cache_entry));
+    cache_entry.key = _prDriverCacheKey(ppd, num_inst_options, inst_options);
+    if (!_prDriverCacheLoad(global_data, cache_entry.key, &cache_entry))
+    {
+      probe_resolutions(ppd, num_inst_options, inst_options, cache_entry.res);
+      _prDriverCacheSave(global_data, &cache_entry);
+    }
+    cupsFreeOptions(num_inst_options, inst_options);
+    ppdCacheDestroy(pc);
+    ppd->cache = NULL;
+  }
+  ppdClose(ppd);
+}
+
+
+//
+// 'prewarm_worker()' - Worker thread for preparing the drivers of the
+//                      saved printers.
+//
+
+static void *                   // O - Thread exit status (unused)
+prewarm_worker(void *data)      // I - Prewarm data
+{
+  pr_prewarm_t *prewarm = (pr_prewarm_t *)data;
+  pr_printer_app_global_data_t *global_data = prewarm->global_data;
+  int          task;            // Current task
+  bool         full;            // Memory budget used up?
+
+
+  for (;;)
+  {
+    pthread_mutex_lock(&prewarm->mutex);
+    task = prewarm->next_task ++;
+    pthread_mutex_unlock(&prewarm->mutex);
+
+    if (task >= prewarm->num_tasks)
+      break;
+
+    // In lazy loading mode PPDs beyond the memory budget would only
+    // get evicted again
+    if (prewarm->tasks[task].extension &&
+	(global_data->config->components & PR_COPTIONS_LAZY_PPD_LOADING))
+    {
+      pthread_mutex_lock(&global_data->ppd_lru_mutex);
+      full = (global_data->ppd_resident_bytes >=
+	      global_data->ppd_memory_budget);
+      pthread_mutex_unlock(&global_data->ppd_lru_mutex);
+      if (full)
+	break;
+    }
+
+    prewarm_driver(global_data, prewarm->tasks + task);
+  }
+
+  return (NULL);
+}
+
+
+//
+// 'prewarm_add_task()' - Get a new entry in the prewarm tasks.
+//
+
+static pr_prewarm_task_t *      // O - Task or NULL on error
+prewarm_add_task(pr_prewarm_t *prewarm) // I - Prewarm data
+{
+  pr_prewarm_task_t *task;      // New task
+
+
+  if (prewarm->num_tasks >= prewarm->alloc_tasks)
+  {
+    if ((task = (pr_prewarm_task_t *)
+	 reallocarray(prewarm->tasks,
+		      prewarm->alloc_tasks ? 2 * prewarm->alloc_tasks : 16,
+		      sizeof(pr_prewarm_task_t))) == NULL)
+      return (NULL);
+    prewarm->tasks       = task;
+    prewarm->alloc_tasks = prewarm->alloc_tasks ?
+                           2 * prewarm->alloc_tasks : 16;
+  }
+
+  task = prewarm->tasks + prewarm->num_tasks ++;
+  memset(task, 0, sizeof(pr_prewarm_task_t));
+
+  return (task);
+}
+
+
+//
+// 'prewarm_add_driver()' - Add a driver/accessory configuration to the
+//                          prewarm tasks if it is not already there.
+//
+
+static void
+prewarm_add_driver(pr_prewarm_t *prewarm,      // I - Prewarm data
+		   pr_driver_list_t *list,     // I - Driver list
+		   const char   *driver_name,  // I - Driver name
+		   const char   *inst_options) // I - Accessory settings
+{
+  int               i;                   // Looping variable
+  pr_prewarm_task_t *task;               // Current task
+  pr_ppd_path_t     *ppd_path,           // PPD path of the driver
+                    search_ppd_path;     // Search key
+
+
+  for (i = prewarm->num_tasks, task = prewarm->tasks; i > 0; i --, task ++)
+    if (!strcmp(task->driver_name, driver_name) &&
+	!strcmp(task->inst_options, inst_options))
+      return;
+
+  // Drivers which do not exist any more get replaced by PAPPL's
+  // re-creation of the printer
+  search_ppd_path.driver_name = driver_name;
+  if ((ppd_path = (pr_ppd_path_t *)cupsArrayFind(list->ppd_paths,
+						 &search_ppd_path)) == NULL)
+    return;
+
+  if ((task = prewarm_add_task(prewarm)) == NULL)
+    return;
+  task->driver_name  = strdup(driver_name);
+  task->ppd_path     = strdup(ppd_path->ppd_path);
+  task->inst_options = strdup(inst_options);
+  if (!task->driver_name || !task->ppd_path || !task->inst_options)
+  {
+    free(task->driver_name);
+    free(task->ppd_path);
+    free(task->inst_options);
+    prewarm->num_tasks --;
+  }
+}
+
+
+//
+// 'prewarm_add_printer()' - Add a printer to the prewarm tasks, if no
+//                           printer of the same driver instance is
+//                           already there.
+//
+
+static void
+prewarm_add_printer(pappl_printer_t *printer, // I - Printer
+		    void            *data)    // I - Prewarm data
+{
+  int                    i;             // Looping variable
+  pr_prewarm_t           *prewarm = (pr_prewarm_t *)data;
+  pr_prewarm_task_t      *task;         // Current task
+  pappl_pr_driver_data_t driver_data;   // Driver data of printer
+  pr_driver_extension_t  *extension;    // Driver extension of printer
+
+
+  papplPrinterGetDriverData(printer, &driver_data);
+  if ((extension = (pr_driver_extension_t *)driver_data.extension) == NULL ||
+      !extension->instance)
+    return;
+
+  for (i = prewarm->num_tasks, task = prewarm->tasks; i > 0; i --, task ++)
+    if (task->extension->instance == extension->instance)
+      return;
+
+  if ((task = prewarm_add_task(prewarm)) != NULL)
+    task->extension = extension;
+}
+
+
+//
+// 'prewarm_run()' - Do the prewarm tasks with a pool of worker threads
+//                   and free them.
+//
+
+static void
+prewarm_run(pr_prewarm_t *prewarm,      // I - Prewarm data
+	    const char   *what)         // I - What gets done, for the log
+{
+  int          i, j;                    // Looping variables
+  int          num_threads;             // Number of worker threads
+  pthread_t    threads[PR_PREWARM_MAX_THREADS - 1]; // Worker threads
+
+
+  if (prewarm->num_tasks == 0)
+    return;
+
+  pthread_mutex_init(&prewarm->mutex, NULL);
+
+  if ((num_threads = (int)sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+    num_threads = 1;
+  if (num_threads > PR_PREWARM_MAX_THREADS)
+    num_threads = PR_PREWARM_MAX_THREADS;
+  if (num_threads > prewarm->num_tasks)
+    num_threads = prewarm->num_tasks;
+
+  papplLog(prewarm->global_data->system, PAPPL_LOGLEVEL_DEBUG,
+	   "%s of %d driver configurations of saved printers with %d threads",
+	   what, prewarm->num_tasks, num_threads);
+
+  // If a thread cannot get created, the others (or we ourselves) take
+  // over its work
+  for (i = 0; i < num_threads - 1; i ++)
+    if (pthread_create(threads + i, NULL, prewarm_worker, prewarm))
+      break;
+  prewarm_worker(prewarm);
+  for (j = 0; j < i; j ++)
+    pthread_join(threads[j], NULL);
+
+  pthread_mutex_destroy(&prewarm->mutex);
+
+  for (i = 0; i < prewarm->num_tasks; i ++)
+  {
+    free(prewarm->tasks[i].driver_name);
+    free(prewarm->tasks[i].ppd_path);
+    free(prewarm->tasks[i].inst_options);
+  }
+  free(prewarm->tasks);
+}
+
+
+//
+// 'prewarm_drivers()' - Prepare the drivers of the printers in the state
+//                       file with a pool of worker threads, so that
+//                       re-creating the printers when PAPPL loads the
+//                       state file uses the cached PPD files, driver
+//                       setup snapshots, and resolutions.
+//
+//                       For each printer the driver is prepared for the
+//                       default accessory configuration (Init mode of
+//                       _prDriverSetup()) and for the saved accessory
+//                       configuration (Update mode).
+//
+
+static void
+prewarm_drivers(pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  cups_file_t      *fp;                 // State file
+  pr_prewarm_t     prewarm;             // Prewarm data
+  pr_driver_list_t *list;               // Driver list
+  int              linenum = 0,         // Line number in state file
+                   printer_id = 0,      // ID of current printer
+                   fd,                  // Accessory settings file
+                   bytes;               // Bytes read
+  char             line[1024],          // Line from state file
+                   *value,              // Value in line
+                   driver_name[256] = "", // Driver of current printer
+                   filename[1024],      // Accessory settings file name
+                   inst_options[4096];  // Saved accessory settings
+
+
+  if ((list = _prDriverListAcquire(global_data)) == NULL)
+    return;
+  if (!list->ppd_paths ||
+      (fp = cupsFileOpen(global_data->state_file, "r")) == NULL)
+  {
+    _prDriverListRelease(global_data, list);
+    return;
+  }
+
+  memset(&prewarm, 0, sizeof(prewarm));
+  prewarm.global_data = global_data;
+
+  while (cupsFileGetConf(fp, line, sizeof(line), &value, &linenum))
+  {
+    if (!strcasecmp(line, "<Printer"))
+    {
+      printer_id     = 0;
+      driver_name[0] = '\0';
+    }
+    else if (!strcasecmp(line, "PrinterId") && value)
+      printer_id = atoi(value);
+    else if (!strcasecmp(line, "DriverName") && value)
+      strncpy(driver_name, value, sizeof(driver_name) - 1);
+    else if (!strcasecmp(line, "</Printer>") && driver_name[0] &&
+	     strcasecmp(driver_name, "auto"))
+    {
+      prewarm_add_driver(&prewarm, list, driver_name, "");
+      inst_options_file_name(global_data->state_dir, printer_id, filename,
+			     sizeof(filename));
+      if ((fd = open(filename, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) >= 0)
+      {
+	if ((bytes = read(fd, inst_options, sizeof(inst_options) - 1)) > 0)
+	{
+	  inst_options[bytes] = '\0';
+	  prewarm_add_driver(&prewarm, list, driver_name, inst_options);
+	}
+	close(fd);
+      }
+      driver_name[0] = '\0';
+    }
+  }
+
+  cupsFileClose(fp);
+  _prDriverListRelease(global_data, list);
+
+  prewarm_run(&prewarm, "Preparing the drivers");
+}
+
+
+//
+// 'prewarm_ppds()' - Load the PPD files of the saved printers, which PAPPL
+//                    has created from the state file, with a pool of
+//                    worker threads, so that their first jobs do not
+//                    need to wait for the PPDs. There is one task for
+//                    each driver instance (driver and installable
+//                    accessory configuration).
+//
+
+static void
+prewarm_ppds(pr_printer_app_global_data_t *global_data) // I - Global data
+{
+  pr_prewarm_t prewarm;                 // Prewarm data
+
+
+  memset(&prewarm, 0, sizeof(prewarm));
+  prewarm.global_data = global_data;
+
+  papplSystemIteratePrinters(global_data->system, prewarm_add_printer,
+			     &prewarm);
+
+  prewarm_run(&prewarm, "Loading the PPDs");
+}
+
+
 //
 // '_prSystemCB()' - System callback.
 //
@@ -4566,6 +6298,10 @@ _prSystemCB(int            num_options,	// I - Number of options
                                    PAPPL_SOPTIONS_WEB_TLS;
 					// System options
   static pappl_version_t versions[1];   // Software versions
+  struct timespec       start,          // Start time
+                        ready;          // Time when all printers are loaded
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
 
   // One single record for version information
   strncpy(versions[0].name, global_data->config->system_name,
@@ -4725,6 +6461,15 @@ _prSystemCB(int            num_options,	// I - Number of options
 	     "%.767s/%.249s.state", global_data->state_dir,
 	     global_data->config->system_package_name);
 
+  // Memory budget for the PPD files of the printers in lazy loading mode
+  // (in MB)
+  if ((val = cupsGetOption("ppd-memory-budget", num_options, options)) !=
+      NULL ||
+      (val = getenv("PPD_MEMORY_BUDGET")) != NULL)
+    global_data->ppd_memory_budget = (size_t)atol(val) * 1024 * 1024;
+  else if (!global_data->ppd_memory_budget)
+    global_data->ppd_memory_budget = (size_t)PR_PPD_MEMORY_BUDGET * 1024 * 1024;
+
 
   // Create the system object...
   if ((system =
@@ -4747,6 +6492,11 @@ _prSystemCB(int            num_options,	// I - Number of options
   papplSystemSetHostName(system, hostname);
   _prSetup(global_data);
 
+  // Prepare the drivers of the saved printers in parallel, as PAPPL
+  // creates them one after the other when loading the state file
+  if (global_data->config->components & PR_COPTIONS_PREWARM_DRIVERS)
+    prewarm_drivers(global_data);
+
   // Extra setup steps for the system (like adding buttos/pages)
   if (global_data->config->extra_setup_cb)
     (global_data->config->extra_setup_cb)(global_data);
@@ -4763,5 +6513,22 @@ _prSystemCB(int            num_options,	// I - Number of options
 			    system_name ? system_name :
 			    global_data->config->system_name);
 
+  // Load the PPD files of the saved printers in parallel, PAPPL has set
+  // the printers up one after the other
+  if (global_data->config->components & PR_COPTIONS_PREWARM_DRIVERS)
+    prewarm_ppds(global_data);
+
+  // Update the driver list and the filter look-up cache when PPDs,
+  // filters, or backends get installed or removed, only now that the
+  // saved printers are created, so that the driver list does not get
+  // replaced under their feet
+  _prDirWatcherStart(global_data);
+
+  clock_gettime(CLOCK_MONOTONIC, &ready);
+  papplLog(system, PAPPL_LOGLEVEL_INFO,
+	   "System and saved printers set up in %.3f seconds",
+	   (double)(ready.tv_sec - start.tv_sec) +
+	   (double)(ready.tv_nsec - start.tv_nsec) / 1000000000.0);
+
   return (system);
 }
@@ -52,6 +52,8 @@ typedef enum pr_devid_regex_mode_e           // Modes to match a regular
   PR_DEVID_REGEX_MATCH_WHOLE_VALUE           // Match the whole value
 } pr_devid_regex_mode_t;
 
+typedef struct pr_devid_s pr_devid_t;        // Parsed IEEE-1284 device ID
+
 typedef struct pr_spooling_conversion_s
 {
   char                     *srctype;           // Input data type
@@ -91,7 +93,27 @@ enum pr_coptions_e                           // Component option bits
   PR_COPTIONS_QUERY_PS_DEFAULTS = 0x0008,    // Support query code in PPDs
   PR_COPTIONS_WEB_ADD_PPDS = 0x0010,         // Support user adding PPDs
   PR_COPTIONS_CUPS_BACKENDS = 0x0020,        // Also use CUPS backends
-  PR_COPTIONS_NO_PAPPL_BACKENDS = 0x0040     // Only use CUPS backends
+  PR_COPTIONS_NO_PAPPL_BACKENDS = 0x0040,    // Only use CUPS backends
+  PR_COPTIONS_LAZY_PPD_LOADING = 0x0080,     // Load the PPD files of the
+                                             // printers only when needed and
+                                             // free the least recently used
+                                             // ones when they exceed the
+                                             // memory budget
+  PR_COPTIONS_PREWARM_DRIVERS = 0x0100,      // Prepare the drivers of the
+                                             // saved printers in parallel
+                                             // before loading the state
+                                             // file at startup and load
+                                             // their PPD files after it
+  PR_COPTIONS_CACHE_CUPS_DEVICES = 0x0200,   // Run the discovery of the CUPS
+                                             // backends in the background
+                                             // and reuse its result for
+                                             // device list requests
+  PR_COPTIONS_PERSISTENT_CUPS_BACKENDS = 0x0400 // Keep the CUPS backend of a
+                                             // printer running across jobs,
+                                             // until it is idle for some
+                                             // time, only for the streaming
+                                             // backends of local devices
+                                             // (usb, parallel, serial)
 };
 typedef unsigned int pr_coptions_t;          // Bitfield for component options
 
@@ -233,15 +255,33 @@ extern int prRetroFitPrinterApp(pr_printer_app_config_t *printer_app_config,
 extern const char *prBestMatchingPPD(const char *device_id,
 				     pr_printer_app_global_data_t
 				     *global_data);
+extern int  prBestMatchingPPDBatch(int num_devices,
+				   const char * const *device_ids,
+				   const char **driver_names,
+				   pr_printer_app_global_data_t *global_data);
 extern int  prRegExMatchDevIDField(const char *device_id,
 				   const char *key,
 				   const char *value_regex,
 				   pr_devid_regex_mode_t mode);
+extern void prPPDMemoryStats(pr_printer_app_global_data_t *global_data,
+			     unsigned long *loads, unsigned long *evictions,
+			     size_t *resident);
 extern bool prSupportsPostScript(const char *device_id);
 extern bool prSupportsPDF(const char *device_id);
 extern bool prSupportsPCL5(const char *device_id);
 extern bool prSupportsPCL5c(const char *device_id);
 extern bool prSupportsPCLXL(const char *device_id);
+extern pr_devid_t *prDevIDNew(const char *device_id);
+extern void prDevIDDelete(pr_devid_t *devid);
+extern int  prDevIDRegExMatchField(pr_devid_t *devid,
+				   const char *key,
+				   const char *value_regex,
+				   pr_devid_regex_mode_t mode);
+extern bool prDevIDSupportsPostScript(pr_devid_t *devid);
+extern bool prDevIDSupportsPDF(pr_devid_t *devid);
+extern bool prDevIDSupportsPCL5(pr_devid_t *devid);
+extern bool prDevIDSupportsPCL5c(pr_devid_t *devid);
+extern bool prDevIDSupportsPCLXL(pr_devid_t *devid);
 extern const char *prAutoAdd(const char *device_info, const char *device_uri,
 			     const char *device_id, void *data);
 extern void prPSIdentify(pappl_printer_t *printer, pappl_device_t *device);
@@ -40,6 +40,27 @@ extern "C" {
 // Types...
 //
 
+// Memory block of a job data arena, the data follows the header
+typedef struct pr_arena_block_s pr_arena_block_t;
+
+struct pr_arena_block_s
+{
+  pr_arena_block_t      *next;          // Next (older) block
+  size_t                size,           // Usable size of this block
+                        used;           // Bytes handed out from this block
+};
+
+// Arena for the data of a job, everything allocated in it gets freed
+// at once when the job is done
+typedef struct pr_arena_s
+{
+  pr_arena_block_t      *blocks;        // List of blocks, newest first
+  size_t                block_size,     // Default size for new blocks
+                        used,           // Bytes handed out in total
+                        reserved;       // Bytes allocated from the system
+  int                   num_blocks;     // Number of blocks
+} pr_arena_t;
+
 // Data for _prPrintFilterFunction()
 typedef struct pr_print_filter_function_data_s 
                                         // look-up table
@@ -54,6 +75,8 @@ typedef struct pr_job_data_s		// Job data
 {
   char                  *device_uri;    // Printer device URI
   ppd_file_t            *ppd;           // PPD file loaded from collection
+  struct pr_driver_extension_s *extension; // Driver extension of the
+                                        // printer, to release the PPD
   char                  *temp_ppd_name; // File name of temporary copy of the
                                         // PPD file to be used by CUPS filters
   cf_filter_data_t         *filter_data;   // Common print job data for filter
@@ -73,6 +96,10 @@ typedef struct pr_job_data_s		// Job data
                                         // device
   int                   line_count;     // Raster lines actually received for
                                         // this page
+  char                  **envp;         // Environment variables for the
+                                        // external CUPS filters of this job
+  pr_arena_t            *arena;         // Memory arena for all the
+                                        // job-scoped data structures
   void                  *data;          // Job-type-specific data
   pr_printer_app_global_data_t *global_data; // Global data
 } pr_job_data_t;
@@ -82,6 +109,10 @@ typedef struct pr_job_data_s		// Job data
 // Functions...
 //
 
+extern pr_arena_t *_prArenaNew(size_t block_size);
+extern void   *_prArenaCalloc(pr_arena_t *arena, size_t num, size_t size);
+extern char   *_prArenaStrdup(pr_arena_t *arena, const char *s);
+extern void   _prArenaDelete(pr_arena_t *arena);
 extern void   _prASCII85(FILE *outputfp, const unsigned char *data, int length,
 			 int last_data);
 extern pappl_content_t _prGetFileContentType(pappl_job_t *job);
@@ -23,6 +23,145 @@
 #include <pappl-retrofit/pappl-retrofit-private.h>
 
 
+//
+// Constants...
+//
+
+#define PR_ARENA_ALIGN 16               // Alignment of arena allocations
+#define PR_ARENA_ROUND(n) (((n) + PR_ARENA_ALIGN - 1) & \
+			   ~((size_t)PR_ARENA_ALIGN - 1))
+#define PR_ARENA_HEADER PR_ARENA_ROUND(sizeof(pr_arena_block_t))
+
+
+//
+// '_prArenaNew()' - Create a memory arena for the data structures of a
+//                   job. All memory taken from the arena gets released
+//                   at once with _prArenaDelete(), so nothing needs to
+//                   get freed individually and nothing can leak on
+//                   error paths.
+//
+
+pr_arena_t *                    // O - New arena, NULL on error
+_prArenaNew(size_t block_size)  // I - Size of the memory blocks, 0 for
+                                //     default
+{
+  pr_arena_t *arena;            // New arena
+
+
+  if ((arena = (pr_arena_t *)calloc(1, sizeof(pr_arena_t))) == NULL)
+    return (NULL);
+
+  arena->block_size = PR_ARENA_ROUND(block_size > 0 ? block_size : 4096);
+
+  return (arena);
+}
+
+
+//
+// '_prArenaCalloc()' - Take zeroed memory for an array of "num"
+//                      elements of "size" bytes from the arena.
+//                      Requests which do not fit into the current
+//                      block get a new block, requests larger than a
+//                      quarter of the block size get a block of their
+//                      own so that the rest of the current block is
+//                      not wasted.
+//
+
+void *                          // O - Memory, NULL on error
+_prArenaCalloc(pr_arena_t *arena, // I - Arena
+	       size_t     num,    // I - Number of elements
+	       size_t     size)   // I - Size of an element
+{
+  pr_arena_block_t *block;      // Block to allocate from
+  size_t        bytes,          // Bytes requested (aligned)
+                block_size;     // Size of a new block
+  void          *ptr;           // Allocated memory
+
+
+  if (!arena || num == 0 || size == 0 || num > (size_t)-1 / size)
+    return (NULL);
+
+  bytes = PR_ARENA_ROUND(num * size);
+
+  if ((block = arena->blocks) == NULL || block->size - block->used < bytes)
+  {
+    block_size = (bytes > arena->block_size / 4 ? bytes : arena->block_size);
+    if ((block = (pr_arena_block_t *)calloc(1, PR_ARENA_HEADER +
+					    block_size)) == NULL)
+      return (NULL);
+    block->size = block_size;
+    arena->reserved += PR_ARENA_HEADER + block_size;
+    arena->num_blocks ++;
+
+    if (block_size > arena->block_size && arena->blocks)
+    {
+      // Dedicated block for a large request, keep the current block
+      // on top for further small requests
+      block->next = arena->blocks->next;
+      arena->blocks->next = block;
+    }
+    else
+    {
+      block->next = arena->blocks;
+      arena->blocks = block;
+    }
+  }
+
+  ptr = (char *)block + PR_ARENA_HEADER + block->used;
+  block->used += bytes;
+  arena->used += bytes;
+
+  return (ptr);
+}
+
+
+//
+// '_prArenaStrdup()' - Copy a string into the arena.
+//
+
+char *                          // O - Copy of the string, NULL on error
+_prArenaStrdup(pr_arena_t *arena, // I - Arena
+	       const char *s)     // I - String
+{
+  char   *copy;                 // Copy of the string
+  size_t len;                   // Length of the string
+
+
+  if (!s)
+    return (NULL);
+
+  len = strlen(s);
+  if ((copy = (char *)_prArenaCalloc(arena, len + 1, 1)) != NULL)
+    memcpy(copy, s, len);
+
+  return (copy);
+}
+
+
+//
+// '_prArenaDelete()' - Free all memory of an arena and the arena itself.
+//
+
+void
+_prArenaDelete(pr_arena_t *arena) // I - Arena
+{
+  pr_arena_block_t *block,      // Current block
+                   *next;       // Next block
+
+
+  if (!arena)
+    return;
+
+  for (block = arena->blocks; block; block = next)
+  {
+    next = block->next;
+    free(block);
+  }
+
+  free(arena);
+}
+
+
 //
 // '_prASCII85()' - Print binary data as a series of base-85 numbers.
 //                  4 binary bytes are encoded into 5 printable
@@ -314,7 +453,7 @@ _prGetFileContentType(pappl_job_t *job)
 	      p ++;
 	    while ((q = p + strlen(p) - 1) && (*q == '\n' || *q == '\r'))
 	      *q = '\0';
-	    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+	    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 			"PDF metadata line: %s: %s", fields[i], p);
 	    creatorline_found = 1;
 	    for (j = 0; j < 5; j ++)
@@ -327,7 +466,7 @@ _prGetFileContentType(pappl_job_t *job)
 		  {
 		    found = creating_apps[j][k];
 		    content_type = 1 << j;
-		    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+		    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 				"  Found: %s", creating_apps[j][k]);
 		    break;
 		  }
@@ -347,11 +486,11 @@ _prGetFileContentType(pappl_job_t *job)
       pclose(pd);
     }
     if (creatorline_found == 0)
-      papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+      _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		  "No suitable PDF metadata line found");
   }
 
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 	      "Input file format: %s%s%s%s -> Content optimization: %s",
 	      informat,
 	      found ? " (" : "", found ? found : "", found ? ")" : "", 
@@ -414,19 +553,38 @@ _prCreateJobData(pappl_job_t *job,
    NULL
   };
   pappl_printer_t       *printer = papplJobGetPrinter(job);
+  pr_arena_t            *arena;         // Memory arena for the job data
+  int                   num_env = 0;    // Number of environment variables
 
   //
   // Load the printer's assigned PPD file, mark the defaults, and create the
   // cache
   //
 
-  job_data = (pr_job_data_t *)calloc(1, sizeof(pr_job_data_t));
+  if ((arena = _prArenaNew(0)) == NULL ||
+      (job_data = (pr_job_data_t *)_prArenaCalloc(arena, 1,
+						  sizeof(pr_job_data_t))) ==
+      NULL)
+  {
+    papplLogJob(job, PAPPL_LOGLEVEL_ERROR,
+		"Unable to allocate memory for job data");
+    _prArenaDelete(arena);
+    return (NULL);
+  }
+  job_data->arena = arena;
 
   papplPrinterGetDriverData(printer, &driver_data);
   extension = (pr_driver_extension_t *)driver_data.extension;
   job_data->global_data = extension->global_data;
   job_data->device_uri = (char *)papplPrinterGetDeviceURI(printer);
-  job_data->ppd = extension->ppd;
+  if ((job_data->ppd = _prPPDAcquire(extension)) == NULL)
+  {
+    papplLogJob(job, PAPPL_LOGLEVEL_ERROR,
+		"Unable to load the PPD file of the printer");
+    _prArenaDelete(arena);
+    return (NULL);
+  }
+  job_data->extension = extension;
   pc = job_data->ppd->cache;
   job_data->temp_ppd_name = extension->temp_ppd_name;
   job_data->stream_filter = extension->stream_filter;
@@ -456,7 +614,7 @@ _prCreateJobData(pappl_job_t *job,
   }
 
   // Finishings
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "Adding options for finishings");
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG, "Adding options for finishings");
   if (job_options->finishings & PAPPL_FINISHINGS_PUNCH)
     num_options = ppdCacheGetFinishingOptions(pc, NULL, IPP_FINISHINGS_PUNCH,
 					      num_options, &(options));
@@ -468,7 +626,7 @@ _prCreateJobData(pappl_job_t *job,
 					      num_options, &(options));
 
   // PageSize/media/media-size/media-size-name
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: PageSize");
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: PageSize");
   attrs = ippNew();
   media_col = ippNew();
   media_size = ippNew();
@@ -490,7 +648,7 @@ _prCreateJobData(pappl_job_t *job,
 		"media-bottom-margin", job_options->media.bottom_margin);
   ippAddCollection(attrs, IPP_TAG_PRINTER, "media-col", media_col);
   ippDelete(media_col);
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "  Requesting size: W=%d H=%d L=%d R=%d T=%d B=%d (1/100 mm)",
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG, "  Requesting size: W=%d H=%d L=%d R=%d T=%d B=%d (1/100 mm)",
 	      job_options->media.size_width, job_options->media.size_length,
 	      job_options->media.left_margin, job_options->media.right_margin,
 	      job_options->media.top_margin, job_options->media.bottom_margin);
@@ -501,7 +659,7 @@ _prCreateJobData(pappl_job_t *job,
   ippDelete(attrs);
 
   // InputSlot/media-source
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: %s",
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: %s",
 	      pc->source_option ? pc->source_option : "InputSlot");
   if ((choicestr = ppdCacheGetInputSlot(pc, NULL,
 					job_options->media.source)) !=
@@ -510,14 +668,14 @@ _prCreateJobData(pappl_job_t *job,
 				num_options, &(options));
 
   // MediaType/media-type
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: MediaType");
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: MediaType");
   if ((choicestr = ppdCacheGetMediaType(pc, NULL,
 					job_options->media.type)) != NULL)
     num_options = cupsAddOption("MediaType", choicestr,
 				num_options, &(options));
 
   // orientation-requested (filter option)
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 	      "Adding option: orientation-requested");
   if (job_options->orientation_requested >= IPP_ORIENT_PORTRAIT &&
       job_options->orientation_requested <  IPP_ORIENT_NONE)
@@ -530,7 +688,7 @@ _prCreateJobData(pappl_job_t *job,
   // OutputBin/output-bin
   if ((count = pc->num_bins) > 0)
   {
-    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: OutputBin");
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: OutputBin");
     val = job_options->output_bin;
     for (i = 0, pwg_map = pc->bins; i < count; i ++, pwg_map ++)
       if (!strcmp(pwg_map->pwg, val))
@@ -541,7 +699,7 @@ _prCreateJobData(pappl_job_t *job,
   }
 
   // Presets, selected by color/bw and print quality
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 	      "Adding option presets depending on requested print quality and color mode");
   if (job_data->ppd->color_device &&
       (job_options->print_color_mode &
@@ -557,7 +715,7 @@ _prCreateJobData(pappl_job_t *job,
     pq = 1;
   num_presets = pc->num_presets[pcm][pq];
   presets     = pc->presets[pcm][pq];
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 	      "%sresets for %s printing in %s quality%s",
 	      num_presets ? "P" : "No p",
 	      pcm == 1 ? "color" : "black and white",
@@ -567,7 +725,7 @@ _prCreateJobData(pappl_job_t *job,
   {
     for (i = 0; i < num_presets; i ++)
     {
-      papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+      _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		  "  Adding option: %s=%s", presets[i].name, presets[i].value);
       num_options = cupsAddOption(presets[i].name, presets[i].value,
 				  num_options, &(options));
@@ -575,13 +733,13 @@ _prCreateJobData(pappl_job_t *job,
   }
 
   // Optimize presets, selected by print content optimization
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 	      "Adding option presets depending on requested content optimization");
 
   // Find out about input file content type if not specified
   if (job_options->print_content_optimize == PAPPL_CONTENT_AUTO)
   {
-    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		"Automatic content type selection ...");
     job_options->print_content_optimize = _prGetFileContentType(job);
   }
@@ -607,7 +765,7 @@ _prCreateJobData(pappl_job_t *job,
   }
   num_presets = pc->num_optimize_presets[pco];
   presets     = pc->optimize_presets[pco];
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 	      "%sresets for %s printing%s",
 	      num_presets ? "P" : "No p",
 	      (pco == 0 ? "automatic" :
@@ -624,14 +782,14 @@ _prCreateJobData(pappl_job_t *job,
 	  cupsGetOption(presets[i].name, num_options,
 			options) == NULL)
       {
-	papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+	_PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		    "  Adding option: %s=%s",
 		    presets[i].name, presets[i].value);
 	num_options = cupsAddOption(presets[i].name, presets[i].value,
 				    num_options, &(options));
       }
       else
-	papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+	_PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		    "    Skipping option: %s=%s (This option would also switch to high-quality printing)",
 		    presets[i].name, presets[i].value);
     }
@@ -647,7 +805,7 @@ _prCreateJobData(pappl_job_t *job,
   }
 
   // print-scaling (filter option)
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: print-scaling");
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: print-scaling");
   if (job_options->print_scaling)
   {
     if (job_options->print_scaling & PAPPL_SCALING_AUTO)
@@ -668,7 +826,7 @@ _prCreateJobData(pappl_job_t *job,
   }
 
   // Duplex/sides
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: Duplex");
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: Duplex");
   if (job_options->sides && pc->sides_option)
   {
     if (job_options->sides & PAPPL_SIDES_ONE_SIDED &&
@@ -698,7 +856,7 @@ _prCreateJobData(pappl_job_t *job,
 			     1 : 0);
     if ((param = strchr(extension->vendor_ppd_options[i], ':')) == NULL)
     {
-      papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: %s",
+      _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: %s",
 		  extension->vendor_ppd_options[i] + controlled_by_presets);
       coption = NULL;
       num_cparams = 0;
@@ -707,7 +865,7 @@ _prCreateJobData(pappl_job_t *job,
     else
     {
       param ++;
-      papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "  Custom parameter: %s", param);
+      _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG, "  Custom parameter: %s", param);
     }
     if ((attr = papplJobGetAttribute(job, driver_data.vendor[i])) == NULL ||
 	ippGetString(attr, 0, NULL) == NULL)
@@ -785,7 +943,7 @@ _prCreateJobData(pappl_job_t *job,
 	if (controlled_by_presets && !strcasecmp(val, "automatic-selection"))
 	{
 	  // Option controlled by presets
-	  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+	  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		      "  PPD option %s controlled by the presets",
 		      option->keyword);
 	  continue;
@@ -824,7 +982,7 @@ _prCreateJobData(pappl_job_t *job,
        papplJobGetAttribute(job,
 			    "multiple-document-handling")) != NULL)
   {
-    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: Collate");
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG, "Adding option: Collate");
     val = ippGetString(attr, 0, NULL);
     if (strstr(val, "uncollate"))
       choicestr = "False";
@@ -864,32 +1022,60 @@ _prCreateJobData(pappl_job_t *job,
   }
 
   // Log the option settings which will get used
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "PPD options to be used:");
-  for (i = num_options, opt = options; i > 0; i --, opt ++)
-    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "  %s=%s", opt->name, opt->value);
+  if (_PR_LOG_ENABLED(job_data->global_data->system, PAPPL_LOGLEVEL_DEBUG))
+  {
+    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "PPD options to be used:");
+    for (i = num_options, opt = options; i > 0; i --, opt ++)
+      papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "  %s=%s", opt->name, opt->value);
+  }
 
-  // Set environment variables for filters
+  // Environment variables for filters, we do not use setenv() here as
+  // the environment is process-wide and shared by the jobs of all
+  // printers, so we pass them on per job to the external CUPS filters.
+  // The filter data records get allocated here, too, so that we have
+  // only one place where to bail out if the arena cannot grow
+  if ((job_data->envp =
+       (char **)_prArenaCalloc(arena, 3, sizeof(char *))) == NULL ||
+      (filter_data =
+       (cf_filter_data_t *)_prArenaCalloc(arena, 1,
+					  sizeof(cf_filter_data_t))) == NULL ||
+      (filter_data_ext =
+       (ppd_filter_data_ext_t *)_prArenaCalloc(arena, 1,
+					       sizeof(ppd_filter_data_ext_t))) ==
+      NULL)
+  {
+    papplLogJob(job, PAPPL_LOGLEVEL_ERROR,
+		"Unable to allocate memory for job data");
+    ippDelete(driver_attrs);
+    cupsFreeOptions(num_options, options);
+    _prPPDRelease(extension);
+    _prArenaDelete(arena);
+    return (NULL);
+  }
   if ((val = papplPrinterGetName(printer)) != NULL && val[0])
-    setenv("PRINTER", val, 1);
-  else
-    unsetenv("PRINTER");
+  {
+    snprintf(paramstr, sizeof(paramstr), "PRINTER=%s", val);
+    if ((job_data->envp[num_env] = _prArenaStrdup(arena, paramstr)) != NULL)
+      num_env ++;
+  }
   if ((val = papplPrinterGetLocation(printer, buf, sizeof(buf))) != NULL &&
       buf[0])
-    setenv("PRINTER_LOCATION", val, 1);
-  else
-    unsetenv("PRINTER_LOCATION");
+  {
+    snprintf(paramstr, sizeof(paramstr), "PRINTER_LOCATION=%s", val);
+    if ((job_data->envp[num_env] = _prArenaStrdup(arena, paramstr)) != NULL)
+      num_env ++;
+  }
 
   // Clean up
   ippDelete(driver_attrs);
 
   // Prepare job data to be supplied to filter functions/CUPS filters
   // called during job execution
-  filter_data = (cf_filter_data_t *)calloc(1, sizeof(cf_filter_data_t));
   job_data->filter_data = filter_data;
-  filter_data->printer = strdup(papplPrinterGetName(printer));
+  filter_data->printer = _prArenaStrdup(arena, papplPrinterGetName(printer));
   filter_data->job_id = papplJobGetID(job);
-  filter_data->job_user = strdup(papplJobGetUsername(job));
-  filter_data->job_title = strdup(papplJobGetName(job));
+  filter_data->job_user = _prArenaStrdup(arena, papplJobGetUsername(job));
+  filter_data->job_title = _prArenaStrdup(arena, papplJobGetName(job));
   filter_data->copies = job_options->copies;
   filter_data->job_attrs = NULL;     // We use PPD/filter options
   filter_data->printer_attrs = NULL; // We use the printer's PPD file
@@ -909,8 +1095,6 @@ _prCreateJobData(pappl_job_t *job,
   filter_data->iscanceleddata = job;
 
   // Attach PPD file data as "libppd" filter data extension
-  filter_data_ext =
-    (ppd_filter_data_ext_t *)calloc(1, sizeof(ppd_filter_data_ext_t));
   filter_data_ext->ppdfile = job_data->temp_ppd_name; // PPD file name
   filter_data_ext->ppd = job_data->ppd;               // PPD data
   cfFilterDataAddExt(filter_data, PPD_FILTER_DATA_EXT, filter_data_ext);
@@ -973,10 +1157,14 @@ _prFilter(
 
   job_options = papplJobCreatePrintOptions(job, INT_MAX, 1);
 
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 	      "Printing job in spooling mode");
 
-  job_data = _prCreateJobData(job, job_options);
+  if ((job_data = _prCreateJobData(job, job_options)) == NULL)
+  {
+    papplJobDeletePrintOptions(job_options);
+    return (false);
+  }
   filter_data_ext =
     (ppd_filter_data_ext_t *)cfFilterDataGetExt(job_data->filter_data,
 						PPD_FILTER_DATA_EXT);
@@ -991,6 +1179,8 @@ _prFilter(
   {
     papplLogJob(job, PAPPL_LOGLEVEL_ERROR, "Unable to open input file '%s' for printing: %s",
 		filename, strerror(errno));
+    papplJobDeletePrintOptions(job_options);
+    _prFreeJobData(job_data);
     return (false);
   }
 
@@ -999,7 +1189,7 @@ _prFilter(
   //
 
   informat = papplJobGetFormat(job);
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 	      "Input file format: %s", informat);
 
   //
@@ -1028,6 +1218,45 @@ _prFilter(
     papplLogJob(job, PAPPL_LOGLEVEL_ERROR,
 		"No pre-filter found for input format %s",
 		informat);
+    if (filter_path)
+      free(filter_path);
+    papplJobDeletePrintOptions(job_options);
+    _prFreeJobData(job_data);
+    close(fd);
+    return (false);
+  }
+
+  // Allocate the entries of the filter chain from the job arena. A null
+  // filter is a single char, '-' or '.', whereas an actual filter has a
+  // path starting with '/', so at least 2 chars.
+  if (strlen(filter_path) > 1)
+  {
+    ppd_filter_params =
+      (cf_filter_external_t *)_prArenaCalloc(job_data->arena, 1,
+					     sizeof(cf_filter_external_t));
+    job_data->ppd_filter =
+      (cf_filter_filter_in_chain_t *)
+      _prArenaCalloc(job_data->arena, 1, sizeof(cf_filter_filter_in_chain_t));
+  }
+  else
+    job_data->ppd_filter = NULL;
+  job_data->print =
+    (cf_filter_filter_in_chain_t *)
+    _prArenaCalloc(job_data->arena, 1, sizeof(cf_filter_filter_in_chain_t));
+  print_params =
+    (pr_print_filter_function_data_t *)
+    _prArenaCalloc(job_data->arena, 1,
+		   sizeof(pr_print_filter_function_data_t));
+  if ((strlen(filter_path) > 1 &&
+       (!ppd_filter_params || !job_data->ppd_filter)) ||
+      !job_data->print || !print_params)
+  {
+    papplLogJob(job, PAPPL_LOGLEVEL_ERROR,
+		"Unable to allocate memory for the filter chain");
+    free(filter_path);
+    papplJobDeletePrintOptions(job_options);
+    _prFreeJobData(job_data);
+    close(fd);
     return (false);
   }
 
@@ -1039,16 +1268,16 @@ _prFilter(
   // for the filter functions being able to use it
   ppdFilterLoadPPD(job_data->filter_data);
 
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 	      "Converting input file to format: %s", conversion->dsttype);
   if (filter_path[0] == '.')
-    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		"Passing on PostScript directly to printer");
   else if (filter_path[0] == '-')
-    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		"Passing on %s directly to printer", conversion->dsttype);
   else
-    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		"Using CUPS filter (printer driver): %s", filter_path);
 
   //
@@ -1060,8 +1289,16 @@ _prFilter(
     // Get the device data
     device_data = (pr_cups_device_data_t *)papplDeviceGetData(device);
 
-    // Connect the filter_data
+    // Connect the filter_data and the environment
     device_data->filter_data = job_data->filter_data;
+    device_data->envp        = job_data->envp;
+
+    // Attach a persistent backend already now, so that the filters get its
+    // back and side channel pipes
+    if ((job_data->global_data->config->components &
+	 PR_COPTIONS_PERSISTENT_CUPS_BACKENDS) &&
+	!device_data->backend_pid)
+      _prCUPSDevLaunchBackend(device);
   }
 
   //
@@ -1080,7 +1317,7 @@ _prFilter(
       if (strncmp(line, "%%#PDF-BANNER", 13) == 0 ||
 	  strncmp(line, "%%PDF-BANNER", 12) == 0)
       {
-	papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+	_PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		    "Input PDF file is banner or test page file, calling bannertopdf to add printer and job information");
 	is_banner = 1;
 	job_data->filter_data->content_type = "application/vnd.cups-pdf-banner";
@@ -1099,31 +1336,17 @@ _prFilter(
     cupsArrayAdd(job_data->chain, &banner_filter);
   for (i = 0; i < conversion->num_filters; i ++)
     cupsArrayAdd(job_data->chain, &(conversion->filters[i]));
-  if (strlen(filter_path) > 1) // A null filter is a single char, '-'
-                               // or '.', whereas an actual filter has
-                               // a path starting with '/', so at
-                               // least 2 chars.
+  if (job_data->ppd_filter)
   {
-    ppd_filter_params =
-      (cf_filter_external_t *)calloc(1, sizeof(cf_filter_external_t));
     ppd_filter_params->filter = filter_path;
-    job_data->ppd_filter =
-      (cf_filter_filter_in_chain_t *)calloc(1,
-			                sizeof(cf_filter_filter_in_chain_t));
+    ppd_filter_params->envp = job_data->envp;
     job_data->ppd_filter->function = ppdFilterExternalCUPS;
     job_data->ppd_filter->parameters = ppd_filter_params;
     job_data->ppd_filter->name = strrchr(filter_path, '/') + 1;
     cupsArrayAdd(job_data->chain, job_data->ppd_filter);
-  } else
-    job_data->ppd_filter = NULL;
-  job_data->print =
-    (cf_filter_filter_in_chain_t *)calloc(1,
-					  sizeof(cf_filter_filter_in_chain_t));
+  }
   // Put filter function to send data to PAPPL's built-in backend at the end
   // of the chain
-  print_params =
-    (pr_print_filter_function_data_t *)
-    calloc(1, sizeof(pr_print_filter_function_data_t));
   print_params->device = device;
   print_params->device_uri = job_data->device_uri;
   print_params->job = job;
@@ -1163,7 +1386,7 @@ _prFilter(
 
   if (strncmp(job_data->device_uri, "cups:", 5) == 0)
   {
-    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		"Shutting down CUPS backend");
 
     // Stop the backend
@@ -1175,8 +1398,9 @@ _prFilter(
     // Get the device data
     device_data = (pr_cups_device_data_t *)papplDeviceGetData(device);
 
-    // Disconnect the filter_data
+    // Disconnect the filter_data and the environment
     device_data->filter_data = NULL;
+    device_data->envp        = NULL;
   }
 
   //
@@ -1185,8 +1409,6 @@ _prFilter(
 
   if (filter_path)
     free(filter_path);
-  if (ppd_filter_params)
-    free(ppd_filter_params);
   papplJobDeletePrintOptions(job_options);
   _prFreeJobData(job_data);
   close(fd);
@@ -1202,37 +1424,35 @@ _prFilter(
 
 void _prFreeJobData(pr_job_data_t *job_data)
 {
-  ppd_filter_data_ext_t *filter_data_ext =
-    (ppd_filter_data_ext_t *)cfFilterDataRemoveExt(job_data->filter_data,
-						   PPD_FILTER_DATA_EXT);
+  pr_arena_t *arena = job_data->arena;
+  pappl_job_t *job = (pappl_job_t *)job_data->filter_data->logdata;
+
 
-  unsetenv("PRINTER");
-  unsetenv("PRINTER_LOCATION");
+  // The PPD extension lives in the arena, remove it from the filter data
+  // only to keep ppdFilterFreePPD() away from our PPD file data
+  cfFilterDataRemoveExt(job_data->filter_data, PPD_FILTER_DATA_EXT);
 
   if (job_data->global_data->config->components & PR_COPTIONS_CUPS_BACKENDS)
     cfFilterCloseBackAndSidePipes(job_data->filter_data);
 
-  if (filter_data_ext)
-    free(filter_data_ext);
-
-  free(job_data->filter_data->printer);
-  free(job_data->filter_data->job_user);
-  free(job_data->filter_data->job_title);
+  // Data not allocated in the arena as it gets (re-)allocated by libcups
+  // or libcupsfilters functions
   ppdFilterFreePPD(job_data->filter_data);
   cupsFreeOptions(job_data->filter_data->num_options,
 		  job_data->filter_data->options);
-  free(job_data->filter_data);
-  
-  if (job_data->ppd_filter)
-    free(job_data->ppd_filter);
-  if (job_data->print)
-  {
-    free(job_data->print->parameters);
-    free(job_data->print);
-  }
   if (job_data->chain)
     cupsArrayDelete(job_data->chain);
-  free(job_data);
+
+  // The PPD can get evicted again in lazy loading mode
+  _prPPDRelease(job_data->extension);
+
+  // Everything else, including the job data record itself, is in the arena
+  if (job)
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
+		"Job data arena: Peak usage %lu bytes in %d block(s), %lu bytes allocated",
+		(unsigned long)arena->used, arena->num_blocks,
+		(unsigned long)arena->reserved);
+  _prArenaDelete(arena);
 }
 
 
@@ -1255,7 +1475,11 @@ _prJobIsCanceled(void *data)
 //
 // '_prJobLog()' - Job log function which calls
 //                 papplJobSetImpressionsCompleted() on page logs of
-//                 filter functions
+//                 filter functions. As filters log a lot, messages
+//                 which do not pass the current log level get dropped
+//                 before formatting them and the usual "PAGE: %d %d"
+//                 control messages are read directly from the
+//                 argument list.
 //
 
 void
@@ -1266,28 +1490,57 @@ _prJobLog(void *data,
 {
   va_list arglist;
   pappl_job_t *job = (pappl_job_t *)data;
+  pappl_system_t *system = papplPrinterGetSystem(papplJobGetPrinter(job));
   char buf[1024];
   int page, copies;
 
 
-  va_start(arglist, message);
-  vsnprintf(buf, sizeof(buf) - 1, message, arglist);
-  fflush(stdout);
-  va_end(arglist);
   if (level == CF_LOGLEVEL_CONTROL)
   {
-    if (sscanf(buf, "PAGE: %d %d", &page, &copies) == 2)
+    if (strncmp(message, "PAGE:", 5))
     {
-      papplJobSetImpressionsCompleted(job, copies);
-      papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "Printing page %d, %d copies",
-		  page, copies);
-    }
-    else
+      // Not a page log, only of interest for debugging
+      if (!_PR_LOG_ENABLED(system, PAPPL_LOGLEVEL_DEBUG))
+	return;
+      va_start(arglist, message);
+      vsnprintf(buf, sizeof(buf) - 1, message, arglist);
+      va_end(arglist);
       papplLogJob(job, PAPPL_LOGLEVEL_DEBUG, "Unused control message: %s",
 		  buf);
+      return;
+    }
+
+    if (!strcmp(message, "PAGE: %d %d"))
+    {
+      // Fast path, the form used by the filter functions
+      va_start(arglist, message);
+      page = va_arg(arglist, int);
+      copies = va_arg(arglist, int);
+      va_end(arglist);
+    }
+    else
+    {
+      va_start(arglist, message);
+      vsnprintf(buf, sizeof(buf) - 1, message, arglist);
+      va_end(arglist);
+      if (sscanf(buf, "PAGE: %d %d", &page, &copies) != 2)
+      {
+	_PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG, "Unused control message: %s",
+		    buf);
+	return;
+      }
+    }
+    papplJobSetImpressionsCompleted(job, copies);
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG, "Printing page %d, %d copies",
+		page, copies);
   }
-  else
+  else if (_PR_LOG_ENABLED(system, level))
+  {
+    va_start(arglist, message);
+    vsnprintf(buf, sizeof(buf) - 1, message, arglist);
+    va_end(arglist);
     papplLogJob(job, (pappl_loglevel_t)level, "%s", buf);
+  }
 }
 
 
@@ -1309,7 +1562,7 @@ _prOneBitDitherOnDraft(
   if (!strcmp(papplJobGetFormat(job), "image/urf") ||
       !strcmp(papplJobGetFormat(job), "image/pwg-raster"))
   {
-    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		"Not changing Raster input color depth on PWG/Apple Raster input");
     return;
   }
@@ -1325,25 +1578,25 @@ _prOneBitDitherOnDraft(
     options->header.cupsColorOrder = CUPS_ORDER_CHUNKED;
     options->header.cupsNumColors = 1;
     options->header.cupsBytesPerLine = (options->header.cupsWidth + 7) / 8;
-    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		"Monochrome draft quality job -> 1-bit dithering for speed-up");
     if (options->print_content_optimize == PAPPL_CONTENT_PHOTO ||
 	!strcmp(papplJobGetFormat(job), "image/jpeg") ||
 	!strcmp(papplJobGetFormat(job), "image/png"))
     {
       memcpy(options->dither, driver_data.pdither, sizeof(options->dither));
-      papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+      _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		  "Photo/Image-optimized dither matrix");
     }
     else
     {
       memcpy(options->dither, driver_data.gdither, sizeof(options->dither));
-      papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+      _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		  "General-purpose dither matrix");
     }
   }
   else
-    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		"Not in monochrome draft mode -> no color depth change applied");
 }
 
@@ -1544,15 +1797,16 @@ _prRasterPrepareJob(
                                      // _prPrintFilterFunction()
 
 
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 	      "Printing job in streaming mode");
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 	      "Converting raster input to format %s for further filtering",
 	      starttype);
 
   // Load PPD file and determine the PPD options equivalent to the job options
-  job_data = _prCreateJobData(job, options);
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+  if ((job_data = _prCreateJobData(job, options)) == NULL)
+    return (NULL);
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 	      "Filtering data to get format %s to send off to the driver or device",
 	      job_data->stream_format->dsttype);
 
@@ -1569,14 +1823,53 @@ _prRasterPrepareJob(
 		  job_data->filter_data->num_options,
 		  &job_data->filter_data->options);
 
+  // Allocate the entries of the filter chain from the job arena. A null
+  // filter is a single char, '-' or '.', whereas an actual filter has a
+  // path starting with '/', so at least 2 chars.
+  if (strlen(job_data->stream_filter) > 1)
+  {
+    ppd_filter_params =
+      (cf_filter_external_t *)_prArenaCalloc(job_data->arena, 1,
+					     sizeof(cf_filter_external_t));
+    job_data->ppd_filter =
+      (cf_filter_filter_in_chain_t *)
+      _prArenaCalloc(job_data->arena, 1, sizeof(cf_filter_filter_in_chain_t));
+  }
+  else
+    job_data->ppd_filter = NULL;
+  print_params =
+    (pr_print_filter_function_data_t *)
+    _prArenaCalloc(job_data->arena, 1,
+		   sizeof(pr_print_filter_function_data_t));
+  job_data->print =
+    (cf_filter_filter_in_chain_t *)
+    _prArenaCalloc(job_data->arena, 1, sizeof(cf_filter_filter_in_chain_t));
+  if ((strlen(job_data->stream_filter) > 1 &&
+       (!ppd_filter_params || !job_data->ppd_filter)) ||
+      !print_params || !job_data->print)
+  {
+    papplLogJob(job, PAPPL_LOGLEVEL_ERROR,
+		"Unable to allocate memory for the filter chain");
+    _prFreeJobData(job_data);
+    return (NULL);
+  }
+
   // Connect the job's filter_data to the backend
   if (strncmp(job_data->device_uri, "cups:", 5) == 0)
   {
     // Get the device data
     device_data = (pr_cups_device_data_t *)papplDeviceGetData(device);
 
-    // Connect the filter_data
+    // Connect the filter_data and the environment
     device_data->filter_data = job_data->filter_data;
+    device_data->envp        = job_data->envp;
+
+    // Attach a persistent backend already now, so that the filters get its
+    // back and side channel pipes
+    if ((job_data->global_data->config->components &
+	 PR_COPTIONS_PERSISTENT_CUPS_BACKENDS) &&
+	!device_data->backend_pid)
+      _prCUPSDevLaunchBackend(device);
   }
 
   // The filter chain has no output, data is going directly to the device
@@ -1597,40 +1890,24 @@ _prRasterPrepareJob(
   // for the filter functions being able to use it
   ppdFilterLoadPPD(job_data->filter_data);
   // Filter from PPD?
-  if (strlen(job_data->stream_filter) > 1) // A null filter is a
-                                           // single char, '-' or '.',
-                                           // whereas an actual filter
-                                           // has a path starting with
-                                           // '/', so at least 2
-                                           // chars.
+  if (job_data->ppd_filter)
   {
-    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		"Using CUPS filter (printer driver): %s",
 		job_data->stream_filter);
-    ppd_filter_params =
-      (cf_filter_external_t *)calloc(1, sizeof(cf_filter_external_t));
     ppd_filter_params->filter = job_data->stream_filter;
-    job_data->ppd_filter =
-      (cf_filter_filter_in_chain_t *)calloc(1,
-					  sizeof(cf_filter_filter_in_chain_t));
+    ppd_filter_params->envp = job_data->envp;
     job_data->ppd_filter->function = ppdFilterExternalCUPS;
     job_data->ppd_filter->parameters = ppd_filter_params;
     job_data->ppd_filter->name = strrchr(job_data->stream_filter, '/') + 1;
     cupsArrayAdd(job_data->chain, job_data->ppd_filter);
-  } else
-    job_data->ppd_filter = NULL;
+  }
   // Put filter function to send data to PAPPL's built-in backend at the end
   // of the chain
-  print_params =
-    (pr_print_filter_function_data_t *)
-    calloc(1, sizeof(pr_print_filter_function_data_t));
   print_params->device = device;
   print_params->device_uri = job_data->device_uri;
   print_params->job = job;
   print_params->global_data = job_data->global_data;
-  job_data->print =
-    (cf_filter_filter_in_chain_t *)calloc(1,
-					  sizeof(cf_filter_filter_in_chain_t));
   job_data->print->function = _prPrintFilterFunction;
   job_data->print->parameters = print_params;
   job_data->print->name = "Backend";
@@ -1648,8 +1925,12 @@ _prRasterPrepareJob(
   {
     papplLogJob(job, PAPPL_LOGLEVEL_ERROR,
 		"Unable to create pipe for filtering and sending off the job");
-    if (strlen(job_data->stream_filter) > 1)
-      free(ppd_filter_params);
+    if (device_data)
+    {
+      device_data->filter_data = NULL;
+      device_data->envp        = NULL;
+    }
+    _prFreeJobData(job_data);
     return (NULL);
   }
 
@@ -1674,7 +1955,7 @@ _prRasterCleanUpJob(pappl_job_t      *job,      // I - Job
 
 
   // Stop the filter chain
-  papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+  _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 	      "Shutting down filter chain");
   cfFilterPClose(job_data->device_fd, job_data->device_pid,
 	       job_data->filter_data);
@@ -1685,7 +1966,7 @@ _prRasterCleanUpJob(pappl_job_t      *job,      // I - Job
   // Stop the backend and disconnect the job's filter_data to the backend
   if (strncmp(job_data->device_uri, "cups:", 5) == 0)
   {
-    papplLogJob(job, PAPPL_LOGLEVEL_DEBUG,
+    _PR_LOG_JOB(job, PAPPL_LOGLEVEL_DEBUG,
 		"Shutting down CUPS backend");
 
     // Stop the backend
@@ -1697,13 +1978,12 @@ _prRasterCleanUpJob(pappl_job_t      *job,      // I - Job
     // Get the device data
     device_data = (pr_cups_device_data_t *)papplDeviceGetData(device);
 
-    // Disconnect the filter_data
+    // Disconnect the filter_data and the environment
     device_data->filter_data = NULL;
+    device_data->envp        = NULL;
   }
 
   // Free the data structures
-  if (strlen(job_data->stream_filter) > 1)
-    free(job_data->ppd_filter->parameters);
   _prFreeJobData(job_data);
   papplJobSetData(job, NULL);
 }
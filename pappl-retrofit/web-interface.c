@@ -55,6 +55,8 @@ _prPrinterWebDeviceConfig(
   int          num_options = 0;         // Number of polled options
   cups_option_t	*options = NULL;        // Polled options
   cups_option_t *opt;
+  ipp_name_lookup_t *opt_name,          // PPD/IPP option name entry
+               search_name;             // Search key for look-up table
   bool         polled_installables = false,
                polled_defaults = false;
 
@@ -67,7 +69,11 @@ _prPrinterWebDeviceConfig(
   driver_attrs = papplPrinterGetDriverAttributes(printer);
   extension = (pr_driver_extension_t *)driver_data.extension;
   global_data = extension->global_data;
-  ppd = extension->ppd;
+  if ((ppd = _prPPDAcquire(extension)) == NULL)
+  {
+    ippDelete(driver_attrs);
+    return;
+  }
   pc = ppd->cache;
 
   // Handle POSTs to set "Installable Options" and poll default settings...
@@ -339,91 +345,91 @@ _prPrinterWebDeviceConfig(
 	  }
 	  else if (strcasecmp(opt->name, "PageRegion"))
 	  {
-	    // Vendor options
-	    for (j = 0; j < driver_data.num_vendor; j ++)
+	    // Vendor options, the look-up table is by the exact PPD option
+	    // name, the polled name can differ in case
+	    if ((option = ppdFindOption(ppd, opt->name)) != NULL)
+	      search_name.ppd = option->keyword;
+	    if (option &&
+		(opt_name =
+		 (ipp_name_lookup_t *)cupsArrayFind(extension->ipp_name_lookup,
+						    &search_name)) != NULL &&
+		(j = opt_name->vendor_index) >= 0 &&
+		j < driver_data.num_vendor)
 	    {
-	      if (extension->vendor_ppd_options[j] &&
-		  (!strcasecmp(opt->name, extension->vendor_ppd_options[j]) ||
-		   (extension->vendor_ppd_options[j][0] == '/' &&
-		    !strcasecmp(opt->name,
-				extension->vendor_ppd_options[j] + 1))))
+	      if ((choice = ppdFindChoice(option, opt->value)) != NULL)
 	      {
-		if ((option = ppdFindOption(ppd, opt->name)) != NULL &&
-		    (choice = ppdFindChoice(option, opt->value)) != NULL)
+		snprintf(ipp_supported, sizeof(ipp_supported),
+			 "%s-supported", driver_data.vendor[j]);
+		if ((attr = ippFindAttribute(driver_attrs, ipp_supported,
+					     IPP_TAG_ZERO)) != NULL)
 		{
-		  snprintf(ipp_supported, sizeof(ipp_supported),
-			   "%s-supported", driver_data.vendor[j]);
-		  if ((attr = ippFindAttribute(driver_attrs, ipp_supported,
-					       IPP_TAG_ZERO)) != NULL)
+		  if (ippGetValueTag(attr) == IPP_TAG_BOOLEAN)
 		  {
-		    if (ippGetValueTag(attr) == IPP_TAG_BOOLEAN)
-		    {
-		      if (!strcasecmp(choice->text, "True"))
-			num_vendor = cupsAddOption(driver_data.vendor[j],
-						   "true", num_vendor, &vendor);
-		      else if (!strcasecmp(choice->text, "False"))
-			num_vendor = cupsAddOption(driver_data.vendor[j],
-						   "false",
-						   num_vendor, &vendor);
-		    }
-		    else
+		    if (!strcasecmp(choice->text, "True"))
+		      num_vendor = cupsAddOption(driver_data.vendor[j],
+						 "true", num_vendor, &vendor);
+		    else if (!strcasecmp(choice->text, "False"))
+		      num_vendor = cupsAddOption(driver_data.vendor[j],
+						 "false",
+						 num_vendor, &vendor);
+		  }
+		  else
+		  {
+		    snprintf(ipp_default, sizeof(ipp_default),
+			     "%s-default", driver_data.vendor[j]);
+		    if ((attr = ippFindAttribute(driver_attrs, ipp_default,
+						 IPP_TAG_ZERO)) != NULL &&
+			(ptr1 = (char *)ippGetString(attr, 0, NULL)) !=
+			NULL &&
+			strcasecmp(ptr1, "automatic-selection") == 0)
 		    {
-		      snprintf(ipp_default, sizeof(ipp_default),
-			       "%s-default", driver_data.vendor[j]);
-		      if ((attr = ippFindAttribute(driver_attrs, ipp_default,
-						   IPP_TAG_ZERO)) != NULL &&
-			  (ptr1 = (char *)ippGetString(attr, 0, NULL)) !=
-			  NULL &&
-			  strcasecmp(ptr1, "automatic-selection") == 0)
-		      {
-			// Do not switch a preset-controlled option to
-			// manual (away from "automatic-selection")
-			// Instead, search for the setting in the preset
-			// and increase the score for each preset which
-			// contains the setting. In the end we switch to the
-			// preset with the highest score
-			for (k = 0; k < 2; k ++)
-			  for (l = 0; l < 3; l ++)
-			    for (m = 0; m < pc->num_presets[k][l]; m ++)
-			      if (strcasecmp(opt->name,
-					     pc->presets[k][l][m].name) == 0 &&
-				  strcasecmp(opt->value,
-					     pc->presets[k][l][m].value) == 0)
-			      {
-				default_in_presets = 1;
-				presets_score[k][l] ++;
-				if (strcasecmp(opt->name, "Resolution") == 0)
-				  presets_score[k][l] += 2;
-				papplLogPrinter(printer, PAPPL_LOGLEVEL_DEBUG,
-						"%s=%s in preset [%d][%d] -> Score: %d",
-						opt->name, opt->value, k, l,
-						presets_score[k][l]);
-			      }
-			for (k = 0; k < 5; k ++)
-			  for (m = 0; m < pc->num_optimize_presets[k]; m ++)
+		      // Do not switch a preset-controlled option to
+		      // manual (away from "automatic-selection")
+		      // Instead, search for the setting in the preset
+		      // and increase the score for each preset which
+		      // contains the setting. In the end we switch to the
+		      // preset with the highest score
+		      for (k = 0; k < 2; k ++)
+			for (l = 0; l < 3; l ++)
+			  for (m = 0; m < pc->num_presets[k][l]; m ++)
 			    if (strcasecmp(opt->name,
-					   pc->optimize_presets[k][m].name) ==
-				0 &&
+					   pc->presets[k][l][m].name) == 0 &&
 				strcasecmp(opt->value,
-					   pc->optimize_presets[k][m].value) ==
-				0)
+					   pc->presets[k][l][m].value) == 0)
 			    {
-			      default_in_optimize_presets = 1;
-			      optimize_presets_score[k] ++;
+			      default_in_presets = 1;
+			      presets_score[k][l] ++;
+			      if (strcasecmp(opt->name, "Resolution") == 0)
+				presets_score[k][l] += 2;
 			      papplLogPrinter(printer, PAPPL_LOGLEVEL_DEBUG,
-					      "%s=%s in optimize preset [%d] -> Score: %d",
-					      opt->name, opt->value, k,
-					      optimize_presets_score[k]);
+					      "%s=%s in preset [%d][%d] -> Score: %d",
+					      opt->name, opt->value, k, l,
+					      presets_score[k][l]);
 			    }
-		      }
-		      else
-		      {
-			ppdPwgUnppdizeName(choice->text, ipp_choice,
-					   sizeof(ipp_choice), NULL);
-			num_vendor = cupsAddOption(driver_data.vendor[j],
-						   ipp_choice,
-						   num_vendor, &vendor);
-		      }
+		      for (k = 0; k < 5; k ++)
+			for (m = 0; m < pc->num_optimize_presets[k]; m ++)
+			  if (strcasecmp(opt->name,
+					 pc->optimize_presets[k][m].name) ==
+			      0 &&
+			      strcasecmp(opt->value,
+					 pc->optimize_presets[k][m].value) ==
+			      0)
+			  {
+			    default_in_optimize_presets = 1;
+			    optimize_presets_score[k] ++;
+			    papplLogPrinter(printer, PAPPL_LOGLEVEL_DEBUG,
+					    "%s=%s in optimize preset [%d] -> Score: %d",
+					    opt->name, opt->value, k,
+					    optimize_presets_score[k]);
+			  }
+		    }
+		    else
+		    {
+		      ppdPwgUnppdizeName(choice->text, ipp_choice,
+					 sizeof(ipp_choice), NULL);
+		      num_vendor = cupsAddOption(driver_data.vendor[j],
+						 ipp_choice,
+						 num_vendor, &vendor);
 		    }
 		  }
 		}
@@ -736,6 +742,7 @@ _prPrinterWebDeviceConfig(
   papplClientHTMLPrinterFooter(client);
 
   // Clean up
+  _prPPDRelease(extension);
   ippDelete(driver_attrs);
   if (num_options)
     cupsFreeOptions(num_options, options);
@@ -763,6 +770,7 @@ _prSystemWebAddPPD(
   pappl_version_t     version;
   cups_array_t        *uploaded,        // List of uploaded PPDs, to delete
                                         // them in certain error conditions
+                      *deleted,         // List of deleted PPDs
                       *accepted_report, // Report of accepted PPDs with warnings
                       *rejected_report; // Report of rejected PPDs with errors
   cups_dir_t          *dir;             // User PPD file directory
@@ -776,6 +784,8 @@ _prSystemWebAddPPD(
   // Create arrays to log PPD file upload
   uploaded = cupsArrayNew3(NULL, NULL, NULL, 0, NULL,
 			   (cups_afree_func_t)free);
+  deleted = cupsArrayNew3(NULL, NULL, NULL, 0, NULL,
+			  (cups_afree_func_t)free);
   accepted_report = cupsArrayNew3(NULL, NULL, NULL, 0, NULL,
 				  (cups_afree_func_t)free);
   rejected_report = cupsArrayNew3(NULL, NULL, NULL, 0, NULL,
@@ -795,6 +805,7 @@ _prSystemWebAddPPD(
     http_t              *http;
     bool                error = false;
     bool                ppd_repo_changed = false; // PPD(s) added or removed?
+    bool                ppd_repo_refresh = false; // Full refresh requested?
     char		*ptr;		// Pointer into string
 
 
@@ -1325,6 +1336,7 @@ _prSystemWebAddPPD(
 	    papplLogClient(client, PAPPL_LOGLEVEL_DEBUG,
 			   "Deleting file: %s", destpath);
 	    unlink(destpath);
+	    cupsArrayAdd(deleted, strdup(destpath));
 	    ppd_repo_changed = true;
 	  }
 	if (ppd_repo_changed)
@@ -1334,7 +1346,7 @@ _prSystemWebAddPPD(
       }
       else if (!strcmp(action, "refresh-ppdfiles"))
       {
-	ppd_repo_changed = true;
+	ppd_repo_refresh = true;
 	status = "Driver list refreshed.";
       }
       else
@@ -1358,9 +1370,21 @@ _prSystemWebAddPPD(
       }
     }
 
-    // Refresh driver list (if at least 1 PPD got added or removed)
-    if (ppd_repo_changed)
+    // Refresh driver list (if requested) or update it (if at least 1 PPD
+    // got added or removed)
+    pthread_mutex_lock(&global_data->driver_list_mutex);
+    if (ppd_repo_refresh)
+    {
+      _prCUPSFilterPathFlush();
       _prSetupDriverList(global_data);
+    }
+    else if (ppd_repo_changed)
+    {
+      _prUpdateDriverList(global_data, uploaded, deleted);
+      // The directory watcher sees these changes, too, they are done now
+      _prDirWatcherApplied(global_data, uploaded, deleted);
+    }
+    pthread_mutex_unlock(&global_data->driver_list_mutex);
 
     cupsFreeOptions(num_form, form);
   }
@@ -1515,6 +1539,7 @@ _prSystemWebAddPPD(
  clean_up:
   // Clean up
   cupsArrayDelete(uploaded);
+  cupsArrayDelete(deleted);
   cupsArrayDelete(accepted_report);
   cupsArrayDelete(rejected_report);
 }
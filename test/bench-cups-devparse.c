@@ -0,0 +1,112 @@
+//
+// PPD/Classic CUPS driver retro-fit Printer Application Library
+// (libpappl-retrofit) for the Printer Application Framework (PAPPL)
+//
+// bench-cups-devparse.c
+//
+// Benchmark for _prCUPSDevParseLine(), the parser for the output lines
+// of CUPS backends in discovery mode. Parses typical lines, with and
+// without escaped characters, and reports the time per line.
+//
+// Usage: bench-cups-devparse [ITERATIONS]
+//
+// Copyright © 2020 by Till Kamppeter.
+// Copyright © 2020 by Michael R Sweet.
+//
+// Licensed under Apache License v2.0.  See the file "LICENSE" for more
+// information.
+//
+
+//
+// Include necessary headers...
+//
+
+#include <pappl-retrofit/cups-backends-private.h>
+#include <time.h>
+
+
+//
+// Local globals...
+//
+
+// Typical lines of the usb, snmp, dnssd, and serial backends, and one
+// with many escaped characters in its quoted fields
+
+static const char * const bench_lines[] =
+{
+  "direct usb://HP/LaserJet%201020?serial=00CNBW123456 \"HP LaserJet 1020\" \"HP LaserJet 1020 USB 00CNBW123456 HPLIP\" \"MFG:Hewlett-Packard;CMD:PJL,PCL,POSTSCRIPT;MDL:HP LaserJet 1020;CLS:PRINTER;DES:HP LaserJet 1020;\" \"\"",
+  "network socket://192.168.1.10 \"Brother HL-L2350DW series\" \"Brother HL-L2350DW series 192.168.1.10\" \"MFG:Brother;CMD:PJL,PCL,PCLXL,URF;MDL:HL-L2350DW series;CLS:PRINTER;CID:Brother Laser Type1;URF:W8,CP1,IS4-1,MT1-3-4-5-8,OB10,PQ4,RS300-600,V1.3,DM1;\" \"Office\"",
+  "network dnssd://Canon%20MF640C%20Series._ipp._tcp.local/?uuid=6d4ff0ce-6b11-11d8-8020-f48139a1c3f2 \"Canon MF640C Series\" \"Canon MF640C Series\" \"MFG:Canon;MDL:MF640C Series;CMD:URF,PDF,JPEG;\" \"\"",
+  "serial serial:/dev/ttyS0?baud=115200 \"Unknown\" \"Serial Port #1\"",
+  "network socket://10.0.0.2 \"Unknown\" \"\\\"Front\\\" \\\\ \\\"Desk\\\" \\\\ \\\"Printer\\\"\" \"MFG:Generic\\;MDL:Escaped\\;\" \"\\\"Lobby\\\"\"",
+};
+
+
+//
+// 'main()' - Run the benchmark.
+//
+
+int                             // O - Exit status
+main(int  argc,                 // I - Number of command line arguments
+     char *argv[])              // I - Command line arguments
+{
+  int             i,            // Looping variable
+                  num_lines = (int)(sizeof(bench_lines) /
+				    sizeof(bench_lines[0]));
+  long            j,            // Looping variable
+                  devices = 0,  // Number of lines with a device
+                  iterations = 1000000; // Number of iterations
+  char            *line,        // Line to parse
+                  *dclass, *uri, *info, *device_id; // Parse results
+  size_t          len;          // Length of line
+  struct timespec start, end;   // Start and end time
+  double          secs;         // Elapsed time
+
+
+  if (argc > 1 && (iterations = atol(argv[1])) < 1)
+  {
+    fprintf(stderr, "Usage: %s [ITERATIONS]\n", argv[0]);
+    return (1);
+  }
+
+  for (i = 0; i < num_lines; i ++)
+  {
+    // The parser modifies the line, so each pass works on a fresh copy,
+    // the copying is timed separately and subtracted
+    len = strlen(bench_lines[i]) + 1;
+    if ((line = (char *)malloc(len)) == NULL)
+      return (1);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (j = 0; j < iterations; j ++)
+    {
+      memcpy(line, bench_lines[i], len);
+      devices += (_prCUPSDevParseLine(line, &dclass, &uri, &info,
+				      &device_id) == 1);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs = (double)(end.tv_sec - start.tv_sec) +
+           (double)(end.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (j = 0; j < iterations; j ++)
+    {
+      memcpy(line, bench_lines[i], len);
+      __asm__ __volatile__("" : : "r" (line) : "memory");
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    secs -= (double)(end.tv_sec - start.tv_sec) +
+            (double)(end.tv_nsec - start.tv_nsec) / 1000000000.0;
+
+    printf("Line %d (%d bytes): %.1f ns/line, %.1f MB/s\n", i + 1,
+	   (int)len - 1, secs * 1000000000.0 / (double)iterations,
+	   (double)(len - 1) * (double)iterations / secs / 1000000.0);
+
+    free(line);
+  }
+
+  printf("%ld of %ld lines with a device.\n", devices,
+	 (long)num_lines * iterations);
+
+  return (0);
+}
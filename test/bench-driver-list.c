@@ -0,0 +1,315 @@
+//
+// PPD/Classic CUPS driver retro-fit Printer Application Library
+// (libpappl-retrofit) for the Printer Application Framework (PAPPL)
+//
+// bench-driver-list.c
+//
+// Benchmark for building the driver list in _prSetupDriverList(): Creates
+// a synthetic collection of driver entries, with duplicate names and
+// descriptions, and removes the duplicates and sorts the entries as
+// _prSetupDriverList() does, with _prDriverHashSlot() and
+// _prCompareDrivers(). For comparison the entries also get sorted in
+// one by one with pairwise swaps and duplicate removal via memmove(),
+// as the driver list was built before.
+//
+// Usage: bench-driver-list [NUM-ENTRIES]
+//
+// Copyright © 2020 by Till Kamppeter.
+// Copyright © 2020 by Michael R Sweet.
+//
+// Licensed under Apache License v2.0.  See the file "LICENSE" for more
+// information.
+//
+
+//
+// Include necessary headers...
+//
+
+#include <pappl-retrofit/pappl-retrofit-private.h>
+#include <time.h>
+
+
+//
+// Local functions...
+//
+
+static int      build_hashed(pappl_pr_driver_t *drivers, int num_entries);
+static int      build_insertion(pappl_pr_driver_t *drivers, int num_entries);
+static bool     check_list(pappl_pr_driver_t *drivers, int num_drivers);
+static double   elapsed(struct timespec *start, struct timespec *end);
+
+
+//
+// 'main()' - Run the benchmark.
+//
+
+int                             // O - Exit status
+main(int  argc,                 // I - Number of command line arguments
+     char *argv[])              // I - Command line arguments
+{
+  int             i,            // Looping variable
+                  num_entries = 20000, // Number of entries
+                  num_hashed,   // Entries left by build_hashed()
+                  num_insertion; // Entries left by build_insertion()
+  unsigned        model;        // Pseudo-random model number
+  pappl_pr_driver_t *entries,   // Synthetic entries, collection order
+                  *drivers;     // Working copy of the entries
+  char            buf[256],     // String buffer
+                  *ptr;         // Pointer into buffer
+  struct timespec start, end;   // Start and end time
+  double          secs_hashed,  // Time for build_hashed()
+                  secs_insertion; // Time for build_insertion()
+
+
+  if (argc > 1 && (num_entries = atoi(argv[1])) < 1)
+  {
+    fprintf(stderr, "Usage: %s [NUM-ENTRIES]\n", argv[0]);
+    return (1);
+  }
+
+  if ((entries = (pappl_pr_driver_t *)calloc(num_entries,
+					     sizeof(pappl_pr_driver_t))) ==
+      NULL ||
+      (drivers = (pappl_pr_driver_t *)calloc(num_entries,
+					     sizeof(pappl_pr_driver_t))) ==
+      NULL)
+    return (1);
+
+  // Entries in the order of the PPD collections, the generic driver
+  // first, models in pseudo-random order, every 10th entry repeats the
+  // description of an earlier one in other case and every 25th one
+  // repeats a driver name, as PPDs in several collections do
+  entries[0].name        = strdup("generic");
+  entries[0].description = strdup("Generic Printer");
+  entries[0].device_id   = strdup("");
+  entries[0].extension   = strdup(" generic");
+  for (i = 1, model = 12345; i < num_entries; i ++)
+  {
+    model = model * 1103515245 + 12345;
+    if (i % 10 == 9)
+    {
+      snprintf(buf, sizeof(buf), "acme-copy-%d-en", i);
+      entries[i].name        = strdup(buf);
+      snprintf(buf, sizeof(buf), "%s", entries[i - 5].description);
+      for (ptr = buf; *ptr; ptr ++)
+	*ptr = (char)toupper(*ptr & 255);
+      entries[i].description = strdup(buf);
+      entries[i].extension   = strdup((char *)entries[i - 5].extension);
+    }
+    else if (i % 25 == 24)
+    {
+      entries[i].name        = strdup(entries[i - 7].name);
+      snprintf(buf, sizeof(buf), "Acme%02d LaserJet %u, Copy %d",
+	       i % 40, (model >> 8) % 100000, i);
+      entries[i].description = strdup(buf);
+      entries[i].extension   = strdup((char *)entries[i - 7].extension);
+    }
+    else
+    {
+      snprintf(buf, sizeof(buf), "acme%02d-laserjet-%u-%d-en", i % 40,
+	       (model >> 8) % 100000, i);
+      entries[i].name = strdup(buf);
+      snprintf(buf, sizeof(buf), "Acme%02d LaserJet %u (%d), en", i % 40,
+	       (model >> 8) % 100000, i);
+      entries[i].description = strdup(buf);
+      snprintf(buf, sizeof(buf), "acme%02d laserjet %08u %08d en", i % 40,
+	       (model >> 8) % 100000, i);
+      entries[i].extension = strdup(buf);
+    }
+    snprintf(buf, sizeof(buf), "MFG:Acme%02d;MDL:LaserJet %d;", i % 40, i);
+    entries[i].device_id = strdup(buf);
+  }
+
+  memcpy(drivers, entries, (size_t)num_entries * sizeof(pappl_pr_driver_t));
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  num_hashed = build_hashed(drivers, num_entries);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  secs_hashed = elapsed(&start, &end);
+  if (!check_list(drivers, num_hashed))
+    return (1);
+
+  memcpy(drivers, entries, (size_t)num_entries * sizeof(pappl_pr_driver_t));
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  num_insertion = build_insertion(drivers, num_entries);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  secs_insertion = elapsed(&start, &end);
+
+  printf("%d entries: Hash set and sort: %d drivers in %.3f ms, "
+	 "insertion and memmove(): %d drivers in %.3f ms (%.1fx)\n",
+	 num_entries, num_hashed, secs_hashed * 1000.0, num_insertion,
+	 secs_insertion * 1000.0,
+	 secs_hashed > 0.0 ? secs_insertion / secs_hashed : 0.0);
+
+  _prDriverListFree(entries, num_entries, NULL);
+  free(drivers);
+
+  return (0);
+}
+
+
+//
+// 'build_hashed()' - Remove the duplicates with hash sets on the name and
+//                    on the case-folded description, keeping the first
+//                    entry, and sort the rest in one go, as
+//                    _prSetupDriverList() does.
+//
+
+static int                      // O - Number of drivers left
+build_hashed(pappl_pr_driver_t *drivers, // I - Entries, collection order
+	     int               num_entries) // I - Number of entries
+{
+  int               j,          // Looping variable
+                    num_drivers; // Number of drivers left
+  const char        **names,    // Hash tables for finding duplicates
+                    **descs;
+  size_t            hash_size,  // Size of the hash tables
+                    name_slot,  // Slot for driver name
+                    desc_slot;  // Slot for description
+  pappl_pr_driver_t **sorted,   // Driver entries in sorting order
+                    *sorted_drivers; // Sorted driver list
+
+
+  for (hash_size = 64; hash_size < 2 * (size_t)num_entries; hash_size *= 2);
+  names = (const char **)calloc(hash_size, sizeof(const char *));
+  descs = (const char **)calloc(hash_size, sizeof(const char *));
+  for (j = 0, num_drivers = 0; j < num_entries; j ++)
+  {
+    name_slot = _prDriverHashSlot(names, hash_size, drivers[j].name, false);
+    desc_slot = _prDriverHashSlot(descs, hash_size, drivers[j].description,
+				  true);
+    if (names[name_slot] || descs[desc_slot])
+      continue;
+    names[name_slot] = drivers[j].name;
+    descs[desc_slot] = drivers[j].description;
+    drivers[num_drivers ++] = drivers[j];
+  }
+  free(names);
+  free(descs);
+
+  sorted = (pappl_pr_driver_t **)calloc(num_drivers + 1,
+					sizeof(pappl_pr_driver_t *));
+  for (j = 0; j < num_drivers; j ++)
+    sorted[j] = drivers + j;
+  qsort(sorted, (size_t)num_drivers, sizeof(pappl_pr_driver_t *),
+	_prCompareDrivers);
+  sorted_drivers = (pappl_pr_driver_t *)calloc(num_drivers + 1,
+					       sizeof(pappl_pr_driver_t));
+  for (j = 0; j < num_drivers; j ++)
+    sorted_drivers[j] = *(sorted[j]);
+  memcpy(drivers, sorted_drivers,
+	 (size_t)num_drivers * sizeof(pappl_pr_driver_t));
+  free(sorted);
+  free(sorted_drivers);
+
+  return (num_drivers);
+}
+
+
+//
+// 'build_insertion()' - Sort each entry into the list with pairwise swaps
+//                       and remove it with memmove() if its new
+//                       neighbour has the same name or description, as
+//                       the driver list was built before.
+//
+
+static int                      // O - Number of drivers left
+build_insertion(pappl_pr_driver_t *drivers, // I - Entries, collection order
+		int               num_entries) // I - Number of entries
+{
+  int               i, k,       // Looping variables
+                    n;          // Position of new entry
+  pappl_pr_driver_t swap;       // Entry being swapped
+
+
+  // The sorted part of the list grows in place, the next entry from the
+  // collection order gets appended to it and moved down
+  for (i = 0, k = 0; k < num_entries; k ++)
+  {
+    drivers[i] = drivers[k];
+    for (n = i;
+	 n > 0 &&
+	   ((strncmp(drivers[n - 1].extension, "generic  ", 9) &&
+	     !strncmp(drivers[n].extension, "generic  ", 9)) ||
+	    strcmp((char *)(drivers[n - 1].extension),
+		   (char *)(drivers[n].extension)) > 0);
+	 n --)
+    {
+      swap = drivers[n - 1];
+      drivers[n - 1] = drivers[n];
+      drivers[n] = swap;
+    }
+    if (n > 0 &&
+	(strcmp(drivers[n - 1].name, drivers[n].name) == 0 ||
+	 strcasecmp(drivers[n - 1].description, drivers[n].description) == 0))
+    {
+      memmove(&drivers[n], &drivers[n + 1],
+	      (i - n) * sizeof(pappl_pr_driver_t));
+      i --;
+    }
+    i ++;
+  }
+
+  return (i);
+}
+
+
+//
+// 'check_list()' - Check that the driver list is sorted and free of
+//                  duplicate names and descriptions.
+//
+
+static bool                     // O - true if the list is correct
+check_list(pappl_pr_driver_t *drivers, // I - Driver list
+	   int               num_drivers) // I - Number of drivers
+{
+  int          j;               // Looping variable
+  const char   **names,         // Hash tables for finding duplicates
+               **descs;
+  size_t       hash_size,       // Size of the hash tables
+               name_slot,       // Slot for driver name
+               desc_slot;       // Slot for description
+  bool         ret = true;      // Return value
+
+
+  for (j = 1; j < num_drivers; j ++)
+    if (strcmp((char *)drivers[j - 1].extension,
+	       (char *)drivers[j].extension) > 0)
+    {
+      fprintf(stderr, "Entry %d (%s) not sorted\n", j, drivers[j].name);
+      ret = false;
+    }
+
+  for (hash_size = 64; hash_size < 2 * (size_t)num_drivers; hash_size *= 2);
+  names = (const char **)calloc(hash_size, sizeof(const char *));
+  descs = (const char **)calloc(hash_size, sizeof(const char *));
+  for (j = 0; j < num_drivers; j ++)
+  {
+    name_slot = _prDriverHashSlot(names, hash_size, drivers[j].name, false);
+    desc_slot = _prDriverHashSlot(descs, hash_size, drivers[j].description,
+				  true);
+    if (names[name_slot] || descs[desc_slot])
+    {
+      fprintf(stderr, "Entry %d (%s) is a duplicate\n", j, drivers[j].name);
+      ret = false;
+    }
+    names[name_slot] = drivers[j].name;
+    descs[desc_slot] = drivers[j].description;
+  }
+  free(names);
+  free(descs);
+
+  return (ret);
+}
+
+
+//
+// 'elapsed()' - Time between two time stamps in seconds.
+//
+
+static double                   // O - Seconds
+elapsed(struct timespec *start, // I - Start time
+	struct timespec *end)   // I - End time
+{
+  return ((double)(end->tv_sec - start->tv_sec) +
+	  (double)(end->tv_nsec - start->tv_nsec) / 1000000000.0);
+}
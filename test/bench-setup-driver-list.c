@@ -0,0 +1,287 @@
+//
+// PPD/Classic CUPS driver retro-fit Printer Application Library
+// (libpappl-retrofit) for the Printer Application Framework (PAPPL)
+//
+// bench-setup-driver-list.c
+//
+// Benchmark for _prSetupDriverList() and its level-gated logging: Creates
+// a collection of generated PPD files in a temporary directory and times
+// building the driver list from it, once with the system's log level at
+// DEBUG, where the _PR_LOG*() macros let all debug messages through and
+// they get formatted and written, and once at INFO, where the macros
+// drop them before evaluating their arguments. Each run uses an empty
+// state directory, so that the driver index file of the previous run
+// does not get used.
+//
+// Usage: bench-setup-driver-list [NUM-PPDS [ITERATIONS]]
+//
+// Copyright © 2020 by Till Kamppeter.
+// Copyright © 2020 by Michael R Sweet.
+//
+// Licensed under Apache License v2.0.  See the file "LICENSE" for more
+// information.
+//
+
+//
+// Include necessary headers...
+//
+
+#include <pappl-retrofit/pappl-retrofit-private.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+
+
+//
+// Local functions...
+//
+
+static bool     make_collection(const char *dir, int num_ppds);
+static void     remove_dir(const char *dir);
+static double   time_setup(pappl_system_t *system, const char *ppd_dir,
+			   const char *state_dir);
+
+
+//
+// 'main()' - Run the benchmark.
+//
+
+int                             // O - Exit status
+main(int  argc,                 // I - Number of command line arguments
+     char *argv[])              // I - Command line arguments
+{
+  int             i,            // Looping variable
+                  num_ppds = 10000, // Number of PPD files
+                  iterations = 3; // Number of runs for each log level
+  pappl_system_t  *debug_system, // System logging at DEBUG
+                  *info_system; // System logging at INFO
+  double          secs,         // Time of a run
+                  debug_secs = 0.0, // Best time at DEBUG
+                  info_secs = 0.0; // Best time at INFO
+  char            tempdir[1024], // Temporary directory
+                  ppd_dir[1024], // PPD collection
+                  state_dir[1024]; // State directory of a run
+
+
+  if ((argc > 1 && (num_ppds = atoi(argv[1])) < 1) ||
+      (argc > 2 && (iterations = atoi(argv[2])) < 1))
+  {
+    fprintf(stderr, "Usage: %s [NUM-PPDS [ITERATIONS]]\n", argv[0]);
+    return (1);
+  }
+
+  snprintf(tempdir, sizeof(tempdir), "%s/bench-setup-driver-list-XXXXXX",
+	   getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp");
+  if (!mkdtemp(tempdir))
+  {
+    perror(tempdir);
+    return (1);
+  }
+  snprintf(ppd_dir, sizeof(ppd_dir), "%s/ppd", tempdir);
+  if (!make_collection(ppd_dir, num_ppds))
+  {
+    remove_dir(tempdir);
+    return (1);
+  }
+
+  // The messages get formatted and written also at DEBUG, only the
+  // file does not keep them
+  if ((debug_system = papplSystemCreate(PAPPL_SOPTIONS_NONE, "Benchmark", 0,
+					NULL, tempdir, "/dev/null",
+					PAPPL_LOGLEVEL_DEBUG, NULL,
+					false)) == NULL ||
+      (info_system = papplSystemCreate(PAPPL_SOPTIONS_NONE, "Benchmark", 0,
+				       NULL, tempdir, "/dev/null",
+				       PAPPL_LOGLEVEL_INFO, NULL,
+				       false)) == NULL)
+  {
+    fprintf(stderr, "Unable to create system\n");
+    remove_dir(tempdir);
+    return (1);
+  }
+
+  // A first run to get the PPD files into the file system cache
+  snprintf(state_dir, sizeof(state_dir), "%s/state-warmup", tempdir);
+  time_setup(info_system, ppd_dir, state_dir);
+
+  for (i = 0; i < iterations; i ++)
+  {
+    snprintf(state_dir, sizeof(state_dir), "%s/state-debug-%d", tempdir, i);
+    secs = time_setup(debug_system, ppd_dir, state_dir);
+    if (i == 0 || secs < debug_secs)
+      debug_secs = secs;
+
+    snprintf(state_dir, sizeof(state_dir), "%s/state-info-%d", tempdir, i);
+    secs = time_setup(info_system, ppd_dir, state_dir);
+    if (i == 0 || secs < info_secs)
+      info_secs = secs;
+  }
+
+  printf("%d PPD files, best of %d runs: Log level DEBUG (debug messages "
+	 "logged): %.3f s, log level INFO (debug messages skipped): "
+	 "%.3f s\n", num_ppds, iterations, debug_secs, info_secs);
+
+  papplSystemDelete(debug_system);
+  papplSystemDelete(info_system);
+  remove_dir(tempdir);
+
+  return (0);
+}
+
+
+//
+// 'make_collection()' - Write a collection of PPD files, in directories
+//                       of 500 files each, like the directories of the
+//                       manufacturers in a real collection.
+//
+
+static bool                     // O - `true` on success
+make_collection(const char *dir, // I - Directory of the collection
+		int        num_ppds) // I - Number of PPD files
+{
+  int  i;                       // Looping variable
+  FILE *fp;                     // PPD file
+  char subdir[1024],            // Directory of manufacturer
+       filename[2048];          // Name of PPD file
+
+
+  if (mkdir(dir, 0755))
+  {
+    perror(dir);
+    return (false);
+  }
+
+  for (i = 0; i < num_ppds; i ++)
+  {
+    snprintf(subdir, sizeof(subdir), "%s/acme%02d", dir, i / 500);
+    if (i % 500 == 0 && mkdir(subdir, 0755))
+    {
+      perror(subdir);
+      return (false);
+    }
+
+    snprintf(filename, sizeof(filename), "%s/acme%02d-laser-%d.ppd", subdir,
+	     i / 500, i);
+    if ((fp = fopen(filename, "w")) == NULL)
+    {
+      perror(filename);
+      return (false);
+    }
+    fprintf(fp,
+	    "*PPD-Adobe: \"4.3\"\n"
+	    "*FormatVersion: \"4.3\"\n"
+	    "*FileVersion: \"1.0\"\n"
+	    "*LanguageVersion: English\n"
+	    "*LanguageEncoding: ISOLatin1\n"
+	    "*PCFileName: \"ACME%05d.PPD\"\n"
+	    "*Manufacturer: \"Acme%02d\"\n"
+	    "*Product: \"(Laser %d)\"\n"
+	    "*Product: \"(Laser %dN)\"\n"
+	    "*Product: \"(Laser %dDN)\"\n"
+	    "*ModelName: \"Acme%02d Laser %d\"\n"
+	    "*ShortNickName: \"Acme%02d Laser %d\"\n"
+	    "*NickName: \"Acme%02d Laser %d, 1.0\"\n"
+	    "*1284DeviceID: \"MFG:Acme%02d;MDL:Laser %d;CMD:PCL,POSTSCRIPT;\"\n"
+	    "*PSVersion: \"(3010.000) 0\"\n"
+	    "*LanguageLevel: \"3\"\n"
+	    "*ColorDevice: False\n"
+	    "*DefaultColorSpace: Gray\n"
+	    "*OpenUI *PageSize/Media Size: PickOne\n"
+	    "*DefaultPageSize: A4\n"
+	    "*PageSize A4/A4: \"<</PageSize[595 842]>>setpagedevice\"\n"
+	    "*PageSize Letter/US Letter: \"<</PageSize[612 792]>>setpagedevice\"\n"
+	    "*CloseUI: *PageSize\n",
+	    i, i / 500, i, i, i, i / 500, i, i / 500, i, i / 500, i, i / 500,
+	    i);
+    fclose(fp);
+  }
+
+  return (true);
+}
+
+
+//
+// 'remove_dir()' - Remove a directory tree.
+//
+
+static void
+remove_dir(const char *dir)     // I - Directory
+{
+  DIR           *dp;            // Directory
+  struct dirent *dent;          // Directory entry
+  struct stat   fileinfo;       // File information
+  char          filename[2048]; // Name of entry
+
+
+  if ((dp = opendir(dir)) != NULL)
+  {
+    while ((dent = readdir(dp)) != NULL)
+    {
+      if (!strcmp(dent->d_name, ".") || !strcmp(dent->d_name, ".."))
+	continue;
+      snprintf(filename, sizeof(filename), "%s/%s", dir, dent->d_name);
+      if (!lstat(filename, &fileinfo) && S_ISDIR(fileinfo.st_mode))
+	remove_dir(filename);
+      else
+	unlink(filename);
+    }
+    closedir(dp);
+  }
+  rmdir(dir);
+}
+
+
+//
+// 'time_setup()' - Build the driver list from the PPD collection, as at
+//                  the start of a Printer Application, and return the
+//                  time it took.
+//
+
+static double                   // O - Seconds
+time_setup(pappl_system_t *system, // I - System
+	   const char     *ppd_dir, // I - PPD collection
+	   const char     *state_dir) // I - Empty state directory
+{
+  pr_printer_app_config_t      config; // Printer Application configuration
+  pr_printer_app_global_data_t global_data; // Global data
+  ppd_collection_t             col;     // PPD collection
+  struct timespec              start, end; // Start and end time
+
+
+  memset(&config, 0, sizeof(config));
+  config.system_name         = "Benchmark";
+  config.system_package_name = "bench-setup-driver-list";
+
+  memset(&global_data, 0, sizeof(global_data));
+  global_data.config = &config;
+  global_data.system = system;
+  pthread_mutex_init(&global_data.driver_list_mutex, NULL);
+  pthread_mutex_init(&global_data.driver_list_ref_mutex, NULL);
+  pthread_rwlock_init(&global_data.driver_matcher_lock, NULL);
+  pthread_mutex_init(&global_data.driver_names_mutex, NULL);
+  pthread_mutex_init(&global_data.driver_cache_mutex, NULL);
+  pthread_mutex_init(&global_data.driver_instances_mutex, NULL);
+  pthread_mutex_init(&global_data.ppd_lru_mutex, NULL);
+  strncpy(global_data.state_dir, state_dir, sizeof(global_data.state_dir) - 1);
+  snprintf(global_data.user_ppd_dir, sizeof(global_data.user_ppd_dir),
+	   "%s/ppd", state_dir);
+  mkdir(state_dir, 0755);
+
+  col.name = NULL;
+  col.path = (char *)ppd_dir;
+  global_data.ppd_collections = cupsArrayNew(NULL, NULL);
+  cupsArrayAdd(global_data.ppd_collections, &col);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  _prSetupDriverList(&global_data);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  // The system is not running, so PAPPL does not read the driver list
+  // any more
+  cupsArrayDelete(global_data.ppd_collections);
+  _prDriverMatcherFree(&global_data);
+  _prDriverListsFree(&global_data);
+
+  return ((double)(end.tv_sec - start.tv_sec) +
+	  (double)(end.tv_nsec - start.tv_nsec) / 1000000000.0);
+}
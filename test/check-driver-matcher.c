@@ -0,0 +1,153 @@
+//
+// PPD/Classic CUPS driver retro-fit Printer Application Library
+// (libpappl-retrofit) for the Printer Application Framework (PAPPL)
+//
+// check-driver-matcher.c
+//
+// Check for prBestMatchingPPDBatch(): Builds the driver matcher index
+// for a synthetic driver list, matches a batch of device IDs, and checks
+// that the result for each device is the same as prBestMatchingPPD()
+// gives.
+//
+// Usage: check-driver-matcher [NUM-DRIVERS [NUM-DEVICES]]
+//
+// Copyright © 2020 by Till Kamppeter.
+// Copyright © 2020 by Michael R Sweet.
+//
+// Licensed under Apache License v2.0.  See the file "LICENSE" for more
+// information.
+//
+
+//
+// Include necessary headers...
+//
+
+#include <pappl-retrofit/pappl-retrofit-private.h>
+
+
+//
+// 'main()' - Run the check.
+//
+
+int                             // O - Exit status
+main(int  argc,                 // I - Number of command line arguments
+     char *argv[])              // I - Command line arguments
+{
+  int             i,            // Looping variable
+                  num_drivers = 2000, // Number of drivers
+                  num_devices = 200, // Number of devices
+                  num_found,    // Devices with driver in batch
+                  errors = 0;   // Number of differences
+  pr_printer_app_config_t config; // Printer Application configuration
+  pr_printer_app_global_data_t global_data; // Global data
+  pr_driver_list_t *list;       // Synthetic driver list
+  pappl_pr_driver_t *driver;    // Current driver
+  char            **device_ids, // Device IDs of the devices
+                  buf[1024];    // Name, description, or device ID
+  const char      **driver_names, // Results of the batch
+                  *single;      // Result of prBestMatchingPPD()
+
+
+  if ((argc > 1 && (num_drivers = atoi(argv[1])) < 2) ||
+      (argc > 2 && (num_devices = atoi(argv[2])) < 1))
+  {
+    fprintf(stderr, "Usage: %s [NUM-DRIVERS [NUM-DEVICES]]\n", argv[0]);
+    return (1);
+  }
+
+  memset(&config, 0, sizeof(config));
+  memset(&global_data, 0, sizeof(global_data));
+  global_data.config = &config;
+  pthread_mutex_init(&global_data.driver_list_ref_mutex, NULL);
+  pthread_rwlock_init(&global_data.driver_matcher_lock, NULL);
+  pthread_mutex_init(&global_data.driver_names_mutex, NULL);
+
+  // Driver list as _prSetupDriverList() creates it: "generic" first, then
+  // drivers with make and model in their device ID, some of them only
+  // differing by language, and some without device ID, matched by name
+  if ((list = (pr_driver_list_t *)calloc(1, sizeof(pr_driver_list_t))) ==
+      NULL ||
+      (list->drivers = (pappl_pr_driver_t *)calloc(num_drivers,
+						   sizeof(pappl_pr_driver_t))) ==
+      NULL)
+    return (1);
+  list->ref_count   = 1;
+  list->num_drivers = num_drivers;
+
+  list->drivers[0].name        = strdup("generic");
+  list->drivers[0].description = strdup("Generic PostScript Printer");
+  list->drivers[0].device_id   = strdup("");
+  for (i = 1, driver = list->drivers + 1; i < num_drivers; i ++, driver ++)
+  {
+    snprintf(buf, sizeof(buf), "acme%d-laser-%d--%s", i % 50, i / 2,
+	     i % 2 ? "en" : "de");
+    driver->name = strdup(buf);
+    snprintf(buf, sizeof(buf), "Acme%d Laser %d, %s", i % 50, i / 2,
+	     i % 2 ? "en" : "de");
+    driver->description = strdup(buf);
+    if (i % 7)
+      snprintf(buf, sizeof(buf), "MFG:Acme%d;MDL:Laser %d;CMD:PCL;", i % 50,
+	       i / 2);
+    else
+      buf[0] = '\0';
+    driver->device_id = strdup(buf);
+  }
+
+  global_data.driver_list = list;
+  _prDriverMatcherBuild(&global_data);
+
+  // Devices: Known make and model, make and model only matching a driver
+  // name, unknown printers, and device IDs without make and model
+  if ((device_ids = (char **)calloc(num_devices, sizeof(char *))) == NULL ||
+      (driver_names = (const char **)calloc(num_devices,
+					    sizeof(const char *))) == NULL)
+    return (1);
+  for (i = 0; i < num_devices; i ++)
+  {
+    switch (i % 4)
+    {
+      case 0 :
+      case 1 :
+	  snprintf(buf, sizeof(buf),
+		   "MFG:ACME%d;MDL:Laser %d;CMD:PCL,POSTSCRIPT;",
+		   (i * 7) % 50, (i * 13) % (num_drivers / 2));
+	  break;
+      case 2 :
+	  snprintf(buf, sizeof(buf), "MFG:Unknown;MDL:Printer %d;", i);
+	  break;
+      default :
+	  snprintf(buf, sizeof(buf), "CMD:PCL;CLS:PRINTER;");
+	  break;
+    }
+    device_ids[i] = strdup(buf);
+  }
+
+  num_found = prBestMatchingPPDBatch(num_devices,
+				     (const char * const *)device_ids,
+				     driver_names, &global_data);
+
+  for (i = 0; i < num_devices; i ++)
+  {
+    single = prBestMatchingPPD(device_ids[i], &global_data);
+    if ((single == NULL) != (driver_names[i] == NULL) ||
+	(single && strcmp(single, driver_names[i])))
+    {
+      fprintf(stderr, "Device %d (%s): Batch gives %s, single gives %s\n",
+	      i, device_ids[i], driver_names[i] ? driver_names[i] : "(null)",
+	      single ? single : "(null)");
+      errors ++;
+    }
+  }
+
+  printf("%d of %d devices with a driver, %d differences.\n", num_found,
+	 num_devices, errors);
+
+  for (i = 0; i < num_devices; i ++)
+    free(device_ids[i]);
+  free(device_ids);
+  free(driver_names);
+  _prDriverMatcherFree(&global_data);
+  _prDriverListsFree(&global_data);
+
+  return (errors ? 1 : 0);
+}
@@ -0,0 +1,194 @@
+//
+// PPD/Classic CUPS driver retro-fit Printer Application Library
+// (libpappl-retrofit) for the Printer Application Framework (PAPPL)
+//
+// fuzz-cups-devparse.c
+//
+// Fuzz driver for _prCUPSDevParseLine(), the parser for the output lines
+// of CUPS backends in discovery mode.
+//
+// Built as a standalone program it parses each file given on the command
+// line as one line, or, without arguments, a set of built-in lines, so
+// that it can run as a test. Compiled with "-DPR_LIBFUZZER
+// -fsanitize=fuzzer" it is a libFuzzer target.
+//
+// Copyright © 2020 by Till Kamppeter.
+// Copyright © 2020 by Michael R Sweet.
+//
+// Licensed under Apache License v2.0.  See the file "LICENSE" for more
+// information.
+//
+
+//
+// Include necessary headers...
+//
+
+#include <pappl-retrofit/cups-backends-private.h>
+#include <stdint.h>
+
+
+//
+// Local globals...
+//
+
+// Lines to parse if no files are given, valid ones and broken ones
+
+static const char * const seed_lines[] =
+{
+  "direct usb://HP/LaserJet%201020?serial=00CNBW123456 \"HP LaserJet 1020\" \"HP LaserJet 1020 USB 00CNBW123456 HPLIP\" \"MFG:Hewlett-Packard;CMD:PJL,PCL;MDL:HP LaserJet 1020;\" \"\"",
+  "network socket://192.168.1.10 \"Unknown\" \"Printer \\\"Lobby\\\"\" \"\" \"2nd floor\"",
+  "network lpd \"Unknown\" \"LPD/LPR Host or Printer\"",
+  "serial serial:/dev/ttyS0?baud=115200 \"Unknown\" \"Serial Port #1\"",
+  "direct usb://Foo/Bar \"Foo Bar\"",
+  "direct usb://Foo/Bar \"Foo Bar\" \"unterminated",
+  "direct usb://Foo/Bar \"Foo\\",
+  "direct",
+  "",
+  "   ",
+  "\"\" \"\" \"\" \"\"",
+  "a b:c \"\\\\\" \"\\\"\" \"\\",
+};
+
+
+//
+// Local functions...
+//
+
+static void     check_field(const char *field, const char *line, size_t len);
+static int      parse_input(const uint8_t *data, size_t size);
+
+
+//
+// 'LLVMFuzzerTestOneInput()' - Parse one input of the fuzzer.
+//
+
+int                             // O - Always 0
+LLVMFuzzerTestOneInput(
+    const uint8_t *data,        // I - Input
+    size_t        size)         // I - Size of input
+{
+  return (parse_input(data, size));
+}
+
+
+#ifndef PR_LIBFUZZER
+//
+// 'main()' - Parse the given files or the built-in lines.
+//
+
+int                             // O - Exit status
+main(int  argc,                 // I - Number of command line arguments
+     char *argv[])              // I - Command line arguments
+{
+  int         i;                // Looping variable
+  FILE        *fp;              // Input file
+  uint8_t     *data = NULL;     // Input
+  size_t      size,             // Size of input
+              alloc_size = 0;   // Allocated size
+  size_t      bytes;            // Bytes read
+
+
+  if (argc < 2)
+  {
+    for (i = 0; i < (int)(sizeof(seed_lines) / sizeof(seed_lines[0])); i ++)
+      parse_input((const uint8_t *)seed_lines[i], strlen(seed_lines[i]));
+    printf("%d lines parsed.\n", i);
+    return (0);
+  }
+
+  for (i = 1; i < argc; i ++)
+  {
+    if ((fp = fopen(argv[i], "rb")) == NULL)
+    {
+      perror(argv[i]);
+      return (1);
+    }
+
+    for (size = 0;; size += bytes)
+    {
+      if (size == alloc_size)
+      {
+	alloc_size = (alloc_size ? 2 * alloc_size : 65536);
+	if ((data = (uint8_t *)realloc(data, alloc_size)) == NULL)
+	{
+	  perror(argv[i]);
+	  return (1);
+	}
+      }
+      if ((bytes = fread(data + size, 1, alloc_size - size, fp)) == 0)
+	break;
+    }
+    fclose(fp);
+
+    parse_input(data, size);
+  }
+
+  free(data);
+
+  return (0);
+}
+#endif // !PR_LIBFUZZER
+
+
+//
+// 'check_field()' - Abort if a field returned by the parser does not lie
+//                   within the line or is not terminated there.
+//
+
+static void
+check_field(const char *field,  // I - Field
+	    const char *line,   // I - Line
+	    size_t     len)     // I - Length of line, without terminator
+{
+  if (!field)
+    return;
+  if (field < line || field > line + len ||
+      !memchr(field, '\0', (size_t)(line + len + 1 - field)))
+    abort();
+}
+
+
+//
+// 'parse_input()' - Parse an input as a backend output line and check the
+//                   results.
+//
+
+static int                      // O - Always 0
+parse_input(const uint8_t *data, // I - Input
+	    size_t        size)  // I - Size of input
+{
+  char *line,                   // Line, zero-terminated
+       *dclass = NULL,          // Device class
+       *uri = NULL,             // Device URI
+       *info = NULL,            // Device info
+       *device_id = NULL;       // 1284 device ID
+  int  result;                  // Result of the parser
+
+
+  // The discovery code passes lines without the newline, zero-terminated,
+  // so an input with an embedded zero byte is a shorter line
+  if ((line = (char *)malloc(size + 1)) == NULL)
+    return (0);
+  memcpy(line, data, size);
+  line[size] = '\0';
+  size = strlen(line);
+
+  result = _prCUPSDevParseLine(line, &dclass, &uri, &info, &device_id);
+
+  if (result < -1 || result > 1)
+    abort();
+
+  check_field(dclass, line, size);
+  check_field(uri, line, size);
+  if (result == 1)
+  {
+    if (!dclass || !uri || !info)
+      abort();
+    check_field(info, line, size);
+    check_field(device_id, line, size);
+  }
+
+  free(line);
+
+  return (0);
+}